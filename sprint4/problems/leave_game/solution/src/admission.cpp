@@ -0,0 +1,145 @@
+#include "admission.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
+
+#include "metrics.h"
+
+namespace admission {
+
+namespace {
+
+struct State {
+    size_t                       max_connections = 0;
+    size_t                       max_pending     = 0;
+    std::unique_ptr<RateLimiter> rate_limiter;
+    std::atomic<size_t>          connections{0};
+    std::atomic<size_t>          pending{0};
+};
+
+State& GetState() {
+    static State state;
+    return state;
+}
+
+// Увеличивает counter, если он меньше limit (0 - без ограничения)
+bool TryIncrement(std::atomic<size_t>& counter, size_t limit) noexcept {
+    if ( limit == 0 ) {
+        counter.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    size_t current = counter.load(std::memory_order_relaxed);
+    do {
+        if ( current >= limit ) {
+            return false;
+        }
+    } while ( !counter.compare_exchange_weak(current, current + 1, std::memory_order_relaxed) );
+    return true;
+}
+
+}  // namespace
+
+void Configure(const Limits& limits) {
+    State& state = GetState();
+    state.max_connections = limits.max_connections;
+    state.max_pending     = limits.max_pending;
+    state.rate_limiter.reset();
+    if ( limits.rate > 0 ) {
+        state.rate_limiter = std::make_unique<RateLimiter>(limits.rate, limits.burst);
+    }
+}
+
+
+//// Connections //////////////////////////////////////////////////////////////////////////////////
+bool OpenConnection() noexcept {
+    State& state = GetState();
+    if ( !TryIncrement(state.connections, state.max_connections) ) {
+        metrics::RecordRejection(metrics::Rejection::CONNECTIONS);
+        return false;
+    }
+    return true;
+}
+
+void CloseConnection() noexcept {
+    GetState().connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+size_t ActiveConnections() noexcept {
+    return GetState().connections.load(std::memory_order_relaxed);
+}
+
+
+//// Pending //////////////////////////////////////////////////////////////////////////////////////
+bool EnterPending() noexcept {
+    State& state = GetState();
+    if ( !TryIncrement(state.pending, state.max_pending) ) {
+        metrics::RecordRejection(metrics::Rejection::OVERLOAD);
+        return false;
+    }
+    metrics::PendingChanged(1);
+    return true;
+}
+
+void LeavePending() noexcept {
+    GetState().pending.fetch_sub(1, std::memory_order_relaxed);
+    metrics::PendingChanged(-1);
+}
+
+
+//// RateLimiter //////////////////////////////////////////////////////////////////////////////////
+RateLimiter::RateLimiter(double rate, double burst)
+    : rate_(rate)
+    , burst_(std::max(1.0, burst))
+    , refill_(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(burst_ / rate_))) {
+}
+
+size_t RateLimiter::KeyHash::operator()(const Key& key) const noexcept {
+    uint64_t hi, lo;
+    std::memcpy(&hi, key.data(), sizeof(hi));
+    std::memcpy(&lo, key.data() + sizeof(hi), sizeof(lo));
+    return static_cast<size_t>((hi ^ lo) * 0x9E3779B97F4A7C15ull >> 7);
+}
+
+std::optional<unsigned> RateLimiter::Take(const net::ip::address& address, Clock::time_point now) {
+    const Key key = address.is_v4()
+        ? net::ip::make_address_v6(net::ip::v4_mapped, address.to_v4()).to_bytes()
+        : address.to_v6().to_bytes();
+    Shard& shard = shards_[KeyHash{}(key) % SHARDS];
+
+    std::lock_guard lock{shard.mutex};
+    auto [it, inserted] = shard.buckets.try_emplace(key, Bucket{burst_, now});
+    Bucket& bucket = it->second;
+    if ( !inserted ) {
+        const double elapsed = std::chrono::duration<double>(now - bucket.last).count();
+        bucket.tokens = std::min(burst_, bucket.tokens + std::max(0.0, elapsed) * rate_);
+        bucket.last   = now;
+    }
+    std::optional<unsigned> retry_after;
+    if ( bucket.tokens >= 1.0 ) {
+        bucket.tokens -= 1.0;
+    } else {
+        retry_after = std::max(1u, static_cast<unsigned>(std::ceil((1.0 - bucket.tokens) / rate_)));
+        metrics::RecordRejection(metrics::Rejection::RATE);
+    }
+    if ( shard.buckets.size() > SWEEP_THRESHOLD && now - shard.last_sweep > refill_ ) {
+        Sweep(shard, now);
+    }
+    return retry_after;
+}
+
+void RateLimiter::Sweep(Shard& shard, Clock::time_point now) {
+    shard.last_sweep = now;
+    std::erase_if(shard.buckets, [this, now](const auto& item) {
+        return now - item.second.last >= refill_;
+    });
+}
+
+std::optional<unsigned> TakeRequest(const net::ip::address& address) {
+    RateLimiter* rate_limiter = GetState().rate_limiter.get();
+    return rate_limiter ? rate_limiter->Take(address) : std::nullopt;
+}
+
+}  // namespace admission
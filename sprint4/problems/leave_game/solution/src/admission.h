@@ -0,0 +1,91 @@
+#pragma once
+
+#include <boost/asio/ip/address.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace admission {
+
+namespace net = boost::asio;
+
+using Clock = std::chrono::steady_clock;
+
+//// Limits ///////////////////////////////////////////////////////////////////////////////////////
+// Ограничения нагрузки; 0 - ограничения нет
+struct Limits {
+    size_t max_connections = 0;     // одновременно открытых соединений
+    double rate            = 0;     // запросов API в секунду с одного адреса
+    double burst           = 0;     // запас запросов сверх rate (ёмкость ведра), не меньше 1
+    size_t max_pending     = 0;     // запросов API, принятых в работу и ещё не получивших ответ
+};
+
+// Задаётся один раз при старте, до запуска сервера
+void Configure(const Limits& limits);
+
+// Сколько секунд предлагать клиенту подождать при отказе из-за перегрузки
+constexpr unsigned OVERLOAD_RETRY_AFTER = 1;
+
+
+//// Connections //////////////////////////////////////////////////////////////////////////////////
+// false - лимит соединений исчерпан, соединение нужно закрыть, CloseConnection не вызывать
+bool OpenConnection() noexcept;
+void CloseConnection() noexcept;
+size_t ActiveConnections() noexcept;
+
+
+//// Pending //////////////////////////////////////////////////////////////////////////////////////
+// Бюджет незавершённой работы: false - запрос нужно отклонить, LeavePending не вызывать
+bool EnterPending() noexcept;
+void LeavePending() noexcept;
+
+
+//// RateLimiter //////////////////////////////////////////////////////////////////////////////////
+// Ведро токенов на каждый адрес клиента. Вёдра разбиты на SHARDS частей по хешу адреса, у каждой
+// свой мьютекс. Полное ведро ничем не отличается от отсутствующего, поэтому разросшаяся часть
+// время от времени выбрасывает вёдра, простоявшие дольше времени их наполнения.
+class RateLimiter {
+public:
+    constexpr static size_t SHARDS          = 16;
+    constexpr static size_t SWEEP_THRESHOLD = 1024;   // вёдер в части, после которого чистим
+
+    RateLimiter(double rate, double burst);
+
+    // nullopt - запрос пропускаем, иначе - через сколько секунд в ведре появится токен
+    std::optional<unsigned> Take(const net::ip::address& address, Clock::time_point now = Clock::now());
+
+private:
+    using Key = std::array<unsigned char, 16>;   // IPv4 - в виде IPv4-mapped IPv6
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept;
+    };
+
+    struct Bucket {
+        double            tokens;
+        Clock::time_point last;
+    };
+
+    struct Shard {
+        std::mutex                                mutex;
+        std::unordered_map<Key, Bucket, KeyHash>  buckets;
+        Clock::time_point                         last_sweep;
+    };
+
+    void Sweep(Shard& shard, Clock::time_point now);
+
+    double                    rate_;
+    double                    burst_;
+    Clock::duration           refill_;   // время наполнения пустого ведра
+    std::array<Shard, SHARDS> shards_;
+};
+
+// nullopt, если ограничение по адресам выключено
+std::optional<unsigned> TakeRequest(const net::ip::address& address);
+
+}  // namespace admission
@@ -1,7 +1,92 @@
 #include "api_handler.h"
 
+#include <charconv>
+#include <optional>
+#include <unordered_map>
+
 namespace http_handler {
 
+namespace {
+
+using QueryParams = std::unordered_map<std::string, std::string>;
+
+int HexValue(char c) {
+    if ( c >= '0' && c <= '9' ) return c - '0';
+    if ( c >= 'a' && c <= 'f' ) return c - 'a' + 10;
+    if ( c >= 'A' && c <= 'F' ) return c - 'A' + 10;
+    return -1;
+}
+
+// %XX и '+' в параметрах строки запроса
+std::optional<std::string> UrlDecode(std::string_view str) {
+    std::string res;
+    res.reserve(str.size());
+    for (size_t i = 0; i < str.size(); ++i) {
+        if ( str[i] == '+' ) {
+            res.push_back(' ');
+        } else if ( str[i] == '%' ) {
+            if ( i + 2 >= str.size() ) {
+                return std::nullopt;
+            }
+            const int hi = HexValue(str[i + 1]);
+            const int lo = HexValue(str[i + 2]);
+            if ( hi < 0 || lo < 0 ) {
+                return std::nullopt;
+            }
+            res.push_back(static_cast<char>(hi * 16 + lo));
+            i += 2;
+        } else {
+            res.push_back(str[i]);
+        }
+    }
+    return res;
+}
+
+// Параметры строки запроса target; nullopt - строка запроса испорчена
+std::optional<QueryParams> ParseQuery(std::string_view target) {
+    QueryParams params;
+    const size_t query_pos = target.find('?');
+    if ( query_pos == std::string_view::npos ) {
+        return params;
+    }
+    std::string_view query = target.substr(query_pos + 1);
+    while ( !query.empty() ) {
+        const size_t amp_pos = query.find('&');
+        std::string_view param = query.substr(0, amp_pos);
+        query = amp_pos == std::string_view::npos ? std::string_view{} : query.substr(amp_pos + 1);
+        const size_t eq_pos = param.find('=');
+        if ( eq_pos == std::string_view::npos ) {
+            return std::nullopt;
+        }
+        auto key   = UrlDecode(param.substr(0, eq_pos));
+        auto value = UrlDecode(param.substr(eq_pos + 1));
+        if ( !key || !value ) {
+            return std::nullopt;
+        }
+        params[std::move(*key)] = std::move(*value);
+    }
+    return params;
+}
+
+// Необязательный числовой параметр: если его нет, value не меняется
+template <typename T>
+bool GetQueryNumber(const QueryParams& params, const std::string& key, T& value) {
+    auto it = params.find(key);
+    if ( it == params.end() ) {
+        return true;
+    }
+    const std::string& str = it->second;
+    T number{};
+    auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), number);
+    if ( str.empty() || ec != std::errc() || ptr != str.data() + str.size() ) {
+        return false;
+    }
+    value = number;
+    return true;
+}
+
+}  // namespace
+
 std::string MethodToString(http::verb verb) {
     switch ( verb ) {
         case http::verb::get:  return "GET";
@@ -14,10 +99,17 @@ std::string MethodToString(http::verb verb) {
 }
 
 
+void ApiHandler::Response(const StringRequest& req, Sender send) {
+    if ( IsRecordsRequest(req.target()) ) {
+        return RecordsResponse(req, std::move(send));
+    }
+    send(Response(req));
+}
+
 StringResponse ApiHandler::Response(const StringRequest& req) {
     unsigned    http_version = req.version();
     bool        keep_alive   = req.keep_alive();
-    std::string target(req.target());
+    std::string_view target = req.target();
     //
     if ( IsMapRequest(target))      { return MapResponse(req);     }
     if ( IsMapsRequest(target) )    { return MapsResponse(req);    }
@@ -26,31 +118,28 @@ StringResponse ApiHandler::Response(const StringRequest& req) {
     if ( IsStateRequest(target) )   { return StateResponse(req);   }
     if ( IsMoveRequest(target) )    { return MoveResponse(req);    }
     if ( IsTickRequest(target) )    { return TickResponse(req);    }
-    if ( IsRecordsRequest(target) ) { return RecordsResponse(req); }
+    if ( IsRankRequest(target) )    { return RankResponse(req);    }
+    if ( IsTickProfileRequest(target) ) { return TickProfileResponse(req); }
     //
     return Response::BadRequest("badRequest"s, "Unknown API target"s, http_version, keep_alive);
 }
 
-bool ApiHandler::CheckToken(const StringRequest& req, std::string& token) {
-    for (const auto& header : req) {
-        if ( "Authorization" == header.name_string() || "authorization" == header.name_string() ) {
-            token = header.value();
-            break;
-        }
+bool ApiHandler::CheckToken(const StringRequest& req, token::Token& token) {
+    // поиск по полю Beast без учёта регистра, значение - без копирования
+    auto it = req.find(http::field::authorization);
+    if ( it == req.end() ) {
+        return false;
     }
-    //
-    bool is_ok = true;
-    if ( token.size() == BEARER.size() + TOKEN_SIZE ) {
-        if ( token.starts_with(BEARER) ) {
-            token = token.substr(BEARER.size());
-            std::count_if(token.begin(), token.end(), [](unsigned char c){ return std::isxdigit(c); } );
-        } else {
-            is_ok = false;
-        }
-    } else {
-        is_ok = false;
+    std::string_view value = it->value();
+    if ( value.size() != BEARER.size() + token::TOKEN_SIZE || !value.starts_with(BEARER) ) {
+        return false;
     }
-    return is_ok;
+    auto parsed = token::Parse(value.substr(BEARER.size()));
+    if ( !parsed ) {
+        return false;
+    }
+    token = *parsed;
+    return true;
 }
 
 // --- Map by Id
@@ -120,7 +209,7 @@ StringResponse ApiHandler::PlayersResponse(const StringRequest& req) {
         return Response::InvalidMethod("invalidMethod"s, "Only GET & HEAD methods are expected"s, "GET, HEAD"s, http_version, keep_alive);
     }
     // get and check Authorization header
-    std::string token;
+    token::Token token;
     if ( !CheckToken(req, token) ) {
         return Response::Unauthorized("invalidToken"s, "Authorization header is missing or wrong"s, http_version, keep_alive);
     }
@@ -140,7 +229,7 @@ StringResponse ApiHandler::StateResponse(const StringRequest& req) {
         return Response::InvalidMethod("invalidMethod"s, "Only GET & HEAD methods are expected"s, "GET, HEAD"s, http_version, keep_alive);
     }
     // get and check Authorization header
-    std::string token;
+    token::Token token;
     if ( !CheckToken(req, token) ) {
         return Response::Unauthorized("invalidToken"s, "Authorization header is missing or wrong"s, http_version, keep_alive);
     }
@@ -173,7 +262,7 @@ StringResponse ApiHandler::MoveResponse(const StringRequest& req) {
         return Response::BadRequest("invalidArgument"s, "Unknown move feild"s, http_version, keep_alive);
     }
     // get and check Authorization header
-    std::string token;
+    token::Token token;
     if ( !CheckToken(req, token) ) {
         return Response::Unauthorized("invalidToken"s, "Authorization header is missing or wrong"s, http_version, keep_alive);
     }
@@ -209,16 +298,72 @@ StringResponse ApiHandler::TickResponse(const StringRequest& req) {
     return Response::MakeResponse(http::status::ok, app_.Tick(time_delta), ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive);
 }
 // --- Results
-StringResponse ApiHandler::RecordsResponse(const StringRequest& req) {
+void ApiHandler::RecordsResponse(const StringRequest& req, Sender send) {
     unsigned     http_version = req.version();
     bool         keep_alive   = req.keep_alive();
     // check method
     if ( req.method() != http::verb::get ) {
-        return Response::InvalidMethod("invalidMethod"s, "Only GET method is expected"s, "GET"s, http_version, keep_alive);
+        return send(Response::InvalidMethod("invalidMethod"s, "Only GET method is expected"s, "GET"s, http_version, keep_alive));
+    }
+    // query: ?start=N&maxItems=M
+    size_t start     = 0;
+    size_t max_items = app::Application::RECORDS_MAX_ITEMS;
+    auto   params    = ParseQuery(req.target());
+    if ( !params
+      || !GetQueryNumber(*params, "start"s, start)
+      || !GetQueryNumber(*params, "maxItems"s, max_items)
+      || max_items > app::Application::RECORDS_MAX_ITEMS ) {
+        return send(Response::BadRequest("invalidArgument"s, "Invalid start or maxItems"s, http_version, keep_alive));
+    }
+    // do
+    app_.GetRecords(start, max_items, [send = std::move(send), http_version, keep_alive](std::optional<std::string> res_body) {
+        if ( !res_body ) {
+            return send(Response::ServiceUnavailable("unavailable"s, "Records are temporarily unavailable"s, http_version, keep_alive));
+        }
+        send(Response::MakeResponse(http::status::ok, *res_body, ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive));
+    });
+}
+// --- Rank
+StringResponse ApiHandler::RankResponse(const StringRequest& req) {
+    unsigned     http_version = req.version();
+    bool         keep_alive   = req.keep_alive();
+    // check method
+    if ( req.method() != http::verb::get && req.method() != http::verb::head ) {
+        return Response::InvalidMethod("invalidMethod"s, "Only GET & HEAD methods are expected"s, "GET, HEAD"s, http_version, keep_alive);
+    }
+    // query: ?score=S&playTime=T[&name=N][&around=K]
+    auto params = ParseQuery(req.target());
+    if ( !params || !params->contains("score"s) || !params->contains("playTime"s) ) {
+        return Response::BadRequest("invalidArgument"s, "score and playTime are required"s, http_version, keep_alive);
+    }
+    leaderboard::Record key;
+    auto& [name, score, play_time] = key;
+    size_t around = 0;
+    if ( !GetQueryNumber(*params, "score"s, score)
+      || !GetQueryNumber(*params, "playTime"s, play_time)
+      || !GetQueryNumber(*params, "around"s, around)
+      || around > app::Application::RANK_MAX_AROUND ) {
+        return Response::BadRequest("invalidArgument"s, "Invalid score, playTime or around"s, http_version, keep_alive);
+    }
+    if ( auto it = params->find("name"s); it != params->end() ) {
+        name = it->second;
+    }
+    // do
+    std::string res_body;
+    app_.GetRank(key, around, res_body);
+    return Response::MakeResponse(http::status::ok, res_body, ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive);
+}
+// --- Tick profile
+StringResponse ApiHandler::TickProfileResponse(const StringRequest& req) {
+    unsigned     http_version = req.version();
+    bool         keep_alive   = req.keep_alive();
+    // check method
+    if ( req.method() != http::verb::get && req.method() != http::verb::head ) {
+        return Response::InvalidMethod("invalidMethod"s, "Only GET & HEAD methods are expected"s, "GET, HEAD"s, http_version, keep_alive);
     }
     // do
     std::string res_body;
-    app_.GetRecords(res_body);
+    app_.GetTickProfile(res_body);
     return Response::MakeResponse(http::status::ok, res_body, ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive);
 }
 
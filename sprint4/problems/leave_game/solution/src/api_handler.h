@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "app.h"
 #include "model.h"
 #include "response.h"
@@ -18,9 +20,10 @@ class ApiHandler {
     constexpr static std::string_view MOVE    = "/api/v1/game/player/action"sv;
     constexpr static std::string_view TICK    = "/api/v1/game/tick"sv;
     constexpr static std::string_view RECORDS = "/api/v1/game/records"sv;
+    constexpr static std::string_view RECORDS_RANK = "/api/v1/game/records/rank"sv;
+    constexpr static std::string_view TICK_PROFILE = "/api/v1/debug/tick-profile"sv;
     // others
     constexpr static std::string_view BEARER  = "Bearer "sv;
-    constexpr static size_t TOKEN_SIZE = 32;
 public:
     explicit ApiHandler(app::Application& app)
         : app_(app) {
@@ -32,36 +35,45 @@ public:
     void SetDebugMode(bool debug_mode) { debug_mode_ = debug_mode; }
     bool CanAccept(const std::string& target) { return target.find(API) == 0; }
 
-    StringResponse Response(const StringRequest& req);
+    // Ответ передаётся в send - сразу или позже из потока пула соединений с базой
+    using Sender = std::function<void(StringResponse&&)>;
+    void Response(const StringRequest& req, Sender send);
 
 private:
-    bool CheckToken(const StringRequest& req, std::string& token);
+    StringResponse Response(const StringRequest& req);
+    bool CheckToken(const StringRequest& req, token::Token& token);
 
 private:
     // --- Map by Id
-    bool IsMapRequest(std::string target) { return target.find(MAPS) == 0 && target.size() > MAPS.size() + 1; }
+    bool IsMapRequest(std::string_view target) { return target.find(MAPS) == 0 && target.size() > MAPS.size() + 1; }
     StringResponse MapResponse(const StringRequest& req);
     // --- All maps
-    bool IsMapsRequest(std::string target) { return target == MAPS; }
+    bool IsMapsRequest(std::string_view target) { return target == MAPS; }
     StringResponse MapsResponse(const StringRequest& req);
     // --- Join
-    bool IsJoinRequest(std::string target) { return target == JOIN; }
+    bool IsJoinRequest(std::string_view target) { return target == JOIN; }
     StringResponse JoinResponse(const StringRequest& req);
     // --- Players
-    bool IsPlayersRequest(std::string target) { return target == PLAYERS; }
+    bool IsPlayersRequest(std::string_view target) { return target == PLAYERS; }
     StringResponse PlayersResponse(const StringRequest& req);
     // --- State
-    bool IsStateRequest(std::string target) { return target == STATE; }
+    bool IsStateRequest(std::string_view target) { return target == STATE; }
     StringResponse StateResponse(const StringRequest& req);
     // --- Move
-    bool IsMoveRequest(std::string target) { return target == MOVE; }
+    bool IsMoveRequest(std::string_view target) { return target == MOVE; }
     StringResponse MoveResponse(const StringRequest& req);
     // --- Tick
-    bool IsTickRequest(std::string target) { return target == TICK; }
+    bool IsTickRequest(std::string_view target) { return target == TICK; }
     StringResponse TickResponse(const StringRequest& req);
     // --- Results
-    bool IsRecordsRequest(std::string target) { return target == RECORDS; }
-    StringResponse RecordsResponse(const StringRequest& req);
+    bool IsRecordsRequest(std::string_view target) { return target.substr(0, target.find('?')) == RECORDS; }
+    void RecordsResponse(const StringRequest& req, Sender send);
+    // --- Rank
+    bool IsRankRequest(std::string_view target) { return target.substr(0, target.find('?')) == RECORDS_RANK; }
+    StringResponse RankResponse(const StringRequest& req);
+    // --- Tick profile
+    bool IsTickProfileRequest(std::string_view target) { return target == TICK_PROFILE; }
+    StringResponse TickProfileResponse(const StringRequest& req);
 
 private:
     app::Application& app_;
@@ -1,69 +1,159 @@
 #include "app.h"
+#include "bots.h"
+#include "logger.h"
+#include "metrics.h"
 #include "serializer.h"
+#include "wal.h"
 
 namespace app {
 
+namespace {
+
+// FNV-1a по байтам полей состояния
+class Digest {
+public:
+    template <typename T>
+    void Add(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        const auto* bytes = reinterpret_cast<const unsigned char*>(&value);
+        for (size_t i = 0; i < sizeof(T); ++i) {
+            hash_ = (hash_ ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+    void Add(std::string_view str) {
+        Add(str.size());
+        for (unsigned char c : str) {
+            hash_ = (hash_ ^ c) * 1099511628211ull;
+        }
+    }
+    uint64_t Get() const noexcept { return hash_; }
+
+private:
+    uint64_t hash_ = 14695981039346656037ull;
+};
+
+json::object SerializeRecord(const leaderboard::Record& record) {
+    json::object item;
+    item["name"]     = std::get<0>(record);
+    item["score"]    = std::get<1>(record);
+    item["playTime"] = std::get<2>(record);
+    return item;
+}
+
+std::string SerializeRecords(const std::vector<leaderboard::Record>& retired_players) {
+    json::array arr;
+    for (auto& retired_player : retired_players) {
+        arr.push_back(SerializeRecord(retired_player));
+    }
+    return json::serialize(arr);
+}
+
+}  // namespace
+
+
 //// Player ///////////////////////////////////////////////////////////////////////////////////////
 std::string Player::ToString(std::string offs) const {
     std::ostringstream oss;
-    oss << offs << "dog_ptr     = "  << dog_ << "\n";
+    oss << offs << "dog         = "  << dog_.dog.index << ":" << dog_.dog.generation << "\n";
     oss << offs << "dog_id_     = "  << dog_id_ << "\n";
-    if ( dog_ != nullptr ) {
-        oss << offs << "dog name_   = '" << dog_->GetName() << "' (" << dog_->GetId() << ")" << "\n";
-    } else {
-        oss << offs << "dog name_   = 'nullptr'\n";
-    }
-    oss << offs << "session_ptr = "  << session_ << "\n";
+    oss << offs << "session     = "  << dog_.session.index << ":" << dog_.session.generation << "\n";
     oss << offs << "session_id_ = "  << *session_id_ << "\n";
-    if ( session_ != nullptr ) {
-        oss << offs << "map name    = '" << session_->GetMap()->GetName() << "' (" << *session_->GetMap()->GetId() << ")" << "\n";
-    } else {
-        oss << offs << "map name    = 'nullptr'\n";
-    }
     return oss.str();
 }
 
 
 
 //// Players //////////////////////////////////////////////////////////////////////////////////////
-std::vector<std::tuple<std::string, int, int>> Players::GetRetiredPlayers() {
+std::vector<std::tuple<std::string, int, int>> Players::GetRetiredPlayers(model::Game& game, RemovedPlayers& removed_players) {
     // try find retired dogs
     std::vector<RetiredPlayer> retired_players;
+    std::vector<size_t> lost_players;
     for (size_t idx = 0; idx < players_.size(); ++idx) {
-        model::Dog* dog = players_[idx].GetDog();
+        model::Dog* dog = game.GetDog(players_[idx].GetDog());
+        if ( dog == nullptr ) {
+            lost_players.push_back(idx);
+            continue;
+        }
         auto play_time = dog->GetPlayTime();
         if ( play_time.has_value() ) {
-            RetiredPlayer retired_player{dog->GetName(), static_cast<int>(dog->GetScore()), static_cast<int>(play_time.value()), idx};
+            RetiredPlayer retired_player{dog->GetName(), static_cast<int>(dog->GetScore()), static_cast<int>(play_time.value()), idx, dog->IsBot()};
             retired_players.push_back(retired_player);
         }
     }
     // process found retired dogs
     std::vector<std::tuple<std::string, int, int>> result;
+    if ( retired_players.empty() && lost_players.empty() ) {
+        return result;
+    }
+    std::vector<bool> removed(players_.size(), false);
+    for (size_t idx : lost_players) {
+        removed[idx] = true;
+    }
     for (const auto& retired_player : retired_players) {
-        result.emplace_back(retired_player.name, retired_player.score, retired_player.play_time_ms);
-        // remove player
-        players_.erase(players_.begin() + retired_player.idx);
-        // find & remove player token
-        std::string retired_token;
-        for (const auto& [token, idx] : token_to_index_) {
-            if ( idx == retired_player.idx ) {
-                retired_token = token;
-                break;
-            }
+        // боты уходят из игры, но не в таблицу рекордов
+        if ( !retired_player.bot ) {
+            result.emplace_back(retired_player.name, retired_player.score, retired_player.play_time_ms);
         }
-        if ( !retired_token.empty() ) {
-            token_to_index_.erase(retired_token);
+        removed[retired_player.idx] = true;
+    }
+    removed_players = Compact(removed);
+    return result;
+}
+
+void Players::AddPlayersTokenAndIndex(const std::string& token, size_t index) {
+    auto parsed = token::Parse(token);
+    if ( !parsed ) {
+        std::string err = "Player: invalid token '" + token + "'";
+        throw std::runtime_error(err);
+    }
+    token_to_index_.Insert(*parsed, index);
+}
+
+std::vector<model::DogRef> Players::Remove(const std::vector<std::string>& tokens) {
+    std::vector<bool> removed(players_.size(), false);
+    for (const auto& token : tokens) {
+        auto parsed = token::Parse(token);
+        if ( !parsed ) {
+            continue;
+        }
+        if ( auto index = token_to_index_.Find(*parsed) ) {
+            removed[*index] = true;
+        }
+    }
+    return Compact(removed).dogs;
+}
+
+RemovedPlayers Players::Compact(const std::vector<bool>& removed) {
+    // remove players & their tokens, renumber the rest: индексы сдвигаются после каждого удалённого
+    RemovedPlayers result;
+    std::vector<size_t> new_index(players_.size());
+    size_t kept = 0;
+    for (size_t idx = 0; idx < players_.size(); ++idx) {
+        if ( removed[idx] ) {
+            result.dogs.push_back(players_[idx].GetDog());
+        } else {
+            new_index[idx] = kept;
+            players_[kept++] = players_[idx];
         }
     }
+    players_.erase(players_.begin() + kept, players_.end());
+    token_to_index_.Rewrite([&removed, &new_index, &result](const token::Token& token, size_t& idx) {
+        if ( removed[idx] ) {
+            result.tokens.push_back(token::ToString(token));
+            return false;
+        }
+        idx = new_index[idx];
+        return true;
+    });
     return result;
 }
 
 std::string Players::ToString() const {
     std::ostringstream oss;
     oss << "--- Players:\n";
-    oss << "\tcounter = "  << players_.size() << "(" << token_to_index_.size() << ")\n";
-    for (const auto& [token, idx] : token_to_index_) {
-        oss << "\ttoken   = '" << token << "'" << "\n";
+    oss << "\tcounter = "  << players_.size() << "(" << token_to_index_.Size() << ")\n";
+    for (const auto& [token, idx] : token_to_index_.GetAll()) {
+        oss << "\ttoken   = '" << token::ToString(token) << "'" << "\n";
         oss << "\tidx     = "  << idx << "\n";
 //        oss << "\t---player:\n = " << players_[idx].ToString("\t\t") << "\n";
     }
@@ -76,6 +166,39 @@ std::string Players::ToString() const {
 
 
 //// Application //////////////////////////////////////////////////////////////////////////////////
+Application::Application(postgres::Db& db, model::Game& game, bool debug_mode, bool randomize_spawn, std::string state_file, uint32_t save_period)
+        : db_(db)
+        , game_(game)
+        , debug_mode_(debug_mode)
+        , randomize_spawn_(randomize_spawn)
+        , state_file_(state_file)
+        , save_period_(save_period)
+        , dog_id_(0)
+        , curr_time_(0)
+        , save_time_(0) {
+    // кешу страниц - только начало таблицы, запросом с LIMIT
+    leaderboard_.Seed(db_.ReadRetiredPlayers(0, leaderboard::Leaderboard::CAPACITY));
+    // индексу мест нужна вся таблица: строки идут из курсора прямо в дерево, без вектора всей таблицы
+    rank_index_.Clear();
+    db_.StreamRetiredPlayers([this](postgres::Db::Row row) {
+        rank_index_.Add(std::move(row));
+    });
+    if ( !state_file_.empty() ) {
+        saver_ = std::make_unique<serialization::StateSaver>(state_file_);
+    }
+}
+
+Application::~Application() {
+    // деструктор StateSaver дописывает ожидающий снимок
+    saver_.reset();
+    if ( journal_ ) {
+        try {
+            journal_->End(StateDigest());
+        } catch (...) {
+        }
+    }
+}
+
 //// фасад для api_handler
 std::string Application::ToString() const {
     std::ostringstream oss;
@@ -95,42 +218,57 @@ std::string Application::ToString() const {
 }
 
 std::optional<std::string> Application::GetMap(const std::string& map_id) {
-    const model::Map* map = game_.FindMap(model::Map::Id(map_id));
-    if ( map == nullptr ) {
+    // ответы готовы в каталоге и меняются вместе с ним
+    auto catalog = game_.GetCatalog();
+    const std::string* map_json = catalog->FindMapJson(model::Map::Id(map_id));
+    if ( map_json == nullptr ) {
         return std::nullopt;
     }
-    return { map->Serialize() };
+    return { *map_json };
 }
 
 bool Application::GetMaps(std::string& res_body) {
-    json::array json_maps;
-    for (const auto& map : game_.GetMaps()) {
-        json::object json_map;
-        json_map["id"]   = *map.GetId();
-        json_map["name"] =  map.GetName();
-        json_maps.push_back(json_map);
-    }
-    res_body = json::serialize(json_maps);
+    res_body = game_.GetCatalog()->GetMapsJson();
     return true;
 }
 
 bool Application::TryJoin(const std::string& user_name, const std::string& map_id, std::string& res_body) {
+    return Join(user_name, map_id, std::nullopt, false, res_body).has_value();
+}
+
+bool Application::ReplayJoin(const std::string& user_name, const std::string& map_id, const std::string& token, bool bot) {
+    std::string res_body;
+    return Join(user_name, map_id, token, bot, res_body).has_value();
+}
+
+std::optional<token::Token> Application::JoinBot(const std::string& map_id) {
+    std::string res_body;
+    return Join("bot"s + std::to_string(dog_id_), map_id, std::nullopt, true, res_body);
+}
+
+std::optional<token::Token> Application::Join(const std::string& user_name, const std::string& map_id, std::optional<std::string> token, bool bot, std::string& res_body) {
     // check map_id
     model::Map::Id id(map_id);
-    const model::Map* map = game_.FindMap(id);
-    if ( map == nullptr ) {
-        return false;
+    auto catalog_map = game_.FindMap(id);
+    if ( catalog_map == nullptr ) {
+        return std::nullopt;
     }
 
     // get or create GameSession
-    model::GameSession* session = game_.FindSession(id);
-    if ( session == nullptr ) {
-        session = game_.AddSession(map);
+    model::SessionHandle session_handle = game_.FindSession(id);
+    if ( session_handle.IsNull() ) {
+        session_handle = game_.AddSession(std::move(catalog_map));
+        profiles_dirty_ = true;
     }
+    model::GameSession* session = game_.GetSession(session_handle);
+    // сессия с игроками может остаться на прежней версии карты до их ухода
+    const model::Map* map = session->GetMap();
 
     // create dog
-    model::Dog* dog = session->AddDog(user_name, dog_id_++, curr_time_);
+    const model::DogRef dog_ref{session_handle, session->AddDog(user_name, dog_id_++, curr_time_)};
+    model::Dog* dog = session->GetDog(dog_ref.dog);
     dog->SetBagCapacity(map->GetBagCapacity());
+    dog->SetBot(bot);
     // set dog initial position in random spawn model
     if ( randomize_spawn_ ) {
         auto roads         = map->GetRoads();
@@ -149,22 +287,35 @@ bool Application::TryJoin(const std::string& user_name, const std::string& map_i
     }
 
     // create player
-    std::string token = players_.Add(dog, session);
-    Player* player = players_.FindByToken(token);
-    if ( player == nullptr ) {
-        std::string err = "Can't get just created player";
-        throw std::runtime_error(err);
+    const Player new_player(dog_ref, dog->GetId(), id);
+    token::Token player_token;
+    if ( token.has_value() ) {
+        auto parsed = token::Parse(*token);
+        if ( !parsed ) {
+            std::string err = "Join: invalid token '" + *token + "'";
+            throw std::runtime_error(err);
+        }
+        player_token = players_.Add(new_player, *parsed);
+    } else {
+        player_token = players_.Add(new_player);
+    }
+    const std::string token_str = token::ToString(player_token);
+    if ( journal_ ) {
+        journal_->Join(user_name, map_id, token_str, bot);
+    }
+    if ( wal_ ) {
+        wal_->Join(token_str, dog->GetId(), map_id);
     }
 
     // make response
     json::object result;
-    result["authToken"] = token;
-    result["playerId"]  = player->GetDog()->GetId();
+    result["authToken"] = token_str;
+    result["playerId"]  = dog->GetId();
     res_body = json::serialize(result);
-    return true;
+    return player_token;
 }
 
-bool Application::GetPlayers(const std::string& token, std::string& res_body) {
+bool Application::GetPlayers(const token::Token& token, std::string& res_body) {
     // check game has this token
     if ( !players_.HasToken(token) ) {
         return false;
@@ -173,37 +324,49 @@ bool Application::GetPlayers(const std::string& token, std::string& res_body) {
     auto players = players_.GetPlayers();
     json::object obj;
     for (auto& player : players) {
+        const model::Dog* dog = game_.GetDog(player.GetDog());
+        if ( dog == nullptr ) {
+            continue;
+        }
         json::object sub_obj;
-        sub_obj["name"] = player.GetDog()->GetName();
-        obj[std::to_string(player.GetDog()->GetId())] = sub_obj;
+        sub_obj["name"] = dog->GetName();
+        if ( dog->IsBot() ) {
+            sub_obj["bot"] = true;
+        }
+        obj[std::to_string(dog->GetId())] = sub_obj;
     }
     res_body = json::serialize(obj);
     return true;
 }
 
-bool Application::GetState(const std::string& token, std::string& res_body) {
+bool Application::GetState(const token::Token& token, std::string& res_body) {
     // check game has this token
     auto player  = players_.FindByToken(token);
     if ( player == nullptr ) {
         return false;
     }
-    // get this player map
-    const model::Map* map = player->GetSession()->GetMap();
-    assert(map);
+    // get this player session
+    const model::SessionHandle session_handle = player->GetSession();
+    const model::GameSession* session = game_.GetSession(session_handle);
+    if ( session == nullptr ) {
+        return false;
+    }
 
     // get state of only this player map
     // all dogs on the player map
     json::object dogs;
-    auto players = players_.GetPlayers();
+    const auto& players = players_.GetPlayers();
     for (auto& player : players) {
-        if ( player.GetSession()->GetMap() != map ) {
+        if ( player.GetSession() != session_handle ) {
+            continue;
+        }
+        const model::Dog* dog = session->GetDog(player.GetDog().dog);
+        if ( dog == nullptr ) {
             continue;
         }
         json::object json_dog;
         //
         json::array json_pos;
-        model::Dog* dog = player.GetDog();
-        assert(dog);
         json_pos.push_back(dog->GetPosition().x);
         json_pos.push_back(dog->GetPosition().y);
         json_dog["pos"] = json_pos;
@@ -225,11 +388,13 @@ bool Application::GetState(const std::string& token, std::string& res_body) {
         json_dog["bag"]   = json_bag;
         //
         json_dog["score"] = dog->GetScore();
+        if ( dog->IsBot() ) {
+            json_dog["bot"] = true;
+        }
         //
         dogs[std::to_string(dog->GetId())] = json_dog;
     }
     // all lost objects on the player map (session)
-    const model::GameSession* session = player->GetSession();
     json::object json_losts;
     for (auto& lost : session->GetLostObjects()) {
         json_losts[std::to_string(lost.id_)] = lost.ToJson();
@@ -245,45 +410,295 @@ bool Application::GetState(const std::string& token, std::string& res_body) {
     return true;
 }
 
-bool Application::Move(const std::string& token, const std::string& move, std::string& res_body) {
+bool Application::Move(const token::Token& token, const std::string& move, std::string& res_body) {
     // try get player
     Player* player = players_.FindByToken(token);
     if ( player == nullptr ) {
         return false;
     }
+    model::GameSession* session = game_.GetSession(player->GetSession());
+    model::Dog* dog = session != nullptr ? session->GetDog(player->GetDog().dog) : nullptr;
+    if ( dog == nullptr ) {
+        return false;
+    }
     // get map speed
-    double speed = player->GetSession()->GetMap()->GetDogSpeed();
+    double speed = session->GetMap()->GetDogSpeed();
     // set dog speed
-    player->GetDog()->SetSpeed(speed, move);
+    dog->SetSpeed(speed, move);
+    if ( journal_ ) {
+        journal_->Move(token::ToString(token), move);
+    }
     res_body = "{}";
     return true;
 }
 
 std::string Application::Tick(uint32_t time_delta) {
-    game_.Tick(curr_time_, time_delta);
-    // --- is time to save state ?
+    const auto tick_start = profiler::Clock::now();
+    if ( bots_ ) {
+        profiler::ScopedTimer timer(tick_profile_, BOTS_DECIDE);
+        bots_->Decide(*this, time_delta);
+    }
+    // команды ботов уже в журнале: при воспроизведении они применятся до этого тика, как и здесь
+    if ( journal_ ) {
+        journal_->Tick(time_delta);
+    }
+    {
+        profiler::ScopedTimer timer(tick_profile_, GAME_TICK);
+        game_.Tick(curr_time_, time_delta);
+    }
+    {
+        metrics::MapGaugesByMap map_gauges;
+        for (const auto& session : game_.GetSessions()) {
+            metrics::MapGauges& gauges = map_gauges[*session.GetMapId()];
+            gauges.sessions += 1;
+            gauges.dogs     += session.GetDogsCount();
+            gauges.loot     += session.GetLostsCount();
+        }
+        metrics::SetMapGauges(std::move(map_gauges));
+    }
+    PublishSessionProfiles();
     curr_time_ += time_delta;
+    // --- try find new retired dogs & save if found
+    std::vector<std::tuple<std::string, int, int>> retired_players;
+    RemovedPlayers removed_players;
+    {
+        profiler::ScopedTimer timer(tick_profile_, GET_RETIRED);
+        retired_players = players_.GetRetiredPlayers(game_, removed_players);
+    }
+    {
+        profiler::ScopedTimer timer(tick_profile_, SAVE_RETIRED);
+        leaderboard_.Add(retired_players);
+        rank_index_.Add(retired_players);
+        db_.SaveRetiredPlayers(std::move(retired_players));
+    }
+    // --- записи ушедших уже у писателя БД: их псы больше не нужны
+    if ( !removed_players.dogs.empty() ) {
+        profiler::ScopedTimer timer(tick_profile_, REMOVE_DOGS);
+        RemoveDogs(std::move(removed_players.dogs));
+    }
+    // --- changes of this tick to WAL
+    if ( wal_ ) {
+        profiler::ScopedTimer timer(tick_profile_, WRITE_WAL);
+        wal_->Append(*this, std::move(removed_players.tokens));
+    }
+    // --- is time to save state ?
     if ( curr_time_ - save_time_ > save_period_ ) {
+        profiler::ScopedTimer timer(tick_profile_, SAVE_APP);
         save_time_ = curr_time_;
-        serialization::SaveApp(*this);
+        // в тике только плоский образ состояния, раскладка и запись - в потоке StateSaver;
+        // следующие тики пишутся в новый сегмент WAL, старые удалятся после записи снимка
+        if ( saver_ ) {
+            saver_->Post(serialization::StateImage(*this));
+        }
+        if ( wal_ ) {
+            wal_->Rotate();
+        }
+    }
+    // --- profiling
+    const uint64_t total_us = std::chrono::duration_cast<std::chrono::microseconds>(profiler::Clock::now() - tick_start).count();
+    tick_profile_.Commit(total_us);
+    if ( slow_tick_ms_ != 0 && total_us > uint64_t{slow_tick_ms_} * 1000 ) {
+        ReportSlowTick();
     }
-    // --- try find new retired dogs & save if found
-    db_.SaveRetiredPlayers(players_.GetRetiredPlayers());
     // --- response
     return "{}"s;
 }
 
-bool Application::GetRecords(std::string& res_body) {
-    auto retired_players = db_.ReadRetiredPlayers();
-    json::array arr;
-    for (auto& retired_player : retired_players) {
-        json::object item;
-        item["name"]     = std::get<0>(retired_player);
-        item["score"]    = std::get<1>(retired_player);
-        item["playTime"] = std::get<2>(retired_player);
-        arr.push_back(item);
+void Application::RemoveDogs(std::vector<model::DogRef> dogs) {
+    // ряды метрик опустевших карт удалит следующий тик
+    if ( !game_.RemoveDogs(std::move(dogs)).empty() ) {
+        profiles_dirty_ = true;
+    }
+}
+
+void Application::PublishSessionProfiles() {
+    if ( !profiles_dirty_ ) {
+        return;
+    }
+    profiles_dirty_ = false;
+    SessionProfiles profiles;
+    profiles.reserve(game_.GetSessions().Size());
+    for (const auto& session : game_.GetSessions()) {
+        profiles.emplace_back(*session.GetMapId(), session.ShareTickProfile());
+    }
+    std::lock_guard lock{profiles_mutex_};
+    session_profiles_.swap(profiles);
+}
+
+void Application::StartBots(uint64_t seed) {
+    bots_ = std::make_unique<bots::Swarm>(seed);
+    bots_->Populate(*this);
+}
+
+size_t Application::GetBotCount() const noexcept {
+    return bots_ ? bots_->GetCount() : 0;
+}
+
+void Application::ReportSlowTick() {
+    json::object sessions;
+    for (const auto& session : game_.GetSessions()) {
+        json::object json_session = session.GetTickProfile().LastToJson();
+        json_session["dogs"]  = session.GetDogsCount();
+        json_session["loots"] = session.GetLostsCount();
+        sessions[*session.GetMapId()] = json_session;
+    }
+    json::object data;
+    data["thresholdMs"] = slow_tick_ms_;
+    data["app"]         = tick_profile_.LastToJson();
+    data["sessions"]    = sessions;
+    logger::LogJson("slow tick"sv, data);
+}
+
+bool Application::GetTickProfile(std::string& res_body) {
+    // профиль удалённой сессии живёт, пока на него ссылается копия
+    SessionProfiles profiles;
+    {
+        std::lock_guard lock{profiles_mutex_};
+        profiles = session_profiles_;
+    }
+    json::object sessions;
+    for (const auto& [map_id, profile] : profiles) {
+        sessions[map_id] = profile->ToJson();
+    }
+    json::object result;
+    result["unit"]              = "us";
+    result["slowTickThreshold"] = slow_tick_ms_;
+    result["app"]               = tick_profile_.ToJson();
+    result["sessions"]          = sessions;
+    res_body = json::serialize(result);
+    return true;
+}
+
+void Application::SaveState() {
+    if ( !saver_ ) {
+        return;
+    }
+    saver_->Post(serialization::StateImage(*this));
+    if ( wal_ ) {
+        wal_->Rotate();
+    }
+    saver_->Flush();
+}
+
+void Application::StartWal(uint64_t seq) {
+    if ( !state_file_.empty() ) {
+        wal_ = std::make_unique<serialization::WalWriter>(state_file_, seq, *this);
+    }
+}
+
+uint64_t Application::GetWalSeq() const noexcept {
+    return wal_ ? wal_->GetSeq() : 0;
+}
+
+uint64_t Application::DetachStorage() {
+    const uint64_t seq = GetWalSeq();
+    // деструктор StateSaver дописывает ожидающий снимок, иначе он столкнётся со снимками нового процесса
+    saver_.reset();
+    wal_.reset();
+    return seq;
+}
+
+void Application::AttachStorage(uint64_t seq) {
+    if ( !state_file_.empty() ) {
+        saver_ = std::make_unique<serialization::StateSaver>(state_file_);
+    }
+    StartWal(seq);
+}
+
+void Application::StartJournal(const fs::path& file) {
+    const uint64_t seed = (uint64_t{std::random_device{}()} << 32) | std::random_device{}();
+    model::SeedRandom(seed);
+    uint8_t flags = 0;
+    if ( randomize_spawn_ ) {
+        flags |= journal::RANDOMIZE_SPAWN;
     }
-    res_body = json::serialize(arr);
+    if ( !game_.GetSessions().Empty() ) {
+        flags |= journal::RESTORED;
+    }
+    journal_ = std::make_unique<journal::Writer>(file, seed, flags);
+}
+
+uint64_t Application::StateDigest() const {
+    Digest digest;
+    digest.Add(dog_id_);
+    digest.Add(curr_time_);
+    for (const auto& session : game_.GetSessions()) {
+        digest.Add(std::string_view(*session.GetMapId()));
+        for (const auto& dog : session.GetDogs()) {
+            digest.Add(dog.GetId());
+            digest.Add(std::string_view(dog.GetName()));
+            digest.Add(dog.GetPosition().x);
+            digest.Add(dog.GetPosition().y);
+            digest.Add(dog.GetSpeed().sx);
+            digest.Add(dog.GetSpeed().sy);
+            digest.Add(dog.GetDirection());
+            digest.Add(dog.GetScore());
+            digest.Add(dog.GetValue());
+            digest.Add(dog.IsRetired());
+            digest.Add(dog.IsBot());
+            for (const auto& bag_item : dog.GetBag()) {
+                digest.Add(bag_item.id_);
+                digest.Add(bag_item.type_);
+            }
+        }
+        for (const auto& lost : session.GetLostObjects()) {
+            digest.Add(lost.id_);
+            digest.Add(lost.type_);
+            digest.Add(lost.position_.x);
+            digest.Add(lost.position_.y);
+        }
+    }
+    // порядок обхода таблицы токенов не определён - сортируем
+    auto tokens = players_.GetPlayersTokenToIndex();
+    std::sort(tokens.begin(), tokens.end());
+    for (const auto& [token, index] : tokens) {
+        digest.Add(std::string_view(token::ToString(token)));
+        digest.Add(index);
+    }
+    return digest.Get();
+}
+
+void Application::GetRecords(size_t start, size_t max_items, RecordsHandler handler) {
+    if ( auto cached = leaderboard_.Get(start, max_items) ) {
+        handler(SerializeRecords(*cached));
+        return;
+    }
+    // за пределами кеша - из базы, не занимая поток io_context
+    db_.AsyncReadRetiredPlayers(start, max_items, [handler = std::move(handler)](std::exception_ptr error, std::vector<postgres::Db::Row> rows) {
+        if ( error ) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& ex) {
+                json::object data;
+                data["what"] = ex.what();
+                logger::LogJson("records read error", data);
+            } catch (...) {
+                logger::LogJson("records read error", {});
+            }
+            handler(std::nullopt);
+            return;
+        }
+        handler(SerializeRecords(rows));
+    });
+}
+
+bool Application::GetRank(const leaderboard::Record& key, size_t around, std::string& res_body) {
+    const size_t before = rank_index_.CountBefore(key);
+    json::object result;
+    result["rank"]  = before + 1;
+    result["total"] = rank_index_.Size();
+    if ( around > 0 ) {
+        const size_t start = before > around ? before - around : 0;
+        json::array arr;
+        size_t rank = start + 1;
+        for (const auto& record : rank_index_.Range(start, before - start + around)) {
+            json::object item = SerializeRecord(record);
+            item["rank"] = rank++;
+            arr.push_back(std::move(item));
+        }
+        result["around"] = std::move(arr);
+    }
+    res_body = json::serialize(result);
     return true;
 }
 
@@ -6,7 +6,9 @@
 #include <iostream>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <random>
 #include <sstream>
@@ -16,8 +18,21 @@
 #include <unordered_map>
 #include <vector>
 
+#include "journal.h"
+#include "leaderboard.h"
 #include "model.h"
 #include "postgres.h"
+#include "profiler.h"
+#include "token.h"
+
+namespace serialization {
+class StateSaver;
+class WalWriter;
+}   // namespace serialization
+
+namespace bots {
+class Swarm;
+}   // namespace bots
 
 namespace app {
 
@@ -28,67 +43,32 @@ namespace fs   = std::filesystem;
 
 
 //// Player ///////////////////////////////////////////////////////////////////////////////////////
+// Пёс и сессия игрока - ссылки, разрешаемые через model::Game; пёс или сессия, которых уже
+// нет, дают nullptr, а не висячий указатель
 class Player {
 public:
-    Player(model::Dog* dog, const model::GameSession* session)
+    Player(model::DogRef dog, uint32_t dog_id, model::Map::Id session_id)
         : dog_(dog)
-        , session_(session)
-        , dog_id_(0)
-        , session_id_("")
+        , dog_id_(dog_id)
+        , session_id_(std::move(session_id))
     {
-        if ( dog_ != nullptr ) {
-            dog_id_ = dog->GetId();
-        }
-        if ( session_ != nullptr ) {
-            session_id_ = session->GetMapId();
-        }
     }
-    model::Dog* GetDog() const noexcept { return dog_; }
-    const model::GameSession* GetSession() const noexcept { return session_; }
+    model::DogRef GetDog() const noexcept { return dog_; }
+    model::SessionHandle GetSession() const noexcept { return dog_.session; }
     // for deserialization only
     uint32_t GetDogId() const noexcept { return dog_id_; }
     model::Map::Id GetSessionId() const noexcept { return session_id_; }
-    void SetDogId(uint32_t dog_id) { dog_id_ = dog_id; }
-    void SetSessionId(model::Map::Id session_id) { session_id_ = session_id; }
     //
     std::string ToString(std::string offs) const;
 
 private:
-    model::Dog*               dog_;
-    const model::GameSession* session_;
+    model::DogRef             dog_;
     // for deserialization only
     uint32_t                  dog_id_;
     model::Map::Id            session_id_;
 };  // Player
 
 
-//// PlayerToken Generator ////////////////////////////////////////////////////////////////////////
-class PlayerToken {
-    constexpr static size_t TOKEN_SIZE = 32;
-public:
-    PlayerToken() = default;
-    std::string Get() {
-        std::ostringstream oss;
-        oss << std::hex << generator1_() << generator2_();
-        std::string token = oss.str();
-        while ( token.size() < TOKEN_SIZE ) {
-            token = "0" + token;
-        }
-        return token;
-    }
-private:
-    std::random_device random_device_;
-    std::mt19937_64 generator1_{[this] {
-        std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }()};
-    std::mt19937_64 generator2_{[this] {
-        std::uniform_int_distribution<std::mt19937_64::result_type> dist;
-        return dist(random_device_);
-    }()};
-};  // PlayerToken
-
-
 //// Players //////////////////////////////////////////////////////////////////////////////////////
 struct RetiredPlayer {
     std::string name;
@@ -96,44 +76,64 @@ struct RetiredPlayer {
     int         play_time_ms;
     //
     size_t      idx;
+    bool        bot;
+};
+
+// Игроки, удалённые из списка: токены - для WAL, псы - на удаление из игры
+struct RemovedPlayers {
+    std::vector<std::string>   tokens;
+    std::vector<model::DogRef> dogs;
 };
 
 class Players {
 public:
     Players() = default;
-    std::string Add(model::Dog* dog, const model::GameSession* session) {
-        std::string  token = PlayerToken().Get();
+    token::Token Add(const Player& player) {
+        return Add(player, token::Generate());
+    }
+    // с заданным токеном - для воспроизведения журнала
+    token::Token Add(const Player& player, const token::Token& token) {
         const size_t index = players_.size();
-        Player player(dog, session);
         players_.push_back(player);
         //
-        token_to_index_[token] = index;
+        token_to_index_.Insert(token, index);
         //
         return token;
     }
-    bool HasToken(std::string token) const noexcept {
-        return token_to_index_.find(token) != token_to_index_.end();
+    bool HasToken(const token::Token& token) const {
+        return token_to_index_.Find(token).has_value();
+    }
+    Player* FindByToken(const token::Token& token) {
+        if ( auto index = token_to_index_.Find(token) ) {
+            return &players_.at(*index);
+        }
+        return nullptr;
     }
-    Player* FindByToken(std::string token) noexcept {
-        if ( HasToken(token) ) {
-            return &players_.at(token_to_index_.at(token));
+    const Player* FindByToken(const token::Token& token) const {
+        if ( auto index = token_to_index_.Find(token) ) {
+            return &players_.at(*index);
         }
         return nullptr;
     }
     const std::vector<Player>& GetPlayers() const noexcept { return players_; }
     // for deserialization only
-    const std::unordered_map<std::string, size_t>  GetPlayersTokenToIndex() const noexcept { return token_to_index_; }
+    std::vector<std::pair<token::Token, size_t>> GetPlayersTokenToIndex() const { return token_to_index_.GetAll(); }
     Player* AddPlayer(Player player) {
         players_.push_back(player);
         return &players_.back();
     }
-    void AddPlayersTokenAndIndex(std::string token, size_t index) { token_to_index_[token] = index; }
-    // retiring
-    std::vector<std::tuple<std::string, int, int>> GetRetiredPlayers();
+    void AddPlayersTokenAndIndex(const std::string& token, size_t index);
+    // возвращает псов удалённых игроков
+    std::vector<model::DogRef> Remove(const std::vector<std::string>& tokens);
+    // retiring: removed - удалённые игроки; игроки без пса удаляются без записи
+    std::vector<std::tuple<std::string, int, int>> GetRetiredPlayers(model::Game& game, RemovedPlayers& removed);
     //
     std::string ToString() const;
 
 private:
+    // удаляет отмеченных игроков и их токены
+    RemovedPlayers Compact(const std::vector<bool>& removed);
+
     std::string DebugToken() {
         const int   TOKEN_SIZE = 32;
         std::string debug_token(TOKEN_SIZE, static_cast<char>(0x30 + players_.size()));
@@ -142,38 +142,73 @@ private:
 
 private:
     std::vector<Player> players_;
-    std::unordered_map<std::string, size_t> token_to_index_;
+    token::TokenTable   token_to_index_;
 };  // Players
 
 
 //// Application //////////////////////////////////////////////////////////////////////////////////
+// Фазы тика приложения для профилировщика
+enum AppTickPhase : size_t {
+    GAME_TICK,
+    SAVE_APP,
+    GET_RETIRED,
+    SAVE_RETIRED,
+    WRITE_WAL,
+    BOTS_DECIDE,
+    REMOVE_DOGS
+};
+
+// Все методы, кроме GetMap/GetMaps, вызываются только в strand игры: тик удаляет игроков, псов
+// и сессии, и указатели на них действительны лишь внутри одного вызова
 class Application {
 public:
-    explicit Application(postgres::Db& db, model::Game& game, bool debug_mode, bool randomize_spawn, std::string state_file, uint32_t save_period)
-            : db_(db)
-            , game_(game)
-            , debug_mode_(debug_mode)
-            , randomize_spawn_(randomize_spawn)
-            , state_file_(state_file)
-            , save_period_(save_period)
-            , dog_id_(0)
-            , curr_time_(0)
-            , save_time_(0) {
-    }
+    constexpr static size_t RECORDS_MAX_ITEMS = 100;
+    constexpr static size_t RANK_MAX_AROUND   = RECORDS_MAX_ITEMS / 2;
+
+    explicit Application(postgres::Db& db, model::Game& game, bool debug_mode, bool randomize_spawn, std::string state_file, uint32_t save_period);
+    ~Application();
 
     // unauthorized
     std::optional<std::string> GetMap(const std::string& map_id);
     bool GetMaps(std::string& res_body);
     bool TryJoin(const std::string& user_name, const std::string& map_id, std::string& res_body);
-    bool GetRecords(std::string& res_body);
+    // Страница таблицы рекордов; верхние страницы - из кеша, без обращения к базе. handler вызывается
+    // сразу или из потока пула соединений; nullopt - база недоступна
+    using RecordsHandler = std::function<void(std::optional<std::string> res_body)>;
+    void GetRecords(size_t start, size_t max_items, RecordsHandler handler);
+    // Место рекорда key в таблице и around рекордов выше и ниже него, без обращения к базе
+    bool GetRank(const leaderboard::Record& key, size_t around, std::string& res_body);
     // authorized
-    bool GetPlayers(const std::string& token, std::string& res_body);
-    bool GetState(const std::string& token, std::string& res_body);
-    bool Move(const std::string& token, const std::string& move, std::string& res_body);
+    bool GetPlayers(const token::Token& token, std::string& res_body);
+    bool GetState(const token::Token& token, std::string& res_body);
+    bool Move(const token::Token& token, const std::string& move, std::string& res_body);
+    // Серверные боты: вход с флагом бота, дальше управление через Move
+    std::optional<token::Token> JoinBot(const std::string& map_id);
+    // Доводит число ботов на картах до заданного в конфиге и включает их решения в тике
+    void StartBots(uint64_t seed);
+    size_t GetBotCount() const noexcept;
     // debug (unauthorized)
     std::string Tick(uint32_t time_delta);
+    // Из любого потока: профили сессий читаются из копии, опубликованной тиком
+    bool GetTickProfile(std::string& res_body);
+    // 0 - отчёт о медленных тиках выключен
+    void SetSlowTickThreshold(uint32_t threshold_ms) { slow_tick_ms_ = threshold_ms; }
+    // journal: запись входа, движения и тиков с зерном генератора модели
+    void StartJournal(const fs::path& file);
+    bool ReplayJoin(const std::string& user_name, const std::string& map_id, const std::string& token, bool bot);
+    // Хеш состояния мира для сверки результата воспроизведения
+    uint64_t StateDigest() const;
+    // Синхронно сохраняет состояние и дожидается записи фоновых снимков (при остановке сервера)
+    void SaveState();
     // for deserialization only
     std::string GetStateFile() const noexcept { return state_file_; }
+    // WAL: запись изменений каждого тика после восстановленного тика seq
+    void StartWal(uint64_t seq);
+    uint64_t GetWalSeq() const noexcept;
+    // Передача состояния другому процессу: дописывает фоновые снимки, закрывает WAL и больше
+    // не пишет файлы состояния. Возвращает номер последнего тика в WAL - для AttachStorage при откате
+    uint64_t DetachStorage();
+    void AttachStorage(uint64_t seq);
     //
     model::Game& GetGame() const noexcept { return game_; }
     const Players& GetPlayers() const noexcept { return players_; }
@@ -181,13 +216,24 @@ public:
     //
     Player* AddPlayer(Player player) { return players_.AddPlayer(player); }
     void AddPlayersTokenAndIndex(std::string token, size_t index) { players_.AddPlayersTokenAndIndex(token, index); }
+    void RemovePlayers(const std::vector<std::string>& tokens) { RemoveDogs(players_.Remove(tokens)); }
     void SetDogId(uint32_t dog_id) { dog_id_ = dog_id; }
     //
     std::string ToString() const;
 
+private:
+    std::optional<token::Token> Join(const std::string& user_name, const std::string& map_id, std::optional<std::string> token, bool bot, std::string& res_body);
+    void ReportSlowTick();
+    // публикует профили сессий для GetTickProfile, если набор сессий менялся
+    void PublishSessionProfiles();
+    // удаляет псов из игры, обнуляет метрики освобождённых сессий
+    void RemoveDogs(std::vector<model::DogRef> dogs);
+
 private:
     // components
     postgres::Db& db_;
+    leaderboard::Leaderboard leaderboard_;
+    leaderboard::RankIndex   rank_index_;
     model::Game&  game_;
     Players       players_;
     // command line arguements
@@ -199,6 +245,20 @@ private:
     uint32_t      dog_id_;
     uint64_t      curr_time_;
     uint64_t      save_time_;
+    // profiling
+    profiler::TickProfile tick_profile_{"gameTick"sv, "saveApp"sv, "getRetiredPlayers"sv, "saveRetiredPlayers"sv, "writeWal"sv, "botsDecide"sv, "removeDogs"sv};
+    uint32_t      slow_tick_ms_ = 0;
+    using SessionProfiles = std::vector<std::pair<std::string, std::shared_ptr<const profiler::TickProfile>>>;
+    bool               profiles_dirty_ = true;     // сессии добавлялись или удалялись
+    mutable std::mutex profiles_mutex_;
+    SessionProfiles    session_profiles_;
+    // journal
+    std::unique_ptr<journal::Writer> journal_;
+    // фоновая запись снимков состояния, нет без state_file
+    std::unique_ptr<serialization::StateSaver> saver_;
+    std::unique_ptr<serialization::WalWriter>  wal_;
+    // серверные боты, нет без StartBots
+    std::unique_ptr<bots::Swarm> bots_;
 };  // Application
 
 }   // namespace app
@@ -0,0 +1,303 @@
+#include "bots.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+
+#include "app.h"
+
+namespace bots {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr char MOVES[] = { 'U', 'D', 'L', 'R' };
+
+bool IsHorizontal(char move) noexcept {
+    return move == 'L' || move == 'R';
+}
+
+Profile ProfileOf(const model::Map& map) {
+    if ( map.GetBotProfile().empty() ) {
+        return Profile::RANDOM_WALK;
+    }
+    auto profile = ParseProfile(map.GetBotProfile());
+    if ( !profile ) {
+        throw std::runtime_error("Unknown bot profile '"s + map.GetBotProfile() + "' on map "s + *map.GetId());
+    }
+    return *profile;
+}
+
+double Distance2(model::Position a, model::Position b) noexcept {
+    return (a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y);
+}
+
+}  // namespace
+
+std::optional<Profile> ParseProfile(std::string_view name) {
+    if ( name == "randomWalk"sv ) {
+        return Profile::RANDOM_WALK;
+    }
+    if ( name == "lootSeeker"sv ) {
+        return Profile::LOOT_SEEKER;
+    }
+    if ( name == "officeReturner"sv ) {
+        return Profile::OFFICE_RETURNER;
+    }
+    return std::nullopt;
+}
+
+
+//// LootGrid /////////////////////////////////////////////////////////////////////////////////////
+void LootGrid::Build(const model::GameSession::LostObjects& lost_objects) {
+    items_.clear();
+    start_.clear();
+    cols_ = rows_ = 0;
+    if ( lost_objects.empty() ) {
+        return;
+    }
+    double max_x = min_x_ = lost_objects.front().position_.x;
+    double max_y = min_y_ = lost_objects.front().position_.y;
+    for (const auto& lost_object : lost_objects) {
+        min_x_ = std::min(min_x_, lost_object.position_.x);
+        min_y_ = std::min(min_y_, lost_object.position_.y);
+        max_x  = std::max(max_x,  lost_object.position_.x);
+        max_y  = std::max(max_y,  lost_object.position_.y);
+    }
+    // на огромной карте клетки крупнее, чтобы сетка оставалась ограниченной
+    cell_ = CELL;
+    while ( ((max_x - min_x_) / cell_ + 1) * ((max_y - min_y_) / cell_ + 1) > MAX_CELLS ) {
+        cell_ *= 2;
+    }
+    cols_ = static_cast<int>((max_x - min_x_) / cell_) + 1;
+    rows_ = static_cast<int>((max_y - min_y_) / cell_) + 1;
+
+    // раскладка подсчётом: число предметов в клетках, начала клеток, сами предметы
+    auto cell_of = [this](model::Position pos) {
+        return static_cast<size_t>((pos.y - min_y_) / cell_) * cols_ + static_cast<size_t>((pos.x - min_x_) / cell_);
+    };
+    start_.assign(size_t(cols_) * rows_ + 1, 0);
+    for (const auto& lost_object : lost_objects) {
+        ++start_[cell_of(lost_object.position_) + 1];
+    }
+    for (size_t i = 1; i < start_.size(); ++i) {
+        start_[i] += start_[i - 1];
+    }
+    items_.resize(lost_objects.size());
+    std::vector<uint32_t> fill(start_.begin(), start_.end() - 1);
+    for (const auto& lost_object : lost_objects) {
+        items_[fill[cell_of(lost_object.position_)]++] = lost_object.position_;
+    }
+}
+
+std::optional<model::Position> LootGrid::FindNearest(model::Position from, int radius) const {
+    if ( items_.empty() ) {
+        return std::nullopt;
+    }
+    const int cx = std::clamp(static_cast<int>(std::floor((from.x - min_x_) / cell_)), 0, cols_ - 1);
+    const int cy = std::clamp(static_cast<int>(std::floor((from.y - min_y_) / cell_)), 0, rows_ - 1);
+    std::optional<model::Position> nearest;
+    double best = std::numeric_limits<double>::max();
+    auto scan = [&](int x, int y) {
+        if ( x < 0 || x >= cols_ || y < 0 || y >= rows_ ) {
+            return;
+        }
+        const size_t cell = size_t(y) * cols_ + x;
+        for (uint32_t i = start_[cell]; i < start_[cell + 1]; ++i) {
+            const double d = Distance2(from, items_[i]);
+            if ( d < best ) {
+                best    = d;
+                nearest = items_[i];
+            }
+        }
+    };
+    // кольца клеток вокруг пса; предмет из кольца r не ближе (r - 1) клеток
+    scan(cx, cy);
+    for (int r = 1; r <= radius; ++r) {
+        if ( nearest && best <= (r - 1) * cell_ * (r - 1) * cell_ ) {
+            break;
+        }
+        for (int x = cx - r; x <= cx + r; ++x) {
+            scan(x, cy - r);
+            scan(x, cy + r);
+        }
+        for (int y = cy - r + 1; y <= cy + r - 1; ++y) {
+            scan(cx - r, y);
+            scan(cx + r, y);
+        }
+    }
+    return nearest;
+}
+
+
+//// Swarm ////////////////////////////////////////////////////////////////////////////////////////
+void Swarm::Populate(app::Application& app) {
+    const app::Players& players = app.GetPlayers();
+    const model::Game& game = app.GetGame();
+    // боты восстановленного состояния
+    std::unordered_map<std::string, size_t> on_map;
+    for (const auto& [token, index] : players.GetPlayersTokenToIndex()) {
+        const app::Player& player = players.GetPlayers().at(index);
+        const model::Dog* dog = game.GetDog(player.GetDog());
+        if ( dog != nullptr && dog->IsBot() ) {
+            Add(token, game, player);
+            ++on_map[*player.GetSessionId()];
+        }
+    }
+    // недостающие
+    const auto catalog = app.GetGame().GetCatalog();
+    for (const auto& map : catalog->GetMaps()) {
+        ProfileOf(map);     // неизвестный профиль - ошибка конфига, даже без ботов
+        for (size_t n = on_map[*map.GetId()]; n < map.GetBotCount(); ++n) {
+            auto token = app.JoinBot(*map.GetId());
+            const app::Player* player = token ? players.FindByToken(*token) : nullptr;
+            if ( player == nullptr ) {
+                throw std::runtime_error("Can't join bot to map "s + *map.GetId());
+            }
+            Add(*token, game, *player);
+        }
+    }
+}
+
+void Swarm::Add(const token::Token& token, const model::Game& game, const app::Player& player) {
+    Bot bot{token, player.GetDog(), ProfileOf(*game.GetSession(player.GetSession())->GetMap())};
+    // повороты ботов разнесены по времени, чтобы команды не приходились на один тик
+    bot.turn_in = std::uniform_int_distribution<uint32_t>(0, TURN_MAX)(random_);
+    bots_.push_back(bot);
+}
+
+void Swarm::Decide(app::Application& app, uint32_t time_delta) {
+    const model::Game& game = app.GetGame();
+    BuildLootGrids(game);
+
+    // 1. решения: мир только читается
+    commands_.clear();
+    bool retired = false;
+    for (size_t i = 0; i < bots_.size(); ++i) {
+        Bot& bot = bots_[i];
+        const model::GameSession* session = game.GetSession(bot.dog.session);
+        const model::Dog* dog = session != nullptr ? session->GetDog(bot.dog.dog) : nullptr;
+        if ( dog == nullptr || dog->IsRetired() ) {
+            bot.dog = {};
+            retired = true;
+            continue;
+        }
+        if ( const char move = Choose(bot, *session, *dog, time_delta); move != 0 ) {
+            commands_.push_back({i, move});
+        }
+    }
+
+    // 2. команды - тем же путём, что и запросы клиентов
+    std::string res_body;
+    for (const auto& command : commands_) {
+        Bot& bot = bots_[command.bot];
+        if ( !app.Move(bot.token, std::string(1, command.move), res_body) ) {
+            bot.dog = {};
+            retired = true;
+            continue;
+        }
+        bot.move = command.move;
+    }
+
+    // 3. ушедшие на покой боты больше не управляются
+    if ( retired ) {
+        std::erase_if(bots_, [](const Bot& bot) {
+            return bot.dog.dog.IsNull();
+        });
+    }
+}
+
+void Swarm::BuildLootGrids(const model::Game& game) {
+    std::unordered_set<const model::GameSession*> sessions;
+    for (const auto& bot : bots_) {
+        if ( bot.profile == Profile::LOOT_SEEKER ) {
+            if ( const model::GameSession* session = game.GetSession(bot.dog.session) ) {
+                sessions.insert(session);
+            }
+        }
+    }
+    std::erase_if(loot_grids_, [&sessions](const auto& item) {
+        return !sessions.contains(item.first);
+    });
+    for (const model::GameSession* session : sessions) {
+        loot_grids_[session].Build(session->GetLostObjects());
+    }
+}
+
+char Swarm::Choose(Bot& bot, const model::GameSession& session, const model::Dog& dog, uint32_t time_delta) {
+    const bool stopped = dog.GetSpeed().sx == 0.0 && dog.GetSpeed().sy == 0.0;
+    bot.stuck = stopped ? bot.stuck + 1 : 0;
+    if ( bot.stuck >= STUCK_LIMIT ) {
+        // жадный путь к цели упёрся в тупик: сходим с него на время
+        bot.stuck      = 0;
+        bot.wander_for = WANDER_TIME;
+    }
+    if ( bot.wander_for > 0 ) {
+        bot.wander_for -= std::min(bot.wander_for, time_delta);
+        return Wander(bot, time_delta, stopped);
+    }
+
+    std::optional<model::Position> target;
+    const bool bag_full = dog.GetBag().size() >= dog.GetBagCapacity();
+    switch ( bot.profile ) {
+        case Profile::LOOT_SEEKER:
+            target = bag_full ? NearestOffice(session, dog.GetPosition()) : loot_grids_[&session].FindNearest(dog.GetPosition(), SEARCH_RADIUS);
+            break;
+        case Profile::OFFICE_RETURNER:
+            if ( !dog.GetBag().empty() ) {
+                target = NearestOffice(session, dog.GetPosition());
+            }
+            break;
+        case Profile::RANDOM_WALK:
+            break;
+    }
+    return target ? Toward(bot, dog.GetPosition(), *target, stopped) : Wander(bot, time_delta, stopped);
+}
+
+char Swarm::Wander(Bot& bot, uint32_t time_delta, bool stopped) {
+    if ( !stopped && bot.turn_in > time_delta ) {
+        bot.turn_in -= time_delta;
+        return 0;
+    }
+    bot.turn_in = std::uniform_int_distribution<uint32_t>(TURN_MIN, TURN_MAX)(random_);
+    char move;
+    do {
+        move = MOVES[std::uniform_int_distribution<size_t>(0, std::size(MOVES) - 1)(random_)];
+    } while ( move == bot.move && stopped );
+    return move != bot.move || stopped ? move : 0;
+}
+
+char Swarm::Toward(Bot& bot, model::Position pos, model::Position target, bool stopped) {
+    const double dx = target.x - pos.x;
+    const double dy = target.y - pos.y;
+    bool horizontal = std::abs(dx) >= std::abs(dy);
+    // по оси, в которую упёрлись, дальше не пройти - пробуем другую
+    if ( stopped && bot.move != 0 && IsHorizontal(bot.move) == horizontal ) {
+        horizontal = !horizontal;
+    }
+    if ( (horizontal ? std::abs(dx) : std::abs(dy)) < ARRIVED ) {
+        horizontal = !horizontal;
+    }
+    const char move = horizontal ? (dx > 0 ? 'R' : 'L') : (dy > 0 ? 'D' : 'U');
+    return move != bot.move || stopped ? move : 0;
+}
+
+std::optional<model::Position> Swarm::NearestOffice(const model::GameSession& session, model::Position pos) const {
+    std::optional<model::Position> nearest;
+    double best = std::numeric_limits<double>::max();
+    for (const auto& office : session.GetMap()->GetOffices()) {
+        const model::Position office_pos{static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y)};
+        const double d = Distance2(pos, office_pos);
+        if ( d < best ) {
+            best    = d;
+            nearest = office_pos;
+        }
+    }
+    return nearest;
+}
+
+}  // namespace bots
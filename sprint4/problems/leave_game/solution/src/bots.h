@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "model.h"
+#include "token.h"
+
+namespace app {
+class Application;
+class Player;
+}   // namespace app
+
+namespace bots {
+
+//// Profile //////////////////////////////////////////////////////////////////////////////////////
+enum class Profile : uint8_t {
+    RANDOM_WALK,        // бродит по дорогам, подбирая то, что окажется на пути
+    LOOT_SEEKER,        // идёт к ближайшему предмету, с полным рюкзаком - к офису
+    OFFICE_RETURNER     // бродит, пока рюкзак пуст, с первым предметом идёт к офису
+};
+
+// Профиль карты в конфиге: randomWalk, lootSeeker, officeReturner
+std::optional<Profile> ParseProfile(std::string_view name);
+
+
+//// LootGrid /////////////////////////////////////////////////////////////////////////////////////
+// Предметы сессии, разложенные по квадратным клеткам, для поиска ближайшего
+class LootGrid {
+public:
+    constexpr static double CELL      = 10.0;
+    constexpr static size_t MAX_CELLS = 1 << 20;
+
+    void Build(const model::GameSession::LostObjects& lost_objects);
+    // Ближайший предмет не дальше radius клеток от from
+    std::optional<model::Position> FindNearest(model::Position from, int radius) const;
+
+private:
+    double                       cell_ = CELL;
+    double                       min_x_ = 0, min_y_ = 0;
+    int                          cols_ = 0, rows_ = 0;
+    std::vector<uint32_t>        start_;    // начало клетки в items_, cols_ * rows_ + 1
+    std::vector<model::Position> items_;
+};
+
+
+//// Swarm ////////////////////////////////////////////////////////////////////////////////////////
+// Серверные боты для нагрузочных испытаний. Бот - обычный игрок с флагом на псе: входит через
+// Application::JoinBot и управляет псом через Application::Move, как клиент по HTTP. Решения всех
+// ботов принимаются пачкой в начале тика, пока мир только читается, затем команды применяются;
+// команда отдаётся, только если направление меняется. На состояние бот смотрит через своего пса,
+// поэтому на бота приходится несколько сравнений за тик.
+class Swarm {
+public:
+    constexpr static int      SEARCH_RADIUS = 8;       // клеток LootGrid вокруг пса
+    constexpr static double   ARRIVED       = 0.3;     // ближе по оси - ось пройдена
+    constexpr static uint8_t  STUCK_LIMIT   = 3;       // решений подряд на месте - бот бродит
+    constexpr static uint32_t WANDER_TIME   = 2000;    // мс блуждания после застревания
+    constexpr static uint32_t TURN_MIN      = 1000;    // мс между случайными поворотами
+    constexpr static uint32_t TURN_MAX      = 5000;
+
+    explicit Swarm(uint64_t seed) : random_(seed) {}
+
+    // Подхватывает ботов восстановленного состояния и доводит их число на каждой карте до
+    // заданного в конфиге. Неизвестный профиль - исключение
+    void Populate(app::Application& app);
+    // Решения и команды ботов на этот тик; вызывается приложением перед тиком игры
+    void Decide(app::Application& app, uint32_t time_delta);
+
+    size_t GetCount() const noexcept { return bots_.size(); }
+
+private:
+    struct Bot {
+        token::Token              token;
+        model::DogRef             dog;      // пустая ссылка на пса - бот ушёл
+        Profile                   profile;
+        char                      move       = 0;   // последняя отданная команда
+        uint8_t                   stuck      = 0;
+        uint32_t                  turn_in    = 0;   // мс до случайного поворота
+        uint32_t                  wander_for = 0;   // мс вынужденного блуждания
+    };
+
+    struct Command {
+        size_t bot;
+        char   move;
+    };
+
+    void Add(const token::Token& token, const model::Game& game, const app::Player& player);
+    void BuildLootGrids(const model::Game& game);
+    // 0 - продолжать движение
+    char Choose(Bot& bot, const model::GameSession& session, const model::Dog& dog, uint32_t time_delta);
+    char Wander(Bot& bot, uint32_t time_delta, bool stopped);
+    char Toward(Bot& bot, model::Position pos, model::Position target, bool stopped);
+    std::optional<model::Position> NearestOffice(const model::GameSession& session, model::Position pos) const;
+
+    std::vector<Bot>                                          bots_;
+    std::vector<Command>                                      commands_;
+    std::unordered_map<const model::GameSession*, LootGrid>   loot_grids_;     // перестраиваются каждый тик
+    std::mt19937_64                                           random_;
+};
+
+}  // namespace bots
@@ -0,0 +1,362 @@
+#include "handover.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include "logger.h"
+
+namespace handover {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr char MAGIC[8] = {'G', 'H', 'A', 'N', 'D', 'O', 'V', 'R'};
+constexpr char ACK      = 'A';
+
+// Сколько ждать другую сторону на каждом шаге обмена
+constexpr auto HELLO_TIMEOUT = 1s;
+constexpr auto IO_TIMEOUT    = 30s;
+// Как часто поток сервера проверяет флаг остановки
+constexpr auto POLL_INTERVAL = 200ms;
+
+struct Hello {
+    char     magic[8];
+    uint32_t version;
+};
+
+struct Header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t fd_count;
+    uint64_t snapshot_size;
+    int64_t  last_tick_ns;
+};
+
+static_assert(sizeof(Hello) == 12 && sizeof(Header) == 32);
+
+[[noreturn]] void ThrowErrno(const std::string& what) {
+    throw std::runtime_error("Handover: "s + what + ": "s + std::strerror(errno));
+}
+
+sockaddr_un MakeAddress(const std::string& socket_path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if ( socket_path.size() >= sizeof(addr.sun_path) ) {
+        throw std::runtime_error("Handover: socket path is too long: "s + socket_path);
+    }
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return addr;
+}
+
+// Ждёт готовности fd не дольше timeout
+void WaitFor(int fd, short events, std::chrono::milliseconds timeout) {
+    pollfd pfd{fd, events, 0};
+    int res;
+    do {
+        res = ::poll(&pfd, 1, static_cast<int>(timeout.count()));
+    } while ( res < 0 && errno == EINTR );
+    if ( res < 0 ) {
+        ThrowErrno("poll"s);
+    }
+    if ( res == 0 ) {
+        throw std::runtime_error("Handover: peer timed out"s);
+    }
+}
+
+void WriteAll(int fd, const void* data, size_t size) {
+    const char* ptr = static_cast<const char*>(data);
+    while ( size > 0 ) {
+        WaitFor(fd, POLLOUT, IO_TIMEOUT);
+        const ssize_t n = ::send(fd, ptr, size, MSG_NOSIGNAL);
+        if ( n < 0 ) {
+            if ( errno == EINTR || errno == EAGAIN ) {
+                continue;
+            }
+            ThrowErrno("send"s);
+        }
+        ptr  += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void ReadAll(int fd, void* data, size_t size, std::chrono::milliseconds timeout = IO_TIMEOUT) {
+    char* ptr = static_cast<char*>(data);
+    while ( size > 0 ) {
+        WaitFor(fd, POLLIN, timeout);
+        const ssize_t n = ::recv(fd, ptr, size, 0);
+        if ( n < 0 ) {
+            if ( errno == EINTR || errno == EAGAIN ) {
+                continue;
+            }
+            ThrowErrno("recv"s);
+        }
+        if ( n == 0 ) {
+            throw std::runtime_error("Handover: peer closed the connection"s);
+        }
+        ptr  += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+void Log(std::string_view event, std::string_view what = {}) {
+    boost::json::object data;
+    data["event"] = event;
+    if ( !what.empty() ) {
+        data["what"] = what;
+    }
+    logger::LogJson("handover"sv, std::move(data));
+}
+
+}  // namespace
+
+
+//// Takeover /////////////////////////////////////////////////////////////////////////////////////
+std::optional<Takeover> Takeover::Connect(const std::string& socket_path) {
+    const sockaddr_un addr = MakeAddress(socket_path);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ( fd < 0 ) {
+        ThrowErrno("socket"s);
+    }
+    if ( ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ) {
+        const int err = errno;
+        ::close(fd);
+        if ( err == ENOENT || err == ECONNREFUSED ) {
+            return std::nullopt;
+        }
+        errno = err;
+        ThrowErrno("connect to '"s + socket_path + "'"s);
+    }
+    Takeover takeover(fd);
+    takeover.Receive();
+    return takeover;
+}
+
+Takeover::Takeover(Takeover&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1))
+    , listeners_(std::move(other.listeners_))
+    , state_(std::move(other.state_)) {
+}
+
+Takeover& Takeover::operator=(Takeover&& other) noexcept {
+    if ( this != &other ) {
+        if ( fd_ >= 0 ) {
+            ::close(fd_);
+        }
+        fd_        = std::exchange(other.fd_, -1);
+        listeners_ = std::move(other.listeners_);
+        state_     = std::move(other.state_);
+    }
+    return *this;
+}
+
+Takeover::~Takeover() {
+    if ( fd_ >= 0 ) {
+        ::close(fd_);
+    }
+}
+
+void Takeover::Receive() {
+    Hello hello{};
+    std::memcpy(hello.magic, MAGIC, sizeof(MAGIC));
+    hello.version = PROTOCOL_VERSION;
+    WriteAll(fd_, &hello, sizeof(hello));
+
+    Header header{};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    iovec  iov{&header, sizeof(header)};
+    msghdr msg{};
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+    WaitFor(fd_, POLLIN, IO_TIMEOUT);
+    ssize_t n;
+    do {
+        n = ::recvmsg(fd_, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while ( n < 0 && errno == EINTR );
+    if ( n < 0 ) {
+        ThrowErrno("recvmsg"s);
+    }
+    // сокеты забираем сразу, чтобы закрыть их при любой ошибке ниже
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS ) {
+            const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const size_t first = listeners_.size();
+            listeners_.resize(first + count);
+            std::memcpy(listeners_.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+        }
+    }
+    auto fail = [this](const std::string& what) {
+        for (int fd : listeners_) {
+            ::close(fd);
+        }
+        listeners_.clear();
+        throw std::runtime_error("Handover: "s + what);
+    };
+    if ( static_cast<size_t>(n) != sizeof(header) || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ) {
+        fail("broken header"s);
+    }
+    if ( header.version != PROTOCOL_VERSION ) {
+        fail("unsupported protocol version "s + std::to_string(header.version));
+    }
+    if ( (msg.msg_flags & MSG_CTRUNC) != 0 || listeners_.size() != header.fd_count || listeners_.empty() ) {
+        fail("expected "s + std::to_string(header.fd_count) + " listening sockets, got "s + std::to_string(listeners_.size()));
+    }
+    try {
+        state_.snapshot.resize(header.snapshot_size);
+        ReadAll(fd_, state_.snapshot.data(), state_.snapshot.size());
+    } catch (const std::exception& ex) {
+        fail(ex.what());
+    }
+    state_.last_tick = Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds(header.last_tick_ns)));
+}
+
+void Takeover::Ack() {
+    WriteAll(fd_, &ACK, sizeof(ACK));
+    ::close(fd_);
+    fd_ = -1;
+}
+
+
+//// Server ///////////////////////////////////////////////////////////////////////////////////////
+Server::Server(std::string socket_path, Hooks hooks)
+    : socket_path_(std::move(socket_path))
+    , hooks_(std::move(hooks)) {
+    Listen();
+    thread_ = std::thread([this] { Run(); });
+}
+
+Server::~Server() {
+    stop_ = true;
+    if ( thread_.joinable() ) {
+        thread_.join();
+    }
+    CloseListen();
+}
+
+void Server::Listen() {
+    const sockaddr_un addr = MakeAddress(socket_path_);
+    listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ( listen_fd_ < 0 ) {
+        ThrowErrno("socket"s);
+    }
+    // файл мог остаться от упавшего процесса; живой процесс на этом адресе уже передал работу нам
+    ::unlink(socket_path_.c_str());
+    if ( ::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0
+         || ::listen(listen_fd_, 1) != 0 ) {
+        const int err = errno;
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+        errno = err;
+        ThrowErrno("listen on '"s + socket_path_ + "'"s);
+    }
+}
+
+void Server::CloseListen() {
+    if ( listen_fd_ >= 0 ) {
+        ::close(listen_fd_);
+        ::unlink(socket_path_.c_str());
+        listen_fd_ = -1;
+    }
+}
+
+void Server::Run() {
+    const int poll_interval = static_cast<int>(std::chrono::milliseconds(POLL_INTERVAL).count());
+    while ( !stop_ && listen_fd_ >= 0 ) {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        if ( ::poll(&pfd, 1, poll_interval) <= 0 ) {
+            continue;
+        }
+        const int conn = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if ( conn < 0 ) {
+            continue;
+        }
+        // адрес освобождаем сразу: новый процесс займёт его после ack, и наш unlink не должен
+        // удалить уже его сокет
+        CloseListen();
+        bool done = false;
+        try {
+            done = Serve(conn);
+        } catch (const std::exception& ex) {
+            Log("failed"sv, ex.what());
+        }
+        ::close(conn);
+        if ( done ) {
+            Log("done"sv);
+            hooks_.finish();
+            return;
+        }
+        try {
+            Listen();
+        } catch (const std::exception& ex) {
+            Log("failed"sv, ex.what());
+        }
+    }
+}
+
+bool Server::Serve(int conn) {
+    Hello hello{};
+    ReadAll(conn, &hello, sizeof(hello), HELLO_TIMEOUT);
+    if ( std::memcmp(hello.magic, MAGIC, sizeof(MAGIC)) != 0 || hello.version != PROTOCOL_VERSION ) {
+        throw std::runtime_error("Handover: peer speaks another protocol version"s);
+    }
+    Log("started"sv);
+
+    std::vector<int> listeners = hooks_.pause();
+    try {
+        if ( listeners.empty() || listeners.size() > MAX_LISTENERS ) {
+            throw std::runtime_error("Handover: can't pass "s + std::to_string(listeners.size()) + " listening sockets"s);
+        }
+        State state = hooks_.freeze();
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version       = PROTOCOL_VERSION;
+        header.fd_count      = static_cast<uint32_t>(listeners.size());
+        header.snapshot_size = state.snapshot.size();
+        header.last_tick_ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(state.last_tick.time_since_epoch()).count();
+
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)]{};
+        iovec  iov{&header, sizeof(header)};
+        msghdr msg{};
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * listeners.size());
+        cmsghdr* cmsg   = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * listeners.size());
+        std::memcpy(CMSG_DATA(cmsg), listeners.data(), sizeof(int) * listeners.size());
+        // заголовок мал и уходит одним сообщением вместе с сокетами
+        ssize_t n;
+        do {
+            n = ::sendmsg(conn, &msg, MSG_NOSIGNAL);
+        } while ( n < 0 && errno == EINTR );
+        if ( n != static_cast<ssize_t>(sizeof(header)) ) {
+            ThrowErrno("sendmsg"s);
+        }
+        WriteAll(conn, state.snapshot.data(), state.snapshot.size());
+
+        char ack = 0;
+        ReadAll(conn, &ack, sizeof(ack));
+        if ( ack != ACK ) {
+            throw std::runtime_error("Handover: bad acknowledgement"s);
+        }
+    } catch (...) {
+        Log("rollback"sv);
+        hooks_.resume();
+        throw;
+    }
+    return true;
+}
+
+}  // namespace handover
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace handover {
+
+//// Protocol /////////////////////////////////////////////////////////////////////////////////////
+// Передача работы новому процессу при перезапуске без простоя. Старый процесс слушает Unix-сокет;
+// новый подключается к нему при старте:
+//   новый  -> старый: hello  "GHANDOVR" | version u32
+//   старый -> новый:  header "GHANDOVR" | version u32 | fd count u32 | snapshot size u64 | last tick ns i64
+//                     и слушающие сокеты в SCM_RIGHTS того же сообщения, затем бинарный снимок
+//   новый  -> старый: ack - один байт, когда снимок загружен и сокеты снова принимают соединения
+// До ack старый процесс может откатиться и продолжить работу; после ack он дообслуживает
+// открытые соединения и завершается. last tick - время последнего тика по steady_clock (он общий
+// для процессов машины), поэтому первый тик нового процесса покрывает всю паузу.
+constexpr uint32_t PROTOCOL_VERSION = 1;
+constexpr size_t   MAX_LISTENERS    = 256;
+
+using Clock = std::chrono::steady_clock;
+
+// Что старый процесс отдаёт новому кроме сокетов
+struct State {
+    std::string       snapshot;     // serialization::EncodeSnapshot
+    Clock::time_point last_tick;
+};
+
+
+//// Takeover /////////////////////////////////////////////////////////////////////////////////////
+// Сторона нового процесса
+class Takeover {
+public:
+    // nullopt - по адресу никто не слушает, обычный холодный старт
+    static std::optional<Takeover> Connect(const std::string& socket_path);
+
+    Takeover(Takeover&& other) noexcept;
+    Takeover& operator=(Takeover&& other) noexcept;
+    ~Takeover();
+
+    // Слушающие сокеты старого процесса; владение переходит к тому, кто их заберёт
+    const std::vector<int>& GetListeners() const noexcept { return listeners_; }
+    const std::string& GetSnapshot() const noexcept { return state_.snapshot; }
+    Clock::time_point GetLastTick() const noexcept { return state_.last_tick; }
+
+    // Состояние загружено, сокеты приняты: старый процесс может уходить
+    void Ack();
+
+private:
+    explicit Takeover(int fd) : fd_(fd) {}
+    void Receive();
+
+    int              fd_ = -1;
+    std::vector<int> listeners_;
+    State            state_;
+};
+
+
+//// Server ///////////////////////////////////////////////////////////////////////////////////////
+// Сторона старого процесса: фоновый поток ждёт нового процесса на Unix-сокете. Хуки вызываются
+// из этого потока в порядке pause, freeze, затем finish после ack или resume при любой ошибке
+class Server {
+public:
+    struct Hooks {
+        std::function<std::vector<int>()> pause;    // прекратить приём соединений, вернуть сокеты
+        std::function<State()>             freeze;  // остановить игру и снять снимок
+        std::function<void()>              resume;  // откат: новый процесс не принял работу
+        std::function<void()>              finish;  // работа передана: дообслужить соединения и выйти
+    };
+
+    Server(std::string socket_path, Hooks hooks);
+    ~Server();
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+private:
+    void Listen();
+    void CloseListen();
+    void Run();
+    // true - новый процесс подтвердил приём
+    bool Serve(int conn);
+
+    std::string       socket_path_;
+    Hooks             hooks_;
+    int               listen_fd_ = -1;
+    std::atomic<bool> stop_{false};
+    std::thread       thread_;
+};
+
+}  // namespace handover
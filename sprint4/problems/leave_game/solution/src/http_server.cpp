@@ -1,7 +1,12 @@
 #include "http_server.h"
 
 #include <boost/asio/dispatch.hpp>
+#include <boost/asio/write.hpp>
+#include <cerrno>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 
 namespace http_server {
 
@@ -11,6 +16,46 @@ void ReportError(beast::error_code ec, std::string_view what) {
     std::cerr << what << ": "sv << ec.message() << std::endl;
 }
 
+namespace {
+
+// Отказ в формате ошибок API; Retry-After - через сколько секунд повторить запрос
+http::response<http::string_body> MakeRejection(http::status status, std::string_view code, std::string_view message,
+                                                unsigned retry_after, unsigned http_version, bool keep_alive) {
+    http::response<http::string_body> response(status, http_version);
+    response.keep_alive(keep_alive);
+    response.set(http::field::content_type, "application/json"sv);
+    response.set(http::field::cache_control, "no-cache"sv);
+    response.set(http::field::retry_after, std::to_string(retry_after));
+    response.body() = "{\"code\":\""s + std::string(code) + "\",\"message\":\""s + std::string(message) + "\"}"s;
+    response.content_length(response.body().size());
+    return response;
+}
+
+}  // namespace
+
+tcp ProtocolOf(tcp::acceptor::native_handle_type native_handle) {
+    sockaddr_storage addr{};
+    socklen_t        len = sizeof(addr);
+    if ( ::getsockname(native_handle, reinterpret_cast<sockaddr*>(&addr), &len) != 0 ) {
+        throw std::runtime_error("Can't get address of listening socket: "s + std::strerror(errno));
+    }
+    return addr.ss_family == AF_INET6 ? tcp::v6() : tcp::v4();
+}
+
+void RejectConnection(tcp::socket&& socket) {
+    static const std::string response =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: "s + std::to_string(admission::OVERLOAD_RETRY_AFTER) + "\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n"s;
+    auto safe_socket = std::make_shared<tcp::socket>(std::move(socket));
+    net::async_write(*safe_socket, net::buffer(response), [safe_socket](beast::error_code, std::size_t) {
+        beast::error_code ec;
+        safe_socket->shutdown(tcp::socket::shutdown_both, ec);
+    });
+}
+
 
 //// SessionBase ///////////////////////////////////////////////////////////////////////////////////
 
@@ -42,8 +87,8 @@ void SessionBase::Read() {
 }
 
 void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read) {
-    req_time_ = boost::posix_time::microsec_clock::local_time();
-    
+    req_time_ = Clock::now();
+
     if (ec == http::error::end_of_stream) {
         // Нормальная ситуация - клиент закрыл соединение
         return Close();
@@ -52,12 +97,36 @@ void SessionBase::OnRead(beast::error_code ec, [[maybe_unused]] std::size_t byte
 //        return ReportError(ec, "read"sv);
         return logger::LogNetError(ec.value(), ec.message(), "read"sv);
     }
-    logger::LogRequest(stream_.socket().remote_endpoint().address().to_string(), 
-                            request_.target(), 
-                            MethodToString(request_.method()));
+    route_   = metrics::RouteFromTarget(request_.target());
+    sampled_ = logger::SampleRequest();
+    beast::error_code ep_ec;
+    auto endpoint = stream_.socket().remote_endpoint(ep_ec);
+    if ( sampled_ ) {
+        logger::LogRequest(endpoint.address().to_string(), request_.target(), MethodToString(request_.method()));
+    }
+    if ( auto rejection = Admit(endpoint) ) {
+        return Write(std::move(*rejection));
+    }
     HandleRequest(std::move(request_));
 }
 
+std::optional<http::response<http::string_body>> SessionBase::Admit(const tcp::endpoint& endpoint) {
+    if ( route_ == metrics::Route::STATIC || route_ == metrics::Route::METRICS ) {
+        return std::nullopt;
+    }
+    if ( auto retry_after = admission::TakeRequest(endpoint.address()) ) {
+        return MakeRejection(http::status::too_many_requests, "tooManyRequests"sv, "Request rate limit exceeded"sv,
+                             *retry_after, request_.version(), request_.keep_alive());
+    }
+    if ( !admission::EnterPending() ) {
+        // keep_alive сохраняем: соединение живо, отказ дешевле нового рукопожатия
+        return MakeRejection(http::status::service_unavailable, "overloaded"sv, "Server is overloaded"sv,
+                             admission::OVERLOAD_RETRY_AFTER, request_.version(), request_.keep_alive());
+    }
+    pending_ = true;
+    return std::nullopt;
+}
+
 void SessionBase::Close() {
     beast::error_code ec;
     stream_.socket().shutdown(tcp::socket::shutdown_send, ec);
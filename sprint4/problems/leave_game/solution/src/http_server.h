@@ -5,15 +5,18 @@
 // boost.beast будет использовать std::string_view вместо boost::string_view
 #define BOOST_BEAST_USE_STD_STRING_VIEW
 
+#include <boost/asio/dispatch.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/strand.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
-#include <boost/date_time.hpp>
-
+#include <chrono>
 #include <iostream>
+#include <optional>
 
+#include "admission.h"
 #include "logger.h"
+#include "metrics.h"
 
 namespace http_server {
 
@@ -27,6 +30,14 @@ namespace http  = beast::http;
 
 void ReportError(beast::error_code ec, std::string_view what);
 
+// SO_REUSEPORT: несколько acceptor на одном порту, ядро раздаёт им соединения
+using ReusePort = net::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+// Соединение сверх лимита: короткий 503 без чтения запроса и закрытие
+void RejectConnection(tcp::socket&& socket);
+// Протокол уже открытого слушающего сокета (получен от другого процесса)
+tcp ProtocolOf(tcp::acceptor::native_handle_type native_handle);
+
 
 //// SessionBase ///////////////////////////////////////////////////////////////////////////////////
 class SessionBase {
@@ -41,36 +52,48 @@ public:
 
 protected:
     using HttpRequest = http::request<http::string_body>;
+    using Clock       = std::chrono::steady_clock;
 
-    explicit SessionBase(tcp::socket&& socket) : stream_(std::move(socket)) { }
-    ~SessionBase() = default;
+    explicit SessionBase(tcp::socket&& socket) : stream_(std::move(socket)) {
+        metrics::ConnectionOpened();
+    }
+    // Место в лимите соединений занимает Listener до создания сессии, освобождает сессия
+    ~SessionBase() {
+        if ( pending_ ) {
+            admission::LeavePending();
+        }
+        admission::CloseConnection();
+        metrics::ConnectionClosed();
+    }
 
     template <typename Body, typename Fields>
     void Write(http::response<Body, Fields>&& response) {
-//        std::cout << "--- Write() ---" << std::endl;
-        std::string_view content_type = "null"s;
-        for (const auto& header : response) {
-//            std::cout << "  "sv << header.name_string() << ": "sv << header.value() << std::endl;
-            if ( header.name_string() == "Content-Type" ) {
-                content_type = header.value();
-                break;
-            }
-        }
         // Запись выполняется асинхронно, поэтому response перемещаем в область кучи
         auto safe_response = std::make_shared<http::response<Body, Fields>>(std::move(response));
-    
+        if ( pending_ ) {
+            pending_ = false;
+            admission::LeavePending();
+        }
         //
-        boost::posix_time::ptime res_time = boost::posix_time::microsec_clock::local_time();
-        logger::LogResponse((res_time - req_time_).total_milliseconds(), 
-                                  safe_response->result_int(),
-                                  content_type);
+        metrics::RecordRequest(route_, safe_response->result_int(), metrics::MicrosecondsSince(req_time_));
+        if ( sampled_ ) {
+            std::string_view content_type = safe_response->base()[http::field::content_type];
+            if ( content_type.empty() ) {
+                content_type = "null"sv;
+            }
+            auto response_time = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - req_time_);
+            logger::LogResponse(response_time.count(), safe_response->result_int(), content_type);
+        }
         //
-        
+
+        // Ответ может прийти из чужого потока (пул соединений с базой) - пишем в strand сессии
         auto self = GetSharedThis();
-        http::async_write(stream_, *safe_response,
-                        [safe_response, self](beast::error_code ec, std::size_t bytes_written) {
-                            self->OnWrite(safe_response->need_eof(), ec, bytes_written);
-                        });
+        net::dispatch(stream_.get_executor(), [this, self, safe_response] {
+            http::async_write(stream_, *safe_response,
+                            [safe_response, self](beast::error_code ec, std::size_t bytes_written) {
+                                self->OnWrite(safe_response->need_eof(), ec, bytes_written);
+                            });
+        });
     }
 
 private:
@@ -78,6 +101,9 @@ private:
     // асинхронное чтение запроса
     void Read();
     void OnRead(beast::error_code ec, [[maybe_unused]] std::size_t bytes_read);
+    // Лимит запросов с адреса и бюджет незавершённых запросов - только для API.
+    // Если запрос не принят, возвращает ответ с отказом
+    std::optional<http::response<http::string_body>> Admit(const tcp::endpoint& endpoint);
     void Close();
     // Обработку запроса делегируем подклассу
     virtual void HandleRequest(HttpRequest&& request) = 0;
@@ -112,7 +138,10 @@ private:
     beast::tcp_stream  stream_; // tcp_stream содержит внутри себя сокет и добавляет поддержку таймаутов
     beast::flat_buffer buffer_;
     HttpRequest        request_;
-    boost::posix_time::ptime req_time_;
+    Clock::time_point  req_time_;
+    bool               sampled_ = true;   // логируется ли текущая пара запрос/ответ
+    metrics::Route     route_   = metrics::Route::STATIC;
+    bool               pending_ = false;  // запрос занимает место в бюджете незавершённых
 
 };
 
@@ -143,25 +172,84 @@ private:
 };
 
 
+//// ListenerBase //////////////////////////////////////////////////////////////////////////////////
+// Управление приёмом соединений при передаче работы другому процессу. Методы можно вызывать из
+// любого потока, сами действия выполняются в strand acceptor
+class ListenerBase {
+public:
+    virtual ~ListenerBase() = default;
+
+    // Слушающий сокет для передачи другому процессу; остаётся открытым, пока жив Listener
+    virtual tcp::acceptor::native_handle_type NativeHandle() = 0;
+    // Прекратить и возобновить приём; сокет и очередь ядра при этом сохраняются
+    virtual void Pause() = 0;
+    virtual void Resume() = 0;
+    // Закрыть свою копию сокета; соединения из очереди достанутся другому его владельцу
+    virtual void Close() = 0;
+};
+
+
 //// Listener //////////////////////////////////////////////////////////////////////////////////////
 template <typename RequestHandler>
-class Listener : public std::enable_shared_from_this<Listener<RequestHandler>> {
+class Listener : public ListenerBase, public std::enable_shared_from_this<Listener<RequestHandler>> {
 public:
     template <typename Handler>
-    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler)
+    Listener(net::io_context& ioc, const tcp::endpoint& endpoint, Handler&& request_handler, bool reuse_port)
             : ioc_(ioc)
             , acceptor_(net::make_strand(ioc))      // Обработчики асинхронных операций acceptor_ будут вызываться в своём strand
             , request_handler_(std::forward<Handler>(request_handler)) {
         acceptor_.open(endpoint.protocol());        // Открываем acceptor, используя протокол (IPv4 или IPv6), указанный в endpoint
         acceptor_.set_option(net::socket_base::reuse_address(true));
+        if ( reuse_port ) {
+            acceptor_.set_option(ReusePort(true));
+        }
         acceptor_.bind(endpoint);                   // Привязываем acceptor к адресу и порту endpoint
         acceptor_.listen(net::socket_base::max_listen_connections);
+        native_handle_ = acceptor_.native_handle();
+    }
+
+    // Уже слушающий сокет, полученный от старого процесса
+    template <typename Handler>
+    Listener(net::io_context& ioc, tcp::acceptor::native_handle_type native_handle, Handler&& request_handler)
+            : ioc_(ioc)
+            , acceptor_(net::make_strand(ioc), ProtocolOf(native_handle), native_handle)
+            , request_handler_(std::forward<Handler>(request_handler))
+            , native_handle_(native_handle) {
     }
 
     void Run() {
         DoAccept();
     }
 
+    tcp::acceptor::native_handle_type NativeHandle() override {
+        return native_handle_;
+    }
+
+    void Pause() override {
+        net::dispatch(acceptor_.get_executor(), [self = this->shared_from_this()] {
+            self->paused_ = true;
+            beast::error_code ec;
+            self->acceptor_.cancel(ec);
+        });
+    }
+
+    void Resume() override {
+        net::dispatch(acceptor_.get_executor(), [self = this->shared_from_this()] {
+            if ( self->paused_ && self->acceptor_.is_open() ) {
+                self->paused_ = false;
+                self->DoAccept();
+            }
+        });
+    }
+
+    void Close() override {
+        net::dispatch(acceptor_.get_executor(), [self = this->shared_from_this()] {
+            self->paused_ = true;
+            beast::error_code ec;
+            self->acceptor_.close(ec);
+        });
+    }
+
 private:
     void AsyncRunSession(tcp::socket&& socket) {
         std::make_shared<Session<RequestHandler>>(std::move(socket), request_handler_)->Run();
@@ -180,30 +268,54 @@ private:
     void OnAccept(sys::error_code ec, tcp::socket socket) {
         using namespace std::literals;
 
+        if ( ec == net::error::operation_aborted && paused_ ) {
+            return;
+        }
         if (ec) {
 //            return ReportError(ec, "accept"sv);
             return logger::LogNetError(ec.value(), ec.message(), "accept"sv);
         }
 
-        // Асинхронно обрабатываем сессию
-        AsyncRunSession(std::move(socket));
+        // Асинхронно обрабатываем сессию, если не превышен лимит соединений
+        if ( admission::OpenConnection() ) {
+            AsyncRunSession(std::move(socket));
+        } else {
+            RejectConnection(std::move(socket));
+        }
 
         // Принимаем новое соединение
-        DoAccept();
+        if ( !paused_ ) {
+            DoAccept();
+        }
     }
 
 private:
     net::io_context& ioc_;
     tcp::acceptor    acceptor_;
     RequestHandler   request_handler_;
+    tcp::acceptor::native_handle_type native_handle_;
+    bool             paused_ = false;   // только в strand acceptor
 };
 
 
 //// ServeHttp /////////////////////////////////////////////////////////////////////////////////////
+// reuse_port - для отдельного acceptor в каждом io_context на одном порту; сессии остаются
+// в io_context, принявшем соединение
+template <typename RequestHandler>
+std::shared_ptr<ListenerBase> ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler, bool reuse_port = false) {
+    using MyListener = Listener<std::decay_t<RequestHandler>>;
+    auto listener = std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler), reuse_port);
+    listener->Run();
+    return listener;
+}
+
+// Обслуживание уже слушающего сокета; Listener становится его владельцем
 template <typename RequestHandler>
-void ServeHttp(net::io_context& ioc, const tcp::endpoint& endpoint, RequestHandler&& handler) {
+std::shared_ptr<ListenerBase> ServeHttp(net::io_context& ioc, tcp::acceptor::native_handle_type native_handle, RequestHandler&& handler) {
     using MyListener = Listener<std::decay_t<RequestHandler>>;
-    std::make_shared<MyListener>(ioc, endpoint, std::forward<RequestHandler>(handler))->Run();
+    auto listener = std::make_shared<MyListener>(ioc, native_handle, std::forward<RequestHandler>(handler));
+    listener->Run();
+    return listener;
 }
 
 }  // namespace http_server
@@ -0,0 +1,150 @@
+#include "journal.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace journal {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr char     MAGIC[4]       = { 'G', 'J', 'N', 'L' };
+constexpr uint32_t MAX_STRING_LEN = 1 << 20;
+
+}  // namespace
+
+
+//// Writer ///////////////////////////////////////////////////////////////////////////////////////
+Writer::Writer(const std::filesystem::path& file, uint64_t seed, uint8_t flags)
+    : out_(file, std::ios::binary | std::ios::trunc) {
+    if ( !out_ ) {
+        throw std::runtime_error("Can't open journal file '"s + file.string() + "'"s);
+    }
+    out_.write(MAGIC, sizeof(MAGIC));
+    PutU32(VERSION);
+    PutU64(seed);
+    out_.put(static_cast<char>(flags));
+    out_.flush();
+}
+
+void Writer::Join(std::string_view name, std::string_view map_id, std::string_view token, bool bot) {
+    std::lock_guard lock{mutex_};
+    PutType(RecordType::JOIN);
+    PutString(name);
+    PutString(map_id);
+    PutString(token);
+    out_.put(bot ? 1 : 0);
+}
+
+void Writer::Move(std::string_view token, std::string_view move) {
+    std::lock_guard lock{mutex_};
+    PutType(RecordType::MOVE);
+    PutString(token);
+    PutString(move);
+}
+
+void Writer::Tick(uint32_t delta) {
+    std::lock_guard lock{mutex_};
+    PutType(RecordType::TICK);
+    PutU32(delta);
+    out_.flush();
+}
+
+void Writer::End(uint64_t digest) {
+    std::lock_guard lock{mutex_};
+    PutType(RecordType::END);
+    PutU64(digest);
+    out_.flush();
+}
+
+void Writer::PutType(RecordType type) {
+    out_.put(static_cast<char>(type));
+}
+
+void Writer::PutU32(uint32_t value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Writer::PutU64(uint64_t value) {
+    out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void Writer::PutString(std::string_view str) {
+    PutU32(static_cast<uint32_t>(str.size()));
+    out_.write(str.data(), str.size());
+}
+
+
+//// Reader ///////////////////////////////////////////////////////////////////////////////////////
+Reader::Reader(const std::filesystem::path& file)
+    : in_(file, std::ios::binary) {
+    if ( !in_ ) {
+        throw std::runtime_error("Can't open journal file '"s + file.string() + "'"s);
+    }
+    char     magic[sizeof(MAGIC)];
+    uint32_t version = 0;
+    in_.read(magic, sizeof(magic));
+    if ( !in_ || !std::equal(std::begin(magic), std::end(magic), std::begin(MAGIC)) ) {
+        throw std::runtime_error("'"s + file.string() + "' is not a journal file"s);
+    }
+    if ( !GetU32(version) || version != VERSION ) {
+        throw std::runtime_error("Unsupported journal version "s + std::to_string(version));
+    }
+    char flags = 0;
+    if ( !GetU64(seed_) || !in_.get(flags) ) {
+        throw std::runtime_error("Truncated journal header"s);
+    }
+    flags_ = static_cast<uint8_t>(flags);
+}
+
+bool Reader::Next(Record& record) {
+    char type = 0;
+    if ( !in_.get(type) ) {
+        return false;
+    }
+    record.type = static_cast<RecordType>(type);
+    switch ( record.type ) {
+        case RecordType::JOIN: {
+            uint8_t bot = 0;
+            if ( !GetString(record.name) || !GetString(record.map_id) || !GetString(record.token) || !GetU8(bot) ) {
+                return false;
+            }
+            record.bot = bot != 0;
+            return true;
+        }
+        case RecordType::MOVE:
+            return GetString(record.token) && GetString(record.move);
+        case RecordType::TICK:
+            return GetU32(record.delta);
+        case RecordType::END:
+            return GetU64(record.digest);
+    }
+    throw std::runtime_error("Unknown journal record type "s + std::to_string(static_cast<int>(type)));
+}
+
+bool Reader::GetU8(uint8_t& value) {
+    return static_cast<bool>(in_.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+bool Reader::GetU32(uint32_t& value) {
+    return static_cast<bool>(in_.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+bool Reader::GetU64(uint64_t& value) {
+    return static_cast<bool>(in_.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+bool Reader::GetString(std::string& str) {
+    uint32_t size = 0;
+    if ( !GetU32(size) ) {
+        return false;
+    }
+    if ( size > MAX_STRING_LEN ) {
+        throw std::runtime_error("Corrupted journal: string of "s + std::to_string(size) + " bytes"s);
+    }
+    str.resize(size);
+    return static_cast<bool>(in_.read(str.data(), size));
+}
+
+}  // namespace journal
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace journal {
+
+//// Format ///////////////////////////////////////////////////////////////////////////////////////
+// Журнал команд, меняющих состояние игры: заголовок и записи подряд, только дозапись.
+// Числа пишутся в порядке байт машины, строки - длина uint32 и байты.
+//   header: "GJNL" | version u32 | seed u64 | flags u8
+//   JOIN:   type u8 | name | map_id | token | bot u8
+//   MOVE:   type u8 | token | move
+//   TICK:   type u8 | delta_ms u32
+//   END:    type u8 | state digest u64 (пишется при штатной остановке)
+// Записи идут в порядке применения к миру: TICK закрывает команды, применённые до тика игры,
+// включая команды серверных ботов этого тика
+constexpr uint32_t VERSION = 2;
+
+enum class RecordType : uint8_t {
+    JOIN = 1,
+    MOVE = 2,
+    TICK = 3,
+    END  = 4
+};
+
+enum Flags : uint8_t {
+    RANDOMIZE_SPAWN = 1,    // псы появлялись в случайных точках
+    RESTORED        = 2     // запись началась не с пустого мира, а с восстановленного состояния
+};
+
+struct Record {
+    RecordType  type;
+    std::string name;
+    std::string map_id;
+    std::string token;
+    std::string move;
+    bool        bot    = false;
+    uint32_t    delta  = 0;
+    uint64_t    digest = 0;
+};
+
+
+//// Writer ///////////////////////////////////////////////////////////////////////////////////////
+class Writer {
+public:
+    Writer(const std::filesystem::path& file, uint64_t seed, uint8_t flags);
+
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void Join(std::string_view name, std::string_view map_id, std::string_view token, bool bot);
+    void Move(std::string_view token, std::string_view move);
+    // Тик сбрасывает буфер в файл
+    void Tick(uint32_t delta);
+    void End(uint64_t digest);
+
+private:
+    void PutType(RecordType type);
+    void PutU32(uint32_t value);
+    void PutU64(uint64_t value);
+    void PutString(std::string_view str);
+
+    std::mutex    mutex_;
+    std::ofstream out_;
+};
+
+
+//// Reader ///////////////////////////////////////////////////////////////////////////////////////
+class Reader {
+public:
+    explicit Reader(const std::filesystem::path& file);
+
+    uint64_t GetSeed() const noexcept { return seed_; }
+    uint8_t GetFlags() const noexcept { return flags_; }
+
+    // false - конец журнала; оборванная последняя запись (падение сервера) тоже считается концом
+    bool Next(Record& record);
+
+private:
+    bool GetU8(uint8_t& value);
+    bool GetU32(uint32_t& value);
+    bool GetU64(uint64_t& value);
+    bool GetString(std::string& str);
+
+    std::ifstream in_;
+    uint64_t      seed_  = 0;
+    uint8_t       flags_ = 0;
+};
+
+}  // namespace journal
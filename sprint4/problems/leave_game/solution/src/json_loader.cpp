@@ -1,7 +1,16 @@
-#include <iostream>
-
 #include "json_loader.h"
 
+#include <boost/json/basic_parser_impl.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+
 namespace json_loader {
 
 using namespace std::literals;
@@ -22,79 +31,925 @@ std::string ReadFile(const fs::path& path) {
     return result;
 }
 
-model::Game LoadGame(const fs::path& config_file) {
-    constexpr double   DEFAULT_DOG_SPEED          = 1.0;
-    constexpr unsigned DEFAULT_BAG_CAPACITY       = 3;
-    constexpr int      MILLISECONDS               = 1000;
-    constexpr double   DEFAULT_DOG_RETIREMENT_TME = 1.0;
-    //
-    std::string json_config = ReadFile(config_file);
-    try {
-        json::object config = json::parse(json_config).as_object();
+namespace {
 
-        // try get defaultDogSpeed
-        double default_dog_speed = DEFAULT_DOG_SPEED;
-        try {
-            default_dog_speed = config.at("defaultDogSpeed").as_double();
-        } catch (...) { }
+constexpr double   DEFAULT_DOG_SPEED          = 1.0;
+constexpr unsigned DEFAULT_BAG_CAPACITY       = 3;
+constexpr int      MILLISECONDS               = 1000;
+constexpr double   DEFAULT_DOG_RETIREMENT_TME = 1.0;
+constexpr std::string_view DEFAULT_BOT_PROFILE = "randomWalk"sv;
 
-        // try get defaultBagCapacity
-        unsigned default_bag_capacity = DEFAULT_BAG_CAPACITY;
-        try {
-            default_bag_capacity = config.at("defaultBagCapacity").as_int64();
-        } catch (...) { }
 
-        // try get loot generator config
-        double period;
-        double probability;
-        try {
-            period      = config.at("lootGeneratorConfig").as_object().at("period").as_double();
-            probability = config.at("lootGeneratorConfig").as_object().at("probability").as_double();
-        } catch (...) {
-            std::string err = "Can't get loot generator config";
-            throw std::runtime_error(err);
+//// Fields ///////////////////////////////////////////////////////////////////////////////////////
+// Скалярные поля одного объекта конфига. Ячейки переиспользуются от объекта к объекту, поэтому
+// на тысячах дорог память под ключи и строки выделяется только для первых из них
+struct Field {
+    enum class Kind { NUMBER, STRING, BOOL, NUL };
+
+    std::string            key;
+    Kind                   kind = Kind::NUL;
+    double                 number = 0;
+    std::optional<int64_t> integer;     // число без дробной части, влезающее в int64
+    std::string            str;
+};
+
+class Fields {
+public:
+    void Clear() noexcept { size_ = 0; }
+
+    Field& Add(std::string_view key) {
+        if ( size_ == fields_.size() ) {
+            fields_.emplace_back();
         }
+        Field& field = fields_[size_++];
+        field.key.assign(key);
+        field.kind = Field::Kind::NUL;
+        field.integer.reset();
+        return field;
+    }
 
-        // try get defaultDogRetirementTime
-        double dog_retirement_time = DEFAULT_DOG_RETIREMENT_TME;
-        try {
-            dog_retirement_time = config.at("dogRetirementTime").as_double();
-        } catch (...) { }
+    // Последнее из одноимённых полей
+    const Field* Find(std::string_view key) const noexcept {
+        for (size_t i = size_; i > 0; --i) {
+            if ( fields_[i - 1].key == key ) {
+                return &fields_[i - 1];
+            }
+        }
+        return nullptr;
+    }
 
-        // create game
-        model::Game game(static_cast<unsigned>(period * MILLISECONDS), probability, dog_retirement_time);
+private:
+    std::vector<Field> fields_;
+    size_t             size_ = 0;
+};
+
+bool Convert(const Field& field, double& value) {
+    if ( field.kind != Field::Kind::NUMBER ) {
+        return false;
+    }
+    value = field.number;
+    return true;
+}
+
+bool Convert(const Field& field, int& value) {
+    if ( !field.integer || *field.integer < std::numeric_limits<int>::min() || *field.integer > std::numeric_limits<int>::max() ) {
+        return false;
+    }
+    value = static_cast<int>(*field.integer);
+    return true;
+}
+
+bool Convert(const Field& field, unsigned& value) {
+    if ( !field.integer || *field.integer < 0 || *field.integer > std::numeric_limits<unsigned>::max() ) {
+        return false;
+    }
+    value = static_cast<unsigned>(*field.integer);
+    return true;
+}
+
+bool Convert(const Field& field, std::string& value) {
+    if ( field.kind != Field::Kind::STRING ) {
+        return false;
+    }
+    value = field.str;
+    return true;
+}
+
+template <typename T>
+constexpr std::string_view TypeName() {
+    if constexpr ( std::is_same_v<T, double> ) {
+        return "a number"sv;
+    } else if constexpr ( std::is_same_v<T, int> ) {
+        return "an integer"sv;
+    } else if constexpr ( std::is_same_v<T, unsigned> ) {
+        return "a non-negative integer"sv;
+    } else {
+        return "a string"sv;
+    }
+}
+
+// Чтение полей объекта с запоминанием первой ошибки
+class FieldReader {
+public:
+    FieldReader(const Fields& fields, std::string_view object) : fields_(fields), object_(object) {}
+
+    // Необязательное поле: value не меняется, если поля нет
+    template <typename T>
+    bool Read(std::string_view key, T& value) {
+        const Field* field = fields_.Find(key);
+        if ( field == nullptr ) {
+            return false;
+        }
+        if ( !Convert(*field, value) ) {
+            Fail("field '"s + std::string(key) + "' must be "s + std::string(TypeName<T>()));
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    void Require(std::string_view key, T& value) {
+        if ( !Read(key, value) && fields_.Find(key) == nullptr ) {
+            Fail("missing field '"s + std::string(key) + "'"s);
+        }
+    }
+
+    bool Has(std::string_view key) const noexcept { return fields_.Find(key) != nullptr; }
+
+    void Fail(std::string message) {
+        if ( error_.empty() ) {
+            error_ = std::string(object_) + ": "s + message;
+        }
+    }
+
+    bool Ok() const noexcept { return error_.empty(); }
+    std::string& GetError() noexcept { return error_; }
+
+private:
+    const Fields&    fields_;
+    std::string_view object_;
+    std::string      error_;
+};
+
+
+//// MapDraft /////////////////////////////////////////////////////////////////////////////////////
+// Карта по мере разбора: скорость и вместимость по умолчанию могут стоять в конфиге после карт
+struct MapDraft {
+    std::string                     id;
+    std::string                     name;
+    std::optional<double>           dog_speed;
+    std::optional<unsigned>         bag_capacity;
+    std::optional<unsigned>         bot_count;
+    std::string                     bot_profile;
+    model::Map::LootTypes           loot_types;
+    model::Map::Roads               roads;
+    model::Map::Buildings           buildings;
+    model::Map::Offices             offices;
+    std::unordered_set<std::string> office_ids;
+    unsigned                        lists = 0;      // встреченные массивы, биты по MAP_LISTS
+
+    model::Map Build(double default_dog_speed, unsigned default_bag_capacity) && {
+        model::Map map{model::Map::Id(std::move(id)), std::move(name), dog_speed.value_or(default_dog_speed), bag_capacity.value_or(default_bag_capacity)};
+        for (auto& loot_type : loot_types) {
+            map.AddLootType(std::move(loot_type));
+        }
+        for (const auto& road : roads) {
+            map.AddRoad(road);
+        }
+        for (const auto& building : buildings) {
+            map.AddBuilding(building);
+        }
+        // id офисов проверены при разборе
+        for (auto& office : offices) {
+            map.AddOffice(std::move(office));
+        }
+        if ( bot_count ) {
+            map.SetBots(*bot_count, std::move(bot_profile));
+        }
+        return map;
+    }
+};
+
+// Всё, что лежит в конфиге вне карт
+struct Settings {
+    std::optional<double>   loot_period;
+    std::optional<double>   loot_probability;
+    double                  dog_retirement_time  = DEFAULT_DOG_RETIREMENT_TME;
+    double                  default_dog_speed    = DEFAULT_DOG_SPEED;
+    unsigned                default_bag_capacity = DEFAULT_BAG_CAPACITY;
+};
+
+
+//// ConfigHandler ////////////////////////////////////////////////////////////////////////////////
+// Обработчик событий json::basic_parser: строит карты и их объекты прямо из событий, без DOM.
+// Корень документа - весь конфиг или одна карта (карты разбираются параллельно, каждая своим
+// парсером). Неизвестные поля пропускаются. Ошибка схемы останавливает парсер; её текст - в
+// GetError, позиция - там, где парсер остановился
+class ConfigHandler {
+public:
+    constexpr static size_t max_object_size = std::numeric_limits<size_t>::max();
+    constexpr static size_t max_array_size  = std::numeric_limits<size_t>::max();
+    constexpr static size_t max_key_size    = std::numeric_limits<size_t>::max();
+    constexpr static size_t max_string_size = std::numeric_limits<size_t>::max();
+
+    enum class Root { CONFIG, MAP };
+
+    explicit ConfigHandler(Root root) : root_(root) {
+        frames_.push_back({State::DOCUMENT});
+    }
+
+    // Для следующего документа того же корня; basic_parser::reset обработчик не трогает
+    void Reset() {
+        frames_.assign(1, {State::DOCUMENT});
+        key_part_ = str_part_ = has_maps_ = false;
+        maps_.clear();
+        error_.clear();
+    }
+
+    const std::string& GetError() const noexcept { return error_; }
+    Settings& GetSettings() noexcept { return settings_; }
+    std::vector<MapDraft>& GetMaps() noexcept { return maps_; }
+
+    bool on_document_begin(json::error_code&) { return true; }
+    bool on_document_end(json::error_code&) { return true; }
+
+    bool on_object_begin(json::error_code& ec);
+    bool on_object_end(std::size_t n, json::error_code& ec);
+    bool on_array_begin(json::error_code& ec);
+    bool on_array_end(std::size_t n, json::error_code& ec);
+
+    bool on_key_part(json::string_view s, std::size_t, json::error_code&) {
+        Append(key_, key_part_, s);
+        return true;
+    }
+    bool on_key(json::string_view s, std::size_t, json::error_code&) {
+        Append(key_, key_part_, s);
+        key_part_ = false;
+        return true;
+    }
+    bool on_string_part(json::string_view s, std::size_t, json::error_code&) {
+        Append(str_, str_part_, s);
+        return true;
+    }
+    bool on_string(json::string_view s, std::size_t, json::error_code& ec) {
+        Append(str_, str_part_, s);
+        str_part_ = false;
+        Field* field = AddField(ec);
+        if ( field != nullptr ) {
+            field->kind = Field::Kind::STRING;
+            field->str.assign(str_);
+        }
+        return !ec;
+    }
+
+    bool on_number_part(json::string_view, json::error_code&) { return true; }
+    bool on_int64(std::int64_t i, json::string_view, json::error_code& ec) {
+        return SetNumber(static_cast<double>(i), i, ec);
+    }
+    bool on_uint64(std::uint64_t u, json::string_view, json::error_code& ec) {
+        const bool fits = u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+        return SetNumber(static_cast<double>(u), fits ? std::optional<int64_t>(u) : std::nullopt, ec);
+    }
+    bool on_double(double d, json::string_view, json::error_code& ec) {
+        // 3.0 годится и для целого поля
+        const bool integral = std::trunc(d) == d && std::abs(d) < 0x1p63;
+        return SetNumber(d, integral ? std::optional<int64_t>(static_cast<int64_t>(d)) : std::nullopt, ec);
+    }
+    bool on_bool(bool, json::error_code& ec) {
+        if ( Field* field = AddField(ec) ) {
+            field->kind = Field::Kind::BOOL;
+        }
+        return !ec;
+    }
+    bool on_null(json::error_code& ec) {
+        if ( Field* field = AddField(ec) ) {
+            field->kind = Field::Kind::NUL;
+        }
+        return !ec;
+    }
+
+    bool on_comment_part(json::string_view, json::error_code&) { return true; }
+    bool on_comment(json::string_view, json::error_code&) { return true; }
+
+private:
+    enum class State { DOCUMENT, CONFIG, MAPS, MAP, LIST, LEAF, SKIP };
+    enum class Leaf { LOOT_GENERATOR, BOTS, LOOT_TYPE, ROAD, BUILDING, OFFICE };
 
-        // try get maps
-        for (auto& json_map : config.at("maps").as_array()) {
-            // map
-            model::Map map = model::Map::FromJson(json_map.as_object(), default_dog_speed, default_bag_capacity);
+    struct Frame {
+        State  state;
+        Leaf   leaf  = Leaf::ROAD;
+        size_t depth = 0;       // SKIP: вложенность внутри пропускаемого значения
+    };
 
-            // loot
-            for (const auto& json_loot_type : json_map.as_object().at("lootTypes").as_array()) {
-                map.AddLootType(model::LootType::FromJson(json_loot_type.as_object()));
+    struct ListKey {
+        std::string_view key;
+        Leaf             leaf;
+    };
+    constexpr static ListKey MAP_LISTS[] = {
+        {"lootTypes"sv, Leaf::LOOT_TYPE}, {"roads"sv, Leaf::ROAD}, {"buildings"sv, Leaf::BUILDING}, {"offices"sv, Leaf::OFFICE}
+    };
+
+    static void Append(std::string& buffer, bool& partial, std::string_view s) {
+        if ( !partial ) {
+            buffer.clear();
+            partial = true;
+        }
+        buffer.append(s);
+    }
+
+    bool Fail(std::string message, json::error_code& ec) {
+        error_ = std::move(message);
+        ec = json::error::exception;     // код только останавливает парсер, причина - в error_
+        return false;
+    }
+
+    bool Push(State state, Leaf leaf = Leaf::ROAD) {
+        frames_.push_back({state, leaf});
+        return true;
+    }
+
+    // Вложенное значение пропускается, но поле остаётся: если на его месте ждали скаляр, ошибкой
+    // будет неверный тип, а не отсутствие поля
+    bool Skip(json::error_code& ec) {
+        AddField(ec);
+        return Push(State::SKIP);
+    }
+
+    Field* AddField(json::error_code& ec);
+    bool SetNumber(double number, std::optional<int64_t> integer, json::error_code& ec);
+    Fields& LeafFields() noexcept { return leaf_fields_; }
+
+    bool EndConfig(json::error_code& ec);
+    bool EndMap(json::error_code& ec);
+    bool EndLeaf(Leaf leaf, json::error_code& ec);
+
+    Root               root_;
+    std::vector<Frame> frames_;
+    std::string        key_;
+    std::string        str_;
+    bool               key_part_ = false;
+    bool               str_part_ = false;
+    //
+    Fields             config_fields_;
+    Fields             map_fields_;
+    Fields             leaf_fields_;
+    bool               has_maps_ = false;
+    MapDraft           map_;
+    //
+    Settings              settings_;
+    std::vector<MapDraft> maps_;
+    std::string           error_;
+};
+
+bool ConfigHandler::on_object_begin(json::error_code& ec) {
+    Frame& frame = frames_.back();
+    switch ( frame.state ) {
+        case State::DOCUMENT:
+            if ( root_ == Root::CONFIG ) {
+                config_fields_.Clear();
+                return Push(State::CONFIG);
+            }
+            [[fallthrough]];
+        case State::MAPS:
+            map_fields_.Clear();
+            map_ = MapDraft{};
+            return Push(State::MAP);
+        case State::CONFIG:
+            if ( key_ == "lootGeneratorConfig"sv ) {
+                leaf_fields_.Clear();
+                return Push(State::LEAF, Leaf::LOOT_GENERATOR);
+            }
+            if ( key_ == "maps"sv ) {
+                return Fail("'maps' must be an array", ec);
+            }
+            return Skip(ec);
+        case State::MAP:
+            if ( key_ == "bots"sv ) {
+                leaf_fields_.Clear();
+                return Push(State::LEAF, Leaf::BOTS);
             }
-            
-            // roads
-            for (const auto& json_road : json_map.as_object().at("roads").as_array()) {
-                map.AddRoad(model::Road::FromJson(json_road.as_object()));
+            for (const auto& list : MAP_LISTS) {
+                if ( key_ == list.key ) {
+                    return Fail("map: '"s + std::string(list.key) + "' must be an array"s, ec);
+                }
             }
+            return Skip(ec);
+        case State::LIST:
+            leaf_fields_.Clear();
+            return Push(State::LEAF, frame.leaf);
+        case State::LEAF:
+            return Skip(ec);
+        case State::SKIP:
+            ++frame.depth;
+            return true;
+    }
+    return true;
+}
 
-            // buildings
-            for (const auto& json_building : json_map.as_object().at("buildings").as_array()) {
-                map.AddBuilding(model::Building::FromJson(json_building.as_object()));
+bool ConfigHandler::on_object_end(std::size_t, json::error_code& ec) {
+    Frame frame = frames_.back();
+    if ( frame.state == State::SKIP && frame.depth > 0 ) {
+        --frames_.back().depth;
+        return true;
+    }
+    frames_.pop_back();
+    switch ( frame.state ) {
+        case State::CONFIG:
+            return EndConfig(ec);
+        case State::MAP:
+            return EndMap(ec);
+        case State::LEAF:
+            return EndLeaf(frame.leaf, ec);
+        default:
+            return true;
+    }
+}
+
+bool ConfigHandler::on_array_begin(json::error_code& ec) {
+    Frame& frame = frames_.back();
+    switch ( frame.state ) {
+        case State::DOCUMENT:
+            return Fail(root_ == Root::CONFIG ? "config must be an object"s : "map must be an object"s, ec);
+        case State::CONFIG:
+            if ( key_ == "maps"sv ) {
+                if ( has_maps_ ) {
+                    return Fail("duplicate field 'maps'", ec);
+                }
+                has_maps_ = true;
+                return Push(State::MAPS);
+            }
+            if ( key_ == "lootGeneratorConfig"sv ) {
+                return Fail("'lootGeneratorConfig' must be an object", ec);
+            }
+            return Skip(ec);
+        case State::MAPS:
+            return Fail("map must be an object", ec);
+        case State::MAP:
+            for (size_t i = 0; i < std::size(MAP_LISTS); ++i) {
+                if ( key_ == MAP_LISTS[i].key ) {
+                    map_.lists |= 1u << i;
+                    return Push(State::LIST, MAP_LISTS[i].leaf);
+                }
+            }
+            if ( key_ == "bots"sv ) {
+                return Fail("map: 'bots' must be an object", ec);
             }
+            return Skip(ec);
+        case State::LIST:
+            return Fail("items of map arrays must be objects", ec);
+        case State::LEAF:
+            return Skip(ec);
+        case State::SKIP:
+            ++frame.depth;
+            return true;
+    }
+    return true;
+}
+
+bool ConfigHandler::on_array_end(std::size_t, json::error_code&) {
+    Frame& frame = frames_.back();
+    if ( frame.state == State::SKIP && frame.depth > 0 ) {
+        --frame.depth;
+    } else {
+        frames_.pop_back();
+    }
+    return true;
+}
+
+Field* ConfigHandler::AddField(json::error_code& ec) {
+    switch ( frames_.back().state ) {
+        case State::CONFIG:
+            return &config_fields_.Add(key_);
+        case State::MAP:
+            return &map_fields_.Add(key_);
+        case State::LEAF:
+            return &leaf_fields_.Add(key_);
+        case State::SKIP:
+            return nullptr;
+        case State::DOCUMENT:
+            Fail(root_ == Root::CONFIG ? "config must be an object"s : "map must be an object"s, ec);
+            return nullptr;
+        case State::MAPS:
+            Fail("map must be an object", ec);
+            return nullptr;
+        case State::LIST:
+            Fail("items of map arrays must be objects", ec);
+            return nullptr;
+    }
+    return nullptr;
+}
+
+bool ConfigHandler::SetNumber(double number, std::optional<int64_t> integer, json::error_code& ec) {
+    if ( Field* field = AddField(ec) ) {
+        field->kind    = Field::Kind::NUMBER;
+        field->number  = number;
+        field->integer = integer;
+    }
+    return !ec;
+}
+
+bool ConfigHandler::EndConfig(json::error_code& ec) {
+    FieldReader reader(config_fields_, "config"sv);
+    reader.Read("dogRetirementTime"sv, settings_.dog_retirement_time);
+    reader.Read("defaultDogSpeed"sv, settings_.default_dog_speed);
+    reader.Read("defaultBagCapacity"sv, settings_.default_bag_capacity);
+    if ( reader.Has("maps"sv) ) {
+        reader.Fail("'maps' must be an array");
+    } else if ( reader.Has("lootGeneratorConfig"sv) ) {
+        reader.Fail("'lootGeneratorConfig' must be an object");
+    } else if ( !has_maps_ ) {
+        reader.Fail("missing field 'maps'");
+    }
+    return reader.Ok() || Fail(std::move(reader.GetError()), ec);
+}
 
-            // offices
-            for (const auto& json_office : json_map.as_object().at("offices").as_array()) {
-                map.AddOffice(model::Office::FromJson(json_office.as_object()));
+bool ConfigHandler::EndMap(json::error_code& ec) {
+    FieldReader reader(map_fields_, "map"sv);
+    reader.Require("id"sv, map_.id);
+    reader.Require("name"sv, map_.name);
+    double dog_speed;
+    if ( reader.Read("dogSpeed"sv, dog_speed) ) {
+        map_.dog_speed = dog_speed;
+    }
+    unsigned bag_capacity;
+    if ( reader.Read("bagCapacity"sv, bag_capacity) ) {
+        map_.bag_capacity = bag_capacity;
+    }
+    for (size_t i = 0; i < std::size(MAP_LISTS); ++i) {
+        if ( reader.Has(MAP_LISTS[i].key) ) {
+            reader.Fail("'"s + std::string(MAP_LISTS[i].key) + "' must be an array"s);
+        } else if ( (map_.lists & (1u << i)) == 0 ) {
+            reader.Fail("missing field '"s + std::string(MAP_LISTS[i].key) + "'"s);
+        }
+    }
+    if ( reader.Has("bots"sv) ) {
+        reader.Fail("'bots' must be an object");
+    }
+    if ( !reader.Ok() ) {
+        if ( !map_.id.empty() ) {
+            reader.GetError().insert(3, " '"s + map_.id + "'"s);
+        }
+        return Fail(std::move(reader.GetError()), ec);
+    }
+    maps_.push_back(std::move(map_));
+    return true;
+}
+
+bool ConfigHandler::EndLeaf(Leaf leaf, json::error_code& ec) {
+    switch ( leaf ) {
+        case Leaf::LOOT_GENERATOR: {
+            FieldReader reader(leaf_fields_, "lootGeneratorConfig"sv);
+            double period = 0, probability = 0;
+            reader.Require("period"sv, period);
+            reader.Require("probability"sv, probability);
+            if ( !reader.Ok() ) {
+                return Fail(std::move(reader.GetError()), ec);
+            }
+            settings_.loot_period      = period;
+            settings_.loot_probability = probability;
+            return true;
+        }
+        case Leaf::BOTS: {
+            FieldReader reader(leaf_fields_, "bots"sv);
+            unsigned count = 0;
+            std::string profile(DEFAULT_BOT_PROFILE);
+            reader.Require("count"sv, count);
+            reader.Read("profile"sv, profile);
+            if ( !reader.Ok() ) {
+                return Fail(std::move(reader.GetError()), ec);
             }
+            map_.bot_count   = count;
+            map_.bot_profile = std::move(profile);
+            return true;
+        }
+        case Leaf::LOOT_TYPE: {
+            FieldReader reader(leaf_fields_, "loot type"sv);
+            std::string name, file, type, color(model::LootType::COLOR_DEFAULT);
+            double   scale    = model::LootType::SCALE_DEFAULT;
+            int      rotation = model::LootType::ROTATION_DEFAULT;
+            unsigned value    = 0;
+            reader.Require("name"sv, name);
+            reader.Require("file"sv, file);
+            reader.Require("type"sv, type);
+            reader.Require("scale"sv, scale);
+            reader.Read("rotation"sv, rotation);
+            reader.Read("color"sv, color);
+            reader.Read("value"sv, value);
+            if ( !reader.Ok() ) {
+                return Fail(std::move(reader.GetError()), ec);
+            }
+            map_.loot_types.emplace_back(std::move(name), std::move(file), type, scale, rotation, color, value);
+            return true;
+        }
+        case Leaf::ROAD: {
+            FieldReader reader(leaf_fields_, "road"sv);
+            int x0 = 0, y0 = 0, end = 0;
+            reader.Require("x0"sv, x0);
+            reader.Require("y0"sv, y0);
+            if ( reader.Read("x1"sv, end) ) {
+                map_.roads.emplace_back(model::Road::HORIZONTAL, model::Point{x0, y0}, end);
+            } else if ( reader.Read("y1"sv, end) ) {
+                map_.roads.emplace_back(model::Road::VERTICAL, model::Point{x0, y0}, end);
+            } else {
+                reader.Fail("missing field 'x1' or 'y1'");
+            }
+            return reader.Ok() || Fail(std::move(reader.GetError()), ec);
+        }
+        case Leaf::BUILDING: {
+            FieldReader reader(leaf_fields_, "building"sv);
+            int x = 0, y = 0, w = 0, h = 0;
+            reader.Require("x"sv, x);
+            reader.Require("y"sv, y);
+            reader.Require("w"sv, w);
+            reader.Require("h"sv, h);
+            if ( !reader.Ok() ) {
+                return Fail(std::move(reader.GetError()), ec);
+            }
+            map_.buildings.emplace_back(model::Rectangle{{x, y}, {w, h}});
+            return true;
+        }
+        case Leaf::OFFICE: {
+            FieldReader reader(leaf_fields_, "office"sv);
+            std::string id;
+            int x = 0, y = 0, offset_x = 0, offset_y = 0;
+            reader.Require("id"sv, id);
+            reader.Require("x"sv, x);
+            reader.Require("y"sv, y);
+            reader.Require("offsetX"sv, offset_x);
+            reader.Require("offsetY"sv, offset_y);
+            if ( reader.Ok() && !map_.office_ids.insert(id).second ) {
+                reader.Fail("duplicate id '"s + id + "'"s);
+            }
+            if ( !reader.Ok() ) {
+                return Fail(std::move(reader.GetError()), ec);
+            }
+            map_.offices.emplace_back(model::Office::Id(std::move(id)), model::Point{x, y}, model::Offset{offset_x, offset_y});
+            return true;
+        }
+    }
+    return true;
+}
+
+using Parser = json::basic_parser<ConfigHandler>;
+
+
+//// Parse ////////////////////////////////////////////////////////////////////////////////////////
+// Кусок документа и его место в файле
+struct Piece {
+    std::string_view data;
+    size_t           offset;
+};
+
+// "line L, column C: message"; offset - байт файла, на котором остановился разбор
+std::string Describe(std::string_view text, size_t offset, std::string_view message) {
+    offset = std::min(offset, text.size());
+    const std::string_view before = text.substr(0, offset);
+    const size_t line_start = before.rfind('\n');
+    const size_t line   = std::count(before.begin(), before.end(), '\n') + 1;
+    const size_t column = offset - (line_start == std::string_view::npos ? 0 : line_start + 1) + 1;
+    return "line "s + std::to_string(line) + ", column "s + std::to_string(column) + ": "s + std::string(message);
+}
 
-            game.AddMap(map);
+// Скармливает куски одному парсеру как один документ; nullopt - документ разобран
+std::optional<std::string> Feed(Parser& parser, std::string_view text, std::span<const Piece> pieces) {
+    json::error_code ec;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        const Piece& piece = pieces[i];
+        const bool more = i + 1 < pieces.size();
+        const size_t parsed = parser.write_some(more, piece.data.data(), piece.data.size(), ec);
+        if ( ec ) {
+            const std::string& error = parser.handler().GetError();
+            return Describe(text, piece.offset + parsed, error.empty() ? ec.message() : error);
         }
+        if ( !more && piece.data.substr(parsed).find_first_not_of(" \t\r\n"sv) != std::string_view::npos ) {
+            return Describe(text, piece.offset + parsed, "extra data after the document"sv);
+        }
+    }
+    return std::nullopt;
+}
+
+// Массив maps: скобки и границы элементов. Находится быстрым просмотром без разбора значений;
+// корректность всего проверяют парсеры частей
+struct MapsArray {
+    size_t                                 begin = 0;   // '['
+    size_t                                 end   = 0;   // за ']'
+    std::vector<std::pair<size_t, size_t>> items;       // [начало, конец) без пробелов
+};
+
+std::optional<MapsArray> FindMaps(std::string_view text) {
+    constexpr std::string_view SPACES = " \t\r\n"sv;
+    const size_t first = text.find_first_not_of(SPACES);
+    if ( first == std::string_view::npos || text[first] != '{' ) {
+        return std::nullopt;
+    }
+    MapsArray maps;
+    std::string_view key;                       // последний ключ верхнего уровня
+    size_t depth      = 0;
+    size_t item_begin = std::string_view::npos;
+    size_t item_end   = 0;
+    for (size_t i = first; i < text.size(); ++i) {
+        const char c = text[i];
+        const bool in_maps = maps.begin != 0;
+        if ( in_maps && depth == 2 && item_begin == std::string_view::npos && c != ',' && c != ']' && SPACES.find(c) == std::string_view::npos ) {
+            item_begin = i;
+        }
+        if ( c == '"' ) {
+            const size_t start = i + 1;
+            for (++i; i < text.size() && text[i] != '"'; ++i) {
+                if ( text[i] == '\\' ) {
+                    ++i;
+                }
+            }
+            if ( i >= text.size() ) {
+                return std::nullopt;
+            }
+            const size_t next = text.find_first_not_of(SPACES, i + 1);
+            if ( !in_maps && depth == 1 && next != std::string_view::npos && text[next] == ':' ) {
+                key = text.substr(start, i - start);
+            }
+        } else if ( c == '{' || c == '[' ) {
+            if ( !in_maps && depth == 1 && c == '[' && key == "maps"sv ) {
+                maps.begin = i;
+            }
+            ++depth;
+        } else if ( c == '}' || c == ']' ) {
+            if ( depth == 0 ) {
+                return std::nullopt;
+            }
+            --depth;
+            if ( in_maps && depth == 1 ) {
+                // пустой последний элемент ("[a,]") разбирать по частям нельзя: потеряется ошибка
+                if ( item_begin != std::string_view::npos ) {
+                    maps.items.emplace_back(item_begin, item_end);
+                } else if ( !maps.items.empty() ) {
+                    return std::nullopt;
+                }
+                maps.end = i + 1;
+                return maps;
+            }
+        } else if ( c == ',' && in_maps && depth == 2 ) {
+            if ( item_begin == std::string_view::npos ) {
+                return std::nullopt;
+            }
+            maps.items.emplace_back(item_begin, item_end);
+            item_begin = std::string_view::npos;
+            continue;
+        }
+        if ( in_maps && SPACES.find(c) == std::string_view::npos ) {
+            item_end = i + 1;
+        }
+    }
+    return std::nullopt;
+}
+
+// Меньше этого массив карт разбирается в вызывающем потоке
+constexpr size_t PARALLEL_MIN_SIZE = 1 << 20;
+
+struct Config {
+    Settings              settings;
+    std::vector<MapDraft> maps;
+};
+
+// Разбирает конфиг; при ошибке бросает runtime_error с её позицией. Массив карт, если его удалось
+// выделить, режется на элементы, и карты разбираются параллельно независимыми парсерами
+Config ParseConfig(std::string_view text) {
+    const json::parse_options options{};
+    Parser parser(options, ConfigHandler::Root::CONFIG);
+    const std::optional<MapsArray> maps_array = FindMaps(text);
+    if ( !maps_array ) {
+        const Piece whole{text, 0};
+        if ( auto error = Feed(parser, text, {&whole, 1}) ) {
+            throw std::runtime_error(*error);
+        }
+        return {parser.handler().GetSettings(), std::move(parser.handler().GetMaps())};
+    }
+
+    // всё вокруг массива карт, сам массив - пустой
+    const Piece pieces[] = {
+        {text.substr(0, maps_array->begin), 0},
+        {"[]"sv, maps_array->begin},
+        {text.substr(maps_array->end), maps_array->end}
+    };
+    if ( auto error = Feed(parser, text, pieces) ) {
+        throw std::runtime_error(*error);
+    }
+
+    const auto& items = maps_array->items;
+    std::vector<std::optional<MapDraft>>    drafts(items.size());
+    std::vector<std::optional<std::string>> errors(items.size());
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> first_error{items.size()};  // элементы за первой ошибкой можно не разбирать
+    auto worker = [&] {
+        Parser item_parser(options, ConfigHandler::Root::MAP);
+        for (size_t i = next++; i < items.size(); i = next++) {
+            if ( i > first_error.load(std::memory_order_relaxed) ) {
+                continue;
+            }
+            const auto [begin, end] = items[i];
+            const Piece item{text.substr(begin, end - begin), begin};
+            item_parser.reset();
+            item_parser.handler().Reset();
+            if ( auto error = Feed(item_parser, text, {&item, 1}) ) {
+                errors[i] = std::move(error);
+                size_t current = first_error.load(std::memory_order_relaxed);
+                while ( i < current && !first_error.compare_exchange_weak(current, i, std::memory_order_relaxed) ) {
+                }
+            } else {
+                drafts[i] = std::move(item_parser.handler().GetMaps().front());
+            }
+        }
+    };
+    size_t thread_count = 1;
+    if ( maps_array->end - maps_array->begin >= PARALLEL_MIN_SIZE ) {
+        // пустой, но большой массив (одни пробелы) - тоже один поток
+        thread_count = std::max<size_t>(1, std::min<size_t>(items.size(), std::thread::hardware_concurrency()));
+    }
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if ( first_error < items.size() ) {
+        throw std::runtime_error(*errors[first_error]);
+    }
+    Config config{parser.handler().GetSettings(), {}};
+    config.maps.reserve(drafts.size());
+    for (auto& draft : drafts) {
+        config.maps.push_back(std::move(*draft));
+    }
+    return config;
+}
+
+model::Game::Maps BuildMaps(Config& config) {
+    model::Game::Maps maps;
+    maps.reserve(config.maps.size());
+    for (auto& draft : config.maps) {
+        maps.push_back(std::move(draft).Build(config.settings.default_dog_speed, config.settings.default_bag_capacity));
+    }
+    return maps;
+}
+
+}  // namespace
+
+model::Game LoadGame(const fs::path& config_file) {
+    const std::string json_config = ReadFile(config_file);
+    try {
+        Config config = ParseConfig(json_config);
+        const Settings& settings = config.settings;
+        if ( !settings.loot_period ) {
+            throw std::runtime_error("config: missing field 'lootGeneratorConfig'");
+        }
+
+        // create game
+        model::Game game(static_cast<unsigned>(*settings.loot_period * MILLISECONDS), *settings.loot_probability, settings.dog_retirement_time);
+        game.SetMaps(BuildMaps(config));
 
         return game;
-    } catch (...) {
-        throw std::runtime_error("Wrong config json");
+    } catch (const std::exception& ex) {
+        throw std::runtime_error("Wrong config json: "s + ex.what());
+    }
+}
+
+model::Game::Maps LoadMaps(const fs::path& config_file) {
+    const std::string json_config = ReadFile(config_file);
+    try {
+        Config config = ParseConfig(json_config);
+        return BuildMaps(config);
+    } catch (const std::exception& ex) {
+        throw std::runtime_error("Wrong config json: "s + ex.what());
+    }
+}
+
+
+//// Reloader ///////
+Reloader::Reloader(fs::path config_file, model::Game& game)
+    : config_file_(std::move(config_file))
+    , game_(game)
+    , thread_([this] { Run(); }) {
+}
+
+Reloader::~Reloader() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    cond_var_.notify_one();
+    thread_.join();
+}
+
+void Reloader::Request(Handler handler) {
+    {
+        std::lock_guard lock{mutex_};
+        pending_.push_back(std::move(handler));
+    }
+    cond_var_.notify_one();
+}
+
+void Reloader::Run() {
+    for (;;) {
+        std::vector<Handler> handlers;
+        {
+            std::unique_lock lock{mutex_};
+            cond_var_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+            if ( stop_ ) {
+                return;
+            }
+            handlers.swap(pending_);
+        }
+        std::optional<std::string> error;
+        try {
+            game_.SetMaps(LoadMaps(config_file_));
+        } catch (const std::exception& ex) {
+            error = ex.what();
+        }
+        for (auto& handler : handlers) {
+            handler(error);
+        }
     }
 }
 
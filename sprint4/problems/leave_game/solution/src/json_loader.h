@@ -2,17 +2,55 @@
 
 #include <boost/json.hpp>
 
+#include <condition_variable>
 #include <filesystem>
 #include <fstream>
-
+#include <functional>
+#include <mutex>
+#include <optional>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "model.h"
 
 namespace json_loader {
 
 //// game ///////////
+// Ошибки синтаксиса и схемы конфига - runtime_error "Wrong config json: line L, column C: ..."
 model::Game LoadGame(const std::filesystem::path& config_file);
+// Только карты: для перезагрузки каталога работающей игры
+model::Game::Maps LoadMaps(const std::filesystem::path& config_file);
+
+
+//// Reloader ///////
+// Перечитывает карты из конфига в фоновом потоке, проверяет их и публикует новый каталог игры.
+// Параметры генератора трофеев и время ухода на покой остаются прежними. Запросы, пришедшие во
+// время разбора, обслуживает следующий разбор
+class Reloader {
+public:
+    // error - nullopt, если новый каталог опубликован
+    using Handler = std::function<void(std::optional<std::string> error)>;
+
+    Reloader(std::filesystem::path config_file, model::Game& game);
+    ~Reloader();
+
+    Reloader(const Reloader&) = delete;
+    Reloader& operator=(const Reloader&) = delete;
+
+    void Request(Handler handler);
+
+private:
+    void Run();
+
+    std::filesystem::path   config_file_;
+    model::Game&            game_;
+    std::mutex              mutex_;
+    std::condition_variable cond_var_;
+    std::vector<Handler>    pending_;
+    bool                    stop_ = false;
+    std::thread             thread_;
+};
 
 }  // namespace json_loader
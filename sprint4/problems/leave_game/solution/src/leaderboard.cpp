@@ -0,0 +1,178 @@
+#include "leaderboard.h"
+
+#include <algorithm>
+#include <mutex>
+
+namespace leaderboard {
+
+bool Before(const Record& lhs, const Record& rhs) noexcept {
+    const auto& [lhs_name, lhs_score, lhs_time] = lhs;
+    const auto& [rhs_name, rhs_score, rhs_time] = rhs;
+    return std::tie(rhs_score, lhs_time, lhs_name) < std::tie(lhs_score, rhs_time, rhs_name);
+}
+
+
+//// Leaderboard //////////////////////////////////////////////////////////////////////////////////
+void Leaderboard::Seed(std::vector<Record> rows) {
+    std::sort(rows.begin(), rows.end(), Before);
+    std::lock_guard lock{mutex_};
+    // таблица целиком поместилась, только если база вернула меньше, чем просили
+    complete_ = rows.size() < CAPACITY;
+    records_  = std::move(rows);
+    if ( records_.size() > CAPACITY ) {
+        records_.resize(CAPACITY);
+    }
+}
+
+void Leaderboard::Add(const std::vector<Record>& rows) {
+    if ( rows.empty() ) {
+        return;
+    }
+    std::lock_guard lock{mutex_};
+    for (const auto& row : rows) {
+        if ( records_.size() == CAPACITY && !Before(row, records_.back()) ) {
+            complete_ = false;
+            continue;
+        }
+        records_.insert(std::upper_bound(records_.begin(), records_.end(), row, Before), row);
+        if ( records_.size() > CAPACITY ) {
+            records_.pop_back();
+            complete_ = false;
+        }
+    }
+}
+
+std::optional<std::vector<Record>> Leaderboard::Get(size_t start, size_t max_items) const {
+    std::shared_lock lock{mutex_};
+    if ( start >= records_.size() ) {
+        return complete_ ? std::optional(std::vector<Record>{}) : std::nullopt;
+    }
+    const size_t count = std::min(max_items, records_.size() - start);
+    if ( count < max_items && !complete_ ) {
+        return std::nullopt;
+    }
+    return std::vector<Record>(records_.begin() + start, records_.begin() + start + count);
+}
+
+
+//// RankIndex ////////////////////////////////////////////////////////////////////////////////////
+void RankIndex::Clear() {
+    std::lock_guard lock{mutex_};
+    nodes_.clear();
+    root_ = NIL;
+}
+
+void RankIndex::Add(Record record) {
+    std::lock_guard lock{mutex_};
+    Insert(std::move(record));
+}
+
+void RankIndex::Add(const std::vector<Record>& rows) {
+    if ( rows.empty() ) {
+        return;
+    }
+    std::lock_guard lock{mutex_};
+    for (const auto& row : rows) {
+        Insert(row);
+    }
+}
+
+size_t RankIndex::CountBefore(const Record& key) const {
+    std::shared_lock lock{mutex_};
+    size_t   count = 0;
+    uint32_t node  = root_;
+    while ( node != NIL ) {
+        const Node& n = nodes_[node];
+        if ( Before(n.record, key) ) {
+            count += SizeOf(n.left) + 1;
+            node = n.right;
+        } else {
+            node = n.left;
+        }
+    }
+    return count;
+}
+
+std::vector<Record> RankIndex::Range(size_t start, size_t count) const {
+    std::shared_lock lock{mutex_};
+    std::vector<Record> out;
+    if ( start < SizeOf(root_) ) {
+        out.reserve(std::min(count, SizeOf(root_) - start));
+        Collect(root_, start, count, out);
+    }
+    return out;
+}
+
+size_t RankIndex::Size() const {
+    std::shared_lock lock{mutex_};
+    return SizeOf(root_);
+}
+
+void RankIndex::Update(uint32_t node) noexcept {
+    Node& n = nodes_[node];
+    n.size = SizeOf(n.left) + SizeOf(n.right) + 1;
+}
+
+void RankIndex::Split(uint32_t node, const Record& key, uint32_t& left, uint32_t& right) {
+    if ( node == NIL ) {
+        left = right = NIL;
+        return;
+    }
+    if ( Before(nodes_[node].record, key) ) {
+        Split(nodes_[node].right, key, nodes_[node].right, right);
+        left = node;
+    } else {
+        Split(nodes_[node].left, key, left, nodes_[node].left);
+        right = node;
+    }
+    Update(node);
+}
+
+uint32_t RankIndex::Merge(uint32_t left, uint32_t right) {
+    if ( left == NIL || right == NIL ) {
+        return left == NIL ? right : left;
+    }
+    if ( nodes_[left].priority > nodes_[right].priority ) {
+        nodes_[left].right = Merge(nodes_[left].right, right);
+        Update(left);
+        return left;
+    }
+    nodes_[right].left = Merge(left, nodes_[right].left);
+    Update(right);
+    return right;
+}
+
+void RankIndex::Insert(Record record) {
+    const auto node = static_cast<uint32_t>(nodes_.size());
+    nodes_.push_back(Node{std::move(record), static_cast<uint32_t>(random_())});
+    // равные рекорды встают после уже имеющихся
+    Record key = nodes_[node].record;
+    std::get<0>(key).push_back('\0');
+    uint32_t left, right;
+    Split(root_, key, left, right);
+    root_ = Merge(Merge(left, node), right);
+}
+
+void RankIndex::Collect(uint32_t node, size_t start, size_t count, std::vector<Record>& out) const {
+    while ( node != NIL && out.size() < count ) {
+        const Node&  n         = nodes_[node];
+        const size_t left_size = SizeOf(n.left);
+        if ( start < left_size ) {
+            Collect(n.left, start, count, out);
+            if ( out.size() >= count ) {
+                return;
+            }
+            start = 0;
+        } else {
+            start -= left_size;
+        }
+        if ( start == 0 ) {
+            out.push_back(n.record);
+        } else {
+            --start;
+        }
+        node = n.right;
+    }
+}
+
+}  // namespace leaderboard
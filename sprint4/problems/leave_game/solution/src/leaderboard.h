@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace leaderboard {
+
+// name, score, play_time_ms - как в таблице retired_players
+using Record = std::tuple<std::string, int, int>;
+
+// Порядок таблицы рекордов: очки по убыванию, затем время игры и имя по возрастанию;
+// имена - побайтно, в SQL тот же порядок даёт name COLLATE "C"
+bool Before(const Record& lhs, const Record& rhs) noexcept;
+
+
+//// Leaderboard //////////////////////////////////////////////////////////////////////////////////
+// Лучшие CAPACITY рекордов в памяти, отсортированные в порядке таблицы. Заполняется из базы при
+// старте и пополняется в тике теми же строками, что уходят в базу, поэтому чтение верхних страниц
+// не обращается к базе. Пока ни одна строка не вытеснена, кеш знает всю таблицу целиком.
+class Leaderboard {
+public:
+    constexpr static size_t CAPACITY = 1000;
+
+    // rows - первые строки таблицы в её порядке, не больше CAPACITY
+    void Seed(std::vector<Record> rows);
+    void Add(const std::vector<Record>& rows);
+
+    // Страница рекордов или nullopt, если её нет в кеше и нужно идти в базу
+    std::optional<std::vector<Record>> Get(size_t start, size_t max_items) const;
+
+private:
+    mutable std::shared_mutex mutex_;
+    std::vector<Record>       records_;
+    bool                      complete_ = true;
+};
+
+
+//// RankIndex ////////////////////////////////////////////////////////////////////////////////////
+// Все рекорды в декартовом дереве (treap), упорядоченном как таблица; узлы хранят размер поддерева,
+// поэтому место записи и выборка по месту - O(log n). Узлы лежат в одном векторе и ссылаются друг
+// на друга индексами; рекорды только добавляются, удаления нет.
+class RankIndex {
+public:
+    void Clear();
+    // По одной строке - заполнение при старте прямо из курсора базы
+    void Add(Record record);
+    void Add(const std::vector<Record>& rows);
+
+    // Сколько рекордов стоит в таблице раньше key. Для рекорда без имени равные по очкам и времени
+    // считаются стоящими после него
+    size_t CountBefore(const Record& key) const;
+    // Рекорды с местами [start, start + count), нумерация с нуля
+    std::vector<Record> Range(size_t start, size_t count) const;
+    size_t Size() const;
+
+private:
+    constexpr static uint32_t NIL = UINT32_MAX;
+
+    struct Node {
+        Record   record;
+        uint32_t priority;
+        uint32_t size  = 1;
+        uint32_t left  = NIL;
+        uint32_t right = NIL;
+    };
+
+    uint32_t SizeOf(uint32_t node) const noexcept { return node == NIL ? 0 : nodes_[node].size; }
+    void Update(uint32_t node) noexcept;
+    // Делит дерево node на рекорды раньше key (left) и остальные (right)
+    void Split(uint32_t node, const Record& key, uint32_t& left, uint32_t& right);
+    uint32_t Merge(uint32_t left, uint32_t right);
+    void Insert(Record record);
+    void Collect(uint32_t node, size_t start, size_t count, std::vector<Record>& out) const;
+
+    mutable std::shared_mutex mutex_;
+    std::vector<Node>         nodes_;
+    uint32_t                  root_ = NIL;
+    std::minstd_rand          random_;
+};
+
+}  // namespace leaderboard
@@ -1,42 +1,275 @@
-#include <iostream>
-
 #include "logger.h"
 
-#include <boost/date_time.hpp>                              // BOOST_LOG_ATTRIBUTE_KEYWORD
-#include <boost/log/trivial.hpp>                            // для BOOST_LOG_TRIVIAL
-#include <boost/log/utility/setup/console.hpp>              // для вывода в консоль
-#include <boost/log/utility/setup/file.hpp>                 // для вывода в файл
-#include <boost/log/utility/manipulators/add_value.hpp>     // logging::add_value
-
-namespace json     = boost::json;
-namespace keywords = boost::log::keywords;
-namespace logging  = boost::log;
-
-BOOST_LOG_ATTRIBUTE_KEYWORD(timestamp,  "TimeStamp", boost::posix_time::ptime)
-BOOST_LOG_ATTRIBUTE_KEYWORD(extra_data, "ExtraData", json::object)
-
-void GameLogFormatter(logging::record_view const& rec, logging::formatting_ostream& strm) {
-    // Выодим временную метку
-    auto ts = *rec[timestamp];
-    strm << "{\"timestamp\":\"" << to_iso_extended_string(ts) << "\",";
-    // Выводим дополнительные данные.
-    strm << "\"data\":" << rec[extra_data] << ",";
-    // Выводим само сообщение.
-    strm << "\"message\":\"" << rec[logging::expressions::smessage] << "\"}";
-}
-//// Logs ///////////////////////////////
+#include <boost/date_time.hpp>
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+namespace json = boost::json;
 
 namespace logger {
 
 using namespace std::literals;
 
-void LogInit() {
-    logging::add_console_log( 
-        std::cout,
-        keywords::format     = &GameLogFormatter,
-        keywords::auto_flush = true
-    );
+namespace {
+
+//// LogRing ////////////////////////////////////////////////////////////////////////////////////////
+// Кольцевой буфер одного потока: пишет только поток-владелец, читает только фоновый писатель,
+// поэтому достаточно двух атомарных счётчиков без блокировок. Строка длиннее слота занимает
+// несколько слотов подряд, длина всей строки - в первом из них
+class LogRing {
+public:
+    constexpr static size_t SLOT_SIZE = 512;
+
+    explicit LogRing(size_t capacity)
+        : slots_(capacity)
+        , mask_(capacity - 1) {
+    }
+
+    // Помещается ли строка в буфер хотя бы пустой
+    bool Fits(std::string_view line) const noexcept {
+        return SlotCount(line.size()) <= slots_.size();
+    }
+
+    bool TryPush(std::string_view line) noexcept {
+        const size_t head  = head_.load(std::memory_order_relaxed);
+        const size_t count = SlotCount(line.size());
+        if ( head - tail_.load(std::memory_order_acquire) + count > slots_.size() ) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & mask_].size = line.size();
+        for (size_t i = 0; i < count; ++i) {
+            const std::string_view piece = line.substr(i * SLOT_SIZE, SLOT_SIZE);
+            std::memcpy(slots_[(head + i) & mask_].data.data(), piece.data(), piece.size());
+        }
+        head_.store(head + count, std::memory_order_release);
+        return true;
+    }
+
+    // Дописывает все готовые строки в out, возвращает их количество
+    size_t DrainTo(std::string& out) {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        const size_t head = head_.load(std::memory_order_acquire);
+        size_t lines = 0;
+        for (size_t i = tail; i != head; ++lines) {
+            const size_t size  = slots_[i & mask_].size;
+            const size_t count = SlotCount(size);
+            for (size_t j = 0; j < count; ++j) {
+                out.append(slots_[(i + j) & mask_].data.data(), std::min(SLOT_SIZE, size - j * SLOT_SIZE));
+            }
+            i += count;
+        }
+        tail_.store(head, std::memory_order_release);
+        return lines;
+    }
+
+    uint64_t GetDropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static size_t SlotCount(size_t size) noexcept {
+        return std::max<size_t>(1, (size + SLOT_SIZE - 1) / SLOT_SIZE);
+    }
+
+    struct Slot {
+        size_t                     size = 0;
+        std::array<char, SLOT_SIZE> data;
+    };
+
+    std::vector<Slot>                 slots_;
+    size_t                            mask_;
+    alignas(64) std::atomic<size_t>   head_{0};
+    alignas(64) std::atomic<size_t>   tail_{0};
+    alignas(64) std::atomic<uint64_t> dropped_{0};
+};
+
+
+//// Backend ////////////////////////////////////////////////////////////////////////////////////////
+// Собирает строки из буферов всех потоков и пишет их в stdout пачками в фоновом потоке
+class Backend {
+    constexpr static auto FLUSH_PERIOD = 2ms;
+public:
+    ~Backend() {
+        Shutdown();
+    }
+
+    void Start(size_t ring_size) {
+        std::lock_guard lock{mutex_};
+        if ( writer_.joinable() ) {
+            return;
+        }
+        ring_size_ = std::bit_ceil(std::max<size_t>(ring_size, 2));
+        stop_      = false;
+        writer_    = std::thread([this] { Run(); });
+        running_.store(true, std::memory_order_release);
+    }
+
+    void Shutdown() {
+        {
+            std::lock_guard lock{mutex_};
+            if ( !writer_.joinable() ) {
+                return;
+            }
+            running_.store(false, std::memory_order_release);
+            stop_ = true;
+        }
+        cv_.notify_one();
+        writer_.join();
+    }
+
+    void Push(std::string_view line) {
+        if ( !running_.load(std::memory_order_acquire) ) {
+            // писатель не запущен (или уже остановлен) - пишем синхронно
+            WriteAll(line);
+            return;
+        }
+        LogRing& ring = GetThreadRing();
+        if ( !ring.Fits(line) ) {
+            // длиннее всего буфера (редкость) - синхронно, без чередования с пачками писателя
+            std::lock_guard lock{output_mutex_};
+            WriteAll(line);
+            oversized_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring.TryPush(line);
+    }
+
+    LogStats GetStats() {
+        std::lock_guard lock{mutex_};
+        uint64_t dropped = 0;
+        for (const auto& ring : rings_) {
+            dropped += ring->GetDropped();
+        }
+        return { written_, dropped, 0, oversized_.load(std::memory_order_relaxed) };
+    }
+
+private:
+    LogRing& GetThreadRing() {
+        thread_local LogRing* ring = nullptr;
+        if ( ring == nullptr ) {
+            std::lock_guard lock{mutex_};
+            rings_.push_back(std::make_unique<LogRing>(ring_size_));
+            ring = rings_.back().get();
+        }
+        return *ring;
+    }
+
+    void Run() {
+        std::string batch;
+        std::unique_lock lock{mutex_};
+        while ( true ) {
+            const bool stop = stop_;
+            size_t lines = 0;
+            for (const auto& ring : rings_) {
+                lines += ring->DrainTo(batch);
+            }
+            written_ += lines;
+            lock.unlock();
+            if ( !batch.empty() ) {
+                std::lock_guard output_lock{output_mutex_};
+                WriteAll(batch);
+                batch.clear();
+            }
+            lock.lock();
+            if ( stop ) {
+                break;
+            }
+            if ( lines == 0 ) {
+                cv_.wait_for(lock, FLUSH_PERIOD, [this] { return stop_; });
+            }
+        }
+    }
+
+    static void WriteAll(std::string_view data) {
+        while ( !data.empty() ) {
+            ssize_t n = ::write(STDOUT_FILENO, data.data(), data.size());
+            if ( n < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return;
+            }
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+
+private:
+    std::mutex                            mutex_;
+    std::mutex                            output_mutex_;
+    std::condition_variable               cv_;
+    std::thread                           writer_;
+    std::atomic<bool>                     running_{false};
+    bool                                  stop_      = false;
+    size_t                                ring_size_ = DEFAULT_RING_SIZE;
+    std::vector<std::unique_ptr<LogRing>> rings_;
+    uint64_t                              written_   = 0;
+    std::atomic<uint64_t>                 oversized_{0};
+};
+
+Backend& GetBackend() {
+    static Backend backend;
+    return backend;
+}
+
+std::atomic<unsigned> sample_every{1};
+std::atomic<uint64_t> sampled_out{0};
+
+
+//// Formatting /////////////////////////////////////////////////////////////////////////////////////
+void AppendEscaped(std::string& out, std::string_view str) {
+    constexpr static char HEX[] = "0123456789abcdef";
+    for (char c : str) {
+        switch ( c ) {
+            case '"':  out += "\\\""sv; break;
+            case '\\': out += "\\\\"sv; break;
+            case '\n': out += "\\n"sv;  break;
+            case '\r': out += "\\r"sv;  break;
+            case '\t': out += "\\t"sv;  break;
+            default:
+                if ( static_cast<unsigned char>(c) < 0x20 ) {
+                    out += "\\u00"sv;
+                    out += HEX[(c >> 4) & 0xf];
+                    out += HEX[c & 0xf];
+                } else {
+                    out += c;
+                }
+        }
+    }
+}
+
+// {"timestamp":"...","data":<data>,"message":"..."}
+template <typename DataWriter>
+void Emit(std::string_view message, DataWriter&& write_data) {
+    thread_local std::string line;
+    line.clear();
+    line += "{\"timestamp\":\""sv;
+    line += to_iso_extended_string(boost::posix_time::microsec_clock::local_time());
+    line += "\",\"data\":"sv;
+    write_data(line);
+    line += ",\"message\":\""sv;
+    AppendEscaped(line, message);
+    line += "\"}\n"sv;
+    GetBackend().Push(line);
+}
+
+}  // namespace
+
+
+//// Logs ///////////////////////////////////////////////////////////////////////////////////////////
+void LogInit(size_t ring_size) {
+    GetBackend().Start(ring_size);
 }
 
 void LogStart(std::string address, unsigned port) {
@@ -50,7 +283,16 @@ void LogStart(std::string address, unsigned port) {
 void LogStop() { LogStop(0, ""); }
 
 void LogStop(int code, std::string what) {
-    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
+    LogStats stats = GetStats();
+    if ( stats.dropped != 0 || stats.oversized != 0 ) {
+        json::object data {
+            {"written",     stats.written},
+            {"dropped",     stats.dropped},
+            {"sampled_out", stats.sampled_out},
+            {"oversized",   stats.oversized}
+        };
+        LogJson("log stats"sv, data);
+    }
     json::object data {
         {"code", code}
     };
@@ -58,27 +300,35 @@ void LogStop(int code, std::string what) {
         data["exception"] = what;
     }
     LogJson("server exited"sv, data);
+    // дописываем всё накопленное и останавливаем фоновый поток
+    GetBackend().Shutdown();
 }
 
-void LogRequest(std::string ip, std::string_view uri, std::string method) {
-    json::object data {
-        {"ip",     ip},
-        {"URI",    uri},
-        {"method", method}
-    };
-    LogJson("request received"sv, data);
+void LogRequest(std::string_view ip, std::string_view uri, std::string_view method) {
+    Emit("request received"sv, [&](std::string& out) {
+        out += "{\"ip\":\""sv;
+        AppendEscaped(out, ip);
+        out += "\",\"URI\":\""sv;
+        AppendEscaped(out, uri);
+        out += "\",\"method\":\""sv;
+        AppendEscaped(out, method);
+        out += "\"}"sv;
+    });
 }
 
 void LogResponse(int response_time, unsigned code, std::string_view content_type) {
-    json::object data {
-        {"response_time", response_time},
-        {"code",          code},
-        {"content_type",  content_type}
-    };
-    LogJson("response sent"sv, data);
+    Emit("response sent"sv, [&](std::string& out) {
+        out += "{\"response_time\":"sv;
+        out += std::to_string(response_time);
+        out += ",\"code\":"sv;
+        out += std::to_string(code);
+        out += ",\"content_type\":\""sv;
+        AppendEscaped(out, content_type);
+        out += "\"}"sv;
+    });
 }
 
-void LogNetError(int code, std::string text, std::string_view where) {   
+void LogNetError(int code, std::string text, std::string_view where) {
     json::object data {
         {"code",  code},
         {"text",  text},
@@ -87,9 +337,34 @@ void LogNetError(int code, std::string text, std::string_view where) {
     LogJson("error"sv, data);
 }
 
-void LogJson(std::string_view message, json::object data) {   
-    const boost::posix_time::ptime now = boost::posix_time::microsec_clock::local_time();
-    BOOST_LOG_TRIVIAL(info) << message << logging::add_value(timestamp, now) << logging::add_value(extra_data, data);
+void LogJson(std::string_view message, json::object data) {
+    Emit(message, [&](std::string& out) {
+        out += json::serialize(data);
+    });
+}
+
+void SetSampling(unsigned every_n) {
+    sample_every.store(std::max(1u, every_n), std::memory_order_relaxed);
+}
+
+bool SampleRequest() {
+    const unsigned every_n = sample_every.load(std::memory_order_relaxed);
+    if ( every_n <= 1 ) {
+        return true;
+    }
+    thread_local unsigned counter = 0;
+    if ( ++counter >= every_n ) {
+        counter = 0;
+        return true;
+    }
+    sampled_out.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+LogStats GetStats() {
+    LogStats stats = GetBackend().GetStats();
+    stats.sampled_out = sampled_out.load(std::memory_order_relaxed);
+    return stats;
 }
 
 }  // namespace logger
@@ -2,17 +2,35 @@
 
 #include <boost/json.hpp>
 
+#include <cstdint>
 #include <string>
 
 namespace logger {
 
-void LogInit();
+// Ёмкость кольцевого буфера потока (в записях), степень двойки
+constexpr size_t DEFAULT_RING_SIZE = 1024;
+
+struct LogStats {
+    uint64_t written;       // строк отдано писателю
+    uint64_t dropped;       // строк отброшено: буфер переполнен
+    uint64_t sampled_out;   // запросов пропущено сэмплированием
+    uint64_t oversized;     // строк длиннее всего буфера, записаны синхронно
+};
+
+void LogInit(size_t ring_size = DEFAULT_RING_SIZE);
 void LogStart   (std::string address, unsigned port);
 void LogStop    ();
 void LogStop    (int code, std::string what);
-void LogRequest (std::string ip, std::string_view uri, std::string method);
+void LogRequest (std::string_view ip, std::string_view uri, std::string_view method);
 void LogResponse(int response_time, unsigned code, std::string_view content_type);
 void LogNetError(int code, std::string text, std::string_view where);
 void LogJson    (std::string_view message, boost::json::object data);
 
+// Сэмплирование логов запросов: логируется один запрос из every_n (0 и 1 - все)
+void SetSampling(unsigned every_n);
+// Решение о логировании очередного запроса, принимается один раз на пару запрос/ответ
+bool SampleRequest();
+
+LogStats GetStats();
+
 }  // namespace logger
@@ -5,17 +5,36 @@
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/signal_set.hpp>
 
+#include <atomic>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <optional>
+#include <random>
 #include <thread>
+#include <utility>
+#include <vector>
 
+#include <unistd.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "admission.h"
 #include "app.h"
+#include "handover.h"
 #include "json_loader.h"
 #include "logger.h"
+#include "metrics.h"
 #include "request_handler.h"
 #include "serializer.h"
+#include "snapshot.h"
 
 using namespace std::literals;
 
@@ -39,13 +58,24 @@ public:
         , handler_{std::move(handler)} {
     }
 
-    void Start() {
-        net::dispatch(strand_, [this, self = shared_from_this()] {
-            last_tick_ = Clock::now();
+    // last_tick - время предыдущего тика: после передачи работы от другого процесса первый тик
+    // покрывает паузу, и игровое время не теряется
+    void Start(Clock::time_point last_tick = Clock::now()) {
+        net::dispatch(strand_, [this, self = shared_from_this(), last_tick] {
+            stopped_   = false;
+            last_tick_ = last_tick;
             self->ScheduleTick();
         });
     }
 
+    // Вызывается в strand; возвращает время последнего тика
+    Clock::time_point Stop() {
+        assert(strand_.running_in_this_thread());
+        stopped_ = true;
+        timer_.cancel();
+        return last_tick_;
+    }
+
 private:
     void ScheduleTick() {
         assert(strand_.running_in_this_thread());
@@ -59,7 +89,7 @@ private:
         using namespace std::chrono;
         assert(strand_.running_in_this_thread());
 
-        if (!ec) {
+        if ( !ec && !stopped_ ) {
             auto this_tick = Clock::now();
             auto delta = duration_cast<milliseconds>(this_tick - last_tick_);
             last_tick_ = this_tick;
@@ -67,6 +97,8 @@ private:
                 handler_(delta);
             } catch (...) {
             }
+            auto duration = Clock::now() - this_tick;
+            metrics::RecordTick(duration_cast<microseconds>(duration).count(), duration > period_);
             ScheduleTick();
         }
     }
@@ -76,6 +108,7 @@ private:
     net::steady_timer         timer_{strand_};
     Handler                   handler_;
     std::chrono::steady_clock::time_point last_tick_;
+    bool                      stopped_ = false;
 };
 
 // Параметры программы
@@ -86,8 +119,26 @@ struct Args {
     bool        randomize;
     std::string state_file;
     uint32_t    save_period;
+    unsigned    log_sample_rate;
+    uint32_t    slow_tick_threshold;
+    std::string journal_file;
+    size_t      db_pool_size;
+    uint32_t    db_acquire_timeout;
+    std::string io_mode;
+    bool        cpu_affinity;
+    size_t      max_connections;
+    double      rate_limit;
+    double      rate_burst;
+    size_t      max_pending;
+    std::string handover_socket;
+    uint32_t    handover_drain;
 };
 
+constexpr std::string_view IO_MODE_SHARED   = "shared"sv;
+constexpr std::string_view IO_MODE_PER_CORE = "per-core"sv;
+constexpr uint32_t         DEFAULT_HANDOVER_DRAIN = 5000;   // ms
+constexpr auto             RUN_ON_STRAND_TIMEOUT  = 10s;
+
 // Парсим командную строку
 [[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
     namespace po = boost::program_options;
@@ -101,8 +152,22 @@ struct Args {
         ("config-file,c",            po::value(&args.config_file)->value_name("file"s),         "set config file path")
         ("www-root,w",               po::value(&args.www_root)->value_name("dir"s),            "set static files root")
         ("randomize-spawn-points,r", po::value(&args.randomize)->value_name("bool"s), "spawn dogs at random positions")
-        ("--state-file,s",           po::value(&args.state_file)->value_name("file"s),           "set state file path")
-        ("--save-state-period,p",    po::value(&args.save_period)->value_name("ms"s),      "set statefile save period");
+        ("--state-file,s",           po::value(&args.state_file)->value_name("file"s),           "set state file path; ticks between snapshots go to <file>.wal.*, flushed to disk every 100 ms (an OS crash or power loss may lose the last 100 ms)")
+        ("--save-state-period,p",    po::value(&args.save_period)->value_name("ms"s),      "set statefile save period")
+        ("log-sample-rate,l",        po::value(&args.log_sample_rate)->value_name("n"s),   "log only one of n requests")
+        ("slow-tick-threshold",      po::value(&args.slow_tick_threshold)->value_name("ms"s), "log phase breakdown of ticks longer than ms")
+        ("journal",                  po::value(&args.journal_file)->value_name("file"s),  "record joins, moves and ticks for game_sim --replay")
+        ("db-pool-size",             po::value(&args.db_pool_size)->value_name("n"s),     "number of database connections for queries")
+        ("db-acquire-timeout",       po::value(&args.db_acquire_timeout)->value_name("ms"s), "max wait for a free database connection")
+        ("io-mode",                  po::value(&args.io_mode)->value_name("mode"s),       "shared: one io_context for all threads; per-core: io_context and SO_REUSEPORT acceptor per thread. "
+                                                                                          "In both modes game API calls run on one strand, so API throughput is bounded by a single core")
+        ("cpu-affinity",             po::value(&args.cpu_affinity)->value_name("bool"s),  "pin per-core io threads to cores")
+        ("max-connections",          po::value(&args.max_connections)->value_name("n"s), "refuse connections above n with 503 (0 - unlimited)")
+        ("rate-limit",               po::value(&args.rate_limit)->value_name("rps"s),    "API requests per second from one address, 429 above it (0 - unlimited)")
+        ("rate-burst",               po::value(&args.rate_burst)->value_name("n"s),      "API requests from one address allowed at once above rate-limit")
+        ("max-pending",              po::value(&args.max_pending)->value_name("n"s),     "shed API requests with 503 while n are in progress (0 - unlimited)")
+        ("handover-socket",          po::value(&args.handover_socket)->value_name("file"s), "unix socket to take over sockets and state from a running server and to hand them over on restart")
+        ("handover-drain",           po::value(&args.handover_drain)->value_name("ms"s),  "max time to finish open connections after handover");
 
     // Парсим командную строку
     po::variables_map vm;
@@ -130,6 +195,53 @@ struct Args {
         args.randomize = false;
     }
 
+    if ( !vm.contains("log-sample-rate"s) ) {
+        args.log_sample_rate = 1;
+    }
+
+    if ( !vm.contains("slow-tick-threshold"s) ) {
+        args.slow_tick_threshold = 0;
+    }
+
+    if ( !vm.contains("db-pool-size"s) ) {
+        args.db_pool_size = postgres::Db::DEFAULT_POOL_SIZE;
+    }
+
+    if ( !vm.contains("db-acquire-timeout"s) ) {
+        args.db_acquire_timeout = postgres::Db::DEFAULT_ACQUIRE_TIMEOUT.count();
+    }
+
+    if ( !vm.contains("io-mode"s) ) {
+        args.io_mode = IO_MODE_SHARED;
+    }
+    if ( args.io_mode != IO_MODE_SHARED && args.io_mode != IO_MODE_PER_CORE ) {
+        throw std::runtime_error("io-mode must be 'shared' or 'per-core'"s);
+    }
+
+    if ( !vm.contains("cpu-affinity"s) ) {
+        args.cpu_affinity = false;
+    }
+
+    if ( !vm.contains("max-connections"s) ) {
+        args.max_connections = 0;
+    }
+    if ( !vm.contains("rate-limit"s) ) {
+        args.rate_limit = 0;
+    }
+    if ( !vm.contains("rate-burst"s) ) {
+        args.rate_burst = args.rate_limit;
+    }
+    if ( args.rate_limit < 0 || args.rate_burst < 0 ) {
+        throw std::runtime_error("rate-limit and rate-burst must not be negative"s);
+    }
+    if ( !vm.contains("max-pending"s) ) {
+        args.max_pending = 0;
+    }
+
+    if ( !vm.contains("handover-drain"s) ) {
+        args.handover_drain = DEFAULT_HANDOVER_DRAIN;
+    }
+
     // С опциями программы всё в порядке, возвращаем структуру args
     return args;
 }
@@ -181,6 +293,43 @@ void RunWorkers(unsigned n, const Fn& fn) {
     fn();
 }
 
+// Запускает fn(i) на n потоках, i = 0 - в текущем
+template <typename Fn>
+void RunIndexedWorkers(unsigned n, const Fn& fn) {
+    n = std::max(1u, n);
+    std::vector<std::jthread> workers;
+    workers.reserve(n - 1);
+    for (unsigned i = 1; i < n; ++i) {
+        workers.emplace_back(fn, i);
+    }
+    fn(0u);
+}
+
+// Выполняет fn в strand и возвращает её результат; вызывается не из потоков io_context
+template <typename Strand, typename Fn>
+auto RunOnStrand(Strand& strand, Fn&& fn) {
+    using Result = decltype(fn());
+    auto task   = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+    auto result = task->get_future();
+    net::dispatch(strand, [task] { (*task)(); });
+    if ( result.wait_for(RUN_ON_STRAND_TIMEOUT) != std::future_status::ready ) {
+        throw std::runtime_error("Strand is not responding"s);
+    }
+    return result.get();
+}
+
+// Привязывает текущий поток к ядру core (только Linux, иначе ничего не делает)
+void PinThreadToCore(unsigned core) {
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core % CPU_SETSIZE, &cpu_set);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+#else
+    (void)core;
+#endif
+}
+
 }  // namespace
 
 int main(int argc, const char* argv[]) {
@@ -192,29 +341,81 @@ int main(int argc, const char* argv[]) {
         if ( !args ) {
             return EXIT_SUCCESS;
         }
+        logger::SetSampling(args->log_sample_rate);
+        admission::Configure({args->max_connections, args->rate_limit, args->rate_burst, args->max_pending});
 
         // 1. Загружаем карту из файла, строим модель игры, создаём приложение
-        postgres::Db  db;
+        postgres::Db  db(args->db_pool_size, std::chrono::milliseconds(args->db_acquire_timeout));
         model::Game game = json_loader::LoadGame(GetAndCheckPath(args->config_file, false));
         fs::path    root = GetAndCheckPath(args->www_root, true);
         bool  debug_mode = args->time_delta == 0;
         app::Application app(db, game, debug_mode, args->randomize, args->state_file, args->save_period);
+        app.SetSlowTickThreshold(args->slow_tick_threshold);
         ////
-        serialization::RestoreApp(app);
+        // Если работает прежний сервер, забираем у него слушающие сокеты и состояние; он
+        // останавливает игру только сейчас, когда мы уже готовы её принять
+        std::optional<handover::Takeover> takeover;
+        if ( !args->handover_socket.empty() ) {
+            takeover = handover::Takeover::Connect(args->handover_socket);
+        }
+        if ( takeover ) {
+            serialization::RestoreAppFromSnapshot(app, takeover->GetSnapshot());
+        } else {
+            serialization::RestoreApp(app);
+        }
+        if ( !args->journal_file.empty() ) {
+            app.StartJournal(args->journal_file);
+        }
+        // серверные боты из конфига карт
+        app.StartBots((uint64_t{std::random_device{}()} << 32) | std::random_device{}());
+        if ( app.GetBotCount() != 0 ) {
+            logger::LogJson("bots started"sv, {{"count", app.GetBotCount()}});
+        }
         ////
 
-        // 2. Инициализируем io_context и создаём strand
-        const unsigned num_threads = std::thread::hardware_concurrency();
-        net::io_context ioc(num_threads);
+        // 2. Инициализируем io_context и создаём strand. В режиме per-core у каждого потока свой
+        //    io_context без общей очереди планировщика; приложение и тики живут в первом из них.
+        //    Вызовы API игры в любом режиме идут через один api_strand: потоки масштабируют приём,
+        //    разбор, статику и отправку ответов, но сама игра обслуживается не быстрее одного ядра
+        const unsigned num_threads = std::max(1u, std::thread::hardware_concurrency());
+        const bool     per_core    = args->io_mode == IO_MODE_PER_CORE;
+        std::vector<std::unique_ptr<net::io_context>> iocs;
+        if ( per_core ) {
+            for (unsigned i = 0; i < num_threads; ++i) {
+                iocs.push_back(std::make_unique<net::io_context>(1));
+            }
+        } else {
+            iocs.push_back(std::make_unique<net::io_context>(num_threads));
+        }
+        net::io_context& ioc = *iocs.front();
         auto api_strand = net::make_strand(ioc);
 
         // 3. Добавляем асинхронный обработчик сигналов SIGINT и SIGTERM
         net::signal_set signals(ioc, SIGINT, SIGTERM);
-        signals.async_wait([&ioc](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+        signals.async_wait([&iocs](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
             if (!ec) {
-                ioc.stop();
+                for (auto& ioc : iocs) {
+                    ioc->stop();
+                }
             }
         });
+        // SIGHUP перечитывает карты из конфига, не останавливая игру
+        json_loader::Reloader reloader(GetAndCheckPath(args->config_file, false), game);
+        net::signal_set hangup(ioc, SIGHUP);
+        std::function<void(const sys::error_code&, int)> on_hangup = [&](const sys::error_code& ec, [[maybe_unused]] int signal_number) {
+            if ( ec ) {
+                return;
+            }
+            reloader.Request([&game](std::optional<std::string> error) {
+                if ( error ) {
+                    logger::LogJson("maps reload failed"sv, {{"error", *error}});
+                } else {
+                    logger::LogJson("maps reloaded"sv, {{"version", game.GetCatalog()->GetVersion()}});
+                }
+            });
+            hangup.async_wait(on_hangup);
+        };
+        hangup.async_wait(on_hangup);
 
         // 4. Создаём обработчик HTTP-запросов и связываем его с моделью игры
         http_handler::RequestHandler handler{api_strand, app, root, debug_mode};
@@ -223,25 +424,123 @@ int main(int argc, const char* argv[]) {
         const auto address = net::ip::make_address("0.0.0.0");
         constexpr net::ip::port_type port = 8080;
 
-        http_server::ServeHttp(ioc, {address, port}, [&handler](auto&& req, auto&& send) {
+        auto serve_request = [&handler](auto&& req, auto&& send) {
             handler(std::forward<decltype(req)>(req), std::forward<decltype(send)>(send));
-        });
+        };
+        std::vector<std::shared_ptr<http_server::ListenerBase>> listeners;
+        if ( takeover ) {
+            // сокеты прежнего сервера раскладываем по io_context; если их меньше, чем io_context,
+            // недостающие - копии, принимающие из той же очереди ядра
+            const auto& sockets = takeover->GetListeners();
+            for (size_t i = 0; i < std::max(sockets.size(), iocs.size()); ++i) {
+                const int socket = i < sockets.size() ? sockets[i] : ::dup(sockets[i % sockets.size()]);
+                if ( socket < 0 ) {
+                    throw std::runtime_error("Can't duplicate listening socket: "s + std::strerror(errno));
+                }
+                listeners.push_back(http_server::ServeHttp(*iocs[i % iocs.size()], socket, serve_request));
+            }
+        } else {
+            for (auto& core_ioc : iocs) {
+                listeners.push_back(http_server::ServeHttp(*core_ioc, {address, port}, serve_request, per_core));
+            }
+        }
 
         // 6. Если не в отладочном режиме, запускаем время
+        std::shared_ptr<Ticker> ticker;
         if ( !debug_mode ) {
-           auto ticker = std::make_shared<Ticker>(api_strand, std::chrono::milliseconds(args->time_delta),
+            ticker = std::make_shared<Ticker>(api_strand, std::chrono::milliseconds(args->time_delta),
                 [&app](std::chrono::milliseconds delta) { app.Tick(delta.count()); }
             );
-            ticker->Start();
+            ticker->Start(takeover ? takeover->GetLastTick() : Ticker::Clock::now());
+        }
+
+        // 7. Прежний сервер может уходить; сами занимаем адрес для следующего перезапуска
+        if ( takeover ) {
+            takeover->Ack();
+            takeover.reset();
+        }
+        std::atomic<bool> handed_over = false;
+        // для отката передачи; только в strand игры
+        bool                      frozen         = false;
+        uint64_t                  frozen_wal_seq = 0;
+        Ticker::Clock::time_point frozen_tick;
+        std::unique_ptr<handover::Server> handover_server;
+        if ( !args->handover_socket.empty() ) {
+            handover::Server::Hooks hooks;
+            hooks.pause = [&listeners] {
+                std::vector<int> sockets;
+                for (auto& listener : listeners) {
+                    listener->Pause();
+                    sockets.push_back(listener->NativeHandle());
+                }
+                return sockets;
+            };
+            hooks.freeze = [&handler, &api_strand, &ticker, &app, &frozen, &frozen_wal_seq, &frozen_tick] {
+                handler.Freeze();
+                // снимок и остановка тиков - в strand игры, между тиками
+                auto [image, last_tick] = RunOnStrand(api_strand, [&ticker, &app, &frozen, &frozen_wal_seq, &frozen_tick] {
+                    frozen_tick = ticker ? ticker->Stop() : Ticker::Clock::now();
+                    serialization::StateImage image(app);
+                    frozen_wal_seq = app.DetachStorage();
+                    frozen         = true;
+                    return std::pair{std::move(image), frozen_tick};
+                });
+                return handover::State{serialization::EncodeSnapshot(image), last_tick};
+            };
+            hooks.resume = [&handler, &api_strand, &ticker, &app, &frozen, &frozen_wal_seq, &frozen_tick, &listeners] {
+                // в том же strand, что и заморозка: она могла не дождаться своей очереди и выполниться позже
+                net::dispatch(api_strand, [&ticker, &app, &frozen, &frozen_wal_seq, &frozen_tick] {
+                    if ( !frozen ) {
+                        return;
+                    }
+                    frozen = false;
+                    app.AttachStorage(frozen_wal_seq);
+                    if ( ticker ) {
+                        ticker->Start(frozen_tick);
+                    }
+                });
+                handler.Unfreeze();
+                for (auto& listener : listeners) {
+                    listener->Resume();
+                }
+            };
+            hooks.finish = [&listeners, &iocs, &handed_over, drain = std::chrono::milliseconds(args->handover_drain)] {
+                handed_over = true;
+                for (auto& listener : listeners) {
+                    listener->Close();
+                }
+                // запросы к API уже получают 503 с закрытием соединения; ждём, пока клиенты уйдут
+                const auto deadline = std::chrono::steady_clock::now() + drain;
+                while ( admission::ActiveConnections() != 0 && std::chrono::steady_clock::now() < deadline ) {
+                    std::this_thread::sleep_for(50ms);
+                }
+                for (auto& ioc : iocs) {
+                    ioc->stop();
+                }
+            };
+            handover_server = std::make_unique<handover::Server>(args->handover_socket, std::move(hooks));
         }
 
-        // 7. Запускаем обработку асинхронных операций
+        // 8. Запускаем обработку асинхронных операций
         logger::LogStart(address.to_string(), port);
-        RunWorkers(std::max(1u, num_threads), [&ioc] {
-            ioc.run();
-        });
+        if ( per_core ) {
+            RunIndexedWorkers(num_threads, [&iocs, &args](unsigned i) {
+                if ( args->cpu_affinity ) {
+                    PinThreadToCore(i);
+                }
+                iocs[i]->run();
+            });
+        } else {
+            RunWorkers(num_threads, [&ioc] {
+                ioc.run();
+            });
+        }
+        handover_server.reset();
         ////
-        serialization::SaveApp(app);
+        // после передачи файлы состояния принадлежат новому процессу
+        if ( !handed_over ) {
+            app.SaveState();
+        }
         ////
         logger::LogStop();
     } catch (const std::exception& ex) {
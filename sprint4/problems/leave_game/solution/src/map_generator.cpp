@@ -0,0 +1,157 @@
+#include "map_generator.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace map_gen {
+
+namespace json = boost::json;
+
+namespace {
+
+void AddLootTypes(model::Map& map, size_t count) {
+    for (size_t i = 0; i < std::max<size_t>(count, 1); ++i) {
+        const std::string name = "loot" + std::to_string(i);
+        map.AddLootType(model::LootType(name, "assets/" + name + ".obj", model::LootType::TYPE_DEFAULT,
+                                        0.03, model::LootType::ROTATION_DEFAULT, model::LootType::COLOR_DEFAULT, static_cast<unsigned>(10 * (i + 1))));
+    }
+}
+
+template <typename T>
+T Uniform(T from, T to, std::mt19937& random) {
+    return std::uniform_int_distribution<T>(std::min(from, to), std::max(from, to))(random);
+}
+
+}  // namespace
+
+
+//// Grid /////////////////////////////////////////////////////////////////////////////////////////
+model::Map MakeGridMap(const GridParams& params) {
+    model::Map map{model::Map::Id{params.id}, params.id, params.dog_speed, params.bag_capacity};
+    std::mt19937 random(params.seed);
+
+    // loot
+    AddLootTypes(map, params.loot_types);
+
+    // roads
+    const size_t       rows   = std::max<size_t>(params.roads / 2, 1);
+    const size_t       cols   = std::max<size_t>(params.roads - rows, 1);
+    const model::Coord width  = static_cast<model::Coord>(std::max<size_t>(cols - 1, 1)) * params.block;
+    const model::Coord height = static_cast<model::Coord>(std::max<size_t>(rows - 1, 1)) * params.block;
+    for (size_t row = 0; row < rows; ++row) {
+        map.AddRoad(model::Road(model::Road::HORIZONTAL, {0, static_cast<model::Coord>(row) * params.block}, width));
+    }
+    for (size_t col = 0; col < cols; ++col) {
+        map.AddRoad(model::Road(model::Road::VERTICAL, {static_cast<model::Coord>(col) * params.block, 0}, height));
+    }
+
+    // buildings
+    if ( params.block > 2 ) {
+        for (size_t row = 0; row + 1 < rows; ++row) {
+            for (size_t col = 0; col + 1 < cols; ++col) {
+                const model::Point corner{static_cast<model::Coord>(col) * params.block + 1, static_cast<model::Coord>(row) * params.block + 1};
+                map.AddBuilding(model::Building({corner, {params.block - 2, params.block - 2}}));
+            }
+        }
+    }
+
+    // offices
+    std::uniform_int_distribution<size_t> row_dist(0, rows - 1);
+    std::uniform_int_distribution<size_t> col_dist(0, cols - 1);
+    for (size_t i = 0; i < params.offices; ++i) {
+        const model::Point position{static_cast<model::Coord>(col_dist(random)) * params.block,
+                                    static_cast<model::Coord>(row_dist(random)) * params.block};
+        map.AddOffice(model::Office(model::Office::Id{"o" + std::to_string(i)}, position, {5, 0}));
+    }
+
+    return map;
+}
+
+
+//// Random ///////////////////////////////////////////////////////////////////////////////////////
+model::Map MakeRandomMap(const RandomParams& params) {
+    model::Map map{model::Map::Id{params.id}, params.id, params.dog_speed, params.bag_capacity};
+    std::mt19937 random(params.seed);
+
+    // loot
+    AddLootTypes(map, params.loot_types);
+
+    // roads: первая - горизонталь через центр, остальные ответвляются от уже построенных
+    const model::Coord size       = std::max<model::Coord>(params.size, 1);
+    const model::Coord min_length = std::max<model::Coord>(params.min_road_length, 1);
+    const model::Coord max_length = std::max(params.max_road_length, min_length);
+    map.AddRoad(model::Road(model::Road::HORIZONTAL, {0, size / 2}, size));
+    while ( map.GetRoads().size() < std::max<size_t>(params.roads, 1) ) {
+        // копия: AddRoad может перераспределить вектор дорог
+        const model::Road  base  = map.GetRoads()[Uniform<size_t>(0, map.GetRoads().size() - 1, random)];
+        const model::Point start = base.GetStart();
+        const model::Point end   = base.GetEnd();
+        model::Coord length = Uniform(min_length, max_length, random);
+        if ( Uniform(0, 1, random) == 0 ) {
+            length = -length;
+        }
+        if ( base.IsHorizontal() ) {
+            const model::Point from{Uniform(start.x, end.x, random), start.y};
+            const model::Coord to_y = std::clamp(from.y + length, 0, size);
+            if ( to_y != from.y ) {
+                map.AddRoad(model::Road(model::Road::VERTICAL, from, to_y));
+            }
+        } else {
+            const model::Point from{start.x, Uniform(start.y, end.y, random)};
+            const model::Coord to_x = std::clamp(from.x + length, 0, size);
+            if ( to_x != from.x ) {
+                map.AddRoad(model::Road(model::Road::HORIZONTAL, from, to_x));
+            }
+        }
+    }
+
+    // buildings
+    for (size_t i = 0; i < params.buildings; ++i) {
+        const model::Point position{Uniform(0, size, random), Uniform(0, size, random)};
+        map.AddBuilding(model::Building({position, {Uniform(2, 10, random), Uniform(2, 10, random)}}));
+    }
+
+    // offices
+    for (size_t i = 0; i < params.offices; ++i) {
+        const model::Position point = RandomRoadPoint(map, random);
+        const model::Point position{static_cast<model::Coord>(std::lround(point.x)), static_cast<model::Coord>(std::lround(point.y))};
+        map.AddOffice(model::Office(model::Office::Id{"o" + std::to_string(i)}, position, {5, 0}));
+    }
+
+    return map;
+}
+
+model::Position RandomRoadPoint(const model::Map& map, std::mt19937& random) {
+    const auto& roads = map.GetRoads();
+    const model::Road& road = roads[std::uniform_int_distribution<size_t>(0, roads.size() - 1)(random)];
+    const model::Point start = road.GetStart();
+    const model::Point end   = road.GetEnd();
+    std::uniform_real_distribution<double> along(0.0, 1.0);
+    const double t = along(random);
+    return { start.x + (end.x - start.x) * t, start.y + (end.y - start.y) * t };
+}
+
+
+//// Config ///////////////////////////////////////////////////////////////////////////////////////
+json::object MakeGameConfig(const std::vector<model::Map>& maps, const ConfigParams& params) {
+    json::array json_maps;
+    for (const auto& map : maps) {
+        json::object json_map = map.ToJson();
+        json_map["dogSpeed"]    = map.GetDogSpeed();
+        json_map["bagCapacity"] = static_cast<int64_t>(map.GetBagCapacity());
+        json_maps.push_back(json_map);
+    }
+    json::object loot_config;
+    loot_config["period"]      = params.loot_period;
+    loot_config["probability"] = params.loot_probability;
+    //
+    json::object config;
+    config["defaultDogSpeed"]     = params.default_dog_speed;
+    config["defaultBagCapacity"]  = static_cast<int64_t>(params.default_bag_capacity);
+    config["lootGeneratorConfig"] = loot_config;
+    config["dogRetirementTime"]   = params.dog_retirement_time;
+    config["maps"]                = json_maps;
+    return config;
+}
+
+}  // namespace map_gen
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <boost/json.hpp>
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "model.h"
+
+namespace map_gen {
+
+//// Grid /////////////////////////////////////////////////////////////////////////////////////////
+// Прямоугольная сетка: roads / 2 горизонтальных и остальные вертикальные дороги с шагом block,
+// офисы на перекрёстках, по зданию в каждом квартале
+struct GridParams {
+    std::string     id           = "grid";
+    size_t          roads        = 16;
+    size_t          offices      = 4;
+    size_t          loot_types   = 4;
+    model::Coord    block        = 10;
+    double          dog_speed    = 4.0;
+    unsigned        bag_capacity = 3;
+    uint32_t        seed         = 1;
+};
+
+model::Map MakeGridMap(const GridParams& params);
+
+
+//// Random ///////////////////////////////////////////////////////////////////////////////////////
+// Случайная связная сеть: каждая новая дорога начинается в целой точке одной из уже построенных
+// и идёт перпендикулярно ей, поэтому из любой точки можно доехать до любой другой.
+// Здания ставятся случайно в пределах size x size, офисы - в случайных точках дорог.
+struct RandomParams {
+    std::string     id              = "random";
+    size_t          roads           = 1000;
+    size_t          offices         = 20;
+    size_t          buildings       = 200;
+    size_t          loot_types      = 8;
+    model::Coord    size            = 1000;
+    model::Coord    min_road_length = 5;
+    model::Coord    max_road_length = 100;
+    double          dog_speed       = 4.0;
+    unsigned        bag_capacity    = 3;
+    uint32_t        seed            = 1;
+};
+
+model::Map MakeRandomMap(const RandomParams& params);
+
+
+//// Config ///////////////////////////////////////////////////////////////////////////////////////
+// Общие параметры игры в формате config.json
+struct ConfigParams {
+    double   default_dog_speed    = 3.0;
+    unsigned default_bag_capacity = 3;
+    double   loot_period          = 5.0;
+    double   loot_probability     = 0.5;
+    double   dog_retirement_time  = 15.0;
+};
+
+// Конфигурация, которую читает json_loader::LoadGame
+boost::json::object MakeGameConfig(const std::vector<model::Map>& maps, const ConfigParams& params);
+
+// Случайная точка на случайной дороге карты
+model::Position RandomRoadPoint(const model::Map& map, std::mt19937& random);
+
+}  // namespace map_gen
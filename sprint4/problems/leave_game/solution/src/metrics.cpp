@@ -0,0 +1,348 @@
+#include "metrics.h"
+
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+#include "logger.h"
+
+namespace metrics {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr size_t ROUTES     = static_cast<size_t>(Route::COUNT);
+constexpr size_t STATUS_MAX = 600;
+constexpr size_t REJECTIONS = static_cast<size_t>(Rejection::COUNT);
+
+struct Registry {
+    std::array<LatencyHistogram, ROUTES>            latency;
+    std::array<std::atomic<uint64_t>, STATUS_MAX>   statuses{};
+    std::atomic<int64_t>                            active_connections{0};
+    std::atomic<uint64_t>                           total_connections{0};
+    std::array<std::atomic<uint64_t>, REJECTIONS>   rejections{};
+    std::atomic<int64_t>                            pending_requests{0};
+    //
+    LatencyHistogram                                tick;
+    std::atomic<uint64_t>                           tick_overruns{0};
+    LatencyHistogram                                db_wait;
+    std::atomic<uint64_t>                           db_timeouts{0};
+    std::atomic<uint64_t>                           db_reconnects{0};
+    LatencyHistogram                                state_save;
+    LatencyHistogram                                records_batch;
+    std::atomic<uint64_t>                           records_written{0};
+    std::atomic<uint64_t>                           records_retries{0};
+    std::atomic<uint64_t>                           records_dropped{0};
+    //
+    std::mutex                                      maps_mutex;
+    MapGaugesByMap                                  maps;
+};
+
+Registry& GetRegistry() {
+    static Registry registry;
+    return registry;
+}
+
+void AppendLabelValue(std::string& out, std::string_view value) {
+    for (char c : value) {
+        switch ( c ) {
+            case '\\': out += "\\\\"sv; break;
+            case '"':  out += "\\\""sv; break;
+            case '\n': out += "\\n"sv;  break;
+            default:   out += c;
+        }
+    }
+}
+
+void AppendSeconds(std::string& out, uint64_t us) {
+    char buf[32];
+    int len = std::snprintf(buf, sizeof(buf), "%.6f", static_cast<double>(us) / 1e6);
+    out.append(buf, len);
+}
+
+void AppendHeader(std::string& out, std::string_view name, std::string_view type, std::string_view help) {
+    out += "# HELP "sv; out += name; out += ' '; out += help; out += '\n';
+    out += "# TYPE "sv; out += name; out += ' '; out += type; out += '\n';
+}
+
+void AppendSample(std::string& out, std::string_view name, std::string_view labels, uint64_t value) {
+    out += name;
+    if ( !labels.empty() ) {
+        out += '{'; out += labels; out += '}';
+    }
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+std::string Label(std::string_view key, std::string_view value) {
+    std::string label(key);
+    label += "=\""sv;
+    AppendLabelValue(label, value);
+    label += '"';
+    return label;
+}
+
+}  // namespace
+
+
+//// Route ////////////////////////////////////////////////////////////////////////////////////////
+std::string_view RouteName(Route route) {
+    switch ( route ) {
+        case Route::MAP:       return "map"sv;
+        case Route::MAPS:      return "maps"sv;
+        case Route::JOIN:      return "join"sv;
+        case Route::PLAYERS:   return "players"sv;
+        case Route::STATE:     return "state"sv;
+        case Route::ACTION:    return "action"sv;
+        case Route::TICK:      return "tick"sv;
+        case Route::RECORDS:   return "records"sv;
+        case Route::RANK:      return "rank"sv;
+        case Route::API_OTHER: return "api_other"sv;
+        case Route::METRICS:   return "metrics"sv;
+        case Route::STATIC:    return "static"sv;
+        case Route::COUNT:     break;
+    }
+    return "unknown"sv;
+}
+
+std::string_view RejectionName(Rejection reason) {
+    switch ( reason ) {
+        case Rejection::CONNECTIONS: return "connections"sv;
+        case Rejection::RATE:        return "rate"sv;
+        case Rejection::OVERLOAD:    return "overload"sv;
+        case Rejection::COUNT:       break;
+    }
+    return "unknown"sv;
+}
+
+Route RouteFromTarget(std::string_view target) {
+    if ( auto pos = target.find('?'); pos != std::string_view::npos ) {
+        target = target.substr(0, pos);
+    }
+    if ( !target.starts_with("/api/"sv) ) {
+        return target == "/metrics"sv ? Route::METRICS : Route::STATIC;
+    }
+    if ( target.starts_with("/api/v1/maps/"sv) )       return Route::MAP;
+    if ( target == "/api/v1/maps"sv )                  return Route::MAPS;
+    if ( target == "/api/v1/game/join"sv )             return Route::JOIN;
+    if ( target == "/api/v1/game/players"sv )          return Route::PLAYERS;
+    if ( target == "/api/v1/game/state"sv )            return Route::STATE;
+    if ( target == "/api/v1/game/player/action"sv )    return Route::ACTION;
+    if ( target == "/api/v1/game/tick"sv )             return Route::TICK;
+    if ( target == "/api/v1/game/records"sv )          return Route::RECORDS;
+    if ( target == "/api/v1/game/records/rank"sv )     return Route::RANK;
+    return Route::API_OTHER;
+}
+
+
+//// LatencyHistogram /////////////////////////////////////////////////////////////////////////////
+uint64_t LatencyHistogram::GetPercentile(double q) const noexcept {
+    std::array<uint64_t, BUCKETS> counts;
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        counts[i] = buckets_[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if ( total == 0 ) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * total)));
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        cumulative += counts[i];
+        if ( cumulative >= rank ) {
+            return BucketUpperBound(i);
+        }
+    }
+    return BucketUpperBound(BUCKETS - 1);
+}
+
+void LatencyHistogram::WritePrometheus(std::string& out, std::string_view name, std::string_view labels) const {
+    const std::string prefix = std::string(name) + "_bucket{"s + std::string(labels) + (labels.empty() ? "le=\""s : ",le=\""s);
+    // границы - концы октав: 7, 15, 31, ... мкс; набор всегда полный, чтобы ряды le не появлялись
+    // и не пропадали между опросами и агрегировались между процессами
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        cumulative += buckets_[i].load(std::memory_order_relaxed);
+        if ( i % SUB_COUNT != SUB_COUNT - 1 ) {
+            continue;
+        }
+        out += prefix;
+        AppendSeconds(out, BucketUpperBound(i));
+        out += "\"} "sv;
+        out += std::to_string(cumulative);
+        out += '\n';
+    }
+    out += prefix;
+    out += "+Inf\"} "sv;
+    out += std::to_string(cumulative);
+    out += '\n';
+    //
+    out += name; out += "_sum"sv;
+    if ( !labels.empty() ) {
+        out += '{'; out += labels; out += '}';
+    }
+    out += ' ';
+    AppendSeconds(out, sum_.load(std::memory_order_relaxed));
+    out += '\n';
+    AppendSample(out, std::string(name) + "_count"s, labels, cumulative);
+}
+
+
+//// Recording ////////////////////////////////////////////////////////////////////////////////////
+void RecordRequest(Route route, unsigned status, uint64_t us) noexcept {
+    Registry& registry = GetRegistry();
+    registry.latency[static_cast<size_t>(route) % ROUTES].Record(us);
+    registry.statuses[status < STATUS_MAX ? status : 0].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConnectionOpened() noexcept {
+    Registry& registry = GetRegistry();
+    registry.active_connections.fetch_add(1, std::memory_order_relaxed);
+    registry.total_connections.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConnectionClosed() noexcept {
+    GetRegistry().active_connections.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void RecordRejection(Rejection reason) noexcept {
+    GetRegistry().rejections[static_cast<size_t>(reason) % REJECTIONS].fetch_add(1, std::memory_order_relaxed);
+}
+
+void PendingChanged(int64_t delta) noexcept {
+    GetRegistry().pending_requests.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void RecordTick(uint64_t us, bool overrun) noexcept {
+    Registry& registry = GetRegistry();
+    registry.tick.Record(us);
+    if ( overrun ) {
+        registry.tick_overruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RecordDbWait(uint64_t us) noexcept {
+    GetRegistry().db_wait.Record(us);
+}
+
+void RecordDbTimeout() noexcept {
+    GetRegistry().db_timeouts.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordDbReconnect() noexcept {
+    GetRegistry().db_reconnects.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordStateSave(uint64_t us) noexcept {
+    GetRegistry().state_save.Record(us);
+}
+
+void RecordRecordsBatch(size_t rows, uint64_t us) noexcept {
+    Registry& registry = GetRegistry();
+    registry.records_batch.Record(us);
+    registry.records_written.fetch_add(rows, std::memory_order_relaxed);
+}
+
+void RecordRecordsRetry() noexcept {
+    GetRegistry().records_retries.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RecordRecordsDropped(size_t rows) noexcept {
+    GetRegistry().records_dropped.fetch_add(rows, std::memory_order_relaxed);
+}
+
+void SetMapGauges(MapGaugesByMap maps) {
+    Registry& registry = GetRegistry();
+    std::lock_guard lock{registry.maps_mutex};
+    registry.maps.swap(maps);
+}
+
+
+//// Serialize ////////////////////////////////////////////////////////////////////////////////////
+std::string Serialize() {
+    Registry& registry = GetRegistry();
+    std::string out;
+    out.reserve(16 * 1024);
+    // --- http
+    AppendHeader(out, "game_http_requests_total"sv, "counter"sv, "Requests processed, by route"sv);
+    for (size_t r = 0; r < ROUTES; ++r) {
+        AppendSample(out, "game_http_requests_total"sv, Label("route"sv, RouteName(static_cast<Route>(r))), registry.latency[r].GetCount());
+    }
+    AppendHeader(out, "game_http_request_duration_seconds"sv, "histogram"sv, "Time from request read to response write, by route"sv);
+    for (size_t r = 0; r < ROUTES; ++r) {
+        if ( registry.latency[r].GetCount() != 0 ) {
+            registry.latency[r].WritePrometheus(out, "game_http_request_duration_seconds"sv, Label("route"sv, RouteName(static_cast<Route>(r))));
+        }
+    }
+    AppendHeader(out, "game_http_responses_total"sv, "counter"sv, "Responses sent, by status code"sv);
+    for (size_t code = 0; code < STATUS_MAX; ++code) {
+        if ( uint64_t n = registry.statuses[code].load(std::memory_order_relaxed); n != 0 ) {
+            AppendSample(out, "game_http_responses_total"sv, Label("code"sv, std::to_string(code)), n);
+        }
+    }
+    AppendHeader(out, "game_http_connections_active"sv, "gauge"sv, "Open client connections"sv);
+    AppendSample(out, "game_http_connections_active"sv, ""sv, std::max<int64_t>(0, registry.active_connections.load(std::memory_order_relaxed)));
+    AppendHeader(out, "game_http_connections_total"sv, "counter"sv, "Accepted client connections"sv);
+    AppendSample(out, "game_http_connections_total"sv, ""sv, registry.total_connections.load(std::memory_order_relaxed));
+    AppendHeader(out, "game_http_rejected_total"sv, "counter"sv, "Connections and requests refused under overload, by reason"sv);
+    for (size_t r = 0; r < REJECTIONS; ++r) {
+        AppendSample(out, "game_http_rejected_total"sv, Label("reason"sv, RejectionName(static_cast<Rejection>(r))), registry.rejections[r].load(std::memory_order_relaxed));
+    }
+    AppendHeader(out, "game_http_pending_requests"sv, "gauge"sv, "API requests accepted and not yet answered"sv);
+    AppendSample(out, "game_http_pending_requests"sv, ""sv, std::max<int64_t>(0, registry.pending_requests.load(std::memory_order_relaxed)));
+    // --- tick
+    AppendHeader(out, "game_tick_duration_seconds"sv, "histogram"sv, "Game tick processing time"sv);
+    registry.tick.WritePrometheus(out, "game_tick_duration_seconds"sv, ""sv);
+    AppendHeader(out, "game_tick_overruns_total"sv, "counter"sv, "Ticks that took longer than the tick period"sv);
+    AppendSample(out, "game_tick_overruns_total"sv, ""sv, registry.tick_overruns.load(std::memory_order_relaxed));
+    // --- maps
+    {
+        std::lock_guard lock{registry.maps_mutex};
+        AppendHeader(out, "game_map_sessions"sv, "gauge"sv, "Game sessions, by map"sv);
+        for (const auto& [map_id, gauges] : registry.maps) {
+            AppendSample(out, "game_map_sessions"sv, Label("map"sv, map_id), gauges.sessions);
+        }
+        AppendHeader(out, "game_map_dogs"sv, "gauge"sv, "Dogs in game sessions, by map"sv);
+        for (const auto& [map_id, gauges] : registry.maps) {
+            AppendSample(out, "game_map_dogs"sv, Label("map"sv, map_id), gauges.dogs);
+        }
+        AppendHeader(out, "game_map_loot"sv, "gauge"sv, "Lost objects lying on the map"sv);
+        for (const auto& [map_id, gauges] : registry.maps) {
+            AppendSample(out, "game_map_loot"sv, Label("map"sv, map_id), gauges.loot);
+        }
+    }
+    // --- storage
+    AppendHeader(out, "game_db_pool_wait_seconds"sv, "histogram"sv, "Time spent waiting for a database connection"sv);
+    registry.db_wait.WritePrometheus(out, "game_db_pool_wait_seconds"sv, ""sv);
+    AppendHeader(out, "game_db_pool_timeouts_total"sv, "counter"sv, "Queries that did not get a database connection in time"sv);
+    AppendSample(out, "game_db_pool_timeouts_total"sv, ""sv, registry.db_timeouts.load(std::memory_order_relaxed));
+    AppendHeader(out, "game_db_reconnects_total"sv, "counter"sv, "Closed pool connections reopened before a query"sv);
+    AppendSample(out, "game_db_reconnects_total"sv, ""sv, registry.db_reconnects.load(std::memory_order_relaxed));
+    AppendHeader(out, "game_state_save_duration_seconds"sv, "histogram"sv, "State file save time"sv);
+    registry.state_save.WritePrometheus(out, "game_state_save_duration_seconds"sv, ""sv);
+    AppendHeader(out, "game_records_batch_duration_seconds"sv, "histogram"sv, "Time to insert one batch of retired players"sv);
+    registry.records_batch.WritePrometheus(out, "game_records_batch_duration_seconds"sv, ""sv);
+    AppendHeader(out, "game_records_rows_written_total"sv, "counter"sv, "Retired players written to the database"sv);
+    AppendSample(out, "game_records_rows_written_total"sv, ""sv, registry.records_written.load(std::memory_order_relaxed));
+    AppendHeader(out, "game_records_write_retries_total"sv, "counter"sv, "Failed batch inserts that will be retried"sv);
+    AppendSample(out, "game_records_write_retries_total"sv, ""sv, registry.records_retries.load(std::memory_order_relaxed));
+    AppendHeader(out, "game_records_rows_dropped_total"sv, "counter"sv, "Retired players lost on queue overflow, bad data or shutdown"sv);
+    AppendSample(out, "game_records_rows_dropped_total"sv, ""sv, registry.records_dropped.load(std::memory_order_relaxed));
+    // --- logger
+    logger::LogStats log_stats = logger::GetStats();
+    AppendHeader(out, "game_log_lines_written_total"sv, "counter"sv, "Log lines handed to the writer thread"sv);
+    AppendSample(out, "game_log_lines_written_total"sv, ""sv, log_stats.written);
+    AppendHeader(out, "game_log_lines_dropped_total"sv, "counter"sv, "Log lines dropped on ring buffer overflow"sv);
+    AppendSample(out, "game_log_lines_dropped_total"sv, ""sv, log_stats.dropped);
+    AppendHeader(out, "game_log_lines_oversized_total"sv, "counter"sv, "Log lines longer than the whole ring buffer, written synchronously"sv);
+    AppendSample(out, "game_log_lines_oversized_total"sv, ""sv, log_stats.oversized);
+    AppendHeader(out, "game_log_requests_sampled_out_total"sv, "counter"sv, "Requests not logged because of sampling"sv);
+    AppendSample(out, "game_log_requests_sampled_out_total"sv, ""sv, log_stats.sampled_out);
+    return out;
+}
+
+}  // namespace metrics
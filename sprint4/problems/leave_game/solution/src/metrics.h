@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace metrics {
+
+//// Route ////////////////////////////////////////////////////////////////////////////////////////
+// Маршруты, по которым ведётся статистика запросов
+enum class Route : uint8_t {
+    MAP,
+    MAPS,
+    JOIN,
+    PLAYERS,
+    STATE,
+    ACTION,
+    TICK,
+    RECORDS,
+    RANK,
+    API_OTHER,
+    METRICS,
+    STATIC,
+    COUNT
+};
+
+std::string_view RouteName(Route route);
+Route RouteFromTarget(std::string_view target);
+
+// Причины отказа в обслуживании при перегрузке
+enum class Rejection : uint8_t {
+    CONNECTIONS,    // лимит соединений
+    RATE,           // лимит запросов с адреса
+    OVERLOAD,       // бюджет незавершённых запросов
+    COUNT
+};
+
+std::string_view RejectionName(Rejection reason);
+
+
+//// LatencyHistogram /////////////////////////////////////////////////////////////////////////////
+// Гистограмма в стиле HDR: на каждую степень двойки 8 линейных корзин, значения в микросекундах.
+// Запись - несколько relaxed-инкрементов атомиков, без блокировок.
+class LatencyHistogram {
+    constexpr static unsigned SUB_BITS  = 3;
+    constexpr static unsigned SUB_COUNT = 1u << SUB_BITS;
+    constexpr static unsigned MAX_EXP   = 40;       // ~12 дней в микросекундах
+public:
+    constexpr static size_t BUCKETS = SUB_COUNT + (MAX_EXP - SUB_BITS) * SUB_COUNT;
+
+    void Record(uint64_t us) noexcept {
+        buckets_[BucketIndex(us)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    uint64_t GetCount() const noexcept { return count_.load(std::memory_order_relaxed); }
+    // Верхняя граница корзины, в которую попадает перцентиль q (0..1), в микросекундах
+    uint64_t GetPercentile(double q) const noexcept;
+
+    // Выводит name_bucket/name_sum/name_count, границы корзин - в секундах
+    void WritePrometheus(std::string& out, std::string_view name, std::string_view labels) const;
+
+private:
+    static size_t BucketIndex(uint64_t us) noexcept {
+        if ( us < SUB_COUNT ) {
+            return us;
+        }
+        const unsigned exp = std::min<unsigned>(63 - __builtin_clzll(us), MAX_EXP - 1);
+        const unsigned sub = (us >> (exp - SUB_BITS)) & (SUB_COUNT - 1);
+        return SUB_COUNT + (exp - SUB_BITS) * SUB_COUNT + sub;
+    }
+
+    static uint64_t BucketUpperBound(size_t idx) noexcept {
+        if ( idx < SUB_COUNT ) {
+            return idx;
+        }
+        const unsigned exp   = SUB_BITS + (idx - SUB_COUNT) / SUB_COUNT;
+        const uint64_t sub   = (idx - SUB_COUNT) % SUB_COUNT;
+        const uint64_t width = uint64_t{1} << (exp - SUB_BITS);
+        return (SUB_COUNT + sub) * width + width - 1;
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> buckets_{};
+    std::atomic<uint64_t>                       count_{0};
+    std::atomic<uint64_t>                       sum_{0};
+};
+
+
+//// Recording ////////////////////////////////////////////////////////////////////////////////////
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t MicrosecondsSince(Clock::time_point start) noexcept {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+void RecordRequest(Route route, unsigned status, uint64_t us) noexcept;
+void ConnectionOpened() noexcept;
+void ConnectionClosed() noexcept;
+void RecordRejection(Rejection reason) noexcept;
+void PendingChanged(int64_t delta) noexcept;
+void RecordTick(uint64_t us, bool overrun) noexcept;
+void RecordDbWait(uint64_t us) noexcept;
+void RecordDbTimeout() noexcept;
+void RecordDbReconnect() noexcept;
+void RecordStateSave(uint64_t us) noexcept;
+// Запись рекордов в базу фоновым потоком
+void RecordRecordsBatch(size_t rows, uint64_t us) noexcept;
+void RecordRecordsRetry() noexcept;
+void RecordRecordsDropped(size_t rows) noexcept;
+struct MapGauges {
+    size_t sessions = 0;
+    size_t dogs     = 0;
+    size_t loot     = 0;
+};
+using MapGaugesByMap = std::map<std::string, MapGauges, std::less<>>;
+// Обновляется раз в тик целиком: ряды карт, на которых не осталось сессий, пропадают из вывода
+void SetMapGauges(MapGaugesByMap maps);
+
+// Все метрики в текстовом формате Prometheus
+std::string Serialize();
+
+}  // namespace metrics
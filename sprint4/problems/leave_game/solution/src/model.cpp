@@ -1,16 +1,29 @@
 #include "model.h"
 
+#include <mutex>
 #include <stdexcept>
+#include <tuple>
 
 namespace model {
 using namespace std::literals;
 
 //// Aux ///////////////////////////////////////////////////////////////////////////
+namespace {
+
+std::mutex      random_mutex;
+std::mt19937_64 random_engine{std::random_device{}()};
+
+}  // namespace
+
 int GetRandom(int from, int to) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::uniform_int_distribution<> dis(from, to);
-    return dis(gen);
+    std::lock_guard lock{random_mutex};
+    return dis(random_engine);
+}
+
+void SeedRandom(uint64_t seed) {
+    std::lock_guard lock{random_mutex};
+    random_engine.seed(seed);
 }
 
 std::string DirToStr(Direction dir) {
@@ -65,26 +78,6 @@ json::object LootType::ToJson() const {
     return json_loot_type;
 }
 
-LootType LootType::FromJson(json::object json_loot_type) {
-    std::string name     = json::value_to< std::string >(json_loot_type.at("name"));
-    std::string file     = json::value_to< std::string >(json_loot_type.at("file"));
-    std::string type     = json::value_to< std::string >(json_loot_type.at("type"));
-    double      scale    = json::value_to< double >(json_loot_type.at("scale"));
-    int         rotation = ROTATION_DEFAULT;
-    unsigned    value    = 0;
-    std::string color(COLOR_DEFAULT);
-    try {
-        rotation = json::value_to< int >(json_loot_type.at("rotation"));
-    } catch (...) { }
-    try {
-        color = json::value_to< std::string >(json_loot_type.at("color"));
-    } catch (...) { }
-    try {
-        value = json::value_to< unsigned >(json_loot_type.at("value"));
-    } catch (...) { }
-    return LootType(name, file, type, scale, rotation, color, value);
-}
-
 
 
 //// LostObject ////////////////////////////////////////////////////////////////////
@@ -125,19 +118,172 @@ json::object Road::ToJson() const {
     return json_road;
 }
 
-Road Road::FromJson(json::object json_road) {
-    int x0 = json::value_to< int >(json_road.at("x0"));
-    int y0 = json::value_to< int >(json_road.at("y0"));
-    try {
-        int x1 = json::value_to< int >(json_road.at("x1"));
-        return Road(model::Road::HORIZONTAL, {x0, y0}, x1);
-    } catch (...) { }
-    try {
-        int y1 = json::value_to< int >(json_road.at("y1"));
-        return Road(model::Road::VERTICAL, {x0, y0}, y1);
-    } catch (...) { }
-    //
-    throw std::runtime_error("Unknown road orientation");
+
+
+//// RoadGraph /////////////////////////////////////////////////////////////////////
+namespace {
+
+bool Overlap(const RoadGraph::Bounds& a, const RoadGraph::Bounds& b) noexcept {
+    return a.min_x <= b.max_x && b.min_x <= a.max_x && a.min_y <= b.max_y && b.min_y <= a.max_y;
+}
+
+}  // namespace
+
+RoadGraph::RoadGraph(const std::vector<Road>& roads) {
+    constexpr double HALF_WIDTH = ROAD_WIDTH / 2;
+    bounds_.reserve(roads.size());
+    along_x_.reserve(roads.size());
+    double total_length = 0;
+    for (const auto& road : roads) {
+        const Point start = road.GetStart();
+        const Point end   = road.GetEnd();
+        bounds_.push_back({static_cast<double>(std::min(start.x, end.x)) - HALF_WIDTH, static_cast<double>(std::min(start.y, end.y)) - HALF_WIDTH,
+                           static_cast<double>(std::max(start.x, end.x)) + HALF_WIDTH, static_cast<double>(std::max(start.y, end.y)) + HALF_WIDTH});
+        along_x_.push_back(road.IsHorizontal());
+        total_length += std::abs(end.x - start.x) + std::abs(end.y - start.y);
+    }
+
+    // пары перекрывающихся дорог: прямоугольники раскладываются по клеткам со стороной в среднюю
+    // длину дороги, проверяются только дороги одной клетки
+    const double cell = std::max(1.0, total_length / std::max<size_t>(roads.size(), 1));
+    std::unordered_map<uint64_t, std::vector<Index>> cells;
+    auto cell_key = [](int64_t cx, int64_t cy) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    };
+    for (Index r = 0; r < bounds_.size(); ++r) {
+        const Bounds& b = bounds_[r];
+        for (auto cx = static_cast<int64_t>(std::floor(b.min_x / cell)); cx <= static_cast<int64_t>(std::floor(b.max_x / cell)); ++cx) {
+            for (auto cy = static_cast<int64_t>(std::floor(b.min_y / cell)); cy <= static_cast<int64_t>(std::floor(b.max_y / cell)); ++cy) {
+                cells[cell_key(cx, cy)].push_back(r);
+            }
+        }
+    }
+    std::vector<std::pair<Index, Index>> pairs;
+    for (const auto& [key, in_cell] : cells) {
+        for (size_t i = 0; i < in_cell.size(); ++i) {
+            for (size_t j = i + 1; j < in_cell.size(); ++j) {
+                if ( Overlap(bounds_[in_cell[i]], bounds_[in_cell[j]]) ) {
+                    pairs.emplace_back(in_cell[i], in_cell[j]);
+                }
+            }
+        }
+    }
+    std::sort(pairs.begin(), pairs.end());
+    pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+
+    // пересечения каждой дороги подряд, по возрастанию начала общего участка
+    first_.assign(bounds_.size() + 1, 0);
+    for (const auto& [a, b] : pairs) {
+        ++first_[a + 1];
+        ++first_[b + 1];
+    }
+    for (size_t r = 1; r < first_.size(); ++r) {
+        first_[r] += first_[r - 1];
+    }
+    crossings_.resize(first_.back());
+    std::vector<uint32_t> fill(first_.begin(), first_.end() - 1);
+    auto add = [this, &fill](Index road, Index other) {
+        const Bounds& b = bounds_[road];
+        const Bounds& o = bounds_[other];
+        crossings_[fill[road]++] = along_x_[road]
+            ? Crossing{std::max(b.min_x, o.min_x), std::min(b.max_x, o.max_x), 0, other}
+            : Crossing{std::max(b.min_y, o.min_y), std::min(b.max_y, o.max_y), 0, other};
+    };
+    for (const auto& [a, b] : pairs) {
+        add(a, b);
+        add(b, a);
+    }
+    for (Index r = 0; r < bounds_.size(); ++r) {
+        auto begin = crossings_.begin() + first_[r];
+        auto end   = crossings_.begin() + first_[r + 1];
+        std::sort(begin, end, [](const Crossing& lhs, const Crossing& rhs) {
+            return lhs.from < rhs.from;
+        });
+        double reach = std::numeric_limits<double>::lowest();
+        for (auto it = begin; it != end; ++it) {
+            reach = it->reach = std::max(reach, it->to);
+        }
+    }
+}
+
+RoadGraph::Index RoadGraph::Locate(Position pos) const noexcept {
+    for (Index r = 0; r < bounds_.size(); ++r) {
+        if ( bounds_[r].Contains(pos) ) {
+            return r;
+        }
+    }
+    return NO_ROAD;
+}
+
+RoadGraph::Step RoadGraph::Move(Index road, Position pos, Speed speed, Direction dir, double time) const noexcept {
+    // дорога, по которой пёс уйдёт дальше всех; при равенстве - та, где он не упрётся в край
+    Step   best{pos, road, true};
+    double best_time = -1;
+    double best_edge = 0;
+    auto consider = [&](Index r) {
+        const Bounds& b = bounds_[r];
+        double to, edge;
+        bool   stop;
+        double t;
+        switch ( dir ) {
+            case NORTH:
+                to   = pos.y + speed.sy * time;
+                edge = b.min_y;
+                stop = to <= edge;
+                t    = std::abs(pos.y - (stop ? edge : to)) / std::abs(speed.sy);
+                break;
+            case SOUTH:
+                to   = pos.y + speed.sy * time;
+                edge = b.max_y;
+                stop = to >= edge;
+                t    = std::abs((stop ? edge : to) - pos.y) / std::abs(speed.sy);
+                break;
+            case WEST:
+                to   = pos.x + speed.sx * time;
+                edge = b.min_x;
+                stop = to <= edge;
+                t    = std::abs(pos.x - (stop ? edge : to)) / std::abs(speed.sx);
+                break;
+            case EAST:
+            default:
+                to   = pos.x + speed.sx * time;
+                edge = b.max_x;
+                stop = to >= edge;
+                t    = std::abs((stop ? edge : to) - pos.x) / std::abs(speed.sx);
+                break;
+        }
+        if ( t > best_time || (t == best_time && best.stop && !stop) ) {
+            best_time = t;
+            best_edge = edge;
+            best.road = r;
+            best.stop = stop;
+        }
+    };
+    consider(road);
+    // пересечения, накрывающие pos: начало участка не дальше pos, конец не ближе
+    const double axis   = along_x_[road] ? pos.x : pos.y;
+    const auto crossings = GetCrossings(road);
+    auto it = std::upper_bound(crossings.begin(), crossings.end(), axis, [](double value, const Crossing& crossing) {
+        return value < crossing.from;
+    });
+    while ( it != crossings.begin() ) {
+        --it;
+        if ( it->reach < axis ) {
+            break;
+        }
+        if ( it->to >= axis && bounds_[it->road].Contains(pos) ) {
+            consider(it->road);
+        }
+    }
+
+    if ( best.stop ) {
+        // ровно на краю дороги, без накопления ошибки округления
+        (dir == NORTH || dir == SOUTH ? best.pos.y : best.pos.x) = best_edge;
+    } else {
+        best.pos.x = pos.x + speed.sx * best_time;
+        best.pos.y = pos.y + speed.sy * best_time;
+    }
+    return best;
 }
 
 
@@ -152,14 +298,6 @@ json::object Building::ToJson() const {
     return json_building;
 }
 
-Building Building::FromJson(json::object json_building) {
-    int x = json::value_to< int >(json_building.at("x"));
-    int y = json::value_to< int >(json_building.at("y"));
-    int w = json::value_to< int >(json_building.at("w"));
-    int h = json::value_to< int >(json_building.at("h"));
-    return Building(Rectangle({x, y}, {w, h}));
-}
-
 
 
 //// Office ////////////////////////////////////////////////////////////////////////
@@ -173,19 +311,22 @@ json::object Office::ToJson() const {
     return json_office;
 }
 
-Office Office::FromJson(json::object json_office) {
-    std::string id = json::value_to< std::string >(json_office.at("id"));
-    int x          = json::value_to< int >(json_office.at("x"));
-    int y          = json::value_to< int >(json_office.at("y"));
-    int offset_x   = json::value_to< int >(json_office.at("offsetX"));
-    int offset_y   = json::value_to< int >(json_office.at("offsetY"));
-    return Office(Office::Id(id), {x, y}, {offset_x, offset_y});
-}
-
 
 
 //// Map /////////////////////////////////////////////////////////////////////////
+bool Map::IsCompatible(const Map& other) const noexcept {
+    return loot_types_.size() == other.loot_types_.size()
+        && std::equal(roads_.begin(), roads_.end(), other.roads_.begin(), other.roads_.end(),
+                      [](const Road& lhs, const Road& rhs) {
+                          return lhs.GetStart() == rhs.GetStart() && lhs.GetEnd() == rhs.GetEnd();
+                      });
+}
+
 std::string Map::Serialize() const {
+    return json::serialize(ToJson());
+}
+
+json::object Map::ToJson() const {
     //
     json::object map;
     map["id"]   = *id_;
@@ -215,24 +356,7 @@ std::string Map::Serialize() const {
     }
     map["offices"] = json_offices;
     //
-    return json::serialize(map);
-}
-
-Map Map::FromJson(json::object json_map, double default_dog_speed, unsigned default_bag_capacity) {
-    std::string id   = json::value_to< std::string >(json_map.at("id"));
-    std::string name = json::value_to< std::string >(json_map.at("name"));
-    //
-    double dog_speed = default_dog_speed;
-    try {
-        dog_speed = json_map.at("dogSpeed").as_double();
-    } catch (...) { }
-    //
-    unsigned bag_capacity = default_bag_capacity;
-    try {
-        bag_capacity = json_map.at("bagCapacity").as_int64();
-    } catch (...) { }
-    //
-    return Map{Map::Id(id), name, dog_speed, bag_capacity};
+    return map;
 }
 
 
@@ -296,135 +420,30 @@ std::string Dog::ToString(std::string offs) const {
     oss << std::boolalpha;
     oss << offs << "retited_   = "  << retired_ << "\n";
     oss << offs << "saved_to_db= "  << saved_to_db_ << "\n";
+    oss << offs << "bot_       = "  << bot_ << "\n";
     return oss.str();
 }
 
-bool MoveComparator(const Movement& first, const Movement& second) {
-    if ( first.distanse < second.distanse ) {
-        return true;
-    }
-    return (int)first.stop > (int)second.stop;
-}
-
-void Dog::Move(uint32_t time_delta, const Map::Roads& roads) {
+void Dog::Move(uint32_t time_delta, const RoadGraph& roads) {
     static const double Milliseconds = 1000;
+    start_pos_ = pos_;
     if ( IsStopped() ) {
-        start_pos_ = pos_;
         return;
     }
-    double time = static_cast<double>(time_delta) / Milliseconds;
-    std::vector<Movement> real_moves;
-    for (const auto& road : roads) {
-        real_moves.push_back(MoveOnRoad(time, road));
+    // свою дорогу пёс теряет, только оказавшись в новой точке: загрузка, появление в игре
+    if ( !roads.Contains(road_, pos_) ) {
+        road_ = roads.Locate(pos_);
     }
-    std::sort(real_moves.begin(), real_moves.end(), MoveComparator);
-    Movement do_move = real_moves.back();
-    pos_.x = pos_.x + speed_.sx * do_move.distanse;
-    pos_.y = pos_.y + speed_.sy * do_move.distanse;
-    if ( do_move.stop ) {
+    if ( road_ == RoadGraph::NO_ROAD ) {   // пёс вне дорог
         Stop();
+        return;
     }
-}
-
-Movement Dog::MoveOnRoad(double time, const Road& road) {
-    bool must_stop = false;
-    start_pos_ = pos_;
-    if ( road.IsVertical() ) {
-        // x
-        double cur_x = pos_.x;
-        double left  = static_cast<double>(road.GetStart().x) - ROAD_WIDTH / 2;
-        double right = static_cast<double>(road.GetStart().x) + ROAD_WIDTH / 2;
-        if ( cur_x < left || cur_x > right ) { // пёс не на этой дороге
-            return { 0.0, true };
-        }
-        // y
-        double cur_y = pos_.y;
-        double beg_y = static_cast<double>(road.GetStart().y < road.GetEnd().y ? road.GetStart().y : road.GetEnd().y) - ROAD_WIDTH / 2;
-        double end_y = static_cast<double>(road.GetEnd().y > road.GetStart().y ? road.GetEnd().y : road.GetStart().y) + ROAD_WIDTH / 2;
-        if ( cur_y < beg_y || cur_y > end_y ) { // пёс не на этой дороге
-            return { 0.0, true };
-        }
-        // dir
-        double x, y;
-        switch ( dir_ ) {
-            case NORTH:
-                y = cur_y + speed_.sy * time;
-                if ( y <= beg_y ) {
-                    y = beg_y;
-                    must_stop = true;
-                }
-                return { std::abs(cur_y - y) / std::abs(speed_.sy), must_stop };
-            case SOUTH:
-                y = cur_y + speed_.sy * time;
-                if ( y >= end_y ) {
-                    y = end_y;
-                    must_stop = true;
-                }
-                return { std::abs(y - cur_y) / std::abs(speed_.sy), must_stop };
-            case WEST:
-                x = cur_x + speed_.sx * time;
-                if ( x <= left ) {
-                    x = left;
-                    must_stop = true;
-                }
-                return { std::abs(cur_x - x) / std::abs(speed_.sx), must_stop };
-            case EAST:
-                x = cur_x + speed_.sx * time;
-                if ( x >= right ) {
-                    x = right;
-                    must_stop = true;
-                }
-                return { std::abs(x - cur_x) / std::abs(speed_.sx), must_stop };
-        }
-    } else {
-        // y
-        double cur_y = pos_.y;
-        double down  = static_cast<double>(road.GetStart().y) - ROAD_WIDTH / 2;
-        double up    = static_cast<double>(road.GetStart().y) + ROAD_WIDTH / 2;
-        if ( cur_y < down || cur_y > up ) { // пёс не на этой дороге
-            return { 0.0, true };
-        }
-        // x
-        double cur_x = pos_.x;
-        double beg_x = static_cast<double>(road.GetStart().x < road.GetEnd().x ? road.GetStart().x : road.GetEnd().x) - ROAD_WIDTH / 2;
-        double end_x = static_cast<double>(road.GetEnd().x > road.GetStart().x ? road.GetEnd().x : road.GetStart().x) + ROAD_WIDTH / 2;
-        if ( cur_x < beg_x || cur_x > end_x ) { // пёс не на этой дороге
-            return { 0.0, true };
-        }
-        // dir
-        double x, y;
-        switch ( dir_ ) {
-            case NORTH:
-                y = cur_y + speed_.sy * time;
-                if ( y <= down ) {
-                    y = down;
-                    must_stop = true;
-                }
-                return { std::abs(cur_y - y) / std::abs(speed_.sy), must_stop };
-            case SOUTH:
-                y = cur_y + speed_.sy * time;
-                if ( y >= up ) {
-                    y = up;
-                    must_stop = true;
-                }
-                return { std::abs(y - cur_y) / std::abs(speed_.sy), must_stop };
-            case WEST:
-                x = cur_x + speed_.sx * time;
-                if ( x <= beg_x ) {
-                    x = beg_x;
-                    must_stop = true;
-                }
-                return { std::abs(cur_x - x) / std::abs(speed_.sx), must_stop };
-            case EAST:
-                x = cur_x + speed_.sx * time;
-                if ( x >= end_x ) {
-                    x = end_x;
-                    must_stop = true;
-                }
-                return { std::abs(x - cur_x) / std::abs(speed_.sx), must_stop };
-        }
+    const RoadGraph::Step step = roads.Move(road_, pos_, speed_, dir_, static_cast<double>(time_delta) / Milliseconds);
+    pos_  = step.pos;
+    road_ = step.road;
+    if ( step.stop ) {
+        Stop();
     }
-    return { 0.0, true };
 }
 
 bool Dog::PushIntoBag(BagItem bag_item, unsigned value) {
@@ -474,11 +493,55 @@ void Dog::CheckRetired(uint64_t curr_time, uint32_t retired_time) {
 
 
 
+//// MapCatalog ////////////////////////////////////////////////////////////////////
+MapCatalog::MapCatalog(Maps maps, uint64_t version)
+        : version_(version)
+        , maps_(std::move(maps)) {
+    json::array json_maps;
+    map_jsons_.reserve(maps_.size());
+    for (size_t i = 0; i < maps_.size(); ++i) {
+        Map& map = maps_[i];
+        if ( !map_id_to_index_.emplace(map.GetId(), i).second ) {
+            throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
+        }
+        if ( map.GetRoads().empty() ) {
+            throw std::invalid_argument("Map "s + *map.GetId() + " has no roads"s);
+        }
+        if ( map.GetLootsCount() == 0 ) {
+            throw std::invalid_argument("Map "s + *map.GetId() + " has no loot types"s);
+        }
+        map.BuildRoadGraph();
+        json::object json_map;
+        json_map["id"]   = *map.GetId();
+        json_map["name"] =  map.GetName();
+        json_maps.push_back(std::move(json_map));
+        map_jsons_.push_back(map.Serialize());
+    }
+    maps_json_ = json::serialize(json_maps);
+}
+
+const Map* MapCatalog::FindMap(const Map::Id& id) const noexcept {
+    if (auto it = map_id_to_index_.find(id); it != map_id_to_index_.end()) {
+        return &maps_[it->second];
+    }
+    return nullptr;
+}
+
+const std::string* MapCatalog::FindMapJson(const Map::Id& id) const noexcept {
+    if (auto it = map_id_to_index_.find(id); it != map_id_to_index_.end()) {
+        return &map_jsons_[it->second];
+    }
+    return nullptr;
+}
+
+
+
+
 //// GameSession ///////////////////////////////////////////////////////////////////
 std::string GameSession::ToString(std::string offs) const {
     std::ostringstream oss;
     oss << offs << "--- session:\n";
-    oss << offs << "map_ptr = "   << map_ << "\n";
+    oss << offs << "map_ptr = "   << map_.get() << "\n";
     oss << offs << "map_id_ = "   << *map_id_ << "\n";
     if ( map_ != nullptr ) {
         oss << offs << "map name = '" << map_->GetName() << "'\n";
@@ -498,9 +561,17 @@ std::string GameSession::ToString(std::string offs) const {
     return oss.str();
 }
 
+std::shared_ptr<profiler::TickProfile> GameSession::MakeTickProfile() {
+    return std::make_shared<profiler::TickProfile>(std::initializer_list<std::string_view>{
+        "lootSpawn"sv, "dogMove"sv, "gatherDetect"sv, "eventsResolve"sv, "compaction"sv
+    });
+}
+
 void GameSession::Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_count, uint32_t retirement_time) {
+    const auto tick_start = profiler::Clock::now();
     // create loot
     const Map::Roads& roads = map_->GetRoads();
+    profiler::PhaseTimer timer(*profile_, LOOT_SPAWN);
     for (unsigned i = 0; i < lost_count; ++i) {
         int random_loot    = GetRandom(0, map_->GetLootsCount() - 1);
         int random_road    = GetRandom(0, roads.size() - 1);
@@ -519,13 +590,15 @@ void GameSession::Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_co
     }
 
     // move dog
+    timer.Next(DOG_MOVE);
     for (auto& dog : dogs_) {
         dog.CheckRetired(curr_time, retirement_time);
         if ( !dog.IsRetired() ) {
-            dog.Move(time_delta, roads);
+            dog.Move(time_delta, map_->GetRoadGraph());
         }
     }
     // prepare to gather
+    timer.Next(GATHER_DETECT);
     GameProvider gp;
     for (const auto& lost_object : lost_objects_) {
         gp.PushItem({ { lost_object.position_.x, lost_object.position_.y }, LOOT_WIDTHS / 2, false } );
@@ -540,6 +613,7 @@ void GameSession::Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_co
     std::vector<collision_detector::GatheringEvent> events = FindGatherEvents(gp);
 
     // select events by time
+    timer.Next(EVENTS_RESOLVE);
     std::map<size_t, collision_detector::GatheringEvent> timed_events;
     for (const auto& event : events) {
         if ( timed_events.count(event.item_id) == 0 ) {
@@ -556,15 +630,16 @@ void GameSession::Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_co
         size_t item_id = timed_event.second.item_id;
         size_t dog_id  = timed_event.second.gatherer_id;
         if ( gp.GetItem(item_id).is_office ) {
-            dogs_.at(dog_id).EmptyBag();
+            dogs_[dog_id].EmptyBag();
         } else {
             BagItem bag_item{item_id, lost_objects_.at(item_id).type_};
-            if ( dogs_.at(dog_id).PushIntoBag(bag_item, map_->GetLootTypes()[lost_objects_.at(item_id).type_].value_) ) {
+            if ( dogs_[dog_id].PushIntoBag(bag_item, map_->GetLootTypes()[lost_objects_.at(item_id).type_].value_) ) {
                 found_ids.push_back(item_id);
             }
         }
     }
     // remove found objects
+    timer.Next(COMPACTION);
     LostObjects lost_objects_tmp;
     for (size_t i = 0; i < lost_objects_.size(); ++i) {
         if ( std::find(found_ids.begin(), found_ids.end(), i) == found_ids.end() ) {
@@ -573,6 +648,8 @@ void GameSession::Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_co
     }
     lost_objects_.clear();
     lost_objects_ = lost_objects_tmp;
+    timer.Stop();
+    profile_->Commit(std::chrono::duration_cast<std::chrono::microseconds>(profiler::Clock::now() - tick_start).count());
 }
 
 
@@ -589,28 +666,25 @@ std::string Game::ToString() const {
 }
 
 void Game::AddMap(Map map) {
-    const size_t index = maps_.size();
-    if (auto [it, inserted] = map_id_to_index_.emplace(map.GetId(), index); !inserted) {
-        throw std::invalid_argument("Map with id "s + *map.GetId() + " already exists"s);
-    } else {
-        try {
-            maps_.emplace_back(std::move(map));
-        } catch (...) {
-            map_id_to_index_.erase(it);
-            throw;
-        }
-    }
+    Maps maps = GetCatalog()->GetMaps();
+    maps.emplace_back(std::move(map));
+    SetMaps(std::move(maps));
 }
 
-GameSession* Game::AddSession(const Map* map) {
-    const size_t index = sessions_.size();
-    if (auto [it, inserted] = map_id_to_session_.emplace(map->GetId(), index); !inserted) {
+void Game::SetMaps(Maps maps) {
+    // публикует только один поток за раз: загрузка при старте или фоновая перезагрузка
+    const uint64_t version = GetCatalog()->GetVersion() + 1;
+    catalog_.store(std::make_shared<const MapCatalog>(std::move(maps), version), std::memory_order_release);
+}
+
+SessionHandle Game::AddSession(std::shared_ptr<const Map> map) {
+    if (auto [it, inserted] = map_id_to_session_.emplace(map->GetId(), SessionHandle{}); !inserted) {
         throw std::invalid_argument("GameSession with id "s + *map->GetId() + " already exists"s);
     } else {
         try {
-            GameSession session(map);
-            sessions_.push_back(session);
-            return &sessions_.at(sessions_.size() - 1);
+            const uint64_t version = GetCatalog()->GetVersion();
+            it->second = sessions_.Emplace(std::move(map), version);
+            return it->second;
         } catch (...) {
             map_id_to_session_.erase(it);
             throw;
@@ -618,6 +692,58 @@ GameSession* Game::AddSession(const Map* map) {
     }
 }
 
+std::vector<Map::Id> Game::RemoveDogs(std::vector<DogRef> dogs) {
+    // по сессиям: хранилище каждой сжимается за один проход
+    std::sort(dogs.begin(), dogs.end(), [](const DogRef& lhs, const DogRef& rhs) {
+        return std::tie(lhs.session.index, lhs.session.generation) < std::tie(rhs.session.index, rhs.session.generation);
+    });
+    std::vector<DogHandle> handles;
+    for (auto first = dogs.begin(); first != dogs.end(); ) {
+        const SessionHandle session = first->session;
+        handles.clear();
+        for (; first != dogs.end() && first->session == session; ++first) {
+            handles.push_back(first->dog);
+        }
+        if ( GameSession* game_session = GetSession(session) ) {
+            game_session->RemoveDogs(handles);
+        }
+    }
+    // опустевшая сессия уходит вместе с трофеями; следующий вход создаст новую на текущей карте
+    std::vector<Map::Id> released;
+    sessions_.EraseIf([&released](const GameSession& session) {
+        if ( session.GetDogsCount() != 0 ) {
+            return false;
+        }
+        released.push_back(session.GetMapId());
+        return true;
+    });
+    for (const auto& map_id : released) {
+        map_id_to_session_.erase(map_id);
+    }
+    return released;
+}
+
+void Game::SyncSessionMaps() {
+    const CatalogPtr catalog = GetCatalog();
+    for (auto& session : sessions_) {
+        if ( session.GetCatalogVersion() == catalog->GetVersion() ) {
+            continue;
+        }
+        const Map* map = catalog->FindMap(session.GetMapId());
+        if ( map == nullptr ) {
+            continue;
+        }
+        if ( !session.GetMap()->IsCompatible(*map) ) {
+            if ( session.GetDogsCount() != 0 ) {
+                continue;
+            }
+            // пустая сессия: предметы лежат на дорогах старой карты
+            session.ClearLostObjects();
+        }
+        session.SetMap(std::shared_ptr<const Map>(catalog, map), catalog->GetVersion());
+    }
+}
+
 
 
 }  // namespace model
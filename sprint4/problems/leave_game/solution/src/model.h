@@ -3,11 +3,15 @@
 #include <boost/json.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <deque>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <random>
+#include <span>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -16,6 +20,8 @@
 
 #include "collision_detector.h"
 #include "loot_generator.h"
+#include "profiler.h"
+#include "slot_map.h"
 #include "tagged.h"
 
 namespace model {
@@ -25,13 +31,19 @@ namespace json = boost::json;
 using namespace std::literals;
 
 //// Model's Aux ///////////////////////////////////////////////////////////////////
+// Все случайные решения модели (точки появления псов и трофеев) берутся из одного генератора:
+// при одинаковом зерне и одинаковых командах игра развивается одинаково
 int GetRandom(int from, int to);
+void SeedRandom(uint64_t seed);
 
 using Dimension = int;
 using Coord     = Dimension;
 
 struct Point {
     Coord x, y;
+
+    bool operator==(const Point&) const = default;
+
     std::string ToString() const {
         std::ostringstream oss;
         oss << "[ " << x << ", " << y << " ]";
@@ -84,18 +96,6 @@ struct Speed {
     }
 };
 
-struct Movement {
-    double distanse;
-    bool   stop;
-    std::string ToString() const {
-        std::ostringstream oss;
-        oss << "[ " << distanse << ", " << std::boolalpha << stop << " ]";
-        return oss.str();
-    }
-};
-
-bool MoveComparator(const Movement& first, const Movement& second);
-
 
 
 //// Road //////////////////////////////////////////////////////////////////////////
@@ -139,7 +139,6 @@ public:
     }
 
     json::object ToJson() const;
-    static Road FromJson(json::object json_road);
 
 private:
     Point start_;
@@ -148,6 +147,64 @@ private:
 
 
 
+//// RoadGraph /////////////////////////////////////////////////////////////////////
+// Дороги карты как граф. Дорога - прямоугольник шириной ROAD_WIDTH вокруг своего отрезка, её
+// пересечения - дороги, чьи прямоугольники с ней перекрываются, упорядоченные вдоль её оси.
+// Пёс помнит свою дорогу; под ним может быть только она и накрывающие его точку пересечения,
+// их находит двоичный поиск. Перебор всех дорог нужен лишь псу, который оказался в новой точке
+// (загрузка состояния, появление в игре).
+class RoadGraph {
+public:
+    using Index = uint32_t;
+    constexpr static Index  NO_ROAD    = std::numeric_limits<Index>::max();
+    constexpr static double ROAD_WIDTH = 0.8;
+
+    struct Bounds {
+        double min_x, min_y, max_x, max_y;
+
+        bool Contains(Position pos) const noexcept {
+            return pos.x >= min_x && pos.x <= max_x && pos.y >= min_y && pos.y <= max_y;
+        }
+    };
+
+    struct Crossing {
+        double from, to;    // общий участок вдоль оси дороги
+        double reach;       // наибольший to среди этого и предыдущих пересечений
+        Index  road;
+    };
+
+    struct Step {
+        Position pos;
+        Index    road;      // дорога, по которой пёс пришёл в pos
+        bool     stop;
+    };
+
+    RoadGraph() = default;
+    explicit RoadGraph(const std::vector<Road>& roads);
+
+    size_t GetRoadCount() const noexcept { return bounds_.size(); }
+    const Bounds& GetBounds(Index road) const noexcept { return bounds_[road]; }
+    std::span<const Crossing> GetCrossings(Index road) const noexcept {
+        return { crossings_.data() + first_[road], crossings_.data() + first_[road + 1] };
+    }
+    bool Contains(Index road, Position pos) const noexcept {
+        return road < bounds_.size() && bounds_[road].Contains(pos);
+    }
+    // Дорога под pos перебором всех дорог; NO_ROAD - точка вне дорог
+    Index Locate(Position pos) const noexcept;
+    // Движение из pos (на дороге road) со скоростью speed в направлении dir за time секунд: до
+    // края самой дальней в этом направлении дороги под pos. Остановка - ровно на краю
+    Step Move(Index road, Position pos, Speed speed, Direction dir, double time) const noexcept;
+
+private:
+    std::vector<Bounds>   bounds_;
+    std::vector<bool>     along_x_;     // ось дороги - x
+    std::vector<uint32_t> first_;       // начала пересечений дорог в crossings_, их число + 1
+    std::vector<Crossing> crossings_;
+};
+
+
+
 //// Building //////////////////////////////////////////////////////////////////////
 class Building {
 public:
@@ -160,7 +217,6 @@ public:
     }
 
     json::object ToJson() const;
-    static Building FromJson(json::object json_building);
 
 private:
     Rectangle bounds_;
@@ -192,7 +248,6 @@ public:
     }
 
     json::object ToJson() const;
-    static Office FromJson(json::object json_office);
 
 private:
     Id     id_;
@@ -249,6 +304,14 @@ public:
         roads_.emplace_back(road);
     }
 
+    // Граф строится один раз, когда дороги карты уже известны (при публикации каталога)
+    void BuildRoadGraph() {
+        road_graph_ = RoadGraph(roads_);
+    }
+    const RoadGraph& GetRoadGraph() const noexcept {
+        return road_graph_;
+    }
+
     void AddBuilding(const Building& building) {
         buildings_.emplace_back(building);
     }
@@ -256,7 +319,7 @@ public:
     void AddOffice(Office office);
 
     std::string Serialize() const;
-    static Map FromJson(json::object json_map, double default_dog_speed, unsigned default_bag_capacity);
+    json::object ToJson() const;
 
     ////
     size_t GetLootsCount() const noexcept {
@@ -273,12 +336,25 @@ public:
     ////
     unsigned GetBagCapacity() const noexcept { return bag_capacity_; }
 
+    // Серверные боты карты: сколько их держать и как они себя ведут (bots::ParseProfile)
+    unsigned GetBotCount() const noexcept { return bot_count_; }
+    const std::string& GetBotProfile() const noexcept { return bot_profile_; }
+    void SetBots(unsigned count, std::string profile) {
+        bot_count_   = count;
+        bot_profile_ = std::move(profile);
+    }
+
+    // Сессию можно перевести на other, не трогая псов и предметы: те же дороги и столько же
+    // типов трофеев. Скорость, ценности, вместимость и офисы могут отличаться
+    bool IsCompatible(const Map& other) const noexcept;
+
 private:
     using OfficeIdToIndex = std::unordered_map<Office::Id, size_t, util::TaggedHasher<Office::Id>>;
 
     Id          id_;
     std::string name_;
     Roads       roads_;
+    RoadGraph   road_graph_;
     Buildings   buildings_;
     //
     OfficeIdToIndex warehouse_id_to_index_;
@@ -289,6 +365,9 @@ private:
     LootTypes   loot_types_;
     //
     unsigned    bag_capacity_;
+    //
+    unsigned    bot_count_ = 0;
+    std::string bot_profile_;
 };
 
 
@@ -371,7 +450,6 @@ struct LootType {
     unsigned    value_;
 
     json::object ToJson() const;
-    static LootType FromJson(json::object json_loot_type);
 };
 
 
@@ -399,7 +477,6 @@ struct LostObject {
 
 //// Dog ///////////////////////////////////////////////////////////////////////////
 class Dog {
-    const double ROAD_WIDTH = 0.8;
 public:
     Dog(std::string name, uint32_t id) : filler_(0xdeadbeef), name_(name), id_(id) { }
     std::string ToString() const;
@@ -427,7 +504,9 @@ public:
         if ( move == "L" ) { dir_ = WEST;  speed_ = {-speed, 0 }; return; }
     }
     //
-    void Move(uint32_t time_delta, const Map::Roads& roads);
+    void Move(uint32_t time_delta, const RoadGraph& roads);
+    // дорога, на которой пёс стоит; NO_ROAD - ещё не найдена
+    RoadGraph::Index GetRoad() const noexcept { return road_; }
     //
     const Bag& GetBag() const noexcept { return bag_; }
     size_t GetBagCapacity() const noexcept { return bag_capacity_; }
@@ -439,6 +518,10 @@ public:
     unsigned GetValue() const noexcept { return value_; }
     void SetValue(unsigned value) { value_ = value; }
     //
+    // пёс серверного бота: не попадает в таблицу рекордов
+    bool IsBot() const noexcept { return bot_; }
+    void SetBot(bool bot) { bot_ = bot; }
+    //
     void SetCreateTime(unsigned create_time){ create_time_ = create_time; }
     uint64_t GetCreateTime() const noexcept { return create_time_; }
     uint64_t GetStopTime()   const noexcept { return stop_time_; }
@@ -447,7 +530,6 @@ public:
     std::optional<uint64_t>  GetPlayTime(bool force = false);
 
 private:
-    Movement MoveOnRoad(double time, const Road& road);
     void Stop() { speed_ = { 0, 0 }; }
     bool IsStopped() { return speed_.sx == 0.0 && speed_.sy == 0.0; }
 
@@ -460,6 +542,7 @@ private:
     Position    start_pos_{0, 0};
     Speed       speed_    {0, 0};
     Direction   dir_      {NORTH};
+    RoadGraph::Index road_ = RoadGraph::NO_ROAD;
     //
     Bag         bag_;
     size_t      bag_capacity_ = 0;
@@ -471,38 +554,67 @@ private:
     uint64_t    stop_time_   = 0;
     bool        retired_     = false;
     bool        saved_to_db_ = false;
+    bool        bot_         = false;
 };
 
+using DogHandle = util::Handle<Dog>;
+
 
 
 
 //// GameSession ///////////////////////////////////////////////////////////////////
+// Фазы тика сессии для профилировщика
+enum SessionTickPhase : size_t {
+    LOOT_SPAWN,
+    DOG_MOVE,
+    GATHER_DETECT,
+    EVENTS_RESOLVE,
+    COMPACTION
+};
+
 class GameSession {
 public:
+    using Dogs        = util::SlotMap<Dog>;
     using LostObjects = std::vector<LostObject>;
 
-    explicit GameSession(const Map* map) : map_(map), map_id_("") {
-        if ( map != nullptr ) {
-            map_id_ = map->GetId();
+    // map держит свой каталог карт, пока сессия на нём; version - версия этого каталога
+    explicit GameSession(std::shared_ptr<const Map> map, uint64_t version = 0)
+        : map_(std::move(map)), map_id_(""), catalog_version_(version), profile_(MakeTickProfile()) {
+        if ( map_ != nullptr ) {
+            map_id_ = map_->GetId();
         }
     }
-    Dog* AddDog(std::string name, uint32_t id, uint64_t create_time) {
-        dogs_.emplace_back(name, id);
-        dogs_.back().SetCreateTime(create_time);
-        return &dogs_.back();
+    DogHandle AddDog(std::string name, uint32_t id, uint64_t create_time) {
+        Dog dog(std::move(name), id);
+        dog.SetCreateTime(create_time);
+        return dogs_.Emplace(std::move(dog));
     }
-    void AddDog(Dog dog) {
-        dogs_.push_back(dog);
+    DogHandle AddDog(Dog dog) {
+        return dogs_.Emplace(std::move(dog));
     }
+    // nullptr - ссылка устарела
+    Dog* GetDog(DogHandle handle) noexcept { return dogs_.Get(handle); }
+    const Dog* GetDog(DogHandle handle) const noexcept { return dogs_.Get(handle); }
+    // Один проход по хранилищу; порядок оставшихся псов не меняется
+    void RemoveDogs(std::span<const DogHandle> dogs) { dogs_.Erase(dogs); }
     //
-    const Map* GetMap() const { return map_; }
-    const std::deque<Dog>& GetDogs() const { return dogs_; }
-    size_t GetDogsCount()  const noexcept { return dogs_.size(); }
+    const Map* GetMap() const { return map_.get(); }
+    uint64_t GetCatalogVersion() const noexcept { return catalog_version_; }
+    // Переход на карту из нового каталога; только между тиками
+    void SetMap(std::shared_ptr<const Map> map, uint64_t version) {
+        map_             = std::move(map);
+        catalog_version_ = version;
+    }
+    const Dogs& GetDogs() const { return dogs_; }
+    size_t GetDogsCount()  const noexcept { return dogs_.Size(); }
     //
     void Tick(uint64_t curr_time, uint32_t time_delta, unsigned lost_count, uint32_t dog_retirement_time);
     //
     size_t GetLostsCount() const noexcept { return lost_objects_.size(); }
     const LostObjects& GetLostObjects() const noexcept { return lost_objects_; }
+    // копии сессии разделяют один профиль
+    const profiler::TickProfile& GetTickProfile() const noexcept { return *profile_; }
+    std::shared_ptr<const profiler::TickProfile> ShareTickProfile() const noexcept { return profile_; }
 
     void AddLostObject(const LostObject& lost_object) {
         lost_objects_.emplace_back(lost_object);
@@ -510,18 +622,18 @@ public:
     // for deserialization only
     Map::Id GetMapId() const noexcept { return map_id_; }
     void SetMapId(Map::Id map_id) { map_id_ = map_id; }
-    Dog* FindDog(uint32_t dog_id) noexcept {
-        for (size_t i = 0; i < dogs_.size(); ++i) {
-            if ( dogs_[i].GetId() == dog_id ) {
-                return &dogs_[i];
-            }
-        }
-        return nullptr;
+    void ClearLostObjects() noexcept { lost_objects_.clear(); }
+    void RemoveLostObjects(const std::vector<unsigned>& ids) {
+        std::erase_if(lost_objects_, [&ids](const LostObject& lost_object) {
+            return std::find(ids.begin(), ids.end(), lost_object.id_) != ids.end();
+        });
     }
     //
     std::string ToString(std::string offs) const;
 
 private:
+    static std::shared_ptr<profiler::TickProfile> MakeTickProfile();
+
     void DebugLoot() {
         static int counter = 0;
         const static int MAX = 14;
@@ -541,12 +653,54 @@ private:
     }
 
 private:
-    const Map*      map_;
-    std::deque<Dog> dogs_;
+    std::shared_ptr<const Map> map_;
+    Dogs            dogs_;
     //
     LostObjects     lost_objects_;
     // for deserialization only
     Map::Id         map_id_;
+    uint64_t        catalog_version_;
+    //
+    std::shared_ptr<profiler::TickProfile> profile_;
+};
+
+using SessionHandle = util::Handle<GameSession>;
+
+// Пёс в своей сессии: так его держат игрок, бот и восстановление состояния
+struct DogRef {
+    SessionHandle session;
+    DogHandle     dog;
+};
+
+
+
+
+//// MapCatalog ////////////////////////////////////////////////////////////////////
+// Неизменяемый набор карт вместе с готовыми ответами /maps и /maps/{id}. Game публикует каталог
+// целиком (RCU): читатель держит shared_ptr на взятый каталог, сессия - на свою карту в нём,
+// старый каталог освобождается вместе с последней ссылкой
+class MapCatalog {
+public:
+    using Maps = std::vector<Map>;
+
+    // Проверяет карты: id не повторяются, у каждой есть дороги и типы трофеев
+    explicit MapCatalog(Maps maps, uint64_t version = 0);
+
+    uint64_t GetVersion() const noexcept { return version_; }
+    const Maps& GetMaps() const noexcept { return maps_; }
+    const Map* FindMap(const Map::Id& id) const noexcept;
+
+    const std::string& GetMapsJson() const noexcept { return maps_json_; }
+    const std::string* FindMapJson(const Map::Id& id) const noexcept;
+
+private:
+    using MapIdToIndex = std::unordered_map<Map::Id, size_t, util::TaggedHasher<Map::Id>>;
+
+    uint64_t                 version_;
+    Maps                     maps_;
+    MapIdToIndex             map_id_to_index_;
+    std::string              maps_json_;
+    std::vector<std::string> map_jsons_;    // по индексу карты
 };
 
 
@@ -555,55 +709,73 @@ private:
 //// Game //////////////////////////////////////////////////////////////////////////
 class Game {
 public:
-    using Maps     = std::vector<Map>;
-    using Sessions = std::vector<GameSession>;
-    constexpr static size_t   SESSION_MAX = 16;
+    using Maps       = MapCatalog::Maps;
+    using CatalogPtr = std::shared_ptr<const MapCatalog>;
+    using Sessions   = util::SlotMap<GameSession>;
     constexpr static uint32_t MS_IN_MIN   = 60000;
 
     Game(unsigned period, double probability, double dog_retirement_time) 
-            : loot_gen_(std::chrono::milliseconds{period}, probability)
+            : catalog_(std::make_shared<const MapCatalog>(Maps{}))
+            , loot_gen_(std::chrono::milliseconds{period}, probability)
             , dog_retirement_time_(dog_retirement_time * MS_IN_MIN) {
-        sessions_.reserve(SESSION_MAX);
+    }
+    Game(Game&& other) noexcept
+            : catalog_(other.catalog_.load())
+            , sessions_(std::move(other.sessions_))
+            , map_id_to_session_(std::move(other.map_id_to_session_))
+            , loot_gen_(std::move(other.loot_gen_))
+            , dog_retirement_time_(other.dog_retirement_time_) {
     }
 
+    // При загрузке: каталог публикуется заново на каждую карту
     void AddMap(Map map);
+    // Публикует новый каталог из maps с очередной версией; можно вызывать из любого потока.
+    // Сессии переходят на новые карты в ближайшем тике
+    void SetMaps(Maps maps);
 
-    const Maps& GetMaps() const noexcept {
-        return maps_;
+    // Текущий каталог; ссылки на карты действительны, пока держится указатель
+    CatalogPtr GetCatalog() const noexcept {
+        return catalog_.load(std::memory_order_acquire);
     }
 
-    const Map* FindMap(const Map::Id& id) const noexcept {
-        if (auto it = map_id_to_index_.find(id); it != map_id_to_index_.end()) {
-            return &maps_.at(it->second);
-        }
-        return nullptr;
-    }
-
-    Dog* FindDog(uint32_t dog_id) noexcept {
-        for (auto session : sessions_) {
-            Dog* dog = session.FindDog(dog_id);
-            if ( dog != nullptr ) {
-                return dog;
-            }
-        }
-        return nullptr;
+    // Карта текущего каталога; держит весь каталог
+    std::shared_ptr<const Map> FindMap(const Map::Id& id) const noexcept {
+        CatalogPtr catalog = GetCatalog();
+        const Map* map = catalog->FindMap(id);
+        return map != nullptr ? std::shared_ptr<const Map>(std::move(catalog), map) : nullptr;
     }
 
     //
-    GameSession* AddSession(const Map* map);
+    SessionHandle AddSession(std::shared_ptr<const Map> map);
 
     const Sessions& GetSessions() const noexcept {
         return sessions_;
     }
 
-    GameSession* FindSession(const Map::Id& id) noexcept {
+    // Пустая ссылка - сессии на этой карте нет
+    SessionHandle FindSession(const Map::Id& id) const noexcept {
         if (auto it = map_id_to_session_.find(id); it != map_id_to_session_.end()) {
-            return &sessions_.at(it->second);
+            return it->second;
         }
-        return nullptr;
+        return {};
+    }
+
+    // nullptr - ссылка устарела
+    GameSession* GetSession(SessionHandle handle) noexcept { return sessions_.Get(handle); }
+    const GameSession* GetSession(SessionHandle handle) const noexcept { return sessions_.Get(handle); }
+    Dog* GetDog(DogRef ref) noexcept {
+        GameSession* session = GetSession(ref.session);
+        return session != nullptr ? session->GetDog(ref.dog) : nullptr;
+    }
+    const Dog* GetDog(DogRef ref) const noexcept {
+        const GameSession* session = GetSession(ref.session);
+        return session != nullptr ? session->GetDog(ref.dog) : nullptr;
     }
+    // Удаляет псов и освобождает опустевшие сессии; возвращает карты освобождённых сессий
+    std::vector<Map::Id> RemoveDogs(std::vector<DogRef> dogs);
 
     void Tick(uint64_t curr_time, uint32_t time_delta) {
+        SyncSessionMaps();
         for (auto& session : sessions_) {
             session.Tick(curr_time, time_delta, loot_gen_.Generate(std::chrono::milliseconds{time_delta}, session.GetLostsCount(), session.GetDogsCount()), dog_retirement_time_);
         }
@@ -613,13 +785,17 @@ public:
 
 private:
     using MapIdHasher = util::TaggedHasher<Map::Id>;
-    using MapIdToIndex = std::unordered_map<Map::Id, size_t, MapIdHasher>;
+    using MapIdToSession = std::unordered_map<Map::Id, SessionHandle, MapIdHasher>;
+
+    // Переводит сессии на карты нового каталога: совместимые сразу, остальные - когда опустеют.
+    // Сессия карты, убранной из каталога, доживает на старой карте: войти в неё уже нельзя
+    void SyncSessionMaps();
+
     //
-    Maps         maps_;
-    MapIdToIndex map_id_to_index_;
+    std::atomic<CatalogPtr> catalog_;
     //
-    Sessions     sessions_;
-    MapIdToIndex map_id_to_session_;
+    Sessions       sessions_;
+    MapIdToSession map_id_to_session_;
     //
     loot_gen::LootGenerator loot_gen_;
     uint32_t     dog_retirement_time_;
@@ -1,19 +1,250 @@
+#include <boost/json.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid_io.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
 #include <iostream>
 #include <string>
 
+#include "logger.h"
 #include "postgres.h"
 
 using pqxx::operator"" _zv;
 
 namespace postgres {
 
-Db::Db() {
-    auto conn = conn_pool_.GetConnection();
-    pqxx::work work{*conn};
+namespace {
+
+constexpr char INSERT_RETIRED[] = "insert_retired_players";
+constexpr char SELECT_RECORDS[] = "select_records";
+
+std::string GetDbUrl() {
+    const char* url = std::getenv("GAME_DB_URL");
+    return url != nullptr ? url : "";
+}
+
+// Ошибка в самих данных или запросе (SQLSTATE 22 - data_exception, 23 - integrity_constraint_violation,
+// 42 - синтаксис и доступ): пачка с такими данными не запишется никогда
+bool IsDataError(const pqxx::sql_error& ex) {
+    const std::string& state = ex.sqlstate();
+    return state.starts_with("22") || state.starts_with("23") || state.starts_with("42");
+}
+
+}  // namespace
+
+
+//// ConnectionPool ///////////////////////////////////////////////////////////////////////////////////
+ConnectionPool::ConnectionPool(size_t capacity, std::chrono::milliseconds acquire_timeout, ConnectionFactory connection_factory)
+    : capacity_(std::max<size_t>(1, capacity))
+    , acquire_timeout_(acquire_timeout)
+    , connection_factory_(std::move(connection_factory))
+    , idle_(capacity_)
+    , threads_(capacity_) {
+}
+
+ConnectionPool::~ConnectionPool() {
+    timers_.stop();
+    threads_.stop();
+    timers_.join();
+    threads_.join();
+}
+
+void ConnectionPool::WithConnection(const std::function<void(pqxx::connection&)>& fn) {
+    ConnectionPtr conn;
+    bool          validate = false;
+    {
+        // потоков столько же, сколько соединений, поэтому свободное соединение есть всегда
+        std::lock_guard lock{mutex_};
+        assert(!idle_.empty());
+        conn     = std::move(idle_.back().conn);
+        validate = metrics::Clock::now() - idle_.back().since > VALIDATE_IDLE;
+        idle_.pop_back();
+    }
+    try {
+        Revive(conn, validate);
+        fn(*conn);
+    } catch (const pqxx::broken_connection&) {
+        conn.reset();
+        std::lock_guard lock{mutex_};
+        idle_.push_back({nullptr});
+        throw;
+    } catch (...) {
+        // при неудачном подключении conn пуст - следующий запрос попробует снова
+        std::lock_guard lock{mutex_};
+        idle_.push_back({std::move(conn)});
+        throw;
+    }
+    std::lock_guard lock{mutex_};
+    idle_.push_back({std::move(conn)});
+}
+
+void ConnectionPool::Revive(ConnectionPtr& conn, bool validate) {
+    bool alive = conn && conn->is_open();
+    if ( alive && validate ) {
+        try {
+            pqxx::nontransaction{*conn}.exec("SELECT 1"_zv);
+        } catch (const pqxx::broken_connection&) {
+            alive = false;
+        }
+    }
+    if ( !alive ) {
+        if ( conn ) {
+            metrics::RecordDbReconnect();
+        }
+        conn.reset();
+        conn = connection_factory_();
+    }
+}
+
+
+//// RecordsWriter ////////////////////////////////////////////////////////////////////////////////////
+RecordsWriter::RecordsWriter(std::string db_url)
+    : db_url_(std::move(db_url))
+    , thread_([this] { Run(); }) {
+}
+
+RecordsWriter::~RecordsWriter() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    cond_var_.notify_one();
+    thread_.join();
+}
+
+void RecordsWriter::Push(std::vector<Row> rows) {
+    // тик без ушедших игроков не трогает очередь
+    if ( rows.empty() ) {
+        return;
+    }
+    size_t dropped = 0;
+    bool   batch_ready;
+    {
+        std::lock_guard lock{mutex_};
+        for (auto& row : rows) {
+            if ( queue_.size() >= MAX_QUEUE ) {
+                ++dropped;
+                continue;
+            }
+            queue_.push_back(std::move(row));
+        }
+        batch_ready = queue_.size() >= BATCH_SIZE;
+    }
+    if ( batch_ready ) {
+        cond_var_.notify_one();
+    }
+    if ( dropped != 0 ) {
+        Drop(dropped, "queue is full");
+    }
+}
+
+void RecordsWriter::Run() {
+    Batch    batch;
+    auto     backoff  = MIN_BACKOFF;
+    unsigned failures = 0;
+    std::unique_lock lock{mutex_};
+    while ( true ) {
+        if ( batch.Size() == 0 ) {
+            // ждём полной пачки, периода сброса или остановки
+            cond_var_.wait_for(lock, FLUSH_PERIOD, [this] {
+                return stop_ || queue_.size() >= BATCH_SIZE;
+            });
+            if ( queue_.empty() ) {
+                if ( stop_ ) {
+                    break;
+                }
+                continue;
+            }
+            while ( batch.Size() < BATCH_SIZE && !queue_.empty() ) {
+                auto& [name, score, play_time] = queue_.front();
+                batch.ids.push_back(boost::uuids::to_string(uuid_generator_()));
+                batch.names.push_back(std::move(name));
+                batch.scores.push_back(score);
+                batch.play_times.push_back(play_time);
+                queue_.pop_front();
+            }
+        }
+        const bool stopping = stop_;
+        lock.unlock();
+        const WriteResult result = Write(batch);
+        lock.lock();
+        if ( result != WriteResult::RETRY ) {
+            batch.Clear();
+            backoff  = MIN_BACKOFF;
+            failures = 0;
+            continue;
+        }
+        if ( stopping && ++failures >= SHUTDOWN_ATTEMPTS ) {
+            const size_t rows = batch.Size() + queue_.size();
+            queue_.clear();
+            lock.unlock();
+            Drop(rows, "database is unavailable at shutdown");
+            return;
+        }
+        cond_var_.wait_for(lock, backoff, [this] {
+            return stop_;
+        });
+        backoff = std::min(backoff * 2, MAX_BACKOFF);
+    }
+}
+
+RecordsWriter::WriteResult RecordsWriter::Write(const Batch& batch) {
+    const auto write_start = metrics::Clock::now();
+    try {
+        if ( !conn_ ) {
+            conn_ = std::make_unique<pqxx::connection>(db_url_);
+            conn_->prepare(INSERT_RETIRED, R"(
+                INSERT INTO retired_players (id, name, score, play_time_ms)
+                SELECT * FROM unnest($1::uuid[], $2::varchar[], $3::integer[], $4::integer[])
+                ON CONFLICT (id) DO NOTHING;
+            )"_zv);
+        }
+        pqxx::work work{*conn_};
+        work.exec_prepared(INSERT_RETIRED, batch.ids, batch.names, batch.scores, batch.play_times);
+        work.commit();
+    } catch (const pqxx::sql_error& ex) {
+        if ( IsDataError(ex) ) {
+            Drop(batch.Size(), ex.what());
+            return WriteResult::DROP;
+        }
+        // откат из-за сериализации или взаимоблокировки, отмена по statement_timeout, ожидание
+        // блокировки, нехватка ресурсов - проходят сами, соединение цело
+        return Retry(batch.Size(), ex.what());
+    } catch (const std::exception& ex) {
+        // соединение могло порваться - при повторе переподключаемся
+        conn_.reset();
+        return Retry(batch.Size(), ex.what());
+    }
+    metrics::RecordRecordsBatch(batch.Size(), metrics::MicrosecondsSince(write_start));
+    return WriteResult::OK;
+}
+
+RecordsWriter::WriteResult RecordsWriter::Retry(size_t rows, std::string_view what) {
+    metrics::RecordRecordsRetry();
+    boost::json::object data;
+    data["rows"] = rows;
+    data["what"] = what;
+    logger::LogJson("records write error", data);
+    return WriteResult::RETRY;
+}
+
+void RecordsWriter::Drop(size_t rows, std::string_view what) {
+    metrics::RecordRecordsDropped(rows);
+    boost::json::object data;
+    data["rows"] = rows;
+    data["what"] = what;
+    logger::LogJson("records dropped", data);
+}
+
+
+//// Db ///////////////////////////////////////////////////////////////////////////////////////////////
+Db::Db(size_t pool_size, std::chrono::milliseconds acquire_timeout) {
+    // схема создаётся до пула: запросы пула готовятся на каждом его соединении и требуют таблицу
+    pqxx::connection conn{GetDbUrl()};
+    pqxx::work work{conn};
     work.exec(R"(
         CREATE TABLE IF NOT EXISTS retired_players (
             id UUID CONSTRAINT retired_players_id_constraint PRIMARY KEY, 
@@ -22,33 +253,77 @@ Db::Db() {
             play_time_ms integer NOT NULL);
         )"_zv
     );
-    work.exec(R"(CREATE INDEX IF NOT EXISTS retired_players_multi_idx ON retired_players (score DESC, play_time_ms, name);)"_zv);
+    // имена сравниваются побайтно, как в leaderboard::Before: иначе страница на границе кэша таблицы
+    // рекордов повторит или пропустит игроков с равными очками и временем
+    work.exec(R"(DROP INDEX IF EXISTS retired_players_multi_idx;)"_zv);
+    work.exec(R"(CREATE INDEX IF NOT EXISTS retired_players_rank_idx ON retired_players (score DESC, play_time_ms, name COLLATE "C");)"_zv);
     work.commit();
+    conn_pool_ = std::make_unique<ConnectionPool>(pool_size, acquire_timeout, [] {
+        auto conn = std::make_unique<pqxx::connection>(GetDbUrl());
+        conn->prepare(SELECT_RECORDS,
+            "SELECT name, score, play_time_ms FROM retired_players ORDER BY score DESC, play_time_ms, name COLLATE \"C\" LIMIT $1 OFFSET $2"_zv);
+        return conn;
+    });
+    records_writer_ = std::make_unique<RecordsWriter>(GetDbUrl());
 }
 
-void Db::SaveRetiredPlayers(std::vector<std::tuple<std::string, int, int>> retired_players) {
-    auto conn = conn_pool_.GetConnection();
-    pqxx::work work{*conn};
-    for (const auto& retired_player : retired_players) {
-        auto id = boost::uuids::random_generator()();
-        work.exec_params(R"(
-                INSERT INTO retired_players (id, name, score, play_time_ms) VALUES ($1, $2, $3, $4);
-            )"_zv,
-            to_string(id), std::get<0>(retired_player), std::get<1>(retired_player), std::get<2>(retired_player)
-        );
+void Db::SaveRetiredPlayers(std::vector<Row> retired_players) {
+    if ( !records_writer_ ) {
+        return;
     }
-    work.commit();
+    records_writer_->Push(std::move(retired_players));
 }
 
-std::vector<std::tuple<std::string, int, int>> Db::ReadRetiredPlayers() {
-    auto conn = conn_pool_.GetConnection();
-    pqxx::read_transaction rt(*conn);
-    std::vector<std::tuple<std::string, int, int>> retired_players;
-    for (auto& [name, score, play_time] : rt.query<std::string, int, int>("SELECT name, score, play_time_ms FROM retired_players ORDER BY score DESC, play_time_ms, name"_zv)) {
-        retired_players.emplace_back(name, score, play_time);
+namespace {
+
+std::vector<Db::Row> SelectRecords(pqxx::connection& conn, size_t start, size_t max_items) {
+    pqxx::read_transaction rt(conn);
+    std::vector<Db::Row> retired_players;
+    const auto result = rt.exec_prepared(SELECT_RECORDS, static_cast<int64_t>(max_items), static_cast<int64_t>(start));
+    retired_players.reserve(result.size());
+    for (const auto& row : result) {
+        retired_players.emplace_back(row[0].as<std::string>(), row[1].as<int>(), row[2].as<int>());
     }
     rt.commit();
     return retired_players;
 }
 
+}  // namespace
+
+std::vector<Db::Row> Db::ReadRetiredPlayers(size_t start, size_t max_items) {
+    if ( !conn_pool_ ) {
+        return {};
+    }
+    return conn_pool_->Exec([start, max_items](pqxx::connection& conn) {
+        return SelectRecords(conn, start, max_items);
+    });
+}
+
+size_t Db::StreamRetiredPlayers(const std::function<void(Row)>& fn) {
+    if ( !conn_pool_ ) {
+        return 0;
+    }
+    return conn_pool_->Exec([&fn](pqxx::connection& conn) {
+        pqxx::read_transaction rt(conn);
+        size_t rows = 0;
+        for (const auto& [name, score, play_time] : rt.stream<std::string_view, int, int>(
+                 "SELECT name, score, play_time_ms FROM retired_players"_zv)) {
+            fn({std::string(name), score, play_time});
+            ++rows;
+        }
+        rt.commit();
+        return rows;
+    });
+}
+
+void Db::AsyncReadRetiredPlayers(size_t start, size_t max_items, ReadHandler handler) {
+    if ( !conn_pool_ ) {
+        handler(nullptr, {});
+        return;
+    }
+    conn_pool_->Async([start, max_items](pqxx::connection& conn) {
+        return SelectRecords(conn, start, max_items);
+    }, std::move(handler));
+}
+
 }  // namespace postgres
@@ -1,93 +1,225 @@
 #pragma once
 
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/uuid/random_generator.hpp>
+
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include <pqxx/pqxx>
 
+#include "metrics.h"
+
 namespace postgres {
 
+namespace net = boost::asio;
+namespace sys = boost::system;
+
 //// ConnectionPool ///////////////////////////////////////////////////////////////////////////////////
+// libpqxx блокирует поток на всё время запроса, поэтому запросы выполняются не в потоках io_context,
+// а в собственных потоках пула - по одному на соединение. Запрос ждёт свободное соединение не дольше
+// acquire_timeout: по таймауту его обработчик получает AcquireTimeout, а сам запрос не выполняется.
+// Таймеры ожидания живут в отдельном потоке - потоки запросов как раз заняты, когда они срабатывают.
+// Соединения открываются при первом использовании; закрытое или оборванное во время запроса
+// соединение выбрасывается и открывается заново фабрикой, которая заодно готовит на нём
+// подготовленные запросы - по одному разу на соединение. Соединение, простоявшее без дела дольше
+// VALIDATE_IDLE, перед запросом проверяется SELECT 1: разрыв, о котором libpq ещё не знает
+// (перезапуск сервера, обрыв по таймауту простоя), стоит переподключения, а не ошибки запроса.
 class ConnectionPool {
-    using PoolType      = ConnectionPool;
-    using ConnectionPtr = std::shared_ptr<pqxx::connection>;
-
 public:
-    class ConnectionWrapper {
-    public:
-        ConnectionWrapper(std::shared_ptr<pqxx::connection>&& conn, PoolType& pool) noexcept
-            : conn_{std::move(conn)}
-            , pool_{&pool} {
-        }
+    using ConnectionPtr     = std::unique_ptr<pqxx::connection>;
+    using ConnectionFactory = std::function<ConnectionPtr()>;
 
-        ConnectionWrapper(const ConnectionWrapper&) = delete;
-        ConnectionWrapper& operator=(const ConnectionWrapper&) = delete;
+    struct AcquireTimeout : std::runtime_error {
+        AcquireTimeout() : std::runtime_error("database connection wait timed out") { }
+    };
 
-        ConnectionWrapper(ConnectionWrapper&&) = default;
-        ConnectionWrapper& operator=(ConnectionWrapper&&) = default;
+    constexpr static std::chrono::seconds VALIDATE_IDLE{30};
 
-        pqxx::connection& operator*() const& noexcept {
-            return *conn_;
-        }
-        pqxx::connection& operator*() const&& = delete;
+    ConnectionPool(size_t capacity, std::chrono::milliseconds acquire_timeout, ConnectionFactory connection_factory);
+    // ждёт выполнения начатых запросов, ещё не начатые отбрасываются
+    ~ConnectionPool();
 
-        pqxx::connection* operator->() const& noexcept {
-            return conn_.get();
-        }
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
 
-        ~ConnectionWrapper() {
-            if (conn_) {
-                pool_->ReturnConnection(std::move(conn_));
-            }
-        }
+    // fn(pqxx::connection&) выполняется в потоке пула, затем там же вызывается handler(error, result):
+    // error - исключение fn, AcquireTimeout или nullptr; при ошибке result сконструирован по умолчанию
+    template <typename Fn, typename Handler>
+    void Async(Fn&& fn, Handler&& handler);
+    // Блокирующий вариант - для старта сервера, пока не запущены потоки io_context
+    template <typename Fn>
+    std::invoke_result_t<Fn&, pqxx::connection&> Exec(Fn&& fn);
+
+    size_t GetPoolSize() const noexcept { return capacity_; }
 
-    private:
-        std::shared_ptr<pqxx::connection> conn_;
-        PoolType* pool_;
+private:
+    // Выдаёт соединение потоку пула, при необходимости переподключаясь, и возвращает его обратно;
+    // оборванное во время fn соединение не возвращается
+    void WithConnection(const std::function<void(pqxx::connection&)>& fn);
+    // Открытое соединение, живое по SELECT 1; иначе переподключается
+    void Revive(ConnectionPtr& conn, bool validate);
+
+    struct IdleConnection {
+        ConnectionPtr              conn;
+        metrics::Clock::time_point since = metrics::Clock::now();
     };
 
-    // ConnectionFactory is a functional object returning std::shared_ptr<pqxx::connection>
-    template <typename ConnectionFactory>
-    ConnectionPool(size_t capacity, ConnectionFactory&& connection_factory) {
-        pool_.reserve(capacity);
-        for (size_t i = 0; i < capacity; ++i) {
-            pool_.emplace_back(connection_factory());
+    const size_t                    capacity_;
+    const std::chrono::milliseconds acquire_timeout_;
+    ConnectionFactory               connection_factory_;
+    std::mutex                      mutex_;
+    std::vector<IdleConnection>     idle_;
+    net::thread_pool                threads_;
+    net::thread_pool                timers_{1};
+};
+
+template <typename Fn, typename Handler>
+void ConnectionPool::Async(Fn&& fn, Handler&& handler) {
+    using Result = std::invoke_result_t<Fn&, pqxx::connection&>;
+    // Запрос забирает тот, кто первым выставит taken: поток пула или таймер ожидания
+    struct Job {
+        Job(Fn&& fn, Handler&& handler, net::thread_pool& timers)
+            : fn(std::forward<Fn>(fn))
+            , handler(std::forward<Handler>(handler))
+            , timer(timers) {
         }
-    }
-
-    ConnectionWrapper GetConnection() {
-        std::unique_lock lock{mutex_};
-        // Блокируем текущий поток и ждём, пока cond_var_ не получит уведомление и не освободится
-        // хотя бы одно соединение
-        cond_var_.wait(lock, [this] {
-            return used_connections_ < pool_.size();
+
+        std::decay_t<Fn>           fn;
+        std::decay_t<Handler>      handler;
+        net::steady_timer          timer;
+        metrics::Clock::time_point start = metrics::Clock::now();
+        std::atomic<bool>          taken{false};
+    };
+    auto job = std::make_shared<Job>(std::forward<Fn>(fn), std::forward<Handler>(handler), timers_);
+    // ответит тот, кто первым выставит taken; таймер, проигравший потоку пула, отменяется в своём
+    // потоке, иначе он держал бы обработчик (а с ним сессию HTTP) до конца acquire_timeout
+    job->timer.expires_after(acquire_timeout_);
+    job->timer.async_wait([job](const sys::error_code& ec) {
+        if ( ec || job->taken.exchange(true) ) {
+            return;
+        }
+        metrics::RecordDbTimeout();
+        job->handler(std::make_exception_ptr(AcquireTimeout{}), Result{});
+    });
+    net::post(threads_, [this, job] {
+        if ( job->taken.exchange(true) ) {
+            return;
+        }
+        net::post(timers_, [job] {
+            job->timer.cancel();
         });
-        // После выхода из цикла ожидания мьютекс остаётся захваченным
+        metrics::RecordDbWait(metrics::MicrosecondsSince(job->start));
+        std::exception_ptr error;
+        Result             result{};
+        try {
+            WithConnection([&job, &result](pqxx::connection& conn) {
+                result = job->fn(conn);
+            });
+        } catch (...) {
+            error = std::current_exception();
+        }
+        job->handler(error, std::move(result));
+    });
+}
 
-        return {std::move(pool_[used_connections_++]), *this};
-    }
+template <typename Fn>
+std::invoke_result_t<Fn&, pqxx::connection&> ConnectionPool::Exec(Fn&& fn) {
+    using Result = std::invoke_result_t<Fn&, pqxx::connection&>;
+    std::promise<Result> promise;
+    auto future = promise.get_future();
+    Async(std::forward<Fn>(fn), [&promise](std::exception_ptr error, Result result) {
+        if ( error ) {
+            promise.set_exception(error);
+        } else {
+            promise.set_value(std::move(result));
+        }
+    });
+    return future.get();
+}
+
+
+//// RecordsWriter ////////////////////////////////////////////////////////////////////////////////////
+// Фоновая запись ушедших на покой игроков: тик только кладёт строки в ограниченную очередь.
+// Поток пишет их пачками одним подготовленным INSERT ... unnest, когда набралась пачка или прошёл
+// период сброса. Ошибка соединения - повтор той же пачки с растущей паузой и переподключением,
+// временная ошибка базы (откат сериализации, взаимоблокировка, таймаут) - повтор без него;
+// id строкам даётся один раз при формировании пачки, поэтому повтор после потерянного ответа на
+// COMMIT не создаст дублей. Ошибка в данных отбрасывает пачку. При переполнении очереди новые
+// строки отбрасываются - тик не ждёт базу ни при каких условиях.
+class RecordsWriter {
+public:
+    using Row = std::tuple<std::string, int, int>;
+
+    constexpr static size_t MAX_QUEUE  = 100000;
+    constexpr static size_t BATCH_SIZE = 500;
+    constexpr static std::chrono::milliseconds FLUSH_PERIOD{1000};
+    constexpr static std::chrono::milliseconds MIN_BACKOFF{100};
+    constexpr static std::chrono::milliseconds MAX_BACKOFF{10000};
+    // попыток записи остатка при остановке
+    constexpr static unsigned SHUTDOWN_ATTEMPTS = 3;
 
-    size_t GetPoolSize() { return pool_.size(); }
-    size_t GetUsed()     { return used_connections_; }
+    explicit RecordsWriter(std::string db_url);
+    // дописывает очередь и останавливает поток
+    ~RecordsWriter();
+
+    RecordsWriter(const RecordsWriter&) = delete;
+    RecordsWriter& operator=(const RecordsWriter&) = delete;
+
+    void Push(std::vector<Row> rows);
 
 private:
-    void ReturnConnection(ConnectionPtr&& conn) {
-        // Возвращаем соединение обратно в пул
-        {
-            std::lock_guard lock{mutex_};
-            assert(used_connections_ != 0);
-            pool_[--used_connections_] = std::move(conn);
+    // Пачка по столбцам - в таком виде она уходит параметрами-массивами
+    struct Batch {
+        std::vector<std::string> ids;
+        std::vector<std::string> names;
+        std::vector<int>         scores;
+        std::vector<int>         play_times;
+
+        size_t Size() const noexcept { return ids.size(); }
+        void Clear() {
+            ids.clear();
+            names.clear();
+            scores.clear();
+            play_times.clear();
         }
-        // Уведомляем один из ожидающих потоков об изменении состояния пула
-        cond_var_.notify_one();
-    }
-
-    std::mutex                 mutex_;
-    std::condition_variable    cond_var_;
-    std::vector<ConnectionPtr> pool_;
-    size_t                     used_connections_ = 0;
+    };
+
+    enum class WriteResult {
+        OK,
+        RETRY,
+        DROP
+    };
+
+    void Run();
+    WriteResult Write(const Batch& batch);
+    WriteResult Retry(size_t rows, std::string_view what);
+    void Drop(size_t rows, std::string_view what);
+
+    std::string                       db_url_;
+    std::unique_ptr<pqxx::connection> conn_;     // только в потоке записи
+    boost::uuids::random_generator    uuid_generator_;
+    //
+    std::mutex                        mutex_;
+    std::condition_variable           cond_var_;
+    std::deque<Row>                   queue_;
+    bool                              stop_ = false;
+    std::thread                       thread_;
 };
 
 
@@ -95,15 +227,36 @@ private:
 //constexpr const char DB_URL[]{"GAME_DB_URL"};
 
 class Db {
+    struct OfflineTag {
+        explicit OfflineTag() = default;
+    };
+
 public:
-    Db();
+    using Row         = std::tuple<std::string, int, int>;
+    using ReadHandler = std::function<void(std::exception_ptr error, std::vector<Row> rows)>;
+
+    // Без базы данных: рекорды не сохраняются, таблица рекордов пуста (для бенчмарков и утилит)
+    constexpr static OfflineTag OFFLINE{};
+
+    constexpr static size_t DEFAULT_POOL_SIZE = 2;
+    constexpr static std::chrono::milliseconds DEFAULT_ACQUIRE_TIMEOUT{1000};
+
+    explicit Db(size_t pool_size = DEFAULT_POOL_SIZE, std::chrono::milliseconds acquire_timeout = DEFAULT_ACQUIRE_TIMEOUT);
+    explicit Db(OfflineTag) noexcept { }
 
-    void SaveRetiredPlayers(std::vector<std::tuple<std::string, int, int>> retired_players);
-    std::vector<std::tuple<std::string, int, int>> ReadRetiredPlayers();
+    // Только ставит строки в очередь RecordsWriter
+    void SaveRetiredPlayers(std::vector<Row> retired_players);
+    // Страница таблицы рекордов в её порядке. Блокирует поток - только при старте сервера
+    std::vector<Row> ReadRetiredPlayers(size_t start, size_t max_items);
+    // То же без блокировки: handler вызывается в потоке пула соединений
+    void AsyncReadRetiredPlayers(size_t start, size_t max_items, ReadHandler handler);
+    // Вся таблица потоком COPY, строка за строкой и без сортировки: fn вызывается для каждой строки,
+    // таблица целиком в памяти не собирается. Возвращает число строк. Блокирует поток - только при старте
+    size_t StreamRetiredPlayers(const std::function<void(Row)>& fn);
 
 private:
-    const char* db_url_{std::getenv("GAME_DB_URL")};
-    ConnectionPool conn_pool_{1, [] { return std::make_shared<pqxx::connection>(std::getenv("GAME_DB_URL")); }};
+    std::unique_ptr<ConnectionPool> conn_pool_;
+    std::unique_ptr<RecordsWriter>  records_writer_;
 };
 
 }  // namespace postgres
@@ -0,0 +1,87 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace profiler {
+
+namespace {
+
+json::object PercentilesToJson(const RollingWindow::Percentiles& percentiles) {
+    json::object obj;
+    obj["p50"] = percentiles.p50;
+    obj["p90"] = percentiles.p90;
+    obj["p99"] = percentiles.p99;
+    obj["max"] = percentiles.max;
+    return obj;
+}
+
+uint32_t ClampUs(uint64_t us) {
+    return static_cast<uint32_t>(std::min<uint64_t>(us, std::numeric_limits<uint32_t>::max()));
+}
+
+}  // namespace
+
+
+//// RollingWindow ////////////////////////////////////////////////////////////////////////////////
+RollingWindow::Percentiles RollingWindow::GetPercentiles() const {
+    if ( count_ == 0 ) {
+        return { 0, 0, 0, 0 };
+    }
+    std::vector<uint32_t> sorted(values_.begin(), values_.begin() + count_);
+    std::sort(sorted.begin(), sorted.end());
+    auto at = [&sorted](double p) {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+    };
+    return { at(0.50), at(0.90), at(0.99), sorted.back() };
+}
+
+
+//// TickProfile //////////////////////////////////////////////////////////////////////////////////
+TickProfile::TickProfile(std::initializer_list<std::string_view> phase_names) {
+    for (auto name : phase_names) {
+        if ( phases_ == MAX_PHASES ) {
+            break;
+        }
+        names_[phases_++] = name;
+    }
+}
+
+void TickProfile::Commit(uint64_t total_us) {
+    {
+        std::lock_guard lock{mutex_};
+        for (size_t i = 0; i < phases_; ++i) {
+            windows_[i].Push(ClampUs(current_[i]));
+        }
+        total_.Push(ClampUs(total_us));
+        ++ticks_;
+    }
+    last_       = current_;
+    last_total_ = total_us;
+    current_.fill(0);
+}
+
+json::object TickProfile::LastToJson() const {
+    json::object obj;
+    obj["total"] = last_total_;
+    for (size_t i = 0; i < phases_; ++i) {
+        obj[names_[i]] = last_[i];
+    }
+    return obj;
+}
+
+json::object TickProfile::ToJson() const {
+    std::lock_guard lock{mutex_};
+    json::object phases;
+    for (size_t i = 0; i < phases_; ++i) {
+        phases[names_[i]] = PercentilesToJson(windows_[i].GetPercentiles());
+    }
+    json::object obj;
+    obj["ticks"]  = ticks_;
+    obj["total"]  = PercentilesToJson(total_.GetPercentiles());
+    obj["phases"] = phases;
+    return obj;
+}
+
+}  // namespace profiler
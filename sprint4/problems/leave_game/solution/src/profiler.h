@@ -0,0 +1,145 @@
+#pragma once
+
+#include <boost/json.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <mutex>
+#include <string_view>
+
+namespace profiler {
+
+namespace json = boost::json;
+
+using Clock = std::chrono::steady_clock;
+
+//// RollingWindow ////////////////////////////////////////////////////////////////////////////////
+// Последние SIZE значений (в микросекундах) для скользящих перцентилей
+class RollingWindow {
+public:
+    constexpr static size_t SIZE = 1024;
+
+    struct Percentiles {
+        uint32_t p50;
+        uint32_t p90;
+        uint32_t p99;
+        uint32_t max;
+    };
+
+    void Push(uint32_t us) noexcept {
+        values_[pos_] = us;
+        pos_   = (pos_ + 1) % SIZE;
+        count_ = std::min(count_ + 1, SIZE);
+    }
+
+    Percentiles GetPercentiles() const;
+
+private:
+    std::array<uint32_t, SIZE> values_{};
+    size_t                     pos_   = 0;
+    size_t                     count_ = 0;
+};
+
+
+//// TickProfile //////////////////////////////////////////////////////////////////////////////////
+// Время фаз тика: текущий тик набирается через Add() и фиксируется Commit().
+// Add() вызывается только из потока тика, Commit() и чтение статистики разделены мьютексом.
+class TickProfile {
+public:
+    constexpr static size_t MAX_PHASES = 8;
+
+    explicit TickProfile(std::initializer_list<std::string_view> phase_names);
+
+    TickProfile(const TickProfile&) = delete;
+    TickProfile& operator=(const TickProfile&) = delete;
+
+    void Add(size_t phase, uint64_t us) noexcept {
+        current_[phase] += us;
+    }
+    void Commit(uint64_t total_us);
+
+    // Разбивка последнего завершённого тика: {"total":..,"<phase>":..,...}, вызывается из потока тика
+    json::object LastToJson() const;
+    // {"ticks":..,"total":{"p50":..,"p90":..,"p99":..,"max":..},"phases":{"<phase>":{...},...}}
+    json::object ToJson() const;
+
+private:
+    std::array<std::string_view, MAX_PHASES> names_;
+    size_t                                   phases_ = 0;
+    std::array<uint64_t, MAX_PHASES>         current_{};
+    std::array<uint64_t, MAX_PHASES>         last_{};
+    uint64_t                                 last_total_ = 0;
+    //
+    mutable std::mutex                       mutex_;
+    std::array<RollingWindow, MAX_PHASES>    windows_;
+    RollingWindow                            total_;
+    uint64_t                                 ticks_ = 0;
+};
+
+
+//// ScopedTimer //////////////////////////////////////////////////////////////////////////////////
+class ScopedTimer {
+public:
+    ScopedTimer(TickProfile& profile, size_t phase) noexcept
+        : profile_(profile)
+        , phase_(phase)
+        , start_(Clock::now()) {
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        profile_.Add(phase_, std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start_).count());
+    }
+
+private:
+    TickProfile&      profile_;
+    size_t            phase_;
+    Clock::time_point start_;
+};
+
+
+//// PhaseTimer ///////////////////////////////////////////////////////////////////////////////////
+// Последовательные фазы одной функции: Next() закрывает текущую фазу и открывает следующую,
+// Stop() закрывает последнюю (иначе это сделает деструктор)
+class PhaseTimer {
+public:
+    PhaseTimer(TickProfile& profile, size_t phase) noexcept
+        : profile_(profile)
+        , phase_(phase)
+        , start_(Clock::now()) {
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+    ~PhaseTimer() {
+        Stop();
+    }
+
+    void Stop() noexcept {
+        if ( !stopped_ ) {
+            Next(phase_);
+            stopped_ = true;
+        }
+    }
+
+    void Next(size_t phase) noexcept {
+        const auto now = Clock::now();
+        profile_.Add(phase_, std::chrono::duration_cast<std::chrono::microseconds>(now - start_).count());
+        phase_ = phase;
+        start_ = now;
+    }
+
+private:
+    TickProfile&      profile_;
+    size_t            phase_;
+    Clock::time_point start_;
+    bool              stopped_ = false;
+};
+
+}  // namespace profiler
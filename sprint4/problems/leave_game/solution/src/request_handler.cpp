@@ -2,6 +2,19 @@
 
 namespace http_handler {
 
+void RequestHandler::Freeze() {
+    frozen_ = true;
+    while ( api_calls_ != 0 ) {
+        std::this_thread::yield();
+    }
+}
+
+StringResponse RequestHandler::Restarting(unsigned http_version) {
+    StringResponse response = Response::ServiceUnavailable("restarting"s, "Server is restarting, reconnect and retry"s, http_version, false);
+    response.set(http::field::retry_after, "0"sv);
+    return response;
+}
+
 // Возвращает true, если каталог path содержится внутри base.
 bool RequestHandler::IsSubPath(fs::path path) {
     // Проверяем, что все компоненты base содержатся внутри path
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
+
 #include "api_handler.h"
 #include "app.h"
 #include "http_server.h"
+#include "metrics.h"
 
 namespace http_handler {
 
 class RequestHandler : public std::enable_shared_from_this<RequestHandler>  {
+    constexpr static std::string_view METRICS = "/metrics"sv;
 public:
     using Strand = net::strand<net::io_context::executor_type>;
 
@@ -17,6 +22,11 @@ public:
         api_.SetDebugMode(debug_mode);
     }
 
+    // Передача состояния игры другому процессу: новые запросы к API получают 503 с просьбой
+    // переподключиться, Freeze возвращается, когда выполняемые сейчас запросы закончат работу
+    void Freeze();
+    void Unfreeze() { frozen_ = false; }
+
     RequestHandler(const RequestHandler&) = delete;
     RequestHandler& operator=(const RequestHandler&) = delete;
 
@@ -28,7 +38,30 @@ public:
         //
         StringResponse response;
         if ( api_.CanAccept(target) ) { // request to API /////////////////////////////////
-            response = api_.Response(req);  // without strand
+            // /records может ответить из потока пула соединений с базой
+            auto respond = [this, send](const StringRequest& req) {
+                ++api_calls_;
+                if ( frozen_ ) {
+                    --api_calls_;
+                    return send(Restarting(req.version()));
+                }
+                api_.Response(req, [send](StringResponse&& response) {
+                    send(std::move(response));
+                });
+                --api_calls_;
+            };
+            // Состояние игры принадлежит api_strand при любом режиме io: тик удаляет игроков, псов и
+            // сессии, и запрос из другого потока увидел бы их на полпути. Ответ возвращается в strand сессии
+            net::dispatch(api_strand_, [respond, req = StringRequest(std::move(req))] {
+                respond(req);
+            });
+            return;
+        } else if ( target == METRICS ) { // metrics for Prometheus ///////////////////////
+            if ( req.method() != http::verb::get && req.method() != http::verb::head ) {
+                response = Response::InvalidMethod("invalidMethod"s, "Only GET & HEAD methods are expected"s, "GET, HEAD"s, http_version, keep_alive);
+            } else {
+                response = Response::MakeResponse(http::status::ok, metrics::Serialize(), ContentType::PROMETHEUS, "no-cache"sv, ""sv, http_version, keep_alive);
+            }
         } else {                        // get static content /////////////////////////////
             std::string wanted_file = root_.string() + target;
             if ( target == "/" ) {
@@ -71,6 +104,9 @@ private:
 
     std::string GetMime(fs::path path);
 
+    // Состояние передаётся другому процессу; соединение закрываем, чтобы клиент пришёл к нему
+    static StringResponse Restarting(unsigned http_version);
+
     void DumpRequest(const StringRequest& req);
     void DumpResponse(const StringResponse& res);
 
@@ -78,6 +114,9 @@ private:
     Strand          api_strand_;
     ApiHandler      api_;
     const fs::path& root_;
+    // Freeze: флаг ставится до ожидания счётчика, запрос увеличивает счётчик до проверки флага
+    std::atomic<bool>     frozen_{false};
+    std::atomic<unsigned> api_calls_{0};
 };
 
 }  // namespace http_handler
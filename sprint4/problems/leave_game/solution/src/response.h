@@ -36,6 +36,7 @@ struct ContentType {
     constexpr static std::string_view APP_JSON   = "application/json"sv;
     constexpr static std::string_view TEXT_HTML  = "text/html"sv;
     constexpr static std::string_view TEXT_PLAIN = "text/plain"sv;
+    constexpr static std::string_view PROMETHEUS = "text/plain; version=0.0.4"sv;
     // При необходимости внутрь ContentType можно добавить и другие типы контента
 };
 
@@ -78,6 +79,12 @@ struct Response {
         result["message"] = message;
         return Response::MakeResponse(http::status::unauthorized, json::serialize(result), ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive);
     }
+    static StringResponse ServiceUnavailable(std::string code, std::string message, unsigned http_version, bool keep_alive) {
+        json::object result;
+        result["code"]    = code;
+        result["message"] = message;
+        return Response::MakeResponse(http::status::service_unavailable, json::serialize(result), ContentType::APP_JSON, "no-cache"sv, ""sv, http_version, keep_alive);
+    }
     //
     static StringResponse MakeResponse(
             http::status     status,
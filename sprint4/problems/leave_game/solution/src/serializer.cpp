@@ -1,19 +1,78 @@
 #include "serializer.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "logger.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "wal.h"
+
 namespace serialization {
 
+namespace {
+
+void ThrowErrno(const std::string& what, const std::string& file_name) {
+    throw std::runtime_error(what + " '" + file_name + "': " + std::strerror(errno));
+}
+
+// Записывает data в файл и дожидается, пока она окажется на диске
+void WriteFileSynced(const std::string& file_name, const std::string& data) {
+    const int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        ThrowErrno("Can't open state file", file_name);
+    }
+    size_t written = 0;
+    while ( written < data.size() ) {
+        const ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            ::close(fd);
+            ThrowErrno("Can't write state file", file_name);
+        }
+        written += static_cast<size_t>(n);
+    }
+    if ( ::fsync(fd) != 0 ) {
+        ::close(fd);
+        ThrowErrno("Can't sync state file", file_name);
+    }
+    ::close(fd);
+}
+
+// rename атомарен, но сам переход имени надёжен только после fsync каталога
+void SyncDirectory(const std::filesystem::path& file) {
+    const std::filesystem::path dir = file.has_parent_path() ? file.parent_path() : std::filesystem::path(".");
+    const int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if ( fd >= 0 ) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+}  // namespace
+
+void WriteSnapshot(const std::string& file_name, const StateImage& image) {
+    const auto save_start = metrics::Clock::now();
+    std::string new_file = file_name + ".new";
+    WriteFileSynced(new_file, EncodeSnapshot(image));
+    std::filesystem::rename(new_file, file_name);
+    SyncDirectory(file_name);
+    RemoveWalSegments(file_name, image.GetWalSeq());
+    metrics::RecordStateSave(metrics::MicrosecondsSince(save_start));
+}
+
 void SaveApp(app::Application& app) {
     std::string file_name = app.GetStateFile();
     if ( file_name.empty() ) {
         return;
     }
     //
-    std::string new_file = file_name + ".new";
-    std::ofstream ofs{new_file};
-    boost::archive::text_oarchive oa{ofs};
-    AppRepr app_repr(app);
-    oa << app_repr;
-    std::filesystem::rename(new_file, file_name);
+    WriteSnapshot(file_name, StateImage(app));
 }
 
 void RestoreApp(app::Application& app) {
@@ -21,15 +80,84 @@ void RestoreApp(app::Application& app) {
     if ( file_name.empty() ) {
         return;
     }
-    if ( !std::filesystem::exists(file_name) ) {
-        return;
+    uint64_t wal_seq = 0;
+    if ( std::filesystem::exists(file_name) && IsBinarySnapshot(file_name) ) {
+        wal_seq = LoadSnapshot(file_name, app);
+    } else if ( std::filesystem::exists(file_name) ) {
+        // текстовый архив прежних версий: читается один раз, следующий снимок будет бинарным
+        std::ifstream ifs{file_name};
+        boost::archive::text_iarchive ia{ifs};
+        AppRepr app_repr;
+        ia >> app_repr;
+        app_repr.Restore(app);
+        wal_seq = app_repr.GetWalSeq();
+    }
+    // изменения после снимка - из WAL
+    wal_seq = ReplayWal(file_name, wal_seq, app);
+    app.StartWal(wal_seq);
+}
+
+void RestoreAppFromSnapshot(app::Application& app, std::string_view snapshot) {
+    // снимок снят после последнего тика старого процесса, WAL за ним пуст
+    app.StartWal(LoadSnapshotData(snapshot, app));
+}
+
+
+//// StateSaver ///////////////////////////////////////////////////////////////////////////////////
+StateSaver::StateSaver(std::string file_name)
+    : file_name_(std::move(file_name))
+    , thread_([this] { Run(); }) {
+}
+
+StateSaver::~StateSaver() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    cond_var_.notify_one();
+    thread_.join();
+}
+
+void StateSaver::Post(StateImage image) {
+    {
+        std::lock_guard lock{mutex_};
+        pending_ = std::move(image);
+    }
+    cond_var_.notify_one();
+}
+
+void StateSaver::Flush() {
+    std::unique_lock lock{mutex_};
+    idle_cond_var_.wait(lock, [this] {
+        return !pending_ && !busy_;
+    });
+}
+
+void StateSaver::Run() {
+    std::unique_lock lock{mutex_};
+    while ( true ) {
+        cond_var_.wait(lock, [this] {
+            return stop_ || pending_;
+        });
+        if ( !pending_ ) {
+            break;      // stop_ и писать больше нечего
+        }
+        StateImage image = std::move(*pending_);
+        pending_.reset();
+        busy_ = true;
+        lock.unlock();
+        try {
+            WriteSnapshot(file_name_, image);
+        } catch (const std::exception& ex) {
+            boost::json::object data;
+            data["file"] = file_name_;
+            data["what"] = ex.what();
+            logger::LogJson("state save error", data);
+        }
+        lock.lock();
+        busy_ = false;
+        idle_cond_var_.notify_all();
     }
-    //
-   std::ifstream ifs{file_name};
-   boost::archive::text_iarchive ia{ifs};
-   AppRepr app_repr;
-   ia >> app_repr;
-   app_repr.Restore(app);
 }
 
 
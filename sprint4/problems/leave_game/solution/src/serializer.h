@@ -1,8 +1,14 @@
 #pragma once
 
+#include <condition_variable>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
+#include <string_view>
+#include <thread>
 
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
@@ -10,6 +16,7 @@
 #include <boost/serialization/deque.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/unordered_map.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "app.h"
 #include "model.h"
@@ -69,6 +76,9 @@ namespace app {
 
 namespace serialization {
 
+// Псы восстанавливаемого состояния по id: игрок находит своего пса без обхода сессий
+using DogIndex = std::unordered_map<uint32_t, model::DogRef>;
+
 //// model !!! //////////////////////////////////////////////////////////
 // DogRepr (DogRepresentation) - сериализованное представление класса Dog
 class DogRepr {
@@ -88,6 +98,7 @@ public:
         , bag_capacity_(dog.GetBagCapacity())
         , score_(dog.GetScore())
         , value_(dog.GetValue())
+        , bot_(dog.IsBot())
     { }
 
     [[nodiscard]] model::Dog Restore() const {
@@ -107,6 +118,7 @@ public:
         //
         dog.SetScore(score_);
         dog.SetValue(value_);
+        dog.SetBot(bot_);
         //
         return dog;
     }
@@ -125,10 +137,22 @@ public:
         ar & bag_capacity_;
         ar & score_;
         ar & value_;
+        if ( version >= 1 ) {
+            ar & bot_;
+        }
     }
 
     std::string GetName() const { return name_; }
     unsigned GetId() const { return id_; }
+    const model::Position& GetPosition() const noexcept { return pos_; }
+    const model::Position& GetStartPos() const noexcept { return start_pos_; }
+    const model::Speed& GetSpeed() const noexcept { return speed_; }
+    model::Direction GetDirection() const noexcept { return dir_; }
+    const model::Bag& GetBag() const noexcept { return bag_; }
+    size_t GetBagCapacity() const noexcept { return bag_capacity_; }
+    unsigned GetScore() const noexcept { return score_; }
+    unsigned GetValue() const noexcept { return value_; }
+    bool IsBot() const noexcept { return bot_; }
 
 private:
     std::string      name_;
@@ -142,6 +166,7 @@ private:
     size_t           bag_capacity_ = 0;
     unsigned         score_ = 0;
     unsigned         value_ = 0;
+    bool             bot_   = false;
 };
 //////
 
@@ -160,12 +185,13 @@ public:
         }
     }
 
-    void Restore(model::GameSession* session) const {
+    // handle - ссылка на session
+    void Restore(model::GameSession& session, model::SessionHandle handle, DogIndex& dogs) const {
         for (const auto& dog_repr : dogs_repr_) {
-            session->AddDog(dog_repr.Restore());
+            dogs[dog_repr.GetId()] = {handle, session.AddDog(dog_repr.Restore())};
         }
         for (const auto& lost_object : lost_objects_) {
-            session->AddLostObject(lost_object);
+            session.AddLostObject(lost_object);
         }
     }
 
@@ -177,6 +203,8 @@ public:
     }
 
     model::Map::Id GetSessionId() const noexcept { return map_id_; }
+    const std::vector<DogRepr>& GetDogs() const noexcept { return dogs_repr_; }
+    const std::vector<model::LostObject>& GetLostObjects() const noexcept { return lost_objects_; }
 
 private:
     std::vector<DogRepr>           dogs_repr_;
@@ -196,12 +224,8 @@ public:
         , session_id_(player.GetSessionId())
     { }
 
-    [[nodiscard]] app::Player Restore() const {
-        app::Player player{nullptr, nullptr};
-        //
-        player.SetDogId(dog_id_);
-        player.SetSessionId(session_id_);
-        return player;
+    [[nodiscard]] app::Player Restore(model::DogRef dog) const {
+        return app::Player{dog, dog_id_, session_id_};
     }
 
     template <typename Archive>
@@ -224,45 +248,47 @@ class AppRepr {
 public:
     AppRepr() = default;
 
-    explicit AppRepr(const app::Application& app) : dog_id_(app.GetDogId()) {
+    explicit AppRepr(const app::Application& app)
+        : dog_id_(app.GetDogId())
+        , wal_seq_(app.GetWalSeq())
+        , loot_id_(model::LostObject::CURR_ID)
+    {
         for (const auto& session : app.GetGame().GetSessions()) {
             sessions_repr_.push_back(GameSessionRepr(session));
         }
         for (const auto& player : app.GetPlayers().GetPlayers()) {
             players_repr_.push_back(PlayerRepr(player));
         }
-        for (const auto [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
-            token_to_index_[token] = index;
+        for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+            token_to_index_[token::ToString(token)] = index;
         }
     }
 
     void Restore(app::Application& app) const {
         model::Game& game = app.GetGame();
         app.SetDogId(dog_id_);
+        model::LostObject::CURR_ID = std::max(model::LostObject::CURR_ID, loot_id_);
+        DogIndex dogs;
         for (const auto& session_repr : sessions_repr_) {
-            const model::Map* map = game.FindMap(session_repr.GetSessionId());
+            auto map = game.FindMap(session_repr.GetSessionId());
             if ( map == nullptr ) {
                 std::string err = "Session: can't find map with id " + *session_repr.GetSessionId();
                 throw std::runtime_error(err);
             }
-            model::GameSession* session = game.AddSession(map);
-            session_repr.Restore(session);
+            const model::SessionHandle handle = game.AddSession(std::move(map));
+            session_repr.Restore(*game.GetSession(handle), handle, dogs);
         }
         for (const auto& player_repr : players_repr_) {
-            model::Dog* dog = game.FindDog(player_repr.GetDogId());
-            if ( dog == nullptr ) {
-                std::string err = "Player: can't find dog with id " + *player_repr.GetSessionId();
+            auto dog = dogs.find(player_repr.GetDogId());
+            if ( dog == dogs.end() ) {
+                std::string err = "Player: can't find dog with id " + std::to_string(player_repr.GetDogId());
                 throw std::runtime_error(err);
             }
-            model::GameSession* session = game.FindSession(player_repr.GetSessionId());
-            if ( session == nullptr ) {
+            if ( dog->second.session != game.FindSession(player_repr.GetSessionId()) ) {
                 std::string err = "Player: can't find session with id " + *player_repr.GetSessionId();
                 throw std::runtime_error(err);
             }
-            app::Player player(dog, session);
-            player.SetDogId(player_repr.GetDogId());
-            player.SetSessionId(player_repr.GetSessionId());
-            app.AddPlayer(player);
+            app.AddPlayer(player_repr.Restore(dog->second));
         }
         for (const auto [token, index] : token_to_index_) {
             app.AddPlayersTokenAndIndex(token, index);
@@ -275,21 +301,102 @@ public:
         ar & players_repr_;
         ar & token_to_index_;
         ar & dog_id_;
+        if ( version >= 1 ) {
+            ar & wal_seq_;
+        }
+        if ( version >= 2 ) {
+            ar & loot_id_;
+        }
     }
 
+    // последний тик, вошедший в снимок; WAL применяется с тика после него
+    uint64_t GetWalSeq() const noexcept { return wal_seq_; }
+    // for binary snapshot
+    const std::vector<GameSessionRepr>& GetSessions() const noexcept { return sessions_repr_; }
+    const std::vector<PlayerRepr>& GetPlayers() const noexcept { return players_repr_; }
+    const std::unordered_map<std::string, size_t>& GetTokenToIndex() const noexcept { return token_to_index_; }
+    uint32_t GetDogId() const noexcept { return dog_id_; }
+    unsigned GetLootId() const noexcept { return loot_id_; }
+
 private:
     std::vector<GameSessionRepr>            sessions_repr_;
     std::vector<PlayerRepr>                 players_repr_;
     std::unordered_map<std::string, size_t> token_to_index_;
     uint32_t                                dog_id_;
+    uint64_t                                wal_seq_ = 0;
+    unsigned                                loot_id_ = 0;   // следующий id предмета
 };
 //////
 
 
+//// StateImage ///////////////////////////////////////////////////////////////////////////////////
+// Плоский образ состояния для бинарного снимка: записи фиксированной длины и общий буфер строк.
+// Снимается в тике без копирования объектов модели (в отличие от AppRepr - ни одной аллокации
+// на пса или предмет), раскладывается по секциям файла уже в потоке StateSaver.
+class StateImage {
+public:
+    explicit StateImage(const app::Application& app);
+    StateImage(StateImage&&) noexcept;
+    StateImage& operator=(StateImage&&) noexcept;
+    ~StateImage();
+
+    uint64_t GetWalSeq() const noexcept;
+    // Содержимое файла снимка (формат - в snapshot.h)
+    std::string Encode() const;
+
+private:
+    struct Records;
+    std::unique_ptr<Records> records_;
+};
+//////
+
+
+// Синхронное сохранение: бинарный снимок во временный файл, fsync и rename
 void SaveApp(app::Application& app);
+// Последний снимок и хвост WAL после него, затем запуск WAL приложения
 void RestoreApp(app::Application& app);
+// Бинарный снимок из памяти вместо файла и WAL, затем запуск WAL приложения
+void RestoreAppFromSnapshot(app::Application& app, std::string_view snapshot);
+// После записи снимка удаляет вошедшие в него сегменты WAL
+void WriteSnapshot(const std::string& file_name, const StateImage& image);
+
+
+//// StateSaver ///////////////////////////////////////////////////////////////////////////////////
+// Фоновая запись снимков: тик только снимает плоский образ StateImage и отдаёт его сюда,
+// кодирование и работа с диском идут в отдельном потоке. Если предыдущий снимок ещё пишется,
+// новый заменяет ожидающий - на диск всегда попадает самое свежее состояние.
+class StateSaver {
+public:
+    explicit StateSaver(std::string file_name);
+    // дописывает ожидающий снимок и останавливает поток
+    ~StateSaver();
+
+    StateSaver(const StateSaver&) = delete;
+    StateSaver& operator=(const StateSaver&) = delete;
+
+    void Post(StateImage image);
+    // Ждёт, пока все отданные снимки будут записаны
+    void Flush();
+
+private:
+    void Run();
+
+    std::string             file_name_;
+    std::mutex              mutex_;
+    std::condition_variable cond_var_;
+    std::condition_variable idle_cond_var_;
+    std::optional<StateImage> pending_;
+    bool                    busy_ = false;
+    bool                    stop_ = false;
+    std::thread             thread_;
+};
 
 void TestVectorDogsReps(std::ostream& os, std::string file_name);
 void TestPlayersReps(const app::Application& app, std::ostream& os, const std::string file_name);
 
 }  // namespace serialization
+
+// 1 - номер тика WAL в снимке, 2 - следующий id предмета
+BOOST_CLASS_VERSION(::serialization::AppRepr, 2)
+// 1 - флаг серверного бота
+BOOST_CLASS_VERSION(::serialization::DogRepr, 1)
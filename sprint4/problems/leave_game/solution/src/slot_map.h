@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+//// Handle ///////////////////////////////////////////////////////////////////////////////////////
+// Ссылка на элемент SlotMap<T>: номер ячейки и её поколение. При удалении элемента поколение
+// ячейки растёт, поэтому старая ссылка не найдёт того, кто займёт ячейку после него
+template <typename T>
+struct Handle {
+    constexpr static uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index      = NONE;
+    uint32_t generation = 0;
+
+    bool IsNull() const noexcept { return index == NONE; }
+    bool operator==(const Handle&) const = default;
+};
+
+
+//// SlotMap //////////////////////////////////////////////////////////////////////////////////////
+// Элементы лежат подряд в порядке добавления, обход по ним - обход vector. Ячейки связывают
+// ссылки с текущим местом элемента. Удаление пачкой сдвигает оставшиеся за один проход без
+// перестановок: места элементов меняются, порядок и ссылки на них - нет. Указатели на элементы
+// действительны только до следующего добавления или удаления, между тиками храним ссылки
+template <typename T>
+class SlotMap {
+public:
+    using Handle         = util::Handle<T>;
+    using iterator       = typename std::vector<T>::iterator;
+    using const_iterator = typename std::vector<T>::const_iterator;
+
+    template <typename... Args>
+    Handle Emplace(Args&&... args) {
+        uint32_t index;
+        if ( free_.empty() ) {
+            if ( slots_.size() >= Handle::NONE ) {
+                throw std::length_error("SlotMap: too many slots");
+            }
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        } else {
+            index = free_.back();
+            free_.pop_back();
+        }
+        values_.emplace_back(std::forward<Args>(args)...);
+        slot_of_.push_back(index);
+        slots_[index].pos = static_cast<uint32_t>(values_.size() - 1);
+        return {index, slots_[index].generation};
+    }
+
+    // nullptr - ссылка пустая или устарела
+    T* Get(Handle handle) noexcept {
+        const uint32_t pos = Find(handle);
+        return pos != Handle::NONE ? &values_[pos] : nullptr;
+    }
+    const T* Get(Handle handle) const noexcept {
+        const uint32_t pos = Find(handle);
+        return pos != Handle::NONE ? &values_[pos] : nullptr;
+    }
+    bool Contains(Handle handle) const noexcept { return Find(handle) != Handle::NONE; }
+
+    // Устаревшие ссылки пропускаются; возвращает число удалённых
+    size_t Erase(std::span<const Handle> handles) {
+        std::vector<bool> removed(values_.size(), false);
+        for (const Handle handle : handles) {
+            if ( const uint32_t pos = Find(handle); pos != Handle::NONE ) {
+                removed[pos] = true;
+            }
+        }
+        return Compact(removed);
+    }
+    template <typename Predicate>
+    size_t EraseIf(Predicate pred) {
+        std::vector<bool> removed(values_.size(), false);
+        for (size_t pos = 0; pos < values_.size(); ++pos) {
+            removed[pos] = pred(std::as_const(values_[pos]));
+        }
+        return Compact(removed);
+    }
+
+    // Ссылка на элемент, стоящий на месте pos
+    Handle GetHandle(size_t pos) const {
+        const uint32_t index = slot_of_.at(pos);
+        return {index, slots_[index].generation};
+    }
+
+    size_t Size() const noexcept { return values_.size(); }
+    bool Empty() const noexcept { return values_.empty(); }
+    void Reserve(size_t size) {
+        values_.reserve(size);
+        slot_of_.reserve(size);
+        slots_.reserve(size);
+    }
+
+    T& operator[](size_t pos) { return values_[pos]; }
+    const T& operator[](size_t pos) const { return values_[pos]; }
+    T& Front() { return values_.front(); }
+    const T& Front() const { return values_.front(); }
+
+    iterator begin() noexcept { return values_.begin(); }
+    iterator end() noexcept { return values_.end(); }
+    const_iterator begin() const noexcept { return values_.begin(); }
+    const_iterator end() const noexcept { return values_.end(); }
+
+private:
+    constexpr static size_t SHRINK_RATIO = 4;
+
+    struct Slot {
+        uint32_t generation = 0;
+        uint32_t pos        = Handle::NONE;     // место элемента; NONE - ячейка свободна
+    };
+
+    size_t Compact(const std::vector<bool>& removed) {
+        size_t kept = 0;
+        for (size_t pos = 0; pos < values_.size(); ++pos) {
+            const uint32_t index = slot_of_[pos];
+            if ( removed[pos] ) {
+                slots_[index].pos = Handle::NONE;
+                ++slots_[index].generation;
+                free_.push_back(index);
+                continue;
+            }
+            if ( kept != pos ) {
+                values_[kept]  = std::move(values_[pos]);
+                slot_of_[kept] = index;
+            }
+            slots_[index].pos = static_cast<uint32_t>(kept++);
+        }
+        const size_t erased = values_.size() - kept;
+        values_.erase(values_.begin() + kept, values_.end());
+        slot_of_.resize(kept);
+        // после ухода большинства элементов память возвращается; ячейки остаются - на них ссылки
+        if ( kept < values_.capacity() / SHRINK_RATIO ) {
+            values_.shrink_to_fit();
+            slot_of_.shrink_to_fit();
+        }
+        return erased;
+    }
+
+    uint32_t Find(Handle handle) const noexcept {
+        if ( handle.index >= slots_.size() ) {
+            return Handle::NONE;
+        }
+        const Slot& slot = slots_[handle.index];
+        return slot.generation == handle.generation ? slot.pos : Handle::NONE;
+    }
+
+    std::vector<T>        values_;
+    std::vector<uint32_t> slot_of_;     // ячейка элемента по его месту
+    std::vector<Slot>     slots_;
+    std::vector<uint32_t> free_;
+};
+
+}  // namespace util
@@ -0,0 +1,454 @@
+#include "snapshot.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+
+namespace serialization {
+
+using namespace std::literals;
+
+namespace {
+
+constexpr char MAGIC[8] = { 'G', 'S', 'N', 'A', 'P', 'S', 'H', 'T' };
+
+enum SectionType : uint32_t {
+    STRINGS = 1,
+    SESSIONS,
+    DOGS,
+    BAG_ITEMS,
+    LOOT,
+    PLAYERS,
+    TOKENS,
+    SECTION_COUNT = TOKENS
+};
+
+struct FileHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t section_count;
+    uint64_t wal_seq;
+    uint32_t dog_id;
+    uint32_t loot_id;
+};
+
+struct SectionEntry {
+    uint32_t type;
+    uint32_t record_size;
+    uint64_t count;
+    uint64_t offset;
+};
+
+// Строка в секции STRINGS
+struct StrRef {
+    uint32_t offset;
+    uint32_t size;
+};
+
+struct SessionRecord {
+    StrRef   map_id;
+    uint32_t first_dog;
+    uint32_t dog_count;
+    uint32_t first_loot;
+    uint32_t loot_count;
+};
+
+enum DogFlags : uint32_t {
+    DOG_BOT = 1
+};
+
+struct DogRecord {
+    uint32_t id;
+    uint32_t dir;
+    StrRef   name;
+    double   x, y;
+    double   start_x, start_y;
+    double   sx, sy;
+    uint64_t bag_capacity;
+    uint32_t score;
+    uint32_t value;
+    uint32_t first_bag_item;
+    uint32_t bag_item_count;
+    uint32_t flags;
+    uint32_t reserved;
+};
+
+// Запись пса в снимках версии 1 - начало DogRecord без флагов
+struct DogRecordV1 {
+    char data[offsetof(DogRecord, flags)];
+};
+
+struct BagItemRecord {
+    uint64_t id;
+    uint32_t type;
+    uint32_t reserved;
+};
+
+struct LootRecord {
+    uint32_t id;
+    uint32_t type;
+    double   x, y;
+};
+
+struct PlayerRecord {
+    uint32_t dog_id;
+    uint32_t reserved;
+    StrRef   session_id;
+};
+
+struct TokenRecord {
+    StrRef   token;
+    uint64_t index;
+};
+
+static_assert(sizeof(FileHeader) == 32 && sizeof(SectionEntry) == 24);
+static_assert(sizeof(SessionRecord) == 24 && sizeof(DogRecord) == 96 && sizeof(BagItemRecord) == 16);
+static_assert(sizeof(DogRecordV1) == 88);
+
+DogRecord UpgradeDogRecord(const DogRecordV1& old) {
+    DogRecord record{};
+    std::memcpy(&record, old.data, sizeof(old.data));
+    return record;
+}
+static_assert(sizeof(LootRecord) == 24 && sizeof(PlayerRecord) == 16 && sizeof(TokenRecord) == 16);
+
+size_t Align(size_t offset) {
+    return (offset + 7) & ~size_t{7};
+}
+
+
+//// Encoder //////////////////////////////////////////////////////////////////////////////////////
+// Раскладывает готовые записи образа по секциям файла
+class Encoder {
+public:
+    explicit Encoder(const FileHeader& header) {
+        out_.assign(sizeof(FileHeader) + SECTION_COUNT * sizeof(SectionEntry), '\0');
+        std::memcpy(out_.data(), &header, sizeof(header));
+    }
+
+    template <typename Record>
+    void PutSection(SectionType type, const std::vector<Record>& records) {
+        PutSection(type, sizeof(Record), records.size(), records.data());
+    }
+
+    void PutSection(SectionType type, uint32_t record_size, uint64_t count, const void* data) {
+        const SectionEntry entry{type, record_size, count, Align(out_.size())};
+        std::memcpy(out_.data() + sizeof(FileHeader) + (type - 1) * sizeof(SectionEntry), &entry, sizeof(entry));
+        out_.resize(entry.offset);
+        out_.append(static_cast<const char*>(data), record_size * count);
+    }
+
+    std::string Release() {
+        return std::move(out_);
+    }
+
+private:
+    std::string out_;
+};
+
+
+//// MappedFile ///////////////////////////////////////////////////////////////////////////////////
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& file_name) {
+        const int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if ( fd < 0 ) {
+            throw std::runtime_error("Can't open state file '"s + file_name + "': "s + std::strerror(errno));
+        }
+        struct stat st{};
+        if ( ::fstat(fd, &st) != 0 ) {
+            ::close(fd);
+            throw std::runtime_error("Can't stat state file '"s + file_name + "': "s + std::strerror(errno));
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if ( size_ > 0 ) {
+            void* data = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if ( data == MAP_FAILED ) {
+                ::close(fd);
+                throw std::runtime_error("Can't map state file '"s + file_name + "': "s + std::strerror(errno));
+            }
+            data_ = static_cast<const char*>(data);
+            ::madvise(data, size_, MADV_SEQUENTIAL | MADV_WILLNEED);
+        }
+        ::close(fd);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if ( data_ != nullptr ) {
+            ::munmap(const_cast<char*>(data_), size_);
+        }
+    }
+
+    const char* GetData() const noexcept { return data_; }
+    size_t GetSize() const noexcept { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    size_t      size_ = 0;
+};
+
+
+//// Decoder //////////////////////////////////////////////////////////////////////////////////////
+// Проверяет границы всех ссылок: испорченный файл - исключение, а не чтение мимо отображения
+class Decoder {
+public:
+    Decoder(const char* data, size_t size) : data_(data), size_(size) {
+        if ( size_ < sizeof(FileHeader) || std::memcmp(data_, MAGIC, sizeof(MAGIC)) != 0 ) {
+            throw std::runtime_error("State file is not a binary snapshot"s);
+        }
+        std::memcpy(&header_, data_, sizeof(header_));
+        if ( header_.version < SNAPSHOT_MIN_VERSION || header_.version > SNAPSHOT_VERSION ) {
+            throw std::runtime_error("Unsupported state file version "s + std::to_string(header_.version)
+                                     + ", expected "s + std::to_string(SNAPSHOT_MIN_VERSION) + ".."s + std::to_string(SNAPSHOT_VERSION));
+        }
+        if ( header_.section_count < SECTION_COUNT
+             || size_ < sizeof(FileHeader) + uint64_t{header_.section_count} * sizeof(SectionEntry) ) {
+            throw std::runtime_error("State file: broken section table"s);
+        }
+        for (uint32_t i = 0; i < SECTION_COUNT; ++i) {
+            std::memcpy(&sections_[i], data_ + sizeof(FileHeader) + i * sizeof(SectionEntry), sizeof(SectionEntry));
+            const SectionEntry& entry = sections_[i];
+            if ( entry.type != i + 1 || entry.offset > size_ || entry.count > (size_ - entry.offset) / std::max(1u, entry.record_size) ) {
+                throw std::runtime_error("State file: broken section "s + std::to_string(i + 1));
+            }
+        }
+        strings_ = std::string_view(data_ + sections_[STRINGS - 1].offset, sections_[STRINGS - 1].count);
+    }
+
+    const FileHeader& GetHeader() const noexcept { return header_; }
+
+    template <typename Record>
+    uint64_t GetCount(SectionType type) const {
+        const SectionEntry& entry = sections_[type - 1];
+        if ( entry.record_size != sizeof(Record) ) {
+            throw std::runtime_error("State file: wrong record size in section "s + std::to_string(type));
+        }
+        return entry.count;
+    }
+
+    template <typename Record>
+    Record Get(SectionType type, uint64_t index) const {
+        static_assert(std::is_trivially_copyable_v<Record>);
+        Record record;
+        std::memcpy(&record, data_ + sections_[type - 1].offset + index * sizeof(Record), sizeof(Record));
+        return record;
+    }
+
+    std::string_view GetString(StrRef ref) const {
+        if ( ref.offset > strings_.size() || ref.size > strings_.size() - ref.offset ) {
+            throw std::runtime_error("State file: broken string reference"s);
+        }
+        return strings_.substr(ref.offset, ref.size);
+    }
+
+private:
+    const char*      data_;
+    size_t           size_;
+    FileHeader       header_{};
+    SectionEntry     sections_[SECTION_COUNT]{};
+    std::string_view strings_;
+};
+
+void CheckRange(uint64_t first, uint64_t count, uint64_t total, std::string_view what) {
+    if ( first > total || count > total - first ) {
+        throw std::runtime_error("State file: broken "s + std::string(what) + " range"s);
+    }
+}
+
+}  // namespace
+
+
+//// StateImage ///////////////////////////////////////////////////////////////////////////////////
+struct StateImage::Records {
+    StrRef AddString(std::string_view str) {
+        const StrRef ref{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size())};
+        strings += str;
+        return ref;
+    }
+
+    FileHeader                 header{};
+    std::string                strings;
+    std::vector<SessionRecord> sessions;
+    std::vector<DogRecord>     dogs;
+    std::vector<BagItemRecord> bag_items;
+    std::vector<LootRecord>    loot;
+    std::vector<PlayerRecord>  players;
+    std::vector<TokenRecord>   tokens;
+};
+
+StateImage::StateImage(const app::Application& app)
+    : records_(std::make_unique<Records>()) {
+    Records& r = *records_;
+    std::memcpy(r.header.magic, MAGIC, sizeof(MAGIC));
+    r.header.version       = SNAPSHOT_VERSION;
+    r.header.section_count = SECTION_COUNT;
+    r.header.wal_seq       = app.GetWalSeq();
+    r.header.dog_id        = app.GetDogId();
+    r.header.loot_id       = model::LostObject::CURR_ID;
+
+    for (const auto& session : app.GetGame().GetSessions()) {
+        const auto& lost_objects = session.GetLostObjects();
+        r.sessions.push_back({r.AddString(*session.GetMapId()),
+                              static_cast<uint32_t>(r.dogs.size()), static_cast<uint32_t>(session.GetDogs().Size()),
+                              static_cast<uint32_t>(r.loot.size()), static_cast<uint32_t>(lost_objects.size())});
+        for (const auto& dog : session.GetDogs()) {
+            const auto& pos   = dog.GetPosition();
+            const auto& start = dog.GetStartPos();
+            const auto& speed = dog.GetSpeed();
+            const auto& bag   = dog.GetBag();
+            r.dogs.push_back({dog.GetId(), static_cast<uint32_t>(dog.GetDirection()), r.AddString(dog.GetName()),
+                              pos.x, pos.y, start.x, start.y, speed.sx, speed.sy,
+                              dog.GetBagCapacity(), dog.GetScore(), dog.GetValue(),
+                              static_cast<uint32_t>(r.bag_items.size()), static_cast<uint32_t>(bag.size()),
+                              dog.IsBot() ? uint32_t{DOG_BOT} : 0u, 0});
+            for (const auto& bag_item : bag) {
+                r.bag_items.push_back({bag_item.id_, bag_item.type_, 0});
+            }
+        }
+        for (const auto& lost_object : lost_objects) {
+            r.loot.push_back({lost_object.id_, lost_object.type_, lost_object.position_.x, lost_object.position_.y});
+        }
+    }
+    for (const auto& player : app.GetPlayers().GetPlayers()) {
+        r.players.push_back({player.GetDogId(), 0, r.AddString(*player.GetSessionId())});
+    }
+    for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+        r.tokens.push_back({r.AddString(token::ToString(token)), index});
+    }
+}
+
+StateImage::StateImage(StateImage&&) noexcept = default;
+StateImage& StateImage::operator=(StateImage&&) noexcept = default;
+StateImage::~StateImage() = default;
+
+uint64_t StateImage::GetWalSeq() const noexcept {
+    return records_->header.wal_seq;
+}
+
+std::string StateImage::Encode() const {
+    const Records& r = *records_;
+    Encoder encoder(r.header);
+    encoder.PutSection(STRINGS, 1, r.strings.size(), r.strings.data());
+    encoder.PutSection(SESSIONS, r.sessions);
+    encoder.PutSection(DOGS, r.dogs);
+    encoder.PutSection(BAG_ITEMS, r.bag_items);
+    encoder.PutSection(LOOT, r.loot);
+    encoder.PutSection(PLAYERS, r.players);
+    encoder.PutSection(TOKENS, r.tokens);
+    return encoder.Release();
+}
+
+
+std::string EncodeSnapshot(const StateImage& image) {
+    return image.Encode();
+}
+
+bool IsBinarySnapshot(const std::string& file_name) {
+    std::ifstream ifs{file_name, std::ios::binary};
+    char magic[sizeof(MAGIC)]{};
+    ifs.read(magic, sizeof(magic));
+    return ifs && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+uint64_t LoadSnapshot(const std::string& file_name, app::Application& app) {
+    MappedFile file(file_name);
+    return LoadSnapshotData(std::string_view(file.GetData(), file.GetSize()), app);
+}
+
+uint64_t LoadSnapshotData(std::string_view data, app::Application& app) {
+    Decoder decoder(data.data(), data.size());
+    model::Game& game = app.GetGame();
+
+    const uint64_t session_count  = decoder.GetCount<SessionRecord>(SESSIONS);
+    // в снимках версии 1 у псов нет флагов
+    const bool     dog_flags      = decoder.GetHeader().version >= 2;
+    const uint64_t dog_count      = dog_flags ? decoder.GetCount<DogRecord>(DOGS) : decoder.GetCount<DogRecordV1>(DOGS);
+    const uint64_t bag_item_count = decoder.GetCount<BagItemRecord>(BAG_ITEMS);
+    const uint64_t loot_count     = decoder.GetCount<LootRecord>(LOOT);
+    const uint64_t player_count   = decoder.GetCount<PlayerRecord>(PLAYERS);
+    const uint64_t token_count    = decoder.GetCount<TokenRecord>(TOKENS);
+
+    DogIndex dogs;
+    dogs.reserve(dog_count);
+    for (uint64_t s = 0; s < session_count; ++s) {
+        const auto session_record = decoder.Get<SessionRecord>(SESSIONS, s);
+        const model::Map::Id map_id{std::string(decoder.GetString(session_record.map_id))};
+        auto map = game.FindMap(map_id);
+        if ( map == nullptr ) {
+            throw std::runtime_error("Session: can't find map with id "s + *map_id);
+        }
+        const model::SessionHandle handle = game.AddSession(std::move(map));
+        model::GameSession& session = *game.GetSession(handle);
+
+        CheckRange(session_record.first_dog, session_record.dog_count, dog_count, "dogs"sv);
+        for (uint64_t d = session_record.first_dog; d < session_record.first_dog + session_record.dog_count; ++d) {
+            const DogRecord record = dog_flags ? decoder.Get<DogRecord>(DOGS, d) : UpgradeDogRecord(decoder.Get<DogRecordV1>(DOGS, d));
+            model::Dog dog{std::string(decoder.GetString(record.name)), record.id};
+            dog.SetPosition({record.x, record.y});
+            dog.SetStartPos({record.start_x, record.start_y});
+            dog.SetSpeed(model::Speed{record.sx, record.sy});
+            dog.SetDirection(static_cast<model::Direction>(record.dir));
+            dog.SetBagCapacity(record.bag_capacity);
+            CheckRange(record.first_bag_item, record.bag_item_count, bag_item_count, "bag"sv);
+            for (uint64_t b = record.first_bag_item; b < record.first_bag_item + record.bag_item_count; ++b) {
+                const auto bag_item = decoder.Get<BagItemRecord>(BAG_ITEMS, b);
+                if ( !dog.PushIntoBag({bag_item.id, bag_item.type}, 0) ) {
+                    throw std::runtime_error("Failed to put bag content");
+                }
+            }
+            dog.SetScore(record.score);
+            dog.SetValue(record.value);
+            dog.SetBot((record.flags & DOG_BOT) != 0);
+            dogs[record.id] = {handle, session.AddDog(std::move(dog))};
+        }
+
+        CheckRange(session_record.first_loot, session_record.loot_count, loot_count, "loot"sv);
+        for (uint64_t l = session_record.first_loot; l < session_record.first_loot + session_record.loot_count; ++l) {
+            const auto record = decoder.Get<LootRecord>(LOOT, l);
+            model::LostObject lost_object;
+            lost_object.id_       = record.id;
+            lost_object.type_     = record.type;
+            lost_object.position_ = {record.x, record.y};
+            session.AddLostObject(lost_object);
+        }
+    }
+
+    for (uint64_t p = 0; p < player_count; ++p) {
+        const auto record = decoder.Get<PlayerRecord>(PLAYERS, p);
+        auto dog = dogs.find(record.dog_id);
+        if ( dog == dogs.end() ) {
+            throw std::runtime_error("Player: can't find dog with id "s + std::to_string(record.dog_id));
+        }
+        const model::Map::Id session_id{std::string(decoder.GetString(record.session_id))};
+        if ( dog->second.session != game.FindSession(session_id) ) {
+            throw std::runtime_error("Player: can't find session with id "s + *session_id);
+        }
+        app.AddPlayer(app::Player(dog->second, record.dog_id, session_id));
+    }
+    for (uint64_t t = 0; t < token_count; ++t) {
+        const auto record = decoder.Get<TokenRecord>(TOKENS, t);
+        if ( record.index >= player_count ) {
+            throw std::runtime_error("State file: token of unknown player"s);
+        }
+        app.AddPlayersTokenAndIndex(std::string(decoder.GetString(record.token)), record.index);
+    }
+
+    const FileHeader& header = decoder.GetHeader();
+    app.SetDogId(header.dog_id);
+    model::LostObject::CURR_ID = std::max(model::LostObject::CURR_ID, header.loot_id);
+    return header.wal_seq;
+}
+
+}  // namespace serialization
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "serializer.h"
+
+namespace serialization {
+
+//// Format ///////////////////////////////////////////////////////////////////////////////////////
+// Бинарный снимок состояния. Файл отображается в память целиком и загружается в модель без
+// промежуточного AppRepr. Числа в порядке байт машины, все секции выровнены на 8 байт.
+//   header:   "GSNAPSHT" | version u32 | section count u32 | wal seq u64 | dog id u32 | loot id u32
+//   sections: type u32 | record size u32 | count u64 | offset u64 - таблица сразу за заголовком
+// Секции - массивы записей фиксированной длины (STRINGS - байты): сессии ссылаются на свои
+// диапазоны псов и предметов, псы - на диапазон предметов в рюкзаках, строки - смещение и длина
+// в STRINGS. Размер записи в таблице секций проверяется, версия формата - тоже.
+// Файл без сигнатуры считается текстовым архивом Boost прежних версий сервера.
+// Версия 2: у записи пса есть флаги (серверный бот); снимки версии 1 читаются без них.
+constexpr uint32_t SNAPSHOT_VERSION     = 2;
+constexpr uint32_t SNAPSHOT_MIN_VERSION = 1;
+
+std::string EncodeSnapshot(const StateImage& image);
+// Есть ли в начале файла сигнатура бинарного снимка
+bool IsBinarySnapshot(const std::string& file_name);
+// Загружает снимок в пустое приложение, возвращает номер последнего вошедшего в него тика WAL
+uint64_t LoadSnapshot(const std::string& file_name, app::Application& app);
+// То же для снимка в памяти (получен от старого процесса при передаче работы)
+uint64_t LoadSnapshotData(std::string_view data, app::Application& app);
+
+}  // namespace serialization
@@ -0,0 +1,232 @@
+#include "token.h"
+
+#include <atomic>
+#include <bit>
+#include <random>
+#include <utility>
+
+namespace token {
+
+namespace {
+
+// 16 цифр в число; в error взводится бит, если среди них есть не цифра
+uint64_t ParseHalf(const char* hex, unsigned& error) noexcept {
+    uint64_t value = 0;
+    for (size_t i = 0; i < TOKEN_SIZE / 2; ++i) {
+        const auto     c         = static_cast<unsigned char>(hex[i]);
+        const unsigned digit     = c - '0';            // < 10 только для '0'..'9'
+        const unsigned letter    = (c | 0x20u) - 'a';  // < 6 только для 'a'..'f' и 'A'..'F'
+        const unsigned is_digit  = digit < 10;
+        const unsigned is_letter = letter < 6;
+        error |= 1u ^ (is_digit | is_letter);
+        value  = (value << 4) | (digit * is_digit + (letter + 10) * is_letter);
+    }
+    return value;
+}
+
+// ChaCha20 (RFC 8439) в режиме генератора: ключ процесса, номер потока вместо nonce, счётчик блоков
+class ChaCha20 {
+public:
+    using Block = std::array<uint32_t, 16>;
+
+    ChaCha20(const std::array<uint32_t, 8>& key, uint64_t stream) noexcept {
+        state_[0] = 0x61707865;
+        state_[1] = 0x3320646e;
+        state_[2] = 0x79622d32;
+        state_[3] = 0x6b206574;
+        std::copy(key.begin(), key.end(), state_.begin() + 4);
+        state_[12] = 0;
+        state_[13] = 0;
+        state_[14] = static_cast<uint32_t>(stream);
+        state_[15] = static_cast<uint32_t>(stream >> 32);
+    }
+
+    void Next(Block& out) noexcept {
+        Block x = state_;
+        for (int round = 0; round < 10; ++round) {
+            QuarterRound(x, 0, 4,  8, 12);
+            QuarterRound(x, 1, 5,  9, 13);
+            QuarterRound(x, 2, 6, 10, 14);
+            QuarterRound(x, 3, 7, 11, 15);
+            QuarterRound(x, 0, 5, 10, 15);
+            QuarterRound(x, 1, 6, 11, 12);
+            QuarterRound(x, 2, 7,  8, 13);
+            QuarterRound(x, 3, 4,  9, 14);
+        }
+        for (size_t i = 0; i < out.size(); ++i) {
+            out[i] = x[i] + state_[i];
+        }
+        // 64-битный счётчик блоков в словах 12-13
+        if ( ++state_[12] == 0 ) {
+            ++state_[13];
+        }
+    }
+
+private:
+    static void QuarterRound(Block& x, size_t a, size_t b, size_t c, size_t d) noexcept {
+        x[a] += x[b]; x[d] = std::rotl(x[d] ^ x[a], 16);
+        x[c] += x[d]; x[b] = std::rotl(x[b] ^ x[c], 12);
+        x[a] += x[b]; x[d] = std::rotl(x[d] ^ x[a], 8);
+        x[c] += x[d]; x[b] = std::rotl(x[b] ^ x[c], 7);
+    }
+
+    Block state_;
+};
+
+const std::array<uint32_t, 8>& ProcessKey() {
+    static const std::array<uint32_t, 8> key = [] {
+        std::random_device random_device;
+        std::array<uint32_t, 8> key;
+        for (auto& word : key) {
+            word = random_device();
+        }
+        return key;
+    }();
+    return key;
+}
+
+// Генератор потока: блок ChaCha20 - 64 байта, то есть 4 токена
+class ThreadGenerator {
+public:
+    ThreadGenerator() : cipher_(ProcessKey(), next_stream_.fetch_add(1, std::memory_order_relaxed)) { }
+
+    Token Next() noexcept {
+        if ( used_ == block_.size() ) {
+            cipher_.Next(block_);
+            used_ = 0;
+        }
+        const uint32_t* words = block_.data() + used_;
+        used_ += 4;
+        return {
+            (uint64_t{words[0]} << 32) | words[1],
+            (uint64_t{words[2]} << 32) | words[3]
+        };
+    }
+
+private:
+    inline static std::atomic<uint64_t> next_stream_{0};
+
+    ChaCha20         cipher_;
+    ChaCha20::Block  block_;
+    size_t           used_ = block_.size();
+};
+
+}  // namespace
+
+
+//// Token ////////////////////////////////////////////////////////////////////////////////////////
+std::optional<Token> Parse(std::string_view hex) noexcept {
+    if ( hex.size() != TOKEN_SIZE ) {
+        return std::nullopt;
+    }
+    unsigned error = 0;
+    Token token;
+    token.hi = ParseHalf(hex.data(), error);
+    token.lo = ParseHalf(hex.data() + TOKEN_SIZE / 2, error);
+    if ( error != 0 ) {
+        return std::nullopt;
+    }
+    return token;
+}
+
+Chars ToChars(const Token& token) noexcept {
+    constexpr char DIGITS[] = "0123456789abcdef";
+    Chars chars;
+    for (size_t i = 0; i < TOKEN_SIZE / 2; ++i) {
+        const unsigned shift = 60 - 4 * i;
+        chars[i]                  = DIGITS[(token.hi >> shift) & 0xF];
+        chars[i + TOKEN_SIZE / 2] = DIGITS[(token.lo >> shift) & 0xF];
+    }
+    return chars;
+}
+
+std::string ToString(const Token& token) {
+    const Chars chars = ToChars(token);
+    return std::string(chars.data(), chars.size());
+}
+
+Token Generate() {
+    thread_local ThreadGenerator generator;
+    return generator.Next();
+}
+
+
+//// TokenTable ///////////////////////////////////////////////////////////////////////////////////
+void TokenTable::Insert(const Token& token, size_t index) {
+    Shard& shard = shards_[ShardOf(Hash(token))];
+    std::lock_guard lock{shard.mutex};
+    shard.Insert(token, static_cast<uint32_t>(index));
+}
+
+std::optional<size_t> TokenTable::Find(const Token& token) const {
+    const size_t hash  = Hash(token);
+    const Shard& shard = shards_[ShardOf(hash)];
+    std::shared_lock lock{shard.mutex};
+    if ( shard.slots.empty() ) {
+        return std::nullopt;
+    }
+    const size_t mask = shard.slots.size() - 1;
+    for (size_t pos = (hash / SHARDS) & mask; ; pos = (pos + 1) & mask) {
+        const Slot& slot = shard.slots[pos];
+        if ( slot.index == EMPTY ) {
+            return std::nullopt;
+        }
+        if ( slot.token == token ) {
+            return slot.index;
+        }
+    }
+}
+
+size_t TokenTable::Size() const {
+    size_t size = 0;
+    for (const auto& shard : shards_) {
+        std::shared_lock lock{shard.mutex};
+        size += shard.size;
+    }
+    return size;
+}
+
+std::vector<std::pair<Token, size_t>> TokenTable::GetAll() const {
+    std::vector<std::pair<Token, size_t>> all;
+    for (const auto& shard : shards_) {
+        std::shared_lock lock{shard.mutex};
+        for (const auto& slot : shard.slots) {
+            if ( slot.index != EMPTY ) {
+                all.emplace_back(slot.token, slot.index);
+            }
+        }
+    }
+    return all;
+}
+
+void TokenTable::Shard::Insert(const Token& token, uint32_t index) {
+    // заполнение не больше половины - цепочки пробирования короткие
+    if ( (size + 1) * 2 > slots.size() ) {
+        Grow();
+    }
+    const size_t mask = slots.size() - 1;
+    for (size_t pos = (Hash(token) / SHARDS) & mask; ; pos = (pos + 1) & mask) {
+        Slot& slot = slots[pos];
+        if ( slot.index == EMPTY ) {
+            slot = {token, index};
+            ++size;
+            return;
+        }
+        if ( slot.token == token ) {
+            slot.index = index;
+            return;
+        }
+    }
+}
+
+void TokenTable::Shard::Grow() {
+    std::vector<Slot> old = std::exchange(slots, std::vector<Slot>(std::max(MIN_CAPACITY, slots.size() * 2)));
+    size = 0;
+    for (const auto& slot : old) {
+        if ( slot.index != EMPTY ) {
+            Insert(slot.token, slot.index);
+        }
+    }
+}
+
+}  // namespace token
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace token {
+
+//// Token ////////////////////////////////////////////////////////////////////////////////////////
+// Токен игрока - 128 случайных бит, в API - 32 шестнадцатеричные цифры (hi, затем lo)
+struct Token {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const Token&) const = default;
+    auto operator<=>(const Token&) const = default;
+};
+
+constexpr size_t TOKEN_SIZE = 32;
+
+using Chars = std::array<char, TOKEN_SIZE>;
+
+// Ровно TOKEN_SIZE цифр в любом регистре; без ветвлений по символам и без выделения памяти
+std::optional<Token> Parse(std::string_view hex) noexcept;
+// Строчные цифры, как их выдаёт сервер
+Chars ToChars(const Token& token) noexcept;
+std::string ToString(const Token& token);
+
+// Новый случайный токен. Поток ChaCha20 с ключом из std::random_device, взятым один раз на процесс;
+// у каждого потока свой номер потока шифра и свой буфер блока, поэтому вызовы из разных потоков
+// не синхронизируются
+Token Generate();
+
+// Токены случайны, поэтому достаточно перемешать половины
+inline size_t Hash(const Token& token) noexcept {
+    return static_cast<size_t>((token.hi ^ (token.lo * 0x9E3779B97F4A7C15ull)) >> 7);
+}
+
+
+//// TokenTable ///////////////////////////////////////////////////////////////////////////////////
+// Токен -> индекс игрока. Таблица разбита на SHARDS частей по младшим битам хеша, у каждой свой
+// shared_mutex, поэтому проверки токенов из разных потоков не мешают друг другу. Внутри части -
+// открытая адресация с линейным пробированием; удаляет только Rewrite, перекладывая часть заново,
+// поэтому надгробия не нужны.
+class TokenTable {
+public:
+    constexpr static size_t SHARDS = 16;
+
+    void Insert(const Token& token, size_t index);
+    std::optional<size_t> Find(const Token& token) const;
+    size_t Size() const;
+    std::vector<std::pair<Token, size_t>> GetAll() const;
+    // fn(token, index&) для каждой записи: false - удалить запись, index можно переписать
+    template <typename Fn>
+    void Rewrite(Fn&& fn);
+
+private:
+    constexpr static uint32_t EMPTY = UINT32_MAX;
+    constexpr static size_t   MIN_CAPACITY = 16;
+
+    struct Slot {
+        Token    token;
+        uint32_t index = EMPTY;
+    };
+
+    struct Shard {
+        mutable std::shared_mutex mutex;
+        std::vector<Slot>         slots;   // размер - степень двойки
+        size_t                    size = 0;
+
+        void Insert(const Token& token, uint32_t index);
+        void Grow();
+    };
+
+    static size_t ShardOf(size_t hash) noexcept { return hash % SHARDS; }
+
+    std::array<Shard, SHARDS> shards_;
+};
+
+template <typename Fn>
+void TokenTable::Rewrite(Fn&& fn) {
+    for (auto& shard : shards_) {
+        std::lock_guard lock{shard.mutex};
+        std::vector<Slot> kept;
+        kept.reserve(shard.size);
+        for (auto& slot : shard.slots) {
+            if ( slot.index == EMPTY ) {
+                continue;
+            }
+            size_t index = slot.index;
+            if ( fn(static_cast<const Token&>(slot.token), index) ) {
+                kept.push_back({slot.token, static_cast<uint32_t>(index)});
+            }
+        }
+        // после удаления цепочки пробирования рвутся - проще разложить заново
+        std::fill(shard.slots.begin(), shard.slots.end(), Slot{});
+        shard.size = 0;
+        for (const auto& slot : kept) {
+            shard.Insert(slot.token, slot.index);
+        }
+    }
+}
+
+}  // namespace token
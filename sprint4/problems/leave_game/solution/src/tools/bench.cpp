@@ -0,0 +1,598 @@
+// Микробенчмарки ядра симуляции на сгенерированных картах.
+// Результаты пишутся в JSON в формате Google Benchmark, их можно сравнивать между коммитами
+// его скриптом tools/compare.py или любым diff-ом.
+#include <boost/json.hpp>
+#include <boost/program_options.hpp>
+
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../app.h"
+#include "../collision_detector.h"
+#include "../map_generator.h"
+#include "../model.h"
+#include "../postgres.h"
+#include "../serializer.h"
+#include "../token.h"
+#include "../wal.h"
+
+using namespace std::literals;
+
+namespace json = boost::json;
+namespace fs   = std::filesystem;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t TICK_MS = 50;
+
+// Параметры программы
+struct Args {
+    std::vector<size_t> roads;
+    std::vector<size_t> dogs;
+    std::vector<size_t> loot;
+    std::string         filter;
+    std::string         out;
+    double              min_time;
+    unsigned            repetitions;
+};
+
+std::vector<size_t> ParseList(const std::string& str) {
+    std::vector<size_t> result;
+    std::istringstream iss(str);
+    std::string item;
+    while ( std::getline(iss, item, ',') ) {
+        if ( !item.empty() ) {
+            result.push_back(std::stoul(item));
+        }
+    }
+    if ( result.empty() ) {
+        throw std::runtime_error("Empty parameter list '"s + str + "'"s);
+    }
+    return result;
+}
+
+[[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc{"All options"s};
+
+    Args args;
+    std::string roads, dogs, loot;
+    desc.add_options()
+        ("help,h",                                                                          "produce help message")
+        ("roads",         po::value(&roads)->default_value("64,1024"s),                     "road counts, comma separated")
+        ("dogs",          po::value(&dogs)->default_value("100,1000"s),                     "dog counts, comma separated")
+        ("loot",          po::value(&loot)->default_value("100"s),                          "loot counts, comma separated")
+        ("filter,f",      po::value(&args.filter)->default_value(""s),                      "run only benchmarks containing substring")
+        ("min-time",      po::value(&args.min_time)->default_value(0.2),                    "minimal measured time of one run, seconds")
+        ("repetitions,r", po::value(&args.repetitions)->default_value(3),                   "runs of each benchmark")
+        ("out,o",         po::value(&args.out)->value_name("file"s),                        "write JSON results to file");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if ( vm.contains("help"s) ) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    args.roads       = ParseList(roads);
+    args.dogs        = ParseList(dogs);
+    args.loot        = ParseList(loot);
+    args.repetitions = std::max(1u, args.repetitions);
+    return args;
+}
+
+template <typename T>
+void DoNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+Clock::duration ThreadCpuNow() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+}
+
+
+//// State ////////////////////////////////////////////////////////////////////////////////////////
+// Счётчик итераций одного прогона: while ( state.KeepRunning() ) { ... }.
+// Подготовку внутри цикла можно вынести из замера через PauseTiming()/ResumeTiming().
+class State {
+public:
+    explicit State(size_t iterations) : iterations_(iterations) { }
+
+    bool KeepRunning() {
+        if ( done_ == 0 && !running_ ) {
+            ResumeTiming();
+        }
+        if ( done_ < iterations_ ) {
+            ++done_;
+            return true;
+        }
+        PauseTiming();
+        return false;
+    }
+
+    void PauseTiming() {
+        if ( !running_ ) {
+            return;
+        }
+        real_ += Clock::now() - real_start_;
+        cpu_  += ThreadCpuNow() - cpu_start_;
+        running_ = false;
+    }
+
+    void ResumeTiming() {
+        running_    = true;
+        cpu_start_  = ThreadCpuNow();
+        real_start_ = Clock::now();
+    }
+
+    void SetItemsProcessed(uint64_t items) { items_ = items; }
+    void SetBytesProcessed(uint64_t bytes) { bytes_ = bytes; }
+
+    size_t   GetIterations() const noexcept { return iterations_; }
+    double   GetRealSeconds() const { return std::chrono::duration<double>(real_).count(); }
+    double   GetCpuSeconds() const { return std::chrono::duration<double>(cpu_).count(); }
+    uint64_t GetItems() const noexcept { return items_; }
+    uint64_t GetBytes() const noexcept { return bytes_; }
+
+private:
+    size_t            iterations_;
+    size_t            done_    = 0;
+    bool              running_ = false;
+    Clock::time_point real_start_;
+    Clock::duration   cpu_start_{};
+    Clock::duration   real_{};
+    Clock::duration   cpu_{};
+    uint64_t          items_ = 0;
+    uint64_t          bytes_ = 0;
+};
+
+
+//// World ////////////////////////////////////////////////////////////////////////////////////////
+// Игра на одной сгенерированной карте: dogs игроков в случайных точках дорог, loot трофеев
+struct Params {
+    size_t roads;
+    size_t dogs;
+    size_t loot;
+};
+
+class World {
+public:
+    World(const Params& params, std::string state_file = {}, bool populate = true)
+        : params_(params)
+        , game_(MakeGame(params))
+        , app_(db_, game_, true, false, std::move(state_file), UINT32_MAX)
+        , map_(game_.GetCatalog()->GetMaps().front())
+        , random_(42) {
+        if ( !populate ) {
+            return;
+        }
+        const model::SessionHandle session = game_.AddSession(game_.FindMap(map_.GetId()));
+        std::string body;
+        for (size_t i = 0; i < params_.dogs; ++i) {
+            app_.TryJoin("dog"s + std::to_string(i), *map_.GetId(), body);
+        }
+        for (const auto& [token, index] : app_.GetPlayers().GetPlayersTokenToIndex()) {
+            tokens_.push_back(token);
+        }
+        // псов и сессий больше не добавляется: указатели на них не устареют
+        session_ = game_.GetSession(session);
+        for (const auto& player : app_.GetPlayers().GetPlayers()) {
+            model::Dog* dog = game_.GetDog(player.GetDog());
+            dog->SetPosition(map_gen::RandomRoadPoint(map_, random_));
+            dog->SetSpeed(map_.GetDogSpeed(), RandomMove());
+            dogs_.push_back(dog);
+        }
+        TopUpLoot();
+    }
+
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // Возвращает на карту подобранные трофеи
+    void TopUpLoot() {
+        std::uniform_int_distribution<unsigned> type_dist(0, map_.GetLootsCount() - 1);
+        while ( session_->GetLostsCount() < params_.loot ) {
+            session_->AddLostObject(model::LostObject(type_dist(random_), map_gen::RandomRoadPoint(map_, random_)));
+        }
+    }
+
+    // Остановившиеся псы выбирают новое направление, чтобы нагрузка не падала со временем
+    void RestartStopped() {
+        for (model::Dog* dog : dogs_) {
+            if ( dog->GetSpeed().sx == 0 && dog->GetSpeed().sy == 0 ) {
+                dog->SetSpeed(map_.GetDogSpeed(), RandomMove());
+            }
+        }
+    }
+
+    model::Game&                    GetGame() noexcept { return game_; }
+    app::Application&               GetApp() noexcept { return app_; }
+    const model::Map&               GetMap() const noexcept { return map_; }
+    const std::vector<model::Dog*>& GetDogs() const noexcept { return dogs_; }
+    const token::Token&             GetToken() const { return tokens_.at(0); }
+
+private:
+    static model::Game MakeGame(const Params& params) {
+        model::Game game(5000, 0.5, 1.0);
+        map_gen::GridParams grid;
+        grid.roads = params.roads;
+        game.AddMap(map_gen::MakeGridMap(grid));
+        return game;
+    }
+
+    std::string RandomMove() {
+        constexpr std::string_view MOVES[] = { "U"sv, "D"sv, "L"sv, "R"sv };
+        return std::string(MOVES[std::uniform_int_distribution<size_t>(0, std::size(MOVES) - 1)(random_)]);
+    }
+
+private:
+    Params                   params_;
+    postgres::Db             db_{postgres::Db::OFFLINE};
+    model::Game              game_;
+    app::Application         app_;
+    const model::Map&        map_;
+    model::GameSession*      session_ = nullptr;
+    std::vector<model::Dog*> dogs_;
+    std::vector<token::Token> tokens_;
+    std::mt19937             random_;
+};
+
+// Временный файл состояния, удаляется вместе с сегментами WAL и последней копией функции прогона
+class TempFile {
+public:
+    TempFile() : path_(fs::temp_directory_path() / ("game_bench_"s + std::to_string(std::random_device{}()) + ".state"s)) { }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    ~TempFile() {
+        std::error_code ec;
+        fs::remove(path_, ec);
+        serialization::RemoveWalSegments(path_.string(), UINT64_MAX);
+    }
+
+    const fs::path& GetPath() const noexcept { return path_; }
+
+private:
+    fs::path path_;
+};
+
+
+//// Benchmarks ///////////////////////////////////////////////////////////////////////////////////
+// Каждый бенчмарк получает параметры, строит окружение и возвращает функцию одного прогона
+using RunFn  = std::function<void(State&)>;
+using MakeFn = std::function<RunFn(const Params&)>;
+
+enum Dims : unsigned {
+    ROADS = 1,
+    DOGS  = 2,
+    LOOT  = 4
+};
+
+struct Benchmark {
+    std::string_view name;
+    unsigned         dims;
+    MakeFn           make;
+};
+
+RunFn DogMove(const Params& params) {
+    auto world = std::make_shared<World>(params);
+    return [world](State& state) {
+        const auto& roads = world->GetMap().GetRoadGraph();
+        while ( state.KeepRunning() ) {
+            for (model::Dog* dog : world->GetDogs()) {
+                dog->Move(TICK_MS, roads);
+            }
+            state.PauseTiming();
+            world->RestartStopped();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.GetIterations() * world->GetDogs().size());
+    };
+}
+
+RunFn FindGatherEvents(const Params& params) {
+    World world(params);
+    auto provider = std::make_shared<model::GameProvider>();
+    for (const auto& lost : world.GetGame().GetSessions().Front().GetLostObjects()) {
+        provider->PushItem({ { lost.position_.x, lost.position_.y }, model::LOOT_WIDTHS / 2, false });
+    }
+    for (const auto& office : world.GetMap().GetOffices()) {
+        provider->PushItem({ { static_cast<double>(office.GetPosition().x), static_cast<double>(office.GetPosition().y) }, model::OFFICE_WIDTHS / 2, true });
+    }
+    const double seconds = TICK_MS / 1000.0;
+    for (const model::Dog* dog : world.GetDogs()) {
+        const model::Position pos   = dog->GetPosition();
+        const model::Speed    speed = dog->GetSpeed();
+        provider->PushGatherer({ { pos.x, pos.y }, { pos.x + speed.sx * seconds, pos.y + speed.sy * seconds }, model::DOG_WIDTHS / 2 });
+    }
+    return [provider](State& state) {
+        while ( state.KeepRunning() ) {
+            auto events = collision_detector::FindGatherEvents(*provider);
+            DoNotOptimize(events.data());
+        }
+        state.SetItemsProcessed(state.GetIterations() * provider->GatherersCount());
+    };
+}
+
+RunFn SessionTick(const Params& params) {
+    auto world = std::make_shared<World>(params);
+    return [world, curr_time = uint64_t{0}](State& state) mutable {
+        while ( state.KeepRunning() ) {
+            world->GetGame().Tick(curr_time, TICK_MS);
+            curr_time += TICK_MS;
+            state.PauseTiming();
+            world->TopUpLoot();
+            world->RestartStopped();
+            state.ResumeTiming();
+        }
+        state.SetItemsProcessed(state.GetIterations() * world->GetDogs().size());
+    };
+}
+
+RunFn GetState(const Params& params) {
+    auto world = std::make_shared<World>(params);
+    return [world](State& state) {
+        std::string body;
+        uint64_t bytes = 0;
+        while ( state.KeepRunning() ) {
+            world->GetApp().GetState(world->GetToken(), body);
+            bytes += body.size();
+        }
+        state.SetBytesProcessed(bytes);
+    };
+}
+
+RunFn SaveApp(const Params& params) {
+    auto file  = std::make_shared<TempFile>();
+    auto world = std::make_shared<World>(params, file->GetPath().string());
+    return [world, file](State& state) {
+        while ( state.KeepRunning() ) {
+            serialization::SaveApp(world->GetApp());
+        }
+        state.SetBytesProcessed(state.GetIterations() * fs::file_size(file->GetPath()));
+    };
+}
+
+RunFn RestoreApp(const Params& params, bool text) {
+    auto file = std::make_shared<TempFile>();
+    {
+        World source(params, file->GetPath().string());
+        if ( text ) {
+            // текстовый архив прежних версий сервера
+            std::ofstream ofs{file->GetPath()};
+            boost::archive::text_oarchive oa{ofs};
+            oa << serialization::AppRepr(source.GetApp());
+        } else {
+            serialization::SaveApp(source.GetApp());
+        }
+    }
+    return [params, file](State& state) {
+        std::unique_ptr<World> target;
+        while ( state.KeepRunning() ) {
+            state.PauseTiming();
+            target.reset();
+            target = std::make_unique<World>(params, file->GetPath().string(), false);
+            state.ResumeTiming();
+            serialization::RestoreApp(target->GetApp());
+        }
+        state.SetBytesProcessed(state.GetIterations() * fs::file_size(file->GetPath()));
+    };
+}
+
+// Вход игрока: новый токен и его шестнадцатеричная запись для ответа
+RunFn TokenGenerate(const Params&) {
+    return [](State& state) {
+        while ( state.KeepRunning() ) {
+            const token::Chars chars = token::ToChars(token::Generate());
+            DoNotOptimize(chars);
+        }
+        state.SetItemsProcessed(state.GetIterations());
+    };
+}
+
+// Проверка заголовка Authorization: разбор токена и поиск в таблице игроков
+RunFn TokenLookup(const Params& params) {
+    auto world = std::make_shared<World>(params);
+    std::vector<std::string> tokens;
+    for (const auto& [token, index] : world->GetApp().GetPlayers().GetPlayersTokenToIndex()) {
+        tokens.push_back(token::ToString(token));
+    }
+    return [world, tokens = std::move(tokens)](State& state) {
+        size_t i = 0;
+        while ( state.KeepRunning() ) {
+            const auto token = token::Parse(tokens[i++ % tokens.size()]);
+            DoNotOptimize(world->GetApp().GetPlayers().HasToken(*token));
+        }
+        state.SetItemsProcessed(state.GetIterations());
+    };
+}
+
+const std::vector<Benchmark>& GetBenchmarks() {
+    static const std::vector<Benchmark> benchmarks{
+        { "DogMove"sv,          ROADS | DOGS,        DogMove },
+        { "FindGatherEvents"sv, DOGS | LOOT,         FindGatherEvents },
+        { "SessionTick"sv,      ROADS | DOGS | LOOT, SessionTick },
+        { "GetState"sv,         DOGS | LOOT,         GetState },
+        { "SaveApp"sv,          DOGS | LOOT,         SaveApp },
+        { "RestoreApp"sv,       DOGS | LOOT,         [](const Params& params) { return RestoreApp(params, false); } },
+        { "RestoreAppText"sv,   DOGS | LOOT,         [](const Params& params) { return RestoreApp(params, true); } },
+        { "TokenGenerate"sv,    0,                   TokenGenerate },
+        { "TokenLookup"sv,      DOGS,                TokenLookup },
+    };
+    return benchmarks;
+}
+
+
+//// Runner ///////////////////////////////////////////////////////////////////////////////////////
+struct Result {
+    size_t iterations;
+    double real_ns;
+    double cpu_ns;
+    double items_per_second;
+    double bytes_per_second;
+};
+
+// Подбирает число итераций так, чтобы прогон длился не меньше min_time
+Result Measure(const RunFn& run, double min_time) {
+    constexpr size_t MAX_ITERATIONS = 1'000'000'000;
+    size_t iterations = 1;
+    while ( true ) {
+        State state(iterations);
+        run(state);
+        const double seconds = state.GetRealSeconds();
+        if ( seconds >= min_time || iterations >= MAX_ITERATIONS ) {
+            const double real_s = std::max(seconds, 1e-12);
+            return { iterations,
+                     seconds * 1e9 / iterations,
+                     state.GetCpuSeconds() * 1e9 / iterations,
+                     state.GetItems() / real_s,
+                     state.GetBytes() / real_s };
+        }
+        const double multiplier = seconds > 0 ? std::min(min_time * 1.4 / seconds, 10.0) : 10.0;
+        iterations = std::min(MAX_ITERATIONS, std::max(iterations + 1, static_cast<size_t>(iterations * multiplier)));
+    }
+}
+
+std::string CaseName(std::string_view name, unsigned dims, const Params& params) {
+    std::string result(name);
+    if ( dims & ROADS ) {
+        result += "/roads:"s + std::to_string(params.roads);
+    }
+    if ( dims & DOGS ) {
+        result += "/dogs:"s + std::to_string(params.dogs);
+    }
+    if ( dims & LOOT ) {
+        result += "/loot:"s + std::to_string(params.loot);
+    }
+    return result;
+}
+
+json::object ResultToJson(const std::string& name, const std::string& run_name, const Result& result) {
+    json::object obj;
+    obj["name"]       = name;
+    obj["run_name"]   = run_name;
+    obj["threads"]    = 1;
+    obj["iterations"] = result.iterations;
+    obj["real_time"]  = result.real_ns;
+    obj["cpu_time"]   = result.cpu_ns;
+    obj["time_unit"]  = "ns";
+    if ( result.items_per_second > 0 ) {
+        obj["items_per_second"] = result.items_per_second;
+    }
+    if ( result.bytes_per_second > 0 ) {
+        obj["bytes_per_second"] = result.bytes_per_second;
+    }
+    return obj;
+}
+
+json::object MakeContext(const Args& args, const char* executable) {
+    const std::time_t now = std::time(nullptr);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    json::object context;
+    context["date"]               = date;
+    context["executable"]         = executable;
+    context["num_cpus"]           = std::thread::hardware_concurrency();
+#ifdef NDEBUG
+    context["library_build_type"] = "release";
+#else
+    context["library_build_type"] = "debug";
+#endif
+    context["min_time"]           = args.min_time;
+    context["repetitions"]        = args.repetitions;
+    return context;
+}
+
+json::array RunAll(const Args& args) {
+    json::array results;
+    std::printf("%-44s %12s %14s %14s %14s %14s\n", "benchmark", "iterations", "time,ns", "cpu,ns", "items/s", "bytes/s");
+    for (const auto& bench : GetBenchmarks()) {
+        // по неиспользуемым измерениям берётся первое значение
+        const std::vector<size_t> roads = (bench.dims & ROADS) ? args.roads : std::vector<size_t>{args.roads.front()};
+        const std::vector<size_t> dogs  = (bench.dims & DOGS)  ? args.dogs  : std::vector<size_t>{args.dogs.front()};
+        const std::vector<size_t> loot  = (bench.dims & LOOT)  ? args.loot  : std::vector<size_t>{args.loot.front()};
+        for (size_t r : roads) {
+            for (size_t d : dogs) {
+                for (size_t l : loot) {
+                    const Params params{r, d, l};
+                    const std::string name = CaseName(bench.name, bench.dims, params);
+                    if ( !args.filter.empty() && name.find(args.filter) == std::string::npos ) {
+                        continue;
+                    }
+                    const RunFn run = bench.make(params);
+                    std::vector<Result> runs;
+                    for (unsigned rep = 0; rep < args.repetitions; ++rep) {
+                        const Result result = Measure(run, args.min_time);
+                        std::printf("%-44s %12zu %14.1f %14.1f %14.0f %14.0f\n", name.c_str(), result.iterations, result.real_ns, result.cpu_ns,
+                                    result.items_per_second, result.bytes_per_second);
+                        std::fflush(stdout);
+                        json::object obj = ResultToJson(name, name, result);
+                        obj["run_type"]         = "iteration";
+                        obj["repetitions"]      = args.repetitions;
+                        obj["repetition_index"] = rep;
+                        results.push_back(obj);
+                        runs.push_back(result);
+                    }
+                    if ( runs.size() > 1 ) {
+                        std::sort(runs.begin(), runs.end(), [](const Result& lhs, const Result& rhs) {
+                            return lhs.real_ns < rhs.real_ns;
+                        });
+                        json::object obj = ResultToJson(name + "_median"s, name, runs[runs.size() / 2]);
+                        obj["run_type"]       = "aggregate";
+                        obj["aggregate_name"] = "median";
+                        obj["repetitions"]    = args.repetitions;
+                        results.push_back(obj);
+                    }
+                }
+            }
+        }
+    }
+    return results;
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        auto args = ParseCommandLine(argc, argv);
+        if ( !args ) {
+            return EXIT_SUCCESS;
+        }
+
+        json::object report;
+        report["context"]    = MakeContext(*args, argv[0]);
+        report["benchmarks"] = RunAll(*args);
+
+        if ( !args->out.empty() ) {
+            std::ofstream ofs(args->out);
+            if ( !ofs ) {
+                throw std::runtime_error("Can't open output file '"s + args->out + "'"s);
+            }
+            ofs << json::serialize(report) << std::endl;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "game_bench exception: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
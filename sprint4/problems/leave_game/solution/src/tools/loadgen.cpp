@@ -0,0 +1,353 @@
+// Генератор нагрузки на игровой сервер: N игроков входят в игру и в цикле шлют move/state
+// по keep-alive соединениям с заданной суммарной частотой запросов
+#include "../sdk.h"
+//
+#define BOOST_BEAST_USE_STD_STRING_VIEW
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/json.hpp>
+#include <boost/program_options.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../metrics.h"
+
+using namespace std::literals;
+
+namespace net   = boost::asio;
+namespace beast = boost::beast;
+namespace http  = beast::http;
+namespace json  = boost::json;
+namespace sys   = boost::system;
+using     tcp   = net::ip::tcp;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Параметры программы
+struct Args {
+    std::string host;
+    std::string port;
+    std::string map_id;
+    unsigned    players;
+    double      rps;
+    unsigned    duration_s;
+    unsigned    threads;
+    unsigned    states_per_move;
+};
+
+[[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc{"All options"s};
+
+    Args args;
+    desc.add_options()
+        ("help,h",                                                                              "produce help message")
+        ("host",            po::value(&args.host)->default_value("127.0.0.1"s),                 "server address")
+        ("port",            po::value(&args.port)->default_value("8080"s),                      "server port")
+        ("map,m",           po::value(&args.map_id)->default_value("map1"s),                    "map to join")
+        ("players,n",       po::value(&args.players)->default_value(100),                       "simulated players")
+        ("rps,r",           po::value(&args.rps)->default_value(0.0),                           "total request rate (open loop: latency counts from the scheduled send), 0 - as fast as possible")
+        ("duration,d",      po::value(&args.duration_s)->default_value(30),                     "test duration, seconds")
+        ("threads,t",       po::value(&args.threads)->default_value(std::thread::hardware_concurrency()), "io threads")
+        ("states-per-move", po::value(&args.states_per_move)->default_value(1),                 "state requests after each move");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if ( vm.contains("help"s) ) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    args.players = std::max(1u, args.players);
+    args.threads = std::max(1u, args.threads);
+    return args;
+}
+
+
+//// Stats ////////////////////////////////////////////////////////////////////////////////////////
+enum Endpoint : size_t {
+    JOIN,
+    ACTION,
+    STATE,
+    ENDPOINTS
+};
+
+constexpr std::string_view ENDPOINT_NAMES[ENDPOINTS] = { "join"sv, "action"sv, "state"sv };
+
+struct Stats {
+    std::array<metrics::LatencyHistogram, ENDPOINTS> latency;
+    std::array<std::atomic<uint64_t>, ENDPOINTS>     errors{};
+    std::atomic<uint64_t>                            reconnects{0};
+
+    void Report(double seconds) const {
+        std::printf("%-8s %10s %10s %10s %10s %10s %10s\n", "endpoint", "requests", "errors", "rps", "p50,ms", "p99,ms", "p999,ms");
+        uint64_t total = 0;
+        for (size_t ep = 0; ep < ENDPOINTS; ++ep) {
+            const auto& hist = latency[ep];
+            const uint64_t count = hist.GetCount();
+            total += count;
+            std::printf("%-8s %10lu %10lu %10.1f %10.3f %10.3f %10.3f\n",
+                        ENDPOINT_NAMES[ep].data(), count, errors[ep].load(), count / seconds,
+                        hist.GetPercentile(0.5) / 1000.0, hist.GetPercentile(0.99) / 1000.0, hist.GetPercentile(0.999) / 1000.0);
+        }
+        std::printf("total: %lu requests in %.1f s, %.1f rps, %lu reconnects\n", total, seconds, total / seconds, reconnects.load());
+    }
+};
+
+
+//// Control //////////////////////////////////////////////////////////////////////////////////////
+struct Control {
+    std::atomic<bool>     stop{false};
+    std::atomic<size_t>   active{0};
+    std::function<void()> on_idle;      // вызывается, когда последний игрок завершил работу
+};
+
+
+//// Player ///////////////////////////////////////////////////////////////////////////////////////
+// Один игрок - одно keep-alive соединение; все обработчики игрока выполняются в его strand
+class Player : public std::enable_shared_from_this<Player> {
+public:
+    Player(net::io_context& ioc, const tcp::resolver::results_type& endpoints, const Args& args,
+           Stats& stats, Control& control, size_t index)
+        : strand_(net::make_strand(ioc))
+        , stream_(strand_)
+        , timer_(strand_)
+        , endpoints_(endpoints)
+        , args_(args)
+        , stats_(stats)
+        , control_(control)
+        , index_(index)
+        , random_(static_cast<uint32_t>(index) * 2654435761u) {
+        if ( args_.rps > 0 ) {
+            interval_ = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(args_.players / args_.rps));
+        }
+    }
+
+    void Start() {
+        control_.active.fetch_add(1);
+        net::dispatch(strand_, [self = shared_from_this()] {
+            // разносим первые запросы игроков по интервалу, чтобы не было залпа
+            std::uniform_int_distribution<Clock::rep> dist(0, self->interval_.count());
+            self->next_send_ = Clock::now() + Clock::duration{dist(self->random_)};
+            self->Connect();
+        });
+    }
+
+private:
+    void Connect() {
+        stream_.expires_after(5s);
+        stream_.async_connect(endpoints_, [self = shared_from_this()](sys::error_code ec, const tcp::endpoint&) {
+            if ( ec ) {
+                return self->Retry();
+            }
+            self->WaitNext();
+        });
+    }
+
+    void Finish() {
+        beast::error_code ignored;
+        stream_.socket().close(ignored);
+        if ( control_.active.fetch_sub(1) == 1 ) {
+            control_.on_idle();
+        }
+    }
+
+    void Retry() {
+        if ( control_.stop.load(std::memory_order_relaxed) ) {
+            return Finish();
+        }
+        stats_.reconnects.fetch_add(1, std::memory_order_relaxed);
+        // слот оборвавшегося запроса израсходован, следующий - по расписанию
+        next_send_ += interval_;
+        beast::error_code ignored;
+        stream_.socket().close(ignored);
+        buffer_.consume(buffer_.size());
+        timer_.expires_after(100ms);
+        timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
+            if ( !ec ) {
+                self->Connect();
+            }
+        });
+    }
+
+    void SendNext() {
+        if ( control_.stop.load(std::memory_order_relaxed) ) {
+            return Finish();
+        }
+        if ( token_.empty() ) {
+            json::object body;
+            body["userName"] = "bot"s + std::to_string(index_);
+            body["mapId"]    = args_.map_id;
+            return Send(JOIN, http::verb::post, "/api/v1/game/join"sv, json::serialize(body));
+        }
+        if ( step_++ % (args_.states_per_move + 1) == 0 ) {
+            constexpr std::string_view MOVES[] = { "U"sv, "D"sv, "L"sv, "R"sv, ""sv };
+            std::uniform_int_distribution<size_t> dist(0, std::size(MOVES) - 1);
+            json::object body;
+            body["move"] = MOVES[dist(random_)];
+            return Send(ACTION, http::verb::post, "/api/v1/game/player/action"sv, json::serialize(body));
+        }
+        Send(STATE, http::verb::get, "/api/v1/game/state"sv, {});
+    }
+
+    void Send(Endpoint endpoint, http::verb verb, std::string_view target, std::string body) {
+        endpoint_ = endpoint;
+        request_  = {verb, target, 11};
+        request_.set(http::field::host, args_.host);
+        request_.keep_alive(true);
+        if ( !token_.empty() ) {
+            request_.set(http::field::authorization, "Bearer "s + token_);
+        }
+        if ( verb == http::verb::post ) {
+            request_.set(http::field::content_type, "application/json"sv);
+            request_.body() = std::move(body);
+        }
+        request_.prepare_payload();
+        // в открытой модели задержка считается от запланированного момента отправки: иначе время,
+        // которое запрос простоял в очереди за медленным ответом, выпадает из статистики
+        sent_at_ = interval_ == Clock::duration::zero() ? Clock::now() : next_send_;
+        stream_.expires_after(10s);
+        http::async_write(stream_, request_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if ( ec ) {
+                self->stats_.errors[self->endpoint_].fetch_add(1, std::memory_order_relaxed);
+                return self->Retry();
+            }
+            self->Read();
+        });
+    }
+
+    void Read() {
+        response_ = {};
+        http::async_read(stream_, buffer_, response_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            self->OnRead(ec);
+        });
+    }
+
+    void OnRead(beast::error_code ec) {
+        if ( ec ) {
+            stats_.errors[endpoint_].fetch_add(1, std::memory_order_relaxed);
+            return Retry();
+        }
+        stats_.latency[endpoint_].Record(metrics::MicrosecondsSince(sent_at_));
+        if ( response_.result() != http::status::ok ) {
+            stats_.errors[endpoint_].fetch_add(1, std::memory_order_relaxed);
+        } else if ( endpoint_ == JOIN ) {
+            sys::error_code parse_ec;
+            json::value value = json::parse(response_.body(), parse_ec);
+            if ( !parse_ec && value.is_object() ) {
+                if ( const auto* token = value.as_object().if_contains("authToken"sv); token && token->is_string() ) {
+                    token_ = std::string(token->as_string());
+                }
+            }
+        }
+        if ( !response_.keep_alive() ) {
+            return Retry();
+        }
+        ScheduleNext();
+    }
+
+    void ScheduleNext() {
+        // открытая модель: расписание не сдвигается, если ответ пришёл с опозданием
+        next_send_ += interval_;
+        WaitNext();
+    }
+
+    void WaitNext() {
+        if ( interval_ == Clock::duration::zero() ) {
+            return SendNext();
+        }
+        timer_.expires_at(next_send_);
+        timer_.async_wait([self = shared_from_this()](sys::error_code ec) {
+            if ( !ec ) {
+                self->SendNext();
+            }
+        });
+    }
+
+private:
+    net::strand<net::io_context::executor_type> strand_;
+    beast::tcp_stream                           stream_;
+    net::steady_timer                           timer_;
+    const tcp::resolver::results_type&          endpoints_;
+    const Args&                                 args_;
+    Stats&                                      stats_;
+    Control&                                    control_;
+    size_t                                      index_;
+    std::mt19937                                random_;
+    //
+    std::string                                 token_;
+    size_t                                      step_ = 0;
+    Endpoint                                    endpoint_ = JOIN;
+    Clock::duration                             interval_ = Clock::duration::zero();
+    Clock::time_point                           next_send_;
+    Clock::time_point                           sent_at_;
+    http::request<http::string_body>            request_;
+    http::response<http::string_body>           response_;
+    beast::flat_buffer                          buffer_;
+};
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        auto args = ParseCommandLine(argc, argv);
+        if ( !args ) {
+            return EXIT_SUCCESS;
+        }
+
+        net::io_context ioc(args->threads);
+        tcp::resolver resolver(ioc);
+        const auto endpoints = resolver.resolve(args->host, args->port);
+
+        // по истечении времени игроки перестают слать запросы; зависшие соединения обрываем позже
+        Stats   stats;
+        Control control;
+        const auto start = Clock::now();
+        Clock::time_point finish = start;
+        net::steady_timer duration_timer(ioc, std::chrono::seconds(args->duration_s));
+        net::steady_timer grace_timer(ioc);
+        control.on_idle = [&ioc] {
+            ioc.stop();
+        };
+        duration_timer.async_wait([&](sys::error_code) {
+            finish = Clock::now();
+            control.stop = true;
+            grace_timer.expires_after(5s);
+            grace_timer.async_wait([&ioc](sys::error_code) { ioc.stop(); });
+        });
+
+        for (size_t i = 0; i < args->players; ++i) {
+            std::make_shared<Player>(ioc, endpoints, *args, stats, control, i)->Start();
+        }
+
+        std::vector<std::jthread> workers;
+        for (unsigned i = 1; i < args->threads; ++i) {
+            workers.emplace_back([&ioc] { ioc.run(); });
+        }
+        ioc.run();
+        workers.clear();
+
+        stats.Report(std::chrono::duration<double>(finish - start).count());
+    } catch (const std::exception& ex) {
+        std::cerr << "game_loadgen exception: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,131 @@
+// Генератор больших карт: пишет config.json, который понимает json_loader::LoadGame
+#include <boost/json.hpp>
+#include <boost/program_options.hpp>
+
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "../map_generator.h"
+
+using namespace std::literals;
+
+namespace json = boost::json;
+
+namespace {
+
+// Параметры программы
+struct Args {
+    std::string layout;
+    size_t      maps;
+    size_t      roads;
+    size_t      offices;
+    size_t      buildings;
+    size_t      loot_types;
+    int         size;
+    int         block;
+    int         min_road;
+    int         max_road;
+    double      dog_speed;
+    unsigned    bag_capacity;
+    uint32_t    seed;
+    std::string out;
+};
+
+[[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc{"All options"s};
+
+    Args args;
+    desc.add_options()
+        ("help,h",                                                                          "produce help message")
+        ("layout",         po::value(&args.layout)->default_value("random"s),               "road network: grid or random")
+        ("maps",           po::value(&args.maps)->default_value(1),                         "number of maps")
+        ("roads",          po::value(&args.roads)->default_value(1000),                     "roads per map")
+        ("offices",        po::value(&args.offices)->default_value(20),                     "offices per map")
+        ("buildings",      po::value(&args.buildings)->default_value(200),                  "buildings per map (random layout)")
+        ("loot-types",     po::value(&args.loot_types)->default_value(8),                   "loot types per map")
+        ("size",           po::value(&args.size)->default_value(1000),                      "map side (random layout)")
+        ("block",          po::value(&args.block)->default_value(10),                       "grid step (grid layout)")
+        ("min-road",       po::value(&args.min_road)->default_value(5),                     "minimal road length (random layout)")
+        ("max-road",       po::value(&args.max_road)->default_value(100),                   "maximal road length (random layout)")
+        ("dog-speed",      po::value(&args.dog_speed)->default_value(4.0),                  "dog speed on generated maps")
+        ("bag-capacity",   po::value(&args.bag_capacity)->default_value(3),                 "bag capacity on generated maps")
+        ("seed",           po::value(&args.seed)->default_value(1),                         "random seed, map i uses seed + i")
+        ("out,o",          po::value(&args.out)->value_name("file"s),                       "output file, stdout by default");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if ( vm.contains("help"s) ) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    if ( args.layout != "grid"s && args.layout != "random"s ) {
+        throw std::runtime_error("Unknown layout '"s + args.layout + "'"s);
+    }
+    return args;
+}
+
+model::Map MakeMap(const Args& args, size_t index) {
+    const std::string id   = args.layout + std::to_string(index);
+    const uint32_t    seed = args.seed + static_cast<uint32_t>(index);
+    if ( args.layout == "grid"s ) {
+        map_gen::GridParams params;
+        params.id           = id;
+        params.roads        = args.roads;
+        params.offices      = args.offices;
+        params.loot_types   = args.loot_types;
+        params.block        = args.block;
+        params.dog_speed    = args.dog_speed;
+        params.bag_capacity = args.bag_capacity;
+        params.seed         = seed;
+        return map_gen::MakeGridMap(params);
+    }
+    map_gen::RandomParams params;
+    params.id              = id;
+    params.roads           = args.roads;
+    params.offices         = args.offices;
+    params.buildings       = args.buildings;
+    params.loot_types      = args.loot_types;
+    params.size            = args.size;
+    params.min_road_length = args.min_road;
+    params.max_road_length = args.max_road;
+    params.dog_speed       = args.dog_speed;
+    params.bag_capacity    = args.bag_capacity;
+    params.seed            = seed;
+    return map_gen::MakeRandomMap(params);
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        auto args = ParseCommandLine(argc, argv);
+        if ( !args ) {
+            return EXIT_SUCCESS;
+        }
+
+        std::vector<model::Map> maps;
+        for (size_t i = 0; i < args->maps; ++i) {
+            maps.push_back(MakeMap(*args, i));
+        }
+        const std::string config = json::serialize(map_gen::MakeGameConfig(maps, map_gen::ConfigParams{}));
+
+        if ( args->out.empty() ) {
+            std::cout << config << std::endl;
+        } else {
+            std::ofstream ofs(args->out);
+            if ( !ofs ) {
+                throw std::runtime_error("Can't open output file '"s + args->out + "'"s);
+            }
+            ofs << config << std::endl;
+        }
+    } catch (const std::exception& ex) {
+        std::cerr << "game_mapgen exception: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
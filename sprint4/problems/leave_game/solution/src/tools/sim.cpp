@@ -0,0 +1,259 @@
+// Безголовая симуляция: загружает config.json, добавляет синтетических игроков со скриптовым
+// движением и крутит N тиков без пауз. Печатает тики в секунду и пиковое потребление памяти.
+// С --replay вместо скрипта воспроизводит журнал сервера и сверяет итоговое состояние.
+#include <boost/program_options.hpp>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../app.h"
+#include "../journal.h"
+#include "../json_loader.h"
+#include "../model.h"
+#include "../postgres.h"
+
+using namespace std::literals;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Параметры программы
+struct Args {
+    std::string config_file;
+    size_t      players;
+    size_t      ticks;
+    uint32_t    tick_ms;
+    uint32_t    turn_min;
+    uint32_t    turn_max;
+    uint32_t    seed;
+    std::string replay_file;
+};
+
+[[nodiscard]] std::optional<Args> ParseCommandLine(int argc, const char* const argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc{"All options"s};
+
+    Args args;
+    desc.add_options()
+        ("help,h",                                                                          "produce help message")
+        ("config-file,c", po::value(&args.config_file)->value_name("file"s),                "set config file path")
+        ("players,n",     po::value(&args.players)->default_value(1000),                    "synthetic players, spread over all maps")
+        ("ticks",         po::value(&args.ticks)->default_value(10000),                     "ticks to simulate")
+        ("tick-period,t", po::value(&args.tick_ms)->default_value(50),                      "game time of one tick, ms")
+        ("turn-min",      po::value(&args.turn_min)->default_value(10),                     "minimal ticks between turns of a player")
+        ("turn-max",      po::value(&args.turn_max)->default_value(40),                     "maximal ticks between turns of a player")
+        ("seed",          po::value(&args.seed)->default_value(1),                          "scripts and model random seed")
+        ("replay",        po::value(&args.replay_file)->value_name("file"s),                "replay server journal instead of scripts");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if ( vm.contains("help"s) ) {
+        std::cout << desc;
+        return std::nullopt;
+    }
+    if ( !vm.contains("config-file"s) ) {
+        throw std::runtime_error("config-file is not specified"s);
+    }
+    args.turn_min = std::max(1u, args.turn_min);
+    args.turn_max = std::max(args.turn_min, args.turn_max);
+    return args;
+}
+
+// Пиковый размер резидентной памяти процесса, КБ
+long MaxRssKb() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+double SecondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void PrintTicks(std::vector<double>& tick_ms, double run_s) {
+    std::sort(tick_ms.begin(), tick_ms.end());
+    auto at = [&tick_ms](double q) {
+        return tick_ms.empty() ? 0.0 : tick_ms[std::min(tick_ms.size() - 1, static_cast<size_t>(q * tick_ms.size()))];
+    };
+    std::printf("ticks: %zu in %.3f s, %.1f ticks/s\n", tick_ms.size(), run_s, tick_ms.size() / run_s);
+    std::printf("tick, ms: p50 %.3f, p99 %.3f, max %.3f\n", at(0.5), at(0.99), tick_ms.empty() ? 0.0 : tick_ms.back());
+}
+
+
+//// Bot //////////////////////////////////////////////////////////////////////////////////////////
+// Скрипт игрока: едет в случайном направлении и сворачивает раз в turn_min..turn_max тиков
+struct Bot {
+    token::Token token;
+    size_t      next_turn;
+};
+
+class Script {
+public:
+    explicit Script(const Args& args) : args_(args), random_(args.seed) { }
+
+    std::string NextMove() {
+        constexpr std::string_view MOVES[] = { "U"sv, "D"sv, "L"sv, "R"sv };
+        return std::string(MOVES[std::uniform_int_distribution<size_t>(0, std::size(MOVES) - 1)(random_)]);
+    }
+
+    size_t NextTurn(size_t tick) {
+        return tick + std::uniform_int_distribution<uint32_t>(args_.turn_min, args_.turn_max)(random_);
+    }
+
+private:
+    const Args&  args_;
+    std::mt19937 random_;
+};
+
+// Скриптовые игроки, раскладываются по картам по кругу
+int Simulate(const Args& args, model::Game& game) {
+    model::SeedRandom(args.seed);
+    postgres::Db db{postgres::Db::OFFLINE};
+    app::Application app(db, game, false, true, ""s, UINT32_MAX);
+    Script script(args);
+    std::string body;
+    const auto catalog = game.GetCatalog();
+    const auto& maps = catalog->GetMaps();
+    for (size_t i = 0; i < args.players; ++i) {
+        const auto& map = maps[i % maps.size()];
+        app.TryJoin("bot"s + std::to_string(i), *map.GetId(), body);
+    }
+    std::vector<Bot> bots;
+    for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+        bots.push_back({token, 0});
+    }
+
+    std::vector<double> tick_ms;
+    tick_ms.reserve(args.ticks);
+    size_t moves = 0;
+    const auto run_start = Clock::now();
+    for (size_t tick = 0; tick < args.ticks; ++tick) {
+        for (auto& bot : bots) {
+            if ( bot.next_turn <= tick ) {
+                app.Move(bot.token, script.NextMove(), body);
+                bot.next_turn = script.NextTurn(tick);
+                ++moves;
+            }
+        }
+        const auto tick_start = Clock::now();
+        app.Tick(args.tick_ms);
+        tick_ms.push_back(SecondsSince(tick_start) * 1000.0);
+    }
+    const double run_s = SecondsSince(run_start);
+
+    size_t dogs = 0, loot = 0;
+    for (const auto& session : game.GetSessions()) {
+        dogs += session.GetDogsCount();
+        loot += session.GetLostsCount();
+    }
+    std::printf("players: %zu, sessions: %zu, dogs: %zu, loot on maps: %zu, moves: %zu\n",
+                bots.size(), game.GetSessions().Size(), dogs, loot, moves);
+    std::printf("game time x%.1f\n", args.ticks * args.tick_ms / 1000.0 / run_s);
+    PrintTicks(tick_ms, run_s);
+    return EXIT_SUCCESS;
+}
+
+// Журнал сервера: те же команды с тем же зерном генератора должны дать то же состояние
+int Replay(const Args& args, model::Game& game) {
+    journal::Reader reader(args.replay_file);
+    if ( reader.GetFlags() & journal::RESTORED ) {
+        throw std::runtime_error("Journal was recorded over a restored state and can't be replayed from an empty world"s);
+    }
+    model::SeedRandom(reader.GetSeed());
+    postgres::Db db{postgres::Db::OFFLINE};
+    app::Application app(db, game, false, (reader.GetFlags() & journal::RANDOMIZE_SPAWN) != 0, ""s, UINT32_MAX);
+
+    std::vector<double>     tick_ms;
+    std::optional<uint64_t> expected;
+    size_t joins = 0, moves = 0;
+    std::string body;
+    journal::Record record;
+    const auto run_start = Clock::now();
+    while ( !expected && reader.Next(record) ) {
+        switch ( record.type ) {
+            case journal::RecordType::JOIN:
+                if ( !app.ReplayJoin(record.name, record.map_id, record.token, record.bot) ) {
+                    throw std::runtime_error("Can't replay join to map '"s + record.map_id + "': wrong config?"s);
+                }
+                ++joins;
+                break;
+            case journal::RecordType::MOVE:
+                if ( auto token = token::Parse(record.token) ) {
+                    app.Move(*token, record.move, body);
+                } else {
+                    throw std::runtime_error("Invalid token in journal: '"s + record.token + "'"s);
+                }
+                ++moves;
+                break;
+            case journal::RecordType::TICK: {
+                const auto tick_start = Clock::now();
+                app.Tick(record.delta);
+                tick_ms.push_back(SecondsSince(tick_start) * 1000.0);
+                break;
+            }
+            case journal::RecordType::END:
+                expected = record.digest;
+                break;
+        }
+    }
+    const double run_s = SecondsSince(run_start);
+
+    std::printf("replayed: %zu joins, %zu moves\n", joins, moves);
+    PrintTicks(tick_ms, run_s);
+    const uint64_t digest = app.StateDigest();
+    if ( !expected ) {
+        std::printf("state digest %016lx, journal has no final digest (server did not stop cleanly)\n", digest);
+        return EXIT_SUCCESS;
+    }
+    if ( *expected != digest ) {
+        std::printf("STATE MISMATCH: digest %016lx, journal %016lx\n", digest, *expected);
+        return EXIT_FAILURE;
+    }
+    std::printf("state digest %016lx matches journal\n", digest);
+    return EXIT_SUCCESS;
+}
+
+}  // namespace
+
+int main(int argc, const char* argv[]) {
+    try {
+        auto args = ParseCommandLine(argc, argv);
+        if ( !args ) {
+            return EXIT_SUCCESS;
+        }
+
+        // 1. Загружаем игру
+        const auto load_start = Clock::now();
+        model::Game game = json_loader::LoadGame(args->config_file);
+        const double load_s = SecondsSince(load_start);
+        const auto catalog = game.GetCatalog();
+        const auto& maps = catalog->GetMaps();
+        size_t roads = 0;
+        for (const auto& map : maps) {
+            roads += map.GetRoads().size();
+        }
+        std::printf("config: %zu maps, %zu roads, loaded in %.3f s, max rss %ld KB\n", maps.size(), roads, load_s, MaxRssKb());
+        if ( maps.empty() ) {
+            throw std::runtime_error("No maps in config"s);
+        }
+
+        const int result = args->replay_file.empty() ? Simulate(*args, game) : Replay(*args, game);
+        std::printf("max rss: %ld KB\n", MaxRssKb());
+        return result;
+    } catch (const std::exception& ex) {
+        std::cerr << "game_sim exception: " << ex.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
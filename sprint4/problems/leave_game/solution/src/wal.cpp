@@ -0,0 +1,497 @@
+#include "wal.h"
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <stdexcept>
+#include <utility>
+
+#include "logger.h"
+
+namespace serialization {
+
+using namespace std::literals;
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t   FRAME_HEADER_SIZE = 8;
+constexpr uint32_t MAX_FRAME_SIZE    = 1u << 30;
+
+uint32_t Checksum(std::string_view data) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : data) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+// size | checksum | TickDelta
+std::string EncodeFrame(const TickDelta& delta) {
+    std::ostringstream oss;
+    {
+        boost::archive::binary_oarchive oa{oss, boost::archive::no_header};
+        oa << delta;
+    }
+    const std::string payload = oss.str();
+    const uint32_t size     = static_cast<uint32_t>(payload.size());
+    const uint32_t checksum = Checksum(payload);
+    std::string frame(FRAME_HEADER_SIZE, '\0');
+    std::memcpy(frame.data(), &size, sizeof(size));
+    std::memcpy(frame.data() + sizeof(size), &checksum, sizeof(checksum));
+    frame += payload;
+    return frame;
+}
+
+// Один write на кадр: после падения процесса кадр либо целиком в page cache, либо оборван.
+// false - ошибка записи, errno её код
+bool WriteFrame(int fd, std::string_view frame) {
+    size_t written = 0;
+    while ( written < frame.size() ) {
+        const ssize_t n = ::write(fd, frame.data() + written, frame.size() - written);
+        if ( n < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+fs::path SegmentDir(const std::string& state_file) {
+    const fs::path file{state_file};
+    return file.has_parent_path() ? file.parent_path() : fs::path(".");
+}
+
+std::string SegmentPrefix(const std::string& state_file) {
+    return fs::path(state_file).filename().string() + ".wal.";
+}
+
+std::string SegmentName(const std::string& state_file, uint64_t first_seq) {
+    char number[24];
+    std::snprintf(number, sizeof(number), "%020lu", static_cast<unsigned long>(first_seq));
+    return state_file + ".wal." + number;
+}
+
+// Сегменты журнала по номеру первого тика
+std::map<uint64_t, fs::path> ListSegments(const std::string& state_file) {
+    std::map<uint64_t, fs::path> segments;
+    const fs::path    dir    = SegmentDir(state_file);
+    const std::string prefix = SegmentPrefix(state_file);
+    if ( !fs::is_directory(dir) ) {
+        return segments;
+    }
+    for (const auto& entry : fs::directory_iterator(dir)) {
+        const std::string name = entry.path().filename().string();
+        if ( !name.starts_with(prefix) || name.size() == prefix.size() ) {
+            continue;
+        }
+        const std::string number = name.substr(prefix.size());
+        if ( std::all_of(number.begin(), number.end(), [](char c) { return c >= '0' && c <= '9'; }) ) {
+            segments[std::stoull(number)] = entry.path();
+        }
+    }
+    return segments;
+}
+
+WalMotion MakeMotion(const model::Dog& dog) {
+    return { dog.GetId(), dog.GetPosition(), dog.GetStartPos(), dog.GetSpeed(), dog.GetDirection() };
+}
+
+WalBag MakeBag(const model::Dog& dog) {
+    return { dog.GetId(), dog.GetBag(), dog.GetScore(), dog.GetValue() };
+}
+
+bool SameMotion(const WalMotion& motion, const model::Dog& dog) {
+    const model::Position pos   = dog.GetPosition();
+    const model::Position start = dog.GetStartPos();
+    const model::Speed    speed = dog.GetSpeed();
+    return motion.pos.x == pos.x && motion.pos.y == pos.y
+        && motion.start_pos.x == start.x && motion.start_pos.y == start.y
+        && motion.speed.sx == speed.sx && motion.speed.sy == speed.sy
+        && motion.dir == dog.GetDirection();
+}
+
+bool SameBag(const WalBag& bag, const model::Dog& dog) {
+    const model::Bag& dog_bag = dog.GetBag();
+    return bag.score == dog.GetScore() && bag.value == dog.GetValue()
+        && std::equal(bag.bag.begin(), bag.bag.end(), dog_bag.begin(), dog_bag.end(), [](const auto& lhs, const auto& rhs) {
+               return lhs.id_ == rhs.id_ && lhs.type_ == rhs.type_;
+           });
+}
+
+
+//// WalApplier ///////////////////////////////////////////////////////////////////////////////////
+// Применение кадров к восстанавливаемому приложению с индексом псов по id
+class WalApplier {
+public:
+    explicit WalApplier(app::Application& app) : app_(app), game_(app.GetGame()) {
+        for (const auto& session : game_.GetSessions()) {
+            const model::SessionHandle handle = game_.FindSession(session.GetMapId());
+            const auto& dogs = session.GetDogs();
+            for (size_t i = 0; i < dogs.Size(); ++i) {
+                dogs_[dogs[i].GetId()] = {handle, dogs.GetHandle(i)};
+            }
+        }
+    }
+
+    void Apply(const TickDelta& delta) {
+        app_.SetDogId(delta.dog_id);
+        for (const auto& wal_dog : delta.dogs) {
+            const model::SessionHandle handle = GetSession(wal_dog.map_id);
+            dogs_[wal_dog.dog.GetId()] = {handle, game_.GetSession(handle)->AddDog(wal_dog.dog.Restore())};
+        }
+        for (const auto& motion : delta.motions) {
+            model::Dog* dog = GetDog(motion.id);
+            dog->SetPosition(motion.pos);
+            dog->SetStartPos(motion.start_pos);
+            dog->SetSpeed(motion.speed);
+            dog->SetDirection(motion.dir);
+        }
+        for (const auto& bag : delta.bags) {
+            model::Dog* dog = GetDog(bag.id);
+            dog->EmptyBag();
+            for (const auto& bag_item : bag.bag) {
+                if ( !dog->PushIntoBag(bag_item, 0) ) {
+                    throw std::runtime_error("WAL: failed to put bag content of dog "s + std::to_string(bag.id));
+                }
+            }
+            dog->SetScore(bag.score);
+            dog->SetValue(bag.value);
+        }
+        for (const auto& loot : delta.loots) {
+            model::GameSession* session = game_.GetSession(GetSession(loot.map_id));
+            session->RemoveLostObjects(loot.removed);
+            for (const auto& lost_object : loot.added) {
+                session->AddLostObject(lost_object);
+            }
+        }
+        for (const auto& joined : delta.joined) {
+            const auto dog = dogs_.find(joined.dog_id);
+            if ( dog == dogs_.end() && std::find(delta.retired.begin(), delta.retired.end(), joined.token) != delta.retired.end() ) {
+                continue;   // вошёл и ушёл между кадрами: пса в кадре уже нет
+            }
+            if ( dog == dogs_.end() ) {
+                throw std::runtime_error("WAL: can't find dog with id "s + std::to_string(joined.dog_id));
+            }
+            app_.AddPlayer(app::Player(dog->second, joined.dog_id, model::Map::Id{joined.map_id}));
+            app_.AddPlayersTokenAndIndex(joined.token, app_.GetPlayers().GetPlayers().size() - 1);
+        }
+        if ( !delta.retired.empty() ) {
+            app_.RemovePlayers(delta.retired);
+        }
+    }
+
+private:
+    model::Dog* GetDog(uint32_t id) {
+        auto it = dogs_.find(id);
+        model::Dog* dog = it != dogs_.end() ? game_.GetDog(it->second) : nullptr;
+        if ( dog == nullptr ) {
+            throw std::runtime_error("WAL: can't find dog with id "s + std::to_string(id));
+        }
+        return dog;
+    }
+
+    // Сессия карты, при необходимости новая
+    model::SessionHandle GetSession(const std::string& map_id) {
+        model::Map::Id id{map_id};
+        model::SessionHandle session = game_.FindSession(id);
+        if ( !session.IsNull() ) {
+            return session;
+        }
+        auto map = game_.FindMap(id);
+        if ( map == nullptr ) {
+            throw std::runtime_error("WAL: can't find map with id "s + map_id);
+        }
+        return game_.AddSession(std::move(map));
+    }
+
+    app::Application& app_;
+    model::Game&      game_;
+    DogIndex          dogs_;
+};
+
+// Кадры одного сегмента до конца или до первого оборванного кадра. false - сегмент не продолжает
+// прочитанные до него кадры (часть их потеряна), дальше журнал читать нельзя
+bool ReplaySegment(const fs::path& segment, uint64_t first_seq, uint64_t& seq, WalApplier& applier) {
+    std::ifstream ifs{segment, std::ios::binary};
+    std::string data{std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>()};
+    size_t offset = 0;
+    bool   first  = true;
+    while ( offset < data.size() ) {
+        if ( data.size() - offset < FRAME_HEADER_SIZE ) {
+            return true;
+        }
+        uint32_t size = 0, checksum = 0;
+        std::memcpy(&size, data.data() + offset, sizeof(size));
+        std::memcpy(&checksum, data.data() + offset + sizeof(size), sizeof(checksum));
+        offset += FRAME_HEADER_SIZE;
+        if ( size > MAX_FRAME_SIZE || data.size() - offset < size ) {
+            return true;
+        }
+        const std::string_view payload{data.data() + offset, size};
+        offset += size;
+        if ( Checksum(payload) != checksum ) {
+            return true;
+        }
+        TickDelta delta;
+        std::istringstream iss{std::string(payload)};
+        {
+            boost::archive::binary_iarchive ia{iss, boost::archive::no_header};
+            ia >> delta;
+        }
+        if ( std::exchange(first, false) ) {
+            if ( delta.Empty() ) {
+                // метка: все тики с изменениями до сегмента должны быть прочитаны
+                if ( delta.seq > seq ) {
+                    return false;
+                }
+                seq = std::max(seq, first_seq - 1);
+                continue;
+            }
+            // сегмент без метки (прежние версии): открывается со следующего за записанными тика
+            if ( first_seq > seq + 1 ) {
+                return false;
+            }
+        }
+        if ( delta.seq <= seq ) {
+            continue;       // уже в снимке: сегмент не успели удалить
+        }
+        applier.Apply(delta);
+        seq = delta.seq;
+    }
+    return true;
+}
+
+}  // namespace
+
+
+//// WalWriter ////////////////////////////////////////////////////////////////////////////////////
+WalWriter::WalWriter(std::string state_file, uint64_t seq, const app::Application& app)
+    : state_file_(std::move(state_file))
+    , seq_(seq)
+    , change_seq_(seq) {
+    for (const auto& session : app.GetGame().GetSessions()) {
+        for (const auto& dog : session.GetDogs()) {
+            dogs_[dog.GetId()] = DogShadow{MakeMotion(dog), MakeBag(dog)};
+        }
+        std::vector<unsigned>& ids = loot_ids_[*session.GetMapId()];
+        for (const auto& lost_object : session.GetLostObjects()) {
+            ids.push_back(lost_object.id_);
+        }
+        std::sort(ids.begin(), ids.end());
+    }
+    Open(seq_ + 1);
+    sync_thread_ = std::thread([this] { SyncLoop(); });
+}
+
+WalWriter::~WalWriter() {
+    {
+        std::lock_guard lock{sync_mutex_};
+        stop_ = true;
+    }
+    sync_cond_var_.notify_one();
+    sync_thread_.join();
+    Close();
+}
+
+void WalWriter::Join(std::string_view token, uint32_t dog_id, std::string_view map_id) {
+    std::lock_guard lock{joins_mutex_};
+    joins_.push_back({std::string(token), dog_id, std::string(map_id)});
+}
+
+void WalWriter::Append(const app::Application& app, std::vector<std::string> retired_tokens) {
+    TickDelta delta;
+    delta.seq    = ++seq_;
+    delta.dog_id = app.GetDogId();
+    {
+        // вход фиксируется после создания пса, поэтому пёс каждого взятого здесь входа попадёт в этот же кадр
+        std::lock_guard lock{joins_mutex_};
+        delta.joined.swap(joins_);
+    }
+    const model::Game& game = app.GetGame();
+    size_t dog_count = 0;
+    for (const auto& session : game.GetSessions()) {
+        dog_count += session.GetDogsCount();
+        for (const auto& dog : session.GetDogs()) {
+            auto it = dogs_.find(dog.GetId());
+            if ( it == dogs_.end() ) {
+                dogs_[dog.GetId()] = DogShadow{MakeMotion(dog), MakeBag(dog), delta.seq};
+                delta.dogs.push_back({*session.GetMapId(), DogRepr(dog)});
+                continue;
+            }
+            DogShadow& shadow = it->second;
+            shadow.seq = delta.seq;
+            if ( !SameMotion(shadow.motion, dog) ) {
+                shadow.motion = MakeMotion(dog);
+                delta.motions.push_back(shadow.motion);
+            }
+            if ( !SameBag(shadow.bag, dog) ) {
+                shadow.bag = MakeBag(dog);
+                delta.bags.push_back(shadow.bag);
+            }
+        }
+        AppendLoot(session, delta);
+    }
+    // псы ушедших удалены из игры, опустевшие сессии - тоже
+    if ( dogs_.size() != dog_count ) {
+        std::erase_if(dogs_, [seq = delta.seq](const auto& item) {
+            return item.second.seq != seq;
+        });
+    }
+    if ( loot_ids_.size() != game.GetSessions().Size() ) {
+        std::erase_if(loot_ids_, [&game](const auto& item) {
+            return game.FindSession(model::Map::Id{item.first}).IsNull();
+        });
+    }
+    delta.retired = std::move(retired_tokens);
+    if ( !delta.Empty() ) {
+        Write(delta);
+        change_seq_ = delta.seq;
+    }
+}
+
+void WalWriter::AppendLoot(const model::GameSession& session, TickDelta& delta) {
+    const auto& lost_objects = session.GetLostObjects();
+    std::vector<std::pair<unsigned, size_t>> current;     // id и индекс предмета
+    current.reserve(lost_objects.size());
+    for (size_t i = 0; i < lost_objects.size(); ++i) {
+        current.emplace_back(lost_objects[i].id_, i);
+    }
+    std::sort(current.begin(), current.end());
+
+    std::vector<unsigned>& known = loot_ids_[*session.GetMapId()];
+    WalLoot loot;
+    auto known_it = known.begin();
+    auto curr_it  = current.begin();
+    while ( known_it != known.end() || curr_it != current.end() ) {
+        if ( curr_it == current.end() || (known_it != known.end() && *known_it < curr_it->first) ) {
+            loot.removed.push_back(*known_it++);
+        } else if ( known_it == known.end() || curr_it->first < *known_it ) {
+            loot.added.push_back(lost_objects[curr_it++->second]);
+        } else {
+            ++known_it;
+            ++curr_it;
+        }
+    }
+    if ( loot.added.empty() && loot.removed.empty() ) {
+        return;
+    }
+    known.resize(current.size());
+    std::transform(current.begin(), current.end(), known.begin(), [](const auto& item) { return item.first; });
+    loot.map_id = *session.GetMapId();
+    delta.loots.push_back(std::move(loot));
+}
+
+void WalWriter::Rotate() {
+    Close();
+    try {
+        Open(seq_ + 1);
+    } catch (const std::exception& ex) {
+        boost::json::object data;
+        data["file"] = state_file_;
+        data["what"] = ex.what();
+        logger::LogJson("wal error", data);
+    }
+}
+
+void WalWriter::Open(uint64_t first_seq) {
+    const std::string segment = SegmentName(state_file_, first_seq);
+    const int fd = ::open(segment.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if ( fd < 0 ) {
+        throw std::runtime_error("Can't open WAL segment '"s + segment + "': "s + std::strerror(errno));
+    }
+    TickDelta marker;
+    marker.seq = change_seq_;
+    if ( !WriteFrame(fd, EncodeFrame(marker)) ) {
+        const int error = errno;
+        ::close(fd);
+        throw std::runtime_error("Can't write WAL segment '"s + segment + "': "s + std::strerror(error));
+    }
+    std::lock_guard lock{sync_mutex_};
+    fd_ = fd;
+}
+
+void WalWriter::Close() {
+    std::lock_guard lock{sync_mutex_};
+    if ( fd_ >= 0 ) {
+        ::fdatasync(fd_);
+        ::close(fd_);
+        fd_ = -1;
+    }
+    dirty_.store(false, std::memory_order_relaxed);
+}
+
+void WalWriter::SyncLoop() {
+    std::unique_lock lock{sync_mutex_};
+    while ( !stop_ ) {
+        sync_cond_var_.wait_for(lock, SYNC_PERIOD, [this] { return stop_; });
+        if ( fd_ >= 0 && dirty_.exchange(false, std::memory_order_relaxed) ) {
+            ::fdatasync(fd_);
+        }
+    }
+}
+
+void WalWriter::Write(const TickDelta& delta) {
+    std::string error;
+    // сегмент не открылся при смене или закрыт после ошибки записи: новый начинается с этого кадра,
+    // его метка не даст восстановлению перескочить через потерянные кадры
+    if ( fd_ < 0 ) {
+        try {
+            Open(delta.seq);
+        } catch (const std::exception& ex) {
+            error = ex.what();
+        }
+    }
+    if ( fd_ >= 0 ) {
+        if ( WriteFrame(fd_, EncodeFrame(delta)) ) {
+            dirty_.store(true, std::memory_order_relaxed);
+            return;
+        }
+        error = std::strerror(errno);
+        // за оборванным кадром следующие не прочитаются
+        Close();
+    }
+    boost::json::object data;
+    data["file"]       = state_file_;
+    data["what"]       = error;
+    data["seq"]        = delta.seq;
+    data["lostFrames"] = ++lost_frames_;
+    logger::LogJson("wal error", data);
+}
+
+
+//// Replay ///////////////////////////////////////////////////////////////////////////////////////
+uint64_t ReplayWal(const std::string& state_file, uint64_t checkpoint_seq, app::Application& app) {
+    uint64_t seq = checkpoint_seq;
+    WalApplier applier(app);
+    for (const auto& [first_seq, segment] : ListSegments(state_file)) {
+        if ( !ReplaySegment(segment, first_seq, seq, applier) ) {
+            break;
+        }
+    }
+    return seq;
+}
+
+void RemoveWalSegments(const std::string& state_file, uint64_t checkpoint_seq) {
+    for (const auto& [first_seq, segment] : ListSegments(state_file)) {
+        if ( first_seq <= checkpoint_seq ) {
+            std::error_code ec;
+            fs::remove(segment, ec);
+        }
+    }
+}
+
+}  // namespace serialization
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "serializer.h"
+
+namespace serialization {
+
+//// Format ///////////////////////////////////////////////////////////////////////////////////////
+// Журнал изменений состояния (write-ahead log) между контрольными точками - снимками StateSaver.
+// Файлы-сегменты "<state_file>.wal.<номер первого тика>"; новый сегмент начинается вместе с
+// каждым снимком. Снимок хранит номер последнего вошедшего в него тика, после его записи
+// более старые сегменты удаляются. Тик с изменениями - один кадр:
+//   size u32 | checksum u32 (FNV-1a от данных) | TickDelta в binary_oarchive без заголовка
+// Оборванный или испорченный кадр (падение посреди записи) считается концом журнала.
+// Первый кадр сегмента - метка: пустой TickDelta с номером последнего тика с изменениями до
+// сегмента. Тики без изменений кадров не пишут, поэтому номер сегмента может отставать от
+// последнего кадра; по метке восстановление видит, что сегмент продолжает предыдущие, а если
+// в них нет кадра с этим номером - что кадры потеряны, и дальше не читает.
+// Надёжность - групповой сброс: кадр уходит в page cache одним write в тике, поэтому падение
+// процесса его не теряет; fdatasync делает фоновый поток не реже раза в WalWriter::SYNC_PERIOD.
+// Сбой ОС или питания теряет не больше тиков за последний SYNC_PERIOD - тик диск не ждёт.
+
+// Новый пёс: полное представление
+struct WalDog {
+    std::string map_id;
+    DogRepr     dog;
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & map_id;
+        ar & dog;
+    }
+};
+
+// Движение пса
+struct WalMotion {
+    uint32_t         id = 0;
+    model::Position  pos;
+    model::Position  start_pos;
+    model::Speed     speed;
+    model::Direction dir = model::Direction::NORTH;
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & id;
+        ar & pos;
+        ar & start_pos;
+        ar & speed;
+        ar & dir;
+    }
+};
+
+// Рюкзак и очки пса: подбор предметов и сдача в офис
+struct WalBag {
+    uint32_t   id = 0;
+    model::Bag bag;
+    unsigned   score = 0;
+    unsigned   value = 0;
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & id;
+        ar & bag;
+        ar & score;
+        ar & value;
+    }
+};
+
+// Появившиеся и подобранные предметы сессии
+struct WalLoot {
+    std::string                    map_id;
+    std::vector<model::LostObject> added;
+    std::vector<unsigned>          removed;
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & map_id;
+        ar & added;
+        ar & removed;
+    }
+};
+
+// Вошедший игрок
+struct WalPlayer {
+    std::string token;
+    uint32_t    dog_id = 0;
+    std::string map_id;
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & token;
+        ar & dog_id;
+        ar & map_id;
+    }
+};
+
+// Изменения за один тик; применяются в порядке полей
+struct TickDelta {
+    uint64_t                 seq    = 0;
+    uint32_t                 dog_id = 0;    // счётчик id псов приложения
+    std::vector<WalDog>      dogs;
+    std::vector<WalMotion>   motions;
+    std::vector<WalBag>      bags;
+    std::vector<WalLoot>     loots;
+    std::vector<WalPlayer>   joined;
+    std::vector<std::string> retired;       // токены ушедших на покой игроков; их псы удаляются
+
+    bool Empty() const noexcept {
+        return dogs.empty() && motions.empty() && bags.empty() && loots.empty() && joined.empty() && retired.empty();
+    }
+
+    template <typename Archive>
+    void serialize(Archive& ar, [[maybe_unused]] const unsigned version) {
+        ar & seq;
+        ar & dog_id;
+        ar & dogs;
+        ar & motions;
+        ar & bags;
+        ar & loots;
+        ar & joined;
+        ar & retired;
+    }
+};
+
+
+//// WalWriter ////////////////////////////////////////////////////////////////////////////////////
+// Хранит последнее записанное состояние псов и предметов и в конце тика пишет только разницу
+class WalWriter {
+public:
+    constexpr static std::chrono::milliseconds SYNC_PERIOD{100};
+
+    // seq - номер последнего тика, уже учтённого в восстановленном состоянии
+    WalWriter(std::string state_file, uint64_t seq, const app::Application& app);
+    ~WalWriter();
+
+    WalWriter(const WalWriter&) = delete;
+    WalWriter& operator=(const WalWriter&) = delete;
+
+    // Вход игрока; вызывается из обработчиков запросов, поэтому под мьютексом
+    void Join(std::string_view token, uint32_t dog_id, std::string_view map_id);
+    // Конец тика: изменения с прошлого тика одним кадром
+    void Append(const app::Application& app, std::vector<std::string> retired_tokens);
+    // Новый сегмент; вызывается вместе с постановкой снимка в очередь
+    void Rotate();
+
+    uint64_t GetSeq() const noexcept { return seq_; }
+
+private:
+    struct DogShadow {
+        WalMotion motion;
+        WalBag    bag;
+        uint64_t  seq = 0;      // последний кадр, в котором пёс был в игре
+    };
+
+    // Сегмент с первым тиком first_seq, начинается с метки
+    void Open(uint64_t first_seq);
+    void Close();
+    void Write(const TickDelta& delta);
+    void AppendLoot(const model::GameSession& session, TickDelta& delta);
+    // Поток группового сброса
+    void SyncLoop();
+
+    std::string state_file_;
+    uint64_t    seq_;
+    uint64_t    change_seq_;        // последний тик с изменениями, записанный или потерянный
+    uint64_t    lost_frames_ = 0;   // кадры, не попавшие в журнал из-за ошибок записи
+    int         fd_ = -1;
+    // последнее записанное состояние
+    std::unordered_map<uint32_t, DogShadow>                dogs_;
+    std::unordered_map<std::string, std::vector<unsigned>> loot_ids_;   // по возрастанию
+    // входы игроков с прошлого тика
+    std::mutex             joins_mutex_;
+    std::vector<WalPlayer> joins_;
+    // fd_ меняется только в тике под sync_mutex_, поток сброса читает его под ним же
+    std::mutex              sync_mutex_;
+    std::condition_variable sync_cond_var_;
+    std::atomic<bool>       dirty_{false};
+    bool                    stop_ = false;
+    std::thread             sync_thread_;
+};
+
+
+// Применяет кадры с номерами после checkpoint_seq, возвращает номер последнего учтённого тика
+uint64_t ReplayWal(const std::string& state_file, uint64_t checkpoint_seq, app::Application& app);
+// Удаляет сегменты, целиком вошедшие в снимок с номером checkpoint_seq
+void RemoveWalSegments(const std::string& state_file, uint64_t checkpoint_seq);
+
+}  // namespace serialization
@@ -0,0 +1,163 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "../src/json_loader.h"
+
+using namespace std::literals;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Карта с дорогой; road подставляется, чтобы испортить её в нужном месте
+std::string MapJson(std::string_view id, std::string_view road = R"({"x0": 0, "y0": 0, "x1": 40})"sv) {
+    return R"(    {"id": ")"s + std::string(id) + R"(", "name": "Map",
+     "lootTypes": [{"name": "key", "file": "key.obj", "type": "obj", "scale": 0.03}],
+     "roads": [)"s + std::string(road) + R"(],
+     "buildings": [], "offices": []})"s;
+}
+
+// Массив карт больше 1 МБ (PARALLEL_MIN_SIZE): разбирается в нескольких потоках
+constexpr size_t PARALLEL_MAP_COUNT = 6000;
+
+// Карты "map0".."map<count-1>", карта i начинается на строке 5 + 4 * i, её дороги - на 7 + 4 * i;
+// broken - испорченные дороги карт по номеру
+std::string ManyMapsJson(size_t count, const std::map<size_t, std::string_view>& broken = {}) {
+    std::string maps;
+    for (size_t i = 0; i < count; ++i) {
+        if ( i != 0 ) {
+            maps += ",\n"s;
+        }
+        const auto it = broken.find(i);
+        maps += it == broken.end() ? MapJson("map"s + std::to_string(i)) : MapJson("map"s + std::to_string(i), it->second);
+    }
+    return maps;
+}
+
+std::string ConfigJson(std::string_view maps, std::string_view settings = R"("lootGeneratorConfig": {"period": 5.0, "probability": 0.5},)"sv) {
+    return "{\n"s
+        + R"(  "defaultDogSpeed": 3.0,)"s + "\n"s
+        + "  "s + std::string(settings) + "\n"s
+        + R"(  "maps": [)"s + "\n"s
+        + std::string(maps) + "\n"s
+        + "  ]\n"s
+        + "}\n"s;
+}
+
+class JsonLoaderTest : public testing::Test {
+protected:
+    void SetUp() override {
+        file_ = fs::temp_directory_path() / ("game_json_loader_tests_"s + std::to_string(::getpid()) + ".json"s);
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove(file_, ec);
+    }
+
+    const fs::path& Write(const std::string& text) {
+        std::ofstream(file_, std::ios::binary) << text;
+        return file_;
+    }
+
+    // Текст ошибки загрузки; пустой - конфиг загрузился
+    std::string LoadError(const std::string& text) {
+        try {
+            json_loader::LoadGame(Write(text));
+        } catch (const std::runtime_error& ex) {
+            return ex.what();
+        }
+        return {};
+    }
+
+    fs::path file_;
+};
+
+}  // namespace
+
+TEST_F(JsonLoaderTest, LoadsValidConfig) {
+    const auto game    = json_loader::LoadGame(Write(ConfigJson(MapJson("map1"sv) + ",\n"s + MapJson("map2"sv))));
+    const auto catalog = game.GetCatalog();
+    ASSERT_EQ(catalog->GetMaps().size(), 2u);
+    EXPECT_EQ(*catalog->GetMaps()[0].GetId(), "map1"s);
+    EXPECT_EQ(*catalog->GetMaps()[1].GetId(), "map2"s);
+}
+
+TEST_F(JsonLoaderTest, SyntaxErrorInSettings) {
+    // пропущено двоеточие после "defaultDogSpeed"
+    const std::string text = "{\n  \"defaultDogSpeed\" 3.0,\n  \"maps\": []\n}\n"s;
+    const std::string error = LoadError(text);
+    EXPECT_TRUE(error.starts_with("Wrong config json: line 2, column 21: "sv)) << error;
+}
+
+TEST_F(JsonLoaderTest, SyntaxErrorInMap) {
+    // лишняя запятая в дороге второй карты: позиция считается от начала файла, а не куска
+    const std::string text = ConfigJson(MapJson("map1"sv) + ",\n"s + MapJson("map2"sv, R"({"x0": 0, "y0": 0,, "x1": 40})"sv));
+    const std::string error = LoadError(text);
+    EXPECT_TRUE(error.starts_with("Wrong config json: line 11, column 34: "sv)) << error;
+}
+
+TEST_F(JsonLoaderTest, SchemaErrorInMap) {
+    const std::string text = ConfigJson(MapJson("map1"sv, R"({"x0": 0, "y0": 0})"sv));
+    const std::string error = LoadError(text);
+    EXPECT_TRUE(error.starts_with("Wrong config json: line 7, column "sv)) << error;
+    EXPECT_TRUE(error.ends_with("road: missing field 'x1' or 'y1'"sv)) << error;
+}
+
+TEST_F(JsonLoaderTest, FirstBrokenMapIsReported) {
+    const std::string text = ConfigJson(MapJson("map1"sv) + ",\n"s
+                                        + MapJson("map2"sv, R"({"x0": 0, "y0": 0})"sv) + ",\n"s
+                                        + MapJson("map3"sv, R"({"x0": 0, "y0": "zero", "x1": 40})"sv));
+    const std::string error = LoadError(text);
+    EXPECT_TRUE(error.starts_with("Wrong config json: line 11, column "sv)) << error;
+    EXPECT_TRUE(error.ends_with("road: missing field 'x1' or 'y1'"sv)) << error;
+}
+
+TEST_F(JsonLoaderTest, MissingLootGenerator) {
+    const std::string error = LoadError(ConfigJson(MapJson("map1"sv), ""sv));
+    EXPECT_EQ(error, "Wrong config json: config: missing field 'lootGeneratorConfig'"s);
+}
+
+TEST_F(JsonLoaderTest, ExtraDataAfterDocument) {
+    // лишняя скобка сразу за документом
+    std::string text = ConfigJson(MapJson("map1"sv));
+    text.back() = '}';
+    EXPECT_EQ(LoadError(text), "Wrong config json: line 10, column 2: extra data after the document"s);
+}
+
+TEST_F(JsonLoaderTest, ParallelLoadsAllMaps) {
+    const std::string text = ConfigJson(ManyMapsJson(PARALLEL_MAP_COUNT));
+    ASSERT_GT(text.size(), size_t{1} << 20);
+    const auto game    = json_loader::LoadGame(Write(text));
+    const auto catalog = game.GetCatalog();
+    ASSERT_EQ(catalog->GetMaps().size(), PARALLEL_MAP_COUNT);
+    for (size_t i = 0; i < PARALLEL_MAP_COUNT; ++i) {
+        ASSERT_EQ(*catalog->GetMaps()[i].GetId(), "map"s + std::to_string(i));
+    }
+}
+
+TEST_F(JsonLoaderTest, ParallelReportsFirstBrokenMap) {
+    // потоки разбирают карты вперемешку, сообщается ошибка карты с меньшим номером
+    const std::string text = ConfigJson(ManyMapsJson(PARALLEL_MAP_COUNT, {
+        {3000, R"({"x0": 0, "y0": 0})"sv},
+        {4500, R"({"x0": 0, "y0": 0,, "x1": 40})"sv},
+        {5999, R"({"x0": 0, "y0": "zero", "x1": 40})"sv}
+    }));
+    ASSERT_GT(text.size(), size_t{1} << 20);
+    const std::string error = LoadError(text);
+    EXPECT_TRUE(error.starts_with("Wrong config json: line 12007, column "sv)) << error.substr(0, 200);
+    EXPECT_TRUE(error.ends_with("road: missing field 'x1' or 'y1'"sv)) << error.substr(0, 200);
+}
+
+TEST_F(JsonLoaderTest, LargeEmptyMapsArray) {
+    const std::string text = ConfigJson(std::string((size_t{1} << 20) + 1, ' '));
+    const auto game = json_loader::LoadGame(Write(text));
+    EXPECT_TRUE(game.GetCatalog()->GetMaps().empty());
+}
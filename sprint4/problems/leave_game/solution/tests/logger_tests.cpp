@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "../src/logger.h"
+
+using namespace std::literals;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Перенаправляет stdout в файл на время теста; логгер запускается и останавливается внутри
+class LoggerTest : public testing::Test {
+protected:
+    void SetUp() override {
+        file_ = fs::temp_directory_path() / ("game_logger_tests_"s + std::to_string(::getpid()));
+        const int fd = ::open(file_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        ASSERT_GE(fd, 0);
+        stdout_ = ::dup(STDOUT_FILENO);
+        ::dup2(fd, STDOUT_FILENO);
+        ::close(fd);
+    }
+
+    void TearDown() override {
+        ::dup2(stdout_, STDOUT_FILENO);
+        ::close(stdout_);
+        std::error_code ec;
+        fs::remove(file_, ec);
+    }
+
+    // Всё, что логгер записал; фоновый писатель к этому времени остановлен
+    std::string Output() const {
+        std::ifstream ifs{file_};
+        std::ostringstream out;
+        out << ifs.rdbuf();
+        return out.str();
+    }
+
+    fs::path file_;
+    int      stdout_ = -1;
+};
+
+}  // namespace
+
+TEST_F(LoggerTest, LongLinesAreWritten) {
+    const std::string text_a(3000, 'a');
+    const std::string text_b(700, 'b');
+    const logger::LogStats before = logger::GetStats();
+    logger::LogInit();
+    logger::LogJson(text_a, {});
+    logger::LogJson("short"sv, {});
+    logger::LogJson(text_b, {});
+    logger::LogStop();
+    const logger::LogStats after = logger::GetStats();
+
+    const std::string output = Output();
+    const size_t a = output.find(text_a);
+    const size_t s = output.find("\"short\""s);
+    const size_t b = output.find(text_b);
+    ASSERT_NE(a, std::string::npos);
+    ASSERT_NE(s, std::string::npos);
+    ASSERT_NE(b, std::string::npos);
+    // строки одного потока не перемешиваются
+    EXPECT_LT(a, s);
+    EXPECT_LT(s, b);
+    EXPECT_EQ(after.dropped, before.dropped);
+    EXPECT_EQ(after.oversized, before.oversized);
+}
+
+TEST_F(LoggerTest, LineLongerThanRingIsWritten) {
+    const std::string text(4000, 'c');
+    const logger::LogStats before = logger::GetStats();
+    // кольцо из 2 слотов - 1 КБ; у нового потока кольцо нового размера
+    logger::LogInit(2);
+    std::thread([&text] {
+        logger::LogJson(text, {});
+    }).join();
+    logger::LogStop();
+    const logger::LogStats after = logger::GetStats();
+
+    EXPECT_NE(Output().find(text), std::string::npos);
+    EXPECT_EQ(after.oversized, before.oversized + 1);
+    EXPECT_EQ(after.dropped, before.dropped);
+}
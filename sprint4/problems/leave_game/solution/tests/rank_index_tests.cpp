@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/leaderboard.h"
+
+using namespace std::literals;
+using leaderboard::Record;
+using leaderboard::RankIndex;
+
+namespace {
+
+// Эталон: отсортированный вектор и линейный поиск
+size_t CountBefore(const std::vector<Record>& sorted, const Record& key) {
+    return std::partition_point(sorted.begin(), sorted.end(), [&key](const Record& record) {
+        return leaderboard::Before(record, key);
+    }) - sorted.begin();
+}
+
+std::vector<Record> RandomRecords(size_t count, std::mt19937& random) {
+    std::uniform_int_distribution<int> score(0, 50);
+    std::uniform_int_distribution<int> time(0, 20);
+    std::uniform_int_distribution<int> letter('a', 'e');
+    std::vector<Record> records;
+    for (size_t i = 0; i < count; ++i) {
+        records.emplace_back(std::string(2, static_cast<char>(letter(random))), score(random), time(random));
+    }
+    return records;
+}
+
+}  // namespace
+
+TEST(RankIndexTest, TableOrder) {
+    // очки по убыванию, затем время и имя по возрастанию
+    EXPECT_TRUE(leaderboard::Before({"b", 10, 5}, {"a", 9, 1}));
+    EXPECT_TRUE(leaderboard::Before({"b", 10, 5}, {"a", 10, 6}));
+    EXPECT_TRUE(leaderboard::Before({"a", 10, 5}, {"b", 10, 5}));
+    EXPECT_FALSE(leaderboard::Before({"a", 10, 5}, {"a", 10, 5}));
+}
+
+TEST(RankIndexTest, Empty) {
+    RankIndex index;
+    EXPECT_EQ(index.Size(), 0u);
+    EXPECT_EQ(index.CountBefore({"", 10, 0}), 0u);
+    EXPECT_TRUE(index.Range(0, 10).empty());
+}
+
+TEST(RankIndexTest, MatchesSortedVector) {
+    std::mt19937 random{42};
+    RankIndex index;
+    std::vector<Record> all;
+    // заполнение при старте по одной строке, потом пачки из тика
+    for (const auto& record : RandomRecords(500, random)) {
+        index.Add(record);
+        all.push_back(record);
+    }
+    for (int batch = 0; batch < 10; ++batch) {
+        const auto records = RandomRecords(100, random);
+        index.Add(records);
+        all.insert(all.end(), records.begin(), records.end());
+    }
+    std::stable_sort(all.begin(), all.end(), leaderboard::Before);
+    ASSERT_EQ(index.Size(), all.size());
+    EXPECT_EQ(index.Range(0, all.size()), all);
+
+    for (const auto& key : RandomRecords(200, random)) {
+        EXPECT_EQ(index.CountBefore(key), CountBefore(all, key));
+    }
+    for (size_t start : {0ul, 1ul, 777ul, all.size() - 3, all.size(), all.size() + 5}) {
+        const auto range = index.Range(start, 10);
+        const size_t expected = start < all.size() ? std::min<size_t>(10, all.size() - start) : 0;
+        ASSERT_EQ(range.size(), expected) << start;
+        EXPECT_TRUE(std::equal(range.begin(), range.end(), all.begin() + std::min(start, all.size())));
+    }
+}
+
+TEST(RankIndexTest, NamelessKeyGoesFirstAmongEqual) {
+    RankIndex index;
+    index.Add(std::vector<Record>{{"a", 10, 5}, {"b", 10, 5}, {"c", 20, 1}, {"d", 5, 1}});
+    // место результата без имени: раньше него только строго лучшие
+    EXPECT_EQ(index.CountBefore({"", 10, 5}), 1u);
+    EXPECT_EQ(index.CountBefore({"", 20, 1}), 0u);
+    EXPECT_EQ(index.CountBefore({"", 1, 1}), 4u);
+    EXPECT_EQ(index.CountBefore({"b", 10, 5}), 2u);
+}
+
+TEST(RankIndexTest, Clear) {
+    RankIndex index;
+    index.Add(std::vector<Record>{{"a", 1, 1}, {"b", 2, 2}});
+    index.Clear();
+    EXPECT_EQ(index.Size(), 0u);
+    index.Add(Record{"c", 3, 3});
+    EXPECT_EQ(index.Range(0, 10), (std::vector<Record>{{"c", 3, 3}}));
+}
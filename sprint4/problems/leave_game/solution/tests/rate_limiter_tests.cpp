@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <string>
+
+#include "../src/admission.h"
+
+using namespace std::literals;
+
+namespace {
+
+namespace net = boost::asio;
+
+using admission::Clock;
+using admission::RateLimiter;
+
+net::ip::address Address(const std::string& str) {
+    return net::ip::make_address(str);
+}
+
+}  // namespace
+
+TEST(RateLimiterTest, BurstThenReject) {
+    RateLimiter limiter{2.0, 3.0};
+    const auto now  = Clock::now();
+    const auto addr = Address("10.0.0.1"s);
+    for (int i = 0; i < 3; ++i) {
+        EXPECT_FALSE(limiter.Take(addr, now)) << i;
+    }
+    const auto retry_after = limiter.Take(addr, now);
+    ASSERT_TRUE(retry_after);
+    EXPECT_EQ(*retry_after, 1u);
+}
+
+TEST(RateLimiterTest, Refill) {
+    RateLimiter limiter{2.0, 2.0};
+    const auto start = Clock::now();
+    const auto addr  = Address("10.0.0.1"s);
+    EXPECT_FALSE(limiter.Take(addr, start));
+    EXPECT_FALSE(limiter.Take(addr, start));
+    EXPECT_TRUE(limiter.Take(addr, start));
+    // 2 токена в секунду: через 0.5 с один токен
+    EXPECT_FALSE(limiter.Take(addr, start + 500ms));
+    EXPECT_TRUE(limiter.Take(addr, start + 500ms));
+    // ведро не переполняется сверх burst
+    EXPECT_FALSE(limiter.Take(addr, start + 100s));
+    EXPECT_FALSE(limiter.Take(addr, start + 100s));
+    EXPECT_TRUE(limiter.Take(addr, start + 100s));
+}
+
+TEST(RateLimiterTest, RetryAfterRoundsUpToSeconds) {
+    RateLimiter limiter{0.25, 1.0};
+    const auto now  = Clock::now();
+    const auto addr = Address("10.0.0.1"s);
+    EXPECT_FALSE(limiter.Take(addr, now));
+    // токен раз в 4 секунды
+    EXPECT_EQ(limiter.Take(addr, now), 4u);
+    EXPECT_EQ(limiter.Take(addr, now + 3s), 1u);
+}
+
+TEST(RateLimiterTest, AddressesAreIndependent) {
+    RateLimiter limiter{1.0, 1.0};
+    const auto now = Clock::now();
+    EXPECT_FALSE(limiter.Take(Address("10.0.0.1"s), now));
+    EXPECT_TRUE(limiter.Take(Address("10.0.0.1"s), now));
+    EXPECT_FALSE(limiter.Take(Address("10.0.0.2"s), now));
+    EXPECT_FALSE(limiter.Take(Address("2001:db8::1"s), now));
+    EXPECT_TRUE(limiter.Take(Address("2001:db8::1"s), now));
+}
+
+TEST(RateLimiterTest, V4MappedSharesBucket) {
+    RateLimiter limiter{1.0, 1.0};
+    const auto now = Clock::now();
+    EXPECT_FALSE(limiter.Take(Address("192.168.1.7"s), now));
+    EXPECT_TRUE(limiter.Take(Address("::ffff:192.168.1.7"s), now));
+}
+
+TEST(RateLimiterTest, SweepKeepsLimits) {
+    RateLimiter limiter{1.0, 1.0};
+    const auto start = Clock::now();
+    const auto addr  = Address("10.0.0.1"s);
+    EXPECT_FALSE(limiter.Take(addr, start));
+    // много адресов разрастают части и запускают чистку простоявших вёдер
+    for (unsigned i = 0; i < 4 * RateLimiter::SHARDS * RateLimiter::SWEEP_THRESHOLD; ++i) {
+        const net::ip::address_v4 other{0x0B000000u + i};
+        limiter.Take(other, start + 2s);
+    }
+    // ведро addr выброшено как полное - и ведёт себя как полное
+    EXPECT_FALSE(limiter.Take(addr, start + 2s));
+    EXPECT_TRUE(limiter.Take(addr, start + 2s));
+}
@@ -0,0 +1,105 @@
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/slot_map.h"
+
+using namespace std::literals;
+
+namespace {
+
+using Map    = util::SlotMap<std::string>;
+using Handle = Map::Handle;
+
+std::vector<std::string> Values(const Map& map) {
+    return {map.begin(), map.end()};
+}
+
+}  // namespace
+
+TEST(SlotMapTest, EmplaceAndGet) {
+    Map map;
+    const Handle a = map.Emplace("a"s);
+    const Handle b = map.Emplace("b"s);
+    ASSERT_NE(a, b);
+    ASSERT_NE(map.Get(a), nullptr);
+    EXPECT_EQ(*map.Get(a), "a"s);
+    EXPECT_EQ(*map.Get(b), "b"s);
+    EXPECT_EQ(map.Size(), 2u);
+    EXPECT_EQ(map.GetHandle(1), b);
+    EXPECT_EQ(map.Get(Handle{}), nullptr);
+    EXPECT_TRUE(Handle{}.IsNull());
+}
+
+TEST(SlotMapTest, ErasedHandleIsStale) {
+    Map map;
+    const Handle a = map.Emplace("a"s);
+    const Handle b = map.Emplace("b"s);
+    EXPECT_EQ(map.Erase(std::vector{a}), 1u);
+    EXPECT_FALSE(map.Contains(a));
+    EXPECT_EQ(map.Get(a), nullptr);
+    EXPECT_EQ(*map.Get(b), "b"s);
+    // повторное удаление по устаревшей ссылке ничего не делает
+    EXPECT_EQ(map.Erase(std::vector{a}), 0u);
+    EXPECT_EQ(map.Size(), 1u);
+}
+
+TEST(SlotMapTest, ReusedSlotGetsNewGeneration) {
+    Map map;
+    const Handle a = map.Emplace("a"s);
+    map.Erase(std::vector{a});
+    const Handle c = map.Emplace("c"s);
+    // ячейка та же, поколение другое: старая ссылка не находит нового владельца
+    EXPECT_EQ(c.index, a.index);
+    EXPECT_NE(c.generation, a.generation);
+    EXPECT_EQ(map.Get(a), nullptr);
+    EXPECT_EQ(*map.Get(c), "c"s);
+}
+
+TEST(SlotMapTest, CompactKeepsOrderAndHandles) {
+    Map map;
+    std::vector<Handle> handles;
+    for (const char* value : {"0", "1", "2", "3", "4", "5"}) {
+        handles.push_back(map.Emplace(value));
+    }
+    EXPECT_EQ(map.Erase(std::vector{handles[1], handles[4]}), 2u);
+    EXPECT_EQ(Values(map), (std::vector{"0"s, "2"s, "3"s, "5"s}));
+    for (size_t i : {0, 2, 3, 5}) {
+        ASSERT_NE(map.Get(handles[i]), nullptr);
+        EXPECT_EQ(*map.Get(handles[i]), std::to_string(i));
+    }
+    // места сдвинулись, ссылка по месту ведёт на тот же элемент
+    for (size_t pos = 0; pos < map.Size(); ++pos) {
+        EXPECT_EQ(map.Get(map.GetHandle(pos)), &map[pos]);
+    }
+}
+
+TEST(SlotMapTest, EraseIf) {
+    Map map;
+    const Handle a = map.Emplace("keep"s);
+    const Handle b = map.Emplace("drop"s);
+    const Handle c = map.Emplace("keep"s);
+    EXPECT_EQ(map.EraseIf([](const std::string& value) { return value == "drop"sv; }), 1u);
+    EXPECT_EQ(map.Size(), 2u);
+    EXPECT_TRUE(map.Contains(a));
+    EXPECT_FALSE(map.Contains(b));
+    EXPECT_TRUE(map.Contains(c));
+    EXPECT_EQ(map.Get(c), &map[1]);
+}
+
+TEST(SlotMapTest, EraseAllThenRefill) {
+    Map map;
+    std::vector<Handle> handles;
+    for (int i = 0; i < 100; ++i) {
+        handles.push_back(map.Emplace(std::to_string(i)));
+    }
+    EXPECT_EQ(map.Erase(handles), 100u);
+    EXPECT_TRUE(map.Empty());
+    for (const Handle& handle : handles) {
+        EXPECT_FALSE(map.Contains(handle));
+    }
+    const Handle fresh = map.Emplace("fresh"s);
+    EXPECT_EQ(*map.Get(fresh), "fresh"s);
+    EXPECT_EQ(map.Size(), 1u);
+}
@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "../src/snapshot.h"
+#include "test_game.h"
+
+using namespace std::literals;
+using namespace test_game;
+
+namespace {
+
+// смещение версии в заголовке - сразу за сигнатурой
+constexpr size_t VERSION_OFFSET = 8;
+
+class SnapshotTest : public testing::Test {
+protected:
+    // Приложение без файла состояния: ни WAL, ни фоновых снимков
+    app::Application MakeApp(model::Game& game) {
+        return app::Application(db_, game, false, true, ""s, 0);
+    }
+
+    // Игроки и боты, несколько десятков тиков с движениями
+    std::string Play(app::Application& app) {
+        for (int t = 0; t < 60; ++t) {
+            PlayTick(app, t);
+        }
+        return serialization::EncodeSnapshot(serialization::StateImage(app));
+    }
+
+    postgres::Db db_{postgres::Db::OFFLINE};
+};
+
+}  // namespace
+
+TEST_F(SnapshotTest, RoundTrip) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    const std::string data = Play(app);
+
+    model::Game restored_game = MakeGame();
+    app::Application restored = MakeApp(restored_game);
+    EXPECT_EQ(serialization::LoadSnapshotData(data, restored), app.GetWalSeq());
+    EXPECT_EQ(Digest(restored), Digest(app));
+}
+
+TEST_F(SnapshotTest, KeepsBotFlag) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    const std::string data = Play(app);
+
+    model::Game restored_game = MakeGame();
+    app::Application restored = MakeApp(restored_game);
+    serialization::LoadSnapshotData(data, restored);
+    size_t bots = 0;
+    for (const auto& session : restored.GetGame().GetSessions()) {
+        for (const auto& dog : session.GetDogs()) {
+            bots += dog.IsBot() ? 1 : 0;
+        }
+    }
+    EXPECT_EQ(bots, 3u);
+}
+
+TEST_F(SnapshotTest, EncodeIsStable) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    const std::string data = Play(app);
+
+    model::Game restored_game = MakeGame();
+    app::Application restored = MakeApp(restored_game);
+    serialization::LoadSnapshotData(data, restored);
+    // снимок восстановленного состояния совпадает с исходным байт в байт
+    EXPECT_EQ(serialization::EncodeSnapshot(serialization::StateImage(restored)), data);
+}
+
+TEST_F(SnapshotTest, RejectsBadMagic) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    std::string data = Play(app);
+    data[0] = 'X';
+
+    model::Game restored_game = MakeGame();
+    app::Application restored = MakeApp(restored_game);
+    EXPECT_THROW(serialization::LoadSnapshotData(data, restored), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, RejectsUnknownVersion) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    std::string data = Play(app);
+    const uint32_t version = serialization::SNAPSHOT_VERSION + 1;
+    std::memcpy(data.data() + VERSION_OFFSET, &version, sizeof(version));
+
+    model::Game restored_game = MakeGame();
+    app::Application restored = MakeApp(restored_game);
+    EXPECT_THROW(serialization::LoadSnapshotData(data, restored), std::runtime_error);
+}
+
+TEST_F(SnapshotTest, RejectsTruncated) {
+    model::Game game = MakeGame();
+    app::Application app = MakeApp(game);
+    const std::string data = Play(app);
+
+    for (size_t size : { size_t{4}, data.size() / 2, data.size() - 1 }) {
+        model::Game restored_game = MakeGame();
+        app::Application restored = MakeApp(restored_game);
+        EXPECT_THROW(serialization::LoadSnapshotData(std::string_view(data).substr(0, size), restored), std::runtime_error)
+            << "size " << size;
+    }
+}
@@ -0,0 +1,72 @@
+#include "test_game.h"
+
+#include <gtest/gtest.h>
+
+#include <map>
+#include <sstream>
+
+#include "../src/map_generator.h"
+
+namespace test_game {
+
+using namespace std::literals;
+
+model::Game MakeGame(double loot_probability) {
+    model::Game game(500, loot_probability, 60.0);
+    map_gen::GridParams params;
+    params.roads = 8;
+    game.AddMap(map_gen::MakeGridMap(params));
+    return game;
+}
+
+std::string Digest(const app::Application& app) {
+    std::ostringstream out;
+    out.precision(17);
+    for (const auto& session : app.GetGame().GetSessions()) {
+        out << "session " << *session.GetMapId() << '\n';
+        for (const auto& dog : session.GetDogs()) {
+            out << "dog " << dog.GetId() << ' ' << dog.GetName() << ' ' << dog.IsBot()
+                << ' ' << dog.GetPosition().x << ' ' << dog.GetPosition().y
+                << ' ' << dog.GetSpeed().sx << ' ' << dog.GetSpeed().sy << ' ' << static_cast<int>(dog.GetDirection())
+                << ' ' << dog.GetScore() << ' ' << dog.GetValue() << " bag";
+            for (const auto& item : dog.GetBag()) {
+                out << ' ' << item.id_ << ':' << item.type_;
+            }
+            out << '\n';
+        }
+        for (const auto& lost_object : session.GetLostObjects()) {
+            out << "loot " << lost_object.id_ << ' ' << lost_object.type_ << ' '
+                << lost_object.position_.x << ' ' << lost_object.position_.y << '\n';
+        }
+    }
+    for (const auto& player : app.GetPlayers().GetPlayers()) {
+        out << "player " << player.GetDogId() << ' ' << *player.GetSessionId() << '\n';
+    }
+    std::map<std::string, size_t> tokens;
+    for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+        tokens[token::ToString(token)] = index;
+    }
+    for (const auto& [token, index] : tokens) {
+        out << "token " << token << ' ' << index << '\n';
+    }
+    return out.str();
+}
+
+void PlayTick(app::Application& app, int t) {
+    std::string body;
+    if ( t % 10 == 0 ) {
+        EXPECT_TRUE(app.TryJoin("player"s + std::to_string(t), "grid"s, body));
+    }
+    if ( t % 20 == 5 ) {
+        EXPECT_TRUE(app.JoinBot("grid"s));
+    }
+    int k = 0;
+    for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+        if ( ++k % 3 == t % 3 ) {
+            app.Move(token, MOVES[(t + k) % std::size(MOVES)], body);
+        }
+    }
+    app.Tick(TICK);
+}
+
+}  // namespace test_game
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "../src/app.h"
+
+// Общая игра тестов сохранения: WAL и снимок должны восстанавливать одно и то же состояние
+namespace test_game {
+
+constexpr uint32_t TICK    = 50;
+// Направления для Move, последнее - остановка
+constexpr const char* MOVES[] = { "U", "D", "L", "R", "" };
+
+// Одна сетчатая карта "grid"
+model::Game MakeGame(double loot_probability = 0.9);
+
+// Всё, что переносят WAL и снимок: псы с флагом бота, рюкзаки, предметы, игроки и их токены
+std::string Digest(const app::Application& app);
+
+// Тик t игры: каждые 10 тиков входит игрок, каждые 20 - бот, часть игроков меняет направление
+void PlayTick(app::Application& app, int t);
+
+}  // namespace test_game
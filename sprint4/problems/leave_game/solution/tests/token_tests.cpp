@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../src/token.h"
+
+using namespace std::literals;
+
+TEST(TokenTest, ParseAndToString) {
+    const auto token = token::Parse("0123456789abcdeffedcba9876543210"sv);
+    ASSERT_TRUE(token);
+    EXPECT_EQ(token->hi, 0x0123456789abcdefull);
+    EXPECT_EQ(token->lo, 0xfedcba9876543210ull);
+    EXPECT_EQ(token::ToString(*token), "0123456789abcdeffedcba9876543210"s);
+}
+
+TEST(TokenTest, ParseIgnoresCase) {
+    const auto lower = token::Parse("00000000000000000000000000abcdef"sv);
+    const auto upper = token::Parse("00000000000000000000000000ABCDEF"sv);
+    ASSERT_TRUE(lower);
+    ASSERT_TRUE(upper);
+    EXPECT_EQ(*lower, *upper);
+    // сервер выдаёт строчные цифры
+    EXPECT_EQ(token::ToString(*upper), "00000000000000000000000000abcdef"s);
+}
+
+TEST(TokenTest, ParseRejectsMalformed) {
+    EXPECT_FALSE(token::Parse(""sv));
+    EXPECT_FALSE(token::Parse("0123456789abcdef0123456789abcde"sv));      // 31 цифра
+    EXPECT_FALSE(token::Parse("0123456789abcdef0123456789abcdef0"sv));    // 33 цифры
+    EXPECT_FALSE(token::Parse("0123456789abcdef0123456789abcdeg"sv));
+    EXPECT_FALSE(token::Parse("0123456789abcdef 123456789abcdef"sv));
+    EXPECT_FALSE(token::Parse("0123456789abcdef-123456789abcdef"sv));
+    // символы рядом с диапазонами цифр
+    for (char c : "/:@G`g"sv) {
+        std::string hex(token::TOKEN_SIZE, '0');
+        hex[7] = c;
+        EXPECT_FALSE(token::Parse(hex)) << hex;
+    }
+}
+
+TEST(TokenTest, GenerateRoundTrip) {
+    std::set<token::Token> seen;
+    for (int i = 0; i < 1000; ++i) {
+        const token::Token token = token::Generate();
+        const std::string  hex   = token::ToString(token);
+        ASSERT_EQ(hex.size(), token::TOKEN_SIZE);
+        EXPECT_EQ(token::Parse(hex), token);
+        seen.insert(token);
+    }
+    EXPECT_EQ(seen.size(), 1000u);
+}
+
+TEST(TokenTableTest, InsertFind) {
+    token::TokenTable table;
+    std::vector<token::Token> tokens;
+    for (size_t i = 0; i < 5000; ++i) {
+        tokens.push_back(token::Generate());
+        table.Insert(tokens.back(), i);
+    }
+    EXPECT_EQ(table.Size(), tokens.size());
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        EXPECT_EQ(table.Find(tokens[i]), i);
+    }
+    EXPECT_FALSE(table.Find(token::Generate()));
+    EXPECT_EQ(table.GetAll().size(), tokens.size());
+}
+
+TEST(TokenTableTest, RewriteRemovesAndRenumbers) {
+    token::TokenTable table;
+    std::vector<token::Token> tokens;
+    for (size_t i = 0; i < 1000; ++i) {
+        tokens.push_back(token::Generate());
+        table.Insert(tokens.back(), i);
+    }
+    // удаляем чётные, нечётные сдвигаем на их место
+    table.Rewrite([](const token::Token&, size_t& index) {
+        if ( index % 2 == 0 ) {
+            return false;
+        }
+        index /= 2;
+        return true;
+    });
+    EXPECT_EQ(table.Size(), 500u);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        if ( i % 2 == 0 ) {
+            EXPECT_FALSE(table.Find(tokens[i]));
+        } else {
+            EXPECT_EQ(table.Find(tokens[i]), i / 2);
+        }
+    }
+    // после перекладки цепочки пробирования целы: новые записи находятся
+    const token::Token fresh = token::Generate();
+    table.Insert(fresh, 500);
+    EXPECT_EQ(table.Find(fresh), 500u);
+}
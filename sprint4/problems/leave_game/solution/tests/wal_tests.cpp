@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+
+#include <unistd.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "../src/serializer.h"
+#include "test_game.h"
+
+using namespace std::literals;
+using namespace test_game;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr uint32_t NO_SAVES    = UINT32_MAX;  // снимков нет, всё состояние - в WAL
+constexpr uint32_t SAVE_PERIOD = 450;         // новый сегмент каждые 10 тиков
+
+class WalTest : public testing::Test {
+protected:
+    void SetUp() override {
+        dir_ = fs::temp_directory_path() / ("game_wal_tests_"s + std::to_string(::getpid()));
+        fs::remove_all(dir_);
+        fs::create_directories(dir_);
+        state_file_ = (dir_ / "state"s).string();
+    }
+
+    void TearDown() override {
+        std::error_code ec;
+        fs::remove_all(dir_, ec);
+    }
+
+    // Игра с входами и движениями; digests_ - состояние после каждого тика по его номеру в WAL
+    void Play(int ticks) {
+        model::Game game = MakeGame();
+        app::Application app(db_, game, false, true, state_file_, NO_SAVES);
+        serialization::RestoreApp(app);
+        for (int t = 0; t < ticks; ++t) {
+            PlayTick(app, t);
+            digests_[app.GetWalSeq()] = Digest(app);
+        }
+        last_seq_ = app.DetachStorage();
+    }
+
+    // Восстановленное состояние и номер последнего применённого тика
+    std::pair<std::string, uint64_t> Restore() {
+        model::Game game = MakeGame();
+        app::Application app(db_, game, false, true, state_file_, NO_SAVES);
+        serialization::RestoreApp(app);
+        const uint64_t seq = app.GetWalSeq();
+        std::pair result{Digest(app), seq};
+        app.DetachStorage();
+        return result;
+    }
+
+    fs::path LastSegment() const {
+        fs::path last;
+        for (const auto& entry : fs::directory_iterator(dir_)) {
+            if ( entry.path().filename().string().starts_with("state.wal."s) && entry.path() > last ) {
+                last = entry.path();
+            }
+        }
+        return last;
+    }
+
+    postgres::Db                    db_{postgres::Db::OFFLINE};
+    fs::path                        dir_;
+    std::string                     state_file_;
+    std::map<uint64_t, std::string> digests_;
+    uint64_t                        last_seq_ = 0;
+};
+
+}  // namespace
+
+TEST_F(WalTest, RoundTrip) {
+    Play(200);
+    ASSERT_EQ(last_seq_, 200u);
+    const auto [digest, seq] = Restore();
+    // пустые тики в конце кадров не пишут, состояние от этого не меняется
+    ASSERT_LE(seq, last_seq_);
+    ASSERT_TRUE(digests_.contains(seq));
+    EXPECT_EQ(digest, digests_.at(last_seq_));
+    EXPECT_EQ(digest, digests_.at(seq));
+}
+
+TEST_F(WalTest, TornTailIsEndOfLog) {
+    Play(200);
+    const fs::path segment = LastSegment();
+    ASSERT_FALSE(segment.empty());
+    const auto size = fs::file_size(segment);
+    ASSERT_GT(size, 3u);
+    // падение посреди записи последнего кадра
+    fs::resize_file(segment, size - 3);
+    const auto [digest, seq] = Restore();
+    ASSERT_LT(seq, last_seq_);
+    ASSERT_TRUE(digests_.contains(seq));
+    EXPECT_EQ(digest, digests_.at(seq));
+}
+
+TEST_F(WalTest, CorruptFrameStopsReplay) {
+    Play(200);
+    const fs::path segment = LastSegment();
+    const auto size = fs::file_size(segment);
+    {
+        std::fstream file{segment, std::ios::in | std::ios::out | std::ios::binary};
+        file.seekg(static_cast<std::streamoff>(size / 2));
+        const char byte = static_cast<char>(file.get());
+        file.seekp(static_cast<std::streamoff>(size / 2));
+        file.put(static_cast<char>(byte ^ 0x5a));
+    }
+    const auto [digest, seq] = Restore();
+    ASSERT_LT(seq, last_seq_);
+    ASSERT_TRUE(digests_.contains(seq));
+    EXPECT_EQ(digest, digests_.at(seq));
+}
+
+TEST_F(WalTest, IdleTicksBeforeRotation) {
+    // снимки не записываются (как при падении посреди записи) - восстановление только по сегментам
+    fs::create_directory(state_file_ + ".new"s);
+    std::string expected;
+    {
+        // без предметов: стоящие псы тиков не меняют
+        model::Game game = MakeGame(0.0);
+        app::Application app(db_, game, false, true, state_file_, SAVE_PERIOD);
+        serialization::RestoreApp(app);
+        std::string body;
+        for (int t = 0; t < 100; ++t) {
+            // 5 тиков движения, затем 15 тиков стоят, сегмент сменяется после простоя
+            if ( t % 20 == 0 ) {
+                ASSERT_TRUE(app.TryJoin("player"s + std::to_string(t), "grid"s, body));
+            }
+            if ( t % 20 == 0 || t % 20 == 5 ) {
+                int k = 0;
+                for (const auto& [token, index] : app.GetPlayers().GetPlayersTokenToIndex()) {
+                    app.Move(token, t % 20 == 0 ? MOVES[(t / 20 + ++k) % 4] : "", body);
+                }
+            }
+            app.Tick(TICK);
+        }
+        expected = Digest(app);
+        app.DetachStorage();
+    }
+    size_t segments = 0;
+    for (const auto& entry : fs::directory_iterator(dir_)) {
+        segments += entry.path().filename().string().starts_with("state.wal."s) ? 1 : 0;
+    }
+    ASSERT_GT(segments, 5u);
+    const auto [digest, seq] = Restore();
+    EXPECT_EQ(digest, expected);
+}
+
+TEST_F(WalTest, ContinuesAfterRestore) {
+    Play(100);
+    // второй запуск дописывает журнал после восстановленного состояния
+    Play(100);
+    const auto [digest, seq] = Restore();
+    ASSERT_LE(seq, last_seq_);
+    EXPECT_EQ(digest, digests_.at(last_seq_));
+}